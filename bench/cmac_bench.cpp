@@ -0,0 +1,105 @@
+/**************************************************************************/
+/*!
+    @file cmac_bench.cpp
+
+    Host benchmark of ntag424_cmac_batch() against one cmac engine that is
+    rekeyed for every (key, message) pair, the way a verifier calls
+    ntag424_cmac() today. Not part of the firmware build.
+
+    g++ -O2 -std=gnu++11 -Isrc bench/cmac_bench.cpp src/ntag424_cmac.cpp \
+        src/ntag424_lrp.cpp src/ntag424_crypto.cpp \
+        src/ntag424_crypto_aesni.cpp -lmbedcrypto -o cmac_bench && ./cmac_bench
+*/
+/**************************************************************************/
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ntag424_cmac.h"
+
+#define BENCH_JOBS 100000   ///< (key, message) pairs per run
+#define BENCH_MAXLENGTH 256 ///< largest message in byte
+
+static uint8_t keys[BENCH_JOBS][NTAG424_AES_KEYSIZE];
+static uint8_t messages[BENCH_JOBS][BENCH_MAXLENGTH];
+static uint8_t cmacs[2][BENCH_JOBS][NTAG424_CMAC_BLOCKSIZE];
+static ntag424_CMACJobType jobs[BENCH_JOBS];
+
+/**************************************************************************/
+/*!
+    @brief   cmac of every job with one engine, rekeyed per job.
+*/
+/**************************************************************************/
+static void single(const ntag424_CryptoProviderType *provider, size_t length)
+{
+  ntag424_CMACType engine;
+  ntag424_cmac_init(&engine, provider);
+  for (size_t i = 0; i < BENCH_JOBS; i++)
+  {
+    ntag424_cmac_setkey(&engine, keys[i]);
+    ntag424_cmac_update(&engine, messages[i], length);
+    ntag424_cmac_finish(&engine, cmacs[0][i]);
+  }
+  ntag424_cmac_free(&engine);
+}
+
+/**************************************************************************/
+/*!
+    @brief   time fn and print ns per job.
+*/
+/**************************************************************************/
+template <typename Fn>
+static double bench(const char *name, size_t length, Fn fn)
+{
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  auto stop = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(stop - start).count() /
+              BENCH_JOBS;
+  printf("%-8s %4zu byte: %7.1f ns/cmac %6.2f Mcmac/s\n", name, length, ns,
+         1000.0 / ns);
+  return ns;
+}
+
+int main()
+{
+  for (size_t i = 0; i < BENCH_JOBS; i++)
+  {
+    for (size_t k = 0; k < NTAG424_AES_KEYSIZE; k++)
+    {
+      keys[i][k] = (uint8_t)rand();
+    }
+    for (size_t k = 0; k < BENCH_MAXLENGTH; k++)
+    {
+      messages[i][k] = (uint8_t)rand();
+    }
+  }
+  const ntag424_CryptoProviderType *provider = ntag424_crypto_default();
+  printf("provider %s\n", provider->name);
+
+  const size_t lengths[] = {0, 16, 32, 64, 256};
+  for (size_t n = 0; n < sizeof(lengths) / sizeof(lengths[0]); n++)
+  {
+    size_t length = lengths[n];
+    for (size_t i = 0; i < BENCH_JOBS; i++)
+    {
+      jobs[i].key = keys[i];
+      jobs[i].data = messages[i];
+      jobs[i].length = length;
+      jobs[i].cmac = cmacs[1][i];
+    }
+    double t1 = bench("single", length, [&] { single(provider, length); });
+    double t2 = bench("batch", length, [&] {
+      ntag424_cmac_batch(jobs, BENCH_JOBS, provider);
+    });
+    if (memcmp(cmacs[0], cmacs[1], sizeof(cmacs[0])) != 0)
+    {
+      printf("cmac mismatch\n");
+      return 1;
+    }
+    printf("speedup %.1fx\n", t1 / t2);
+  }
+  return 0;
+}
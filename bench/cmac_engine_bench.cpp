@@ -0,0 +1,117 @@
+/**************************************************************************/
+/*!
+    @file cmac_engine_bench.cpp
+
+    Host benchmark of the session cmac engine: command MACs of one session
+    with a keyed ntag424_cmac engine against a mbedtls cipher cmac that is
+    set up and keyed for every MAC, the way ntag424_cmac() worked before
+    the engine. Not part of the firmware build.
+
+    g++ -O2 -std=gnu++11 -Isrc bench/cmac_engine_bench.cpp \
+        src/ntag424_cmac.cpp src/ntag424_lrp.cpp src/ntag424_crypto.cpp \
+        src/ntag424_crypto_aesni.cpp -lmbedcrypto -o cmac_engine_bench && \
+        ./cmac_engine_bench
+*/
+/**************************************************************************/
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mbedtls/cipher.h"
+#include "mbedtls/cmac.h"
+#include "ntag424_cmac.h"
+
+#define BENCH_MACS 100000  ///< command MACs per run
+#define BENCH_MAXLENGTH 64 ///< largest MAC input in byte
+
+static uint8_t message[BENCH_MAXLENGTH];
+static uint8_t cmacs[2][BENCH_MACS][NTAG424_CMAC_BLOCKSIZE];
+
+/**************************************************************************/
+/*!
+    @brief   cmac of every message with a cipher context that is set up,
+   keyed and freed per MAC.
+*/
+/**************************************************************************/
+static void rekeyed(const uint8_t *key, size_t length)
+{
+  const mbedtls_cipher_info_t *info =
+      mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_ECB);
+  for (size_t i = 0; i < BENCH_MACS; i++)
+  {
+    mbedtls_cipher_context_t ctx;
+    mbedtls_cipher_init(&ctx);
+    mbedtls_cipher_setup(&ctx, info);
+    mbedtls_cipher_cmac_starts(&ctx, key, 8 * NTAG424_AES_KEYSIZE);
+    mbedtls_cipher_cmac_update(&ctx, message, length);
+    mbedtls_cipher_cmac_finish(&ctx, cmacs[0][i]);
+    mbedtls_cipher_free(&ctx);
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   cmac of every message with one engine keyed for the session.
+*/
+/**************************************************************************/
+static void session(const uint8_t *key, size_t length)
+{
+  ntag424_CMACType engine;
+  ntag424_cmac_init(&engine);
+  ntag424_cmac_setkey(&engine, key);
+  for (size_t i = 0; i < BENCH_MACS; i++)
+  {
+    ntag424_cmac_update(&engine, message, length);
+    ntag424_cmac_finish(&engine, cmacs[1][i]);
+  }
+  ntag424_cmac_free(&engine);
+}
+
+/**************************************************************************/
+/*!
+    @brief   time fn and print ns per MAC.
+*/
+/**************************************************************************/
+template <typename Fn>
+static double bench(const char *name, size_t length, Fn fn)
+{
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  auto stop = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(stop - start).count() /
+              BENCH_MACS;
+  printf("%-8s %3zu byte: %7.1f ns/cmac\n", name, length, ns);
+  return ns;
+}
+
+int main()
+{
+  uint8_t key[NTAG424_AES_KEYSIZE];
+  for (size_t k = 0; k < sizeof(key); k++)
+  {
+    key[k] = (uint8_t)rand();
+  }
+  for (size_t k = 0; k < sizeof(message); k++)
+  {
+    message[k] = (uint8_t)rand();
+  }
+  printf("provider %s\n", ntag424_crypto_default()->name);
+
+  // Cmd || CmdCtr || TI plus typical headers and data
+  const size_t lengths[] = {7, 8, 15, 32, 64};
+  for (size_t n = 0; n < sizeof(lengths) / sizeof(lengths[0]); n++)
+  {
+    size_t length = lengths[n];
+    double t1 = bench("rekeyed", length, [&] { rekeyed(key, length); });
+    double t2 = bench("session", length, [&] { session(key, length); });
+    if (memcmp(cmacs[0], cmacs[1], sizeof(cmacs[0])) != 0)
+    {
+      printf("cmac mismatch\n");
+      return 1;
+    }
+    printf("speedup %.1fx\n", t1 / t2);
+  }
+  return 0;
+}
@@ -0,0 +1,120 @@
+/**************************************************************************/
+/*!
+    @file crc32_bench.cpp
+
+    Host benchmark of ntag424_crc32 against the bytewise 256 entry table
+    loop of Arduino_CRC32, which ntag424_crc32() used before. Not part of
+    the firmware build.
+
+    g++ -O2 -std=gnu++11 -Isrc bench/crc32_bench.cpp src/ntag424_crc32.cpp \
+        -o crc32_bench && ./crc32_bench
+*/
+/**************************************************************************/
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ntag424_crc32.h"
+
+static uint32_t bytewise_table[256]; ///< table of the Arduino_CRC32 loop
+
+/**************************************************************************/
+/*!
+    @brief   crc32 the way Arduino_CRC32::calc() does: one lookup per byte.
+*/
+/**************************************************************************/
+static uint32_t bytewise_crc32(const uint8_t *data, size_t length)
+{
+  uint32_t crc = 0xFFFFFFFF;
+  while (length-- > 0)
+  {
+    crc = (crc >> 8) ^ bytewise_table[(crc ^ *data++) & 0xff];
+  }
+  return ~crc;
+}
+
+/**************************************************************************/
+/*!
+    @brief   run fn over count buffers of length byte and print ns/buffer.
+*/
+/**************************************************************************/
+template <typename Fn>
+static uint32_t bench(const char *name, Fn fn, const uint8_t *data,
+                      size_t length, size_t count)
+{
+  uint32_t sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; i++)
+  {
+    sum += fn(data + (i % 64), length);
+  }
+  auto stop = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+  printf("%-10s %5zu byte: %8.1f ns/buffer %7.0f MB/s\n", name, length,
+         ns / count, (double)length * count / ns * 1000.0);
+  return sum;
+}
+
+int main()
+{
+  for (uint32_t i = 0; i < 256; i++)
+  {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++)
+    {
+      c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+    }
+    bytewise_table[i] = c;
+  }
+  static uint8_t data[4096 + 64];
+  for (size_t i = 0; i < sizeof(data); i++)
+  {
+    data[i] = (uint8_t)rand();
+  }
+  if (bytewise_crc32(data, 4096) != ntag424_crc32(data, 4096))
+  {
+    printf("crc mismatch\n");
+    return 1;
+  }
+
+  const size_t lengths[] = {16, 64, 256, 4096};
+  uint32_t sum = 0;
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+  {
+    size_t count = (64UL << 20) / lengths[i];
+    sum += bench("bytewise", bytewise_crc32, data, lengths[i], count);
+    sum += bench("ntag424", ntag424_crc32, data, lengths[i], count);
+  }
+
+  // a provisioning batch: jamcrc of 10000 new keys, one by one and in the
+  // four lane batch
+  static uint8_t keys[10000 * 16];
+  static uint32_t crcs[10000];
+  for (size_t i = 0; i < sizeof(keys); i++)
+  {
+    keys[i] = (uint8_t)rand();
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < 10000; i++)
+  {
+    crcs[i] = ntag424_jamcrc(keys + 16 * i, 16);
+  }
+  auto stop = std::chrono::steady_clock::now();
+  uint32_t single = crcs[9999];
+  printf("jamcrc       10000 keys: %.1f us\n",
+         std::chrono::duration<double, std::micro>(stop - start).count());
+  start = std::chrono::steady_clock::now();
+  ntag424_jamcrc_batch(keys, 16, 16, 10000, crcs);
+  stop = std::chrono::steady_clock::now();
+  printf("jamcrc_batch 10000 keys: %.1f us\n",
+         std::chrono::duration<double, std::micro>(stop - start).count());
+  if (single != crcs[9999])
+  {
+    printf("crc mismatch\n");
+    return 1;
+  }
+
+  printf("(checksum %08x)\n", (unsigned)(sum ^ crcs[9999]));
+  return 0;
+}
@@ -0,0 +1,113 @@
+/**************************************************************************/
+/*!
+    @file originality_bench.cpp
+
+    Host benchmark of originality signature verification:
+    ntag424_originality_verify() per tag against
+    ntag424_originality_verify_batch(), plus the one time table setup. The
+    signatures were made with a throwaway secp224r1 key over 7 byte UIDs
+    the way NXP signs the tags. Not part of the firmware build.
+
+    g++ -O2 -std=gnu++11 -DNTAG424_ECC_COMB_TEETH=8 -Isrc \
+        bench/originality_bench.cpp src/ntag424_originality.cpp \
+        -o originality_bench && ./originality_bench
+*/
+/**************************************************************************/
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#include "ntag424_originality.h"
+
+#define BENCH_TAGS 20000 ///< tags per run
+#define BENCH_VECTORS 4  ///< distinct signatures
+
+static const uint8_t pubkey[NTAG424_ECC_PUBKEY_SIZE] = {
+    0x04, 0x79, 0x34, 0x7D, 0x68, 0xB1, 0x5B, 0x86, 0x2A, 0xE3, 0xA5, 0xE4,
+    0x8B, 0x68, 0x5C, 0xDB, 0x99, 0x64, 0xBD, 0x18, 0x61, 0x52, 0xCF, 0x61,
+    0x4C, 0x14, 0x80, 0xE9, 0x04, 0x83, 0x43, 0x3A, 0x47, 0x77, 0xDF, 0xAC,
+    0xCF, 0x87, 0x6E, 0xB1, 0xF2, 0x1F, 0xB4, 0xC4, 0x5E, 0x1A, 0xE0, 0x60,
+    0x1A, 0x0F, 0x3F, 0xB2, 0x43, 0x9D, 0xF7, 0x38, 0xFF};
+static const uint8_t uids[BENCH_VECTORS][7] = {
+    {0x04, 0x20, 0x6C, 0x6C, 0xEC, 0xD1, 0xCB},
+    {0x04, 0xA6, 0x89, 0x2E, 0xC6, 0xE2, 0x0C},
+    {0x04, 0xFA, 0xB8, 0xA2, 0x3E, 0x22, 0xFE},
+    {0x04, 0xB2, 0x53, 0xF1, 0xA2, 0x8C, 0x0C}};
+static const uint8_t sigs[BENCH_VECTORS][NTAG424_ECC_SIG_SIZE] = {
+    {0x02, 0x61, 0x92, 0xAF, 0xE7, 0xB2, 0xC3, 0x83, 0xD9, 0x83, 0x76, 0xCE,
+     0x79, 0xBE, 0x16, 0x78, 0x90, 0xB2, 0x54, 0x99, 0x0F, 0x6A, 0xCA, 0x90,
+     0x5B, 0xE9, 0xE2, 0xC5, 0x3E, 0xEB, 0x4A, 0x34, 0x06, 0xD3, 0x4F, 0x7F,
+     0x3A, 0xFB, 0x3F, 0xB6, 0x93, 0x80, 0xDF, 0x28, 0xFA, 0x26, 0x55, 0xEF,
+     0x6B, 0xB9, 0x03, 0xC4, 0x0E, 0x6E, 0xCD, 0x1C},
+    {0x6B, 0xB6, 0xE0, 0x7F, 0xD3, 0x50, 0xB8, 0xA5, 0xC0, 0xFA, 0x74, 0xB4,
+     0xEF, 0xD6, 0x10, 0x5B, 0xC5, 0x09, 0x4D, 0x2D, 0xA3, 0x79, 0xEF, 0x43,
+     0x97, 0x01, 0x3C, 0x42, 0x66, 0x88, 0x97, 0xED, 0x3B, 0x0B, 0x6B, 0xA9,
+     0x5F, 0x74, 0x55, 0xED, 0x2C, 0xA6, 0x7C, 0xE1, 0x75, 0xFF, 0x8C, 0x6F,
+     0x11, 0xD4, 0x22, 0x05, 0x8F, 0xEB, 0xC6, 0x17},
+    {0x17, 0xA2, 0x0C, 0xB9, 0xF3, 0xB6, 0x40, 0x54, 0xBF, 0x87, 0xE0, 0xF2,
+     0x2A, 0x2E, 0x98, 0xCD, 0x9C, 0xD0, 0x86, 0x92, 0x41, 0xB0, 0x46, 0x4F,
+     0x97, 0x1B, 0x4F, 0x0D, 0x41, 0x7C, 0x93, 0x71, 0x78, 0x6C, 0xF4, 0x62,
+     0xE0, 0x88, 0x1F, 0xFB, 0xCA, 0xFB, 0x9E, 0x5F, 0x4A, 0xFC, 0x2A, 0x6F,
+     0x0B, 0x7A, 0x14, 0xD2, 0x06, 0x7A, 0x56, 0xDF},
+    {0xCB, 0xE7, 0xC4, 0x76, 0x7B, 0x5D, 0x5F, 0x91, 0x20, 0x44, 0xDD, 0xAE,
+     0x67, 0x64, 0xC4, 0xDF, 0x7B, 0x5C, 0xFA, 0x6B, 0x24, 0x4D, 0x6F, 0xA3,
+     0x27, 0xF2, 0xB5, 0x99, 0x51, 0x4D, 0x80, 0x68, 0x0C, 0x63, 0xFE, 0x85,
+     0x24, 0x64, 0x84, 0x75, 0x41, 0x7D, 0xD0, 0xE0, 0xD7, 0x08, 0x9C, 0x43,
+     0xC3, 0x84, 0xA3, 0xFE, 0x97, 0x04, 0xB9, 0x98}};
+
+static ntag424_OriginalityType ctx;
+static ntag424_SignatureJobType jobs[BENCH_TAGS];
+static bool results[BENCH_TAGS];
+
+int main()
+{
+  auto start = std::chrono::steady_clock::now();
+  if (!ntag424_originality_init(&ctx, pubkey))
+  {
+    printf("init failed\n");
+    return 1;
+  }
+  auto stop = std::chrono::steady_clock::now();
+  printf("teeth %d: init %.1f ms, tables %zu byte\n", NTAG424_ECC_COMB_TEETH,
+         std::chrono::duration<double, std::milli>(stop - start).count(),
+         sizeof(ctx));
+
+  for (size_t i = 0; i < BENCH_TAGS; i++)
+  {
+    jobs[i].uid = uids[i % BENCH_VECTORS];
+    jobs[i].uid_length = sizeof(uids[0]);
+    jobs[i].signature = sigs[i % BENCH_VECTORS];
+  }
+
+  size_t valid = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < BENCH_TAGS; i++)
+  {
+    valid += ntag424_originality_verify(&ctx, jobs[i].uid, jobs[i].uid_length,
+                                        jobs[i].signature);
+  }
+  stop = std::chrono::steady_clock::now();
+  double t1 = std::chrono::duration<double, std::micro>(stop - start).count() /
+              BENCH_TAGS;
+
+  start = std::chrono::steady_clock::now();
+  valid += ntag424_originality_verify_batch(&ctx, jobs, BENCH_TAGS, results);
+  stop = std::chrono::steady_clock::now();
+  double t2 = std::chrono::duration<double, std::micro>(stop - start).count() /
+              BENCH_TAGS;
+
+  // a flipped bit must be rejected
+  uint8_t bad[NTAG424_ECC_SIG_SIZE];
+  memcpy(bad, sigs[0], sizeof(bad));
+  bad[40] ^= 0x01;
+  if ((valid != 2 * BENCH_TAGS) ||
+      ntag424_originality_verify(&ctx, uids[0], sizeof(uids[0]), bad))
+  {
+    printf("verification failed\n");
+    return 1;
+  }
+  printf("single %6.1f us/tag, batch %6.1f us/tag (%.0f tags/s)\n", t1, t2,
+         1e6 / t2);
+  return 0;
+}
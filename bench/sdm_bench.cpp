@@ -0,0 +1,125 @@
+/**************************************************************************/
+/*!
+    @file sdm_bench.cpp
+
+    Host benchmark of SUN verification: ntag424_sdm_verify() per message
+    against ntag424_sdm_verify_batch(). The messages are built like the
+    AN12196 "encrypted PICCData + SDMMAC" URL with random UIDs and counters.
+    Not part of the firmware build.
+
+    g++ -O2 -std=gnu++11 -Isrc bench/sdm_bench.cpp src/ntag424_sdm.cpp \
+        src/ntag424_cmac.cpp src/ntag424_lrp.cpp src/ntag424_crypto.cpp \
+        src/ntag424_crypto_aesni.cpp -lmbedcrypto -o sdm_bench && ./sdm_bench
+*/
+/**************************************************************************/
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ntag424_sdm.h"
+
+#define BENCH_MESSAGES 100000 ///< taps per run
+
+static ntag424_SDMMessageType msgs[BENCH_MESSAGES];
+static ntag424_SDMResultType results[BENCH_MESSAGES];
+
+/**************************************************************************/
+/*!
+    @brief   build a valid tap: PICCData encrypted with the meta key, SDMMAC
+   over mac_length bytes of input with the file key.
+*/
+/**************************************************************************/
+static void make_message(const ntag424_SDMKeysType *keys,
+                         const uint8_t *mac_input, size_t mac_length,
+                         ntag424_SDMMessageType *msg)
+{
+  ntag424_SDMResultType tag;
+  ntag424_AESType ctx;
+  uint8_t picc[NTAG424_SDM_PICCDATA_SIZE];
+  uint8_t sv2[NTAG424_AES_BLOCKSIZE];
+  uint8_t mac_key[NTAG424_CMAC_BLOCKSIZE];
+  uint8_t cmac[NTAG424_CMAC_BLOCKSIZE];
+
+  memset(&tag, 0, sizeof(tag));
+  memset(msg, 0, sizeof(*msg));
+  tag.has_uid = tag.has_read_ctr = true;
+  tag.uid[0] = 0x04;
+  for (int i = 1; i < NTAG424_SDM_UID_SIZE; i++)
+  {
+    tag.uid[i] = (uint8_t)rand();
+  }
+  tag.read_ctr = (uint32_t)rand() & 0xFFFFFF;
+
+  for (int i = 0; i < NTAG424_SDM_PICCDATA_SIZE; i++)
+  {
+    picc[i] = (uint8_t)rand();
+  }
+  picc[0] = NTAG424_SDM_PICCTAG_UID | NTAG424_SDM_PICCTAG_CTR |
+            NTAG424_SDM_UID_SIZE;
+  memcpy(picc + 1, tag.uid, NTAG424_SDM_UID_SIZE);
+  picc[8] = (uint8_t)tag.read_ctr;
+  picc[9] = (uint8_t)(tag.read_ctr >> 8);
+  picc[10] = (uint8_t)(tag.read_ctr >> 16);
+  ntag424_aes_setkey(&ctx, NULL, keys->meta_key, NTAG424_AES_ENCRYPT);
+  ctx.provider->aes_ecb(&ctx, picc, msg->picc_data);
+  ntag424_aes_free(&ctx);
+  msg->picc_encrypted = true;
+
+  ntag424_sdm_session_vectors(&tag, NULL, sv2);
+  ntag424_CMACJobType jobs[2] = {
+      {keys->file_key, sv2, sizeof(sv2), mac_key},
+      {mac_key, mac_input, mac_length, cmac}};
+  ntag424_cmac_batch(&jobs[0], 1);
+  ntag424_cmac_batch(&jobs[1], 1);
+  ntag424_cmac_truncate(cmac, msg->mac);
+  msg->mac_input = mac_input;
+  msg->mac_input_length = mac_length;
+}
+
+int main()
+{
+  static const uint8_t meta_key[16] = {1, 2, 3, 4, 5, 6, 7, 8,
+                                       9, 10, 11, 12, 13, 14, 15, 16};
+  static const uint8_t file_key[16] = {16, 15, 14, 13, 12, 11, 10, 9,
+                                       8, 7, 6, 5, 4, 3, 2, 1};
+  static const uint8_t mac_input[] = "EF963FF7828658A599F3041510671E88&c=";
+  ntag424_SDMKeysType keys = {meta_key, file_key};
+  printf("provider %s\n", ntag424_crypto_default()->name);
+
+  const size_t lengths[] = {0, sizeof(mac_input) - 1};
+  for (size_t n = 0; n < sizeof(lengths) / sizeof(lengths[0]); n++)
+  {
+    for (size_t i = 0; i < BENCH_MESSAGES; i++)
+    {
+      make_message(&keys, mac_input, lengths[n], &msgs[i]);
+    }
+
+    size_t valid = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < BENCH_MESSAGES; i++)
+    {
+      valid += ntag424_sdm_verify(&keys, &msgs[i], &results[i]);
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double t1 = std::chrono::duration<double, std::nano>(stop - start).count() /
+                BENCH_MESSAGES;
+
+    start = std::chrono::steady_clock::now();
+    valid += ntag424_sdm_verify_batch(&keys, msgs, BENCH_MESSAGES, results);
+    stop = std::chrono::steady_clock::now();
+    double t2 = std::chrono::duration<double, std::nano>(stop - start).count() /
+                BENCH_MESSAGES;
+
+    if (valid != 2 * BENCH_MESSAGES)
+    {
+      printf("verification failed\n");
+      return 1;
+    }
+    printf("mac input %2zu byte: single %6.1f ns/tap, batch %6.1f ns/tap "
+           "(%.1f M taps/s)\n",
+           lengths[n], t1, t2, 1000.0 / t2);
+  }
+  return 0;
+}
@@ -0,0 +1,27 @@
+/**************************************************************************/
+/*!
+    @file Adafruit_I2CDevice.h
+
+    BusIO I2C device of the native tests, connected to the fake PN532 of
+    ntag424_host.h.
+*/
+/**************************************************************************/
+
+#ifndef NTAG424_HOST_I2CDEVICE_H
+#define NTAG424_HOST_I2CDEVICE_H
+
+#include "Arduino.h"
+
+/**
+ * @brief I2C device, read() and write() talk to the fake PN532.
+ */
+class Adafruit_I2CDevice
+{
+public:
+  Adafruit_I2CDevice(uint8_t /* addr */, TwoWire * /* theWire */ = &Wire) {}
+  bool begin(bool /* addr_detect */ = true) { return true; }
+  bool read(uint8_t *buffer, size_t len, bool stop = true);
+  bool write(const uint8_t *buffer, size_t len, bool stop = true);
+};
+
+#endif
@@ -0,0 +1,47 @@
+/**************************************************************************/
+/*!
+    @file Adafruit_SPIDevice.h
+
+    BusIO SPI device of the native tests. Nothing is connected, the tests
+    use the I2C PN532.
+*/
+/**************************************************************************/
+
+#ifndef NTAG424_HOST_SPIDEVICE_H
+#define NTAG424_HOST_SPIDEVICE_H
+
+#include <string.h>
+
+#include "Arduino.h"
+
+#define SPI_BITORDER_LSBFIRST 0 ///< bit order
+#define SPI_MODE0 0             ///< SPI mode
+
+/**
+ * @brief SPI device without a peer, reads return zeros like an idle MISO.
+ */
+class Adafruit_SPIDevice
+{
+public:
+  Adafruit_SPIDevice(int8_t /* cspin */, uint32_t /* freq */,
+                     uint8_t /* dataOrder */, uint8_t /* dataMode */,
+                     SPIClass * /* theSPI */)
+  {
+  }
+  Adafruit_SPIDevice(int8_t /* cspin */, int8_t /* sck */, int8_t /* miso */,
+                     int8_t /* mosi */, uint32_t /* freq */,
+                     uint8_t /* dataOrder */, uint8_t /* dataMode */)
+  {
+  }
+  bool begin() { return true; }
+  bool write(const uint8_t * /* buffer */, size_t /* len */) { return false; }
+  bool write_then_read(const uint8_t * /* write_buffer */,
+                       size_t /* write_len */, uint8_t *read_buffer,
+                       size_t read_len)
+  {
+    memset(read_buffer, 0, read_len);
+    return false;
+  }
+};
+
+#endif
@@ -0,0 +1,81 @@
+/**************************************************************************/
+/*!
+    @file Arduino.h
+
+    Minimal Arduino core for the native tests: the types, pin and timing
+    functions and Serial the driver uses. Output is discarded.
+*/
+/**************************************************************************/
+
+#ifndef NTAG424_HOST_ARDUINO_H
+#define NTAG424_HOST_ARDUINO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte; ///< Arduino byte
+
+#define HEX 16   ///< print base 16
+#define DEC 10   ///< print base 10
+#define INPUT 0  ///< pinMode input
+#define OUTPUT 1 ///< pinMode output
+#define LOW 0    ///< pin level low
+#define HIGH 1   ///< pin level high
+#define F(x) (x) ///< strings stay in RAM on the host
+
+/**
+ * @brief Print sink, every overload drops its output.
+ */
+class Print
+{
+public:
+  template <typename T> size_t print(T, int = DEC) { return 0; }
+  template <typename T> size_t println(T, int = DEC) { return 0; }
+  size_t println() { return 0; }
+  size_t write(const uint8_t *, size_t length) { return length; }
+};
+
+/**
+ * @brief Serial port without a peer.
+ */
+class HardwareSerial : public Print
+{
+public:
+  void begin(unsigned long) {}
+  int available() { return 0; }
+  int read() { return -1; }
+  size_t readBytes(uint8_t *, size_t) { return 0; }
+  operator bool() { return true; }
+};
+
+/**
+ * @brief I2C bus, Adafruit_I2CDevice does the transfers.
+ */
+class TwoWire
+{
+public:
+  void begin() {}
+};
+
+/**
+ * @brief SPI bus, unused on the host.
+ */
+class SPIClass
+{
+};
+
+extern HardwareSerial Serial; ///< debug output
+extern TwoWire Wire;          ///< I2C bus of the fake PN532
+extern SPIClass SPI;          ///< SPI bus
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void delay(unsigned long ms);
+unsigned long millis();
+unsigned long micros();
+long random(long max);
+
+#endif
@@ -0,0 +1,9 @@
+/**************************************************************************/
+/*!
+    @file SPI.h
+
+    SPIClass lives in Arduino.h on the host.
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
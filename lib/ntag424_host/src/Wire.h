@@ -0,0 +1,9 @@
+/**************************************************************************/
+/*!
+    @file Wire.h
+
+    TwoWire lives in Arduino.h on the host.
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
@@ -0,0 +1,180 @@
+/**************************************************************************/
+/*!
+    @file ntag424_host.cpp
+
+    Arduino stand-ins and the fake I2C PN532, see ntag424_host.h.
+*/
+/**************************************************************************/
+
+#include "ntag424_host.h"
+
+#include "Adafruit_I2CDevice.h"
+#include "Arduino.h"
+
+#define NTAG424_HOST_GETFIRMWAREVERSION 0x02   ///< PN532 command
+#define NTAG424_HOST_INDATAEXCHANGE 0x40       ///< PN532 command
+#define NTAG424_HOST_INLISTPASSIVETARGET 0x4A  ///< PN532 command
+#define NTAG424_HOST_HOSTTOPN532 0xD4          ///< frame identifier
+#define NTAG424_HOST_PN532TOHOST 0xD5          ///< frame identifier
+#define NTAG424_HOST_TIMEOUT 0x01              ///< InDataExchange status
+
+HardwareSerial Serial;
+TwoWire Wire;
+SPIClass SPI;
+
+static ntag424_HostCardFunction ntag424_host_card;
+static uint8_t ntag424_host_uid[7];
+static uint8_t ntag424_host_response[NTAG424_HOST_FRAMESIZE];
+static size_t ntag424_host_response_length;
+static bool ntag424_host_ack;
+static int ntag424_host_busy;
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t, uint8_t) {}
+
+int digitalRead(uint8_t) { return HIGH; }
+
+void delay(unsigned long) {}
+
+unsigned long millis() { return 0; }
+
+unsigned long micros() { return 0; }
+
+long random(long max) { return rand() % max; }
+
+/**************************************************************************/
+/*!
+    @brief   connect a card to the fake PN532.
+
+    @param   card   answers the apdus
+    @param   uid    7 byte UID reported by InListPassiveTarget
+*/
+/**************************************************************************/
+void ntag424_host_attach(ntag424_HostCardFunction card, const uint8_t *uid)
+{
+  ntag424_host_card = card;
+  memcpy(ntag424_host_uid, uid, sizeof(ntag424_host_uid));
+}
+
+/**************************************************************************/
+/*!
+    @brief   frame data as the response of command.
+
+    @param   command   PN532 command code
+    @param   data      response data
+    @param   length    length of data
+*/
+/**************************************************************************/
+static void ntag424_host_respond(uint8_t command, const uint8_t *data,
+                                 size_t length)
+{
+  uint8_t *frame = ntag424_host_response;
+  uint8_t len = (uint8_t)(length + 2);
+  uint8_t sum = NTAG424_HOST_PN532TOHOST + command + 1;
+  frame[0] = 0x00;
+  frame[1] = 0x00;
+  frame[2] = 0xFF;
+  frame[3] = len;
+  frame[4] = (uint8_t)(~len + 1);
+  frame[5] = NTAG424_HOST_PN532TOHOST;
+  frame[6] = command + 1;
+  for (size_t i = 0; i < length; i++)
+  {
+    frame[7 + i] = data[i];
+    sum += data[i];
+  }
+  frame[7 + length] = (uint8_t)(~sum + 1);
+  frame[8 + length] = 0x00;
+  ntag424_host_response_length = length + 9;
+}
+
+/**************************************************************************/
+/*!
+    @brief   take a command frame 00 00 FF LEN LCS D4 CMD .. DCS 00 and
+   prepare ACK and response.
+*/
+/**************************************************************************/
+bool Adafruit_I2CDevice::write(const uint8_t *buffer, size_t len, bool)
+{
+  uint8_t data[NTAG424_HOST_FRAMESIZE];
+  if ((len < 8) || (buffer[5] != NTAG424_HOST_HOSTTOPN532))
+  {
+    return false;
+  }
+  uint8_t command = buffer[6];
+  const uint8_t *params = buffer + 7;
+  size_t params_length = buffer[3] - 2;
+  ntag424_host_ack = true;
+  ntag424_host_busy = NTAG424_HOST_BUSYPOLLS;
+  switch (command)
+  {
+  case NTAG424_HOST_GETFIRMWAREVERSION:
+    data[0] = 0x32;
+    data[1] = 0x01;
+    data[2] = 0x06;
+    data[3] = 0x07;
+    ntag424_host_respond(command, data, 4);
+    break;
+  case NTAG424_HOST_INLISTPASSIVETARGET:
+    // NbTg, Tg, SENS_RES, SEL_RES (ISO 14443-4), NFCID
+    data[0] = 0x01;
+    data[1] = 0x01;
+    data[2] = 0x00;
+    data[3] = 0x44;
+    data[4] = 0x20;
+    data[5] = sizeof(ntag424_host_uid);
+    memcpy(data + 6, ntag424_host_uid, sizeof(ntag424_host_uid));
+    ntag424_host_respond(command, data, 6 + sizeof(ntag424_host_uid));
+    break;
+  case NTAG424_HOST_INDATAEXCHANGE:
+  {
+    // status, card response; params are Tg || apdu
+    size_t length = ntag424_host_card(params + 1, params_length - 1, data + 1);
+    // no answer: time out like a target that left the field
+    data[0] = (length > 0) ? 0x00 : NTAG424_HOST_TIMEOUT;
+    ntag424_host_respond(command, data, 1 + length);
+    break;
+  }
+  default:
+    ntag424_host_respond(command, NULL, 0);
+    break;
+  }
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief   RDY byte, followed by the ACK or the response frame.
+*/
+/**************************************************************************/
+bool Adafruit_I2CDevice::read(uint8_t *buffer, size_t len, bool)
+{
+  static const uint8_t ack[6] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+  if (len == 1)
+  {
+    // status poll, busy for the first polls after each command
+    buffer[0] = (ntag424_host_busy > 0) ? 0x00 : 0x01;
+    if (ntag424_host_busy > 0)
+    {
+      ntag424_host_busy--;
+    }
+    return true;
+  }
+  buffer[0] = 0x01;
+  const uint8_t *frame = ntag424_host_response;
+  size_t length = ntag424_host_response_length;
+  if (ntag424_host_ack)
+  {
+    frame = ack;
+    length = sizeof(ack);
+    ntag424_host_ack = false;
+  }
+  if (length > len - 1)
+  {
+    length = len - 1;
+  }
+  memset(buffer + 1, 0, len - 1);
+  memcpy(buffer + 1, frame, length);
+  return true;
+}
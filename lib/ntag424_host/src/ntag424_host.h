@@ -0,0 +1,32 @@
+/**************************************************************************/
+/*!
+    @file ntag424_host.h
+
+    Fake I2C PN532 of the native tests. It answers the PN532 frames of the
+    driver (ACK, RDY byte, response frame) and passes the apdus of
+    InDataExchange to a card function of the test. The card is activated
+    with a fixed 7 byte UID. Nothing here allocates memory.
+*/
+/**************************************************************************/
+
+#ifndef NTAG424_HOST_H
+#define NTAG424_HOST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NTAG424_HOST_FRAMESIZE 265 ///< largest PN532 frame
+#define NTAG424_HOST_BUSYPOLLS 2   ///< RDY polls answered busy per command
+
+/**
+ * @brief Card of the fake PN532: answer apdu (CLA INS ...) with the
+ * response data and status word in response.
+ *
+ * @return length of response, 0 = no answer (InDataExchange times out)
+ */
+typedef size_t (*ntag424_HostCardFunction)(const uint8_t *apdu, size_t length,
+                                           uint8_t *response);
+
+void ntag424_host_attach(ntag424_HostCardFunction card, const uint8_t *uid);
+
+#endif
@@ -58,8 +58,7 @@
 /**************************************************************************/
 
 #include "Adafruit_PN532_NTAG424.h"
-
-Arduino_CRC32 crc32; ///< Arduino CRC32 Class
+#include "mbedtls/platform_util.h"
 
 byte pn532ack[] = {0x00, 0x00, 0xFF,
                    0x00, 0xFF, 0x00}; ///< ACK message from PN532
@@ -90,12 +89,15 @@ byte pn532_packetbuffer[PN532_PACKBUFFSIZ]; ///< Packet buffer used in various
     @param  miso      SPI MISO pin
     @param  mosi      SPI MOSI pin
     @param  ss        SPI chip select pin (CS/SSEL)
+    @param  crypto    crypto provider, NULL = ntag424_crypto_default()
 */
 /**************************************************************************/
 Adafruit_PN532::Adafruit_PN532(uint8_t clk, uint8_t miso, uint8_t mosi,
-                               uint8_t ss)
+                               uint8_t ss,
+                               const ntag424_CryptoProviderType *crypto)
 {
   _cs = ss;
+  ntag424_Crypto = crypto ? crypto : ntag424_crypto_default();
   spi_dev = new Adafruit_SPIDevice(ss, clk, miso, mosi, 100000,
                                    SPI_BITORDER_LSBFIRST, SPI_MODE0);
 }
@@ -107,11 +109,14 @@ Adafruit_PN532::Adafruit_PN532(uint8_t clk, uint8_t miso, uint8_t mosi,
     @param  irq       Location of the IRQ pin
     @param  reset     Location of the RSTPD_N pin
     @param  theWire   pointer to I2C bus to use
+    @param  crypto    crypto provider, NULL = ntag424_crypto_default()
 */
 /**************************************************************************/
-Adafruit_PN532::Adafruit_PN532(uint8_t irq, uint8_t reset, TwoWire *theWire)
+Adafruit_PN532::Adafruit_PN532(uint8_t irq, uint8_t reset, TwoWire *theWire,
+                               const ntag424_CryptoProviderType *crypto)
     : _irq(irq), _reset(reset)
 {
+  ntag424_Crypto = crypto ? crypto : ntag424_crypto_default();
   pinMode(_irq, INPUT);
   pinMode(_reset, OUTPUT);
   i2c_dev = new Adafruit_I2CDevice(PN532_I2C_ADDRESS, theWire);
@@ -123,11 +128,14 @@ Adafruit_PN532::Adafruit_PN532(uint8_t irq, uint8_t reset, TwoWire *theWire)
 
     @param  ss        SPI chip select pin (CS/SSEL)
     @param  theSPI    pointer to the SPI bus to use
+    @param  crypto    crypto provider, NULL = ntag424_crypto_default()
 */
 /**************************************************************************/
-Adafruit_PN532::Adafruit_PN532(uint8_t ss, SPIClass *theSPI)
+Adafruit_PN532::Adafruit_PN532(uint8_t ss, SPIClass *theSPI,
+                               const ntag424_CryptoProviderType *crypto)
 {
   _cs = ss;
+  ntag424_Crypto = crypto ? crypto : ntag424_crypto_default();
   spi_dev = new Adafruit_SPIDevice(ss, 1000000, SPI_BITORDER_LSBFIRST,
                                    SPI_MODE0, theSPI);
 }
@@ -138,11 +146,14 @@ Adafruit_PN532::Adafruit_PN532(uint8_t ss, SPIClass *theSPI)
 
     @param  reset     Location of the RSTPD_N pin
     @param  theSer    pointer to HardWare Serial bus to use
+    @param  crypto    crypto provider, NULL = ntag424_crypto_default()
 */
 /**************************************************************************/
-Adafruit_PN532::Adafruit_PN532(uint8_t reset, HardwareSerial *theSer)
+Adafruit_PN532::Adafruit_PN532(uint8_t reset, HardwareSerial *theSer,
+                               const ntag424_CryptoProviderType *crypto)
     : _reset(reset)
 {
+  ntag424_Crypto = crypto ? crypto : ntag424_crypto_default();
   pinMode(_reset, OUTPUT);
   ser_dev = theSer;
 }
@@ -160,6 +171,18 @@ bool Adafruit_PN532::begin()
   Serial.println("NTAG424DEBUG: On");
   Serial.println("EncBuffer: 52");
 #endif
+  ntag424_Session.authenticated = false;
+  ntag424_selection_reset(0);
+  memset(ntag424_KeyHints, 0, sizeof(ntag424_KeyHints));
+  ntag424_KeyHintNext = 0;
+  memset(ntag424_FileSettingsCache, 0, sizeof(ntag424_FileSettingsCache));
+  ntag424_FileSettingsCacheNext = 0;
+  ntag424_cmac_init(&ntag424_Session.cmac, ntag424_Crypto);
+  ntag424_lrp_init(&ntag424_Session.lrp_keys, ntag424_Crypto);
+  ntag424_Session.lrp = false;
+  ntag424_rng_init(&ntag424_RNG, ntag424_Crypto);
+  memset(&ntag424_Session.ivcache, 0, sizeof(ntag424_Session.ivcache));
+  ntag424_Session.ivcache.cmd_counter = -1;
   if (spi_dev)
   {
     // SPI initialization
@@ -653,6 +676,9 @@ bool Adafruit_PN532::readDetectedPassiveTargetID(uint8_t *uid,
 {
   // read data packet
   readdata(pn532_packetbuffer, 20);
+  // a new activation ends any NTAG424 session and file selection
+  ntag424_forget_target((pn532_packetbuffer[7] == 1) ? pn532_packetbuffer[8]
+                                                      : 0);
   // check some basic stuff
 
   /* ISO14443A card response should be in the following format:
@@ -701,6 +727,12 @@ bool Adafruit_PN532::readDetectedPassiveTargetID(uint8_t *uid,
 #ifdef MIFAREDEBUG
   PN532DEBUGPRINT.println();
 #endif
+  // remembered for the per UID caches, a random ID (4 byte) is not kept
+  if (*uidLength == sizeof(ntag424_Selection.uid))
+  {
+    memcpy(ntag424_Selection.uid, uid, sizeof(ntag424_Selection.uid));
+    ntag424_Selection.uid_length = *uidLength;
+  }
 
   return 1;
 }
@@ -816,6 +848,8 @@ bool Adafruit_PN532::inDataExchange(uint8_t *send, uint8_t sendLength,
 /**************************************************************************/
 bool Adafruit_PN532::inListPassiveTarget()
 {
+  // a new activation ends any NTAG424 session and file selection
+  ntag424_forget_target(0);
   pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
   pn532_packetbuffer[1] = 1;
   pn532_packetbuffer[2] = 0;
@@ -866,6 +900,7 @@ bool Adafruit_PN532::inListPassiveTarget()
       }
 
       _inListedTag = pn532_packetbuffer[8];
+      ntag424_forget_target(_inListedTag);
       PN532DEBUGPRINT.print(F("Tag number: "));
       PN532DEBUGPRINT.println(_inListedTag);
 
@@ -1392,905 +1427,1808 @@ uint8_t Adafruit_PN532::mifareultralight_WritePage(uint8_t page,
 
 /**************************************************************************/
 /*!
-    @brief   create bytecount random bytes into output.
+    @brief   create bytecount random bytes into output, taken from the
+   random pool that waitready() keeps filled.
 
     @param   output     buffer to generate randomness in
     @param   bytecount  amount of bytes randomness to create in buffer
 
-    @return
+    @return  1 = success; 0 = the entropy source failed
 */
 /**************************************************************************/
-void Adafruit_PN532::ntag424_random(uint8_t *output, uint8_t bytecount)
+uint8_t Adafruit_PN532::ntag424_random(uint8_t *output, uint8_t bytecount)
 {
-  for (int i = 0; i < bytecount; i++)
-  {
-    output[i] = random(256);
-  }
+  return ntag424_rng_get(&ntag424_RNG, output, bytecount);
 }
 
 /**************************************************************************/
 /*!
-    @brief   send an apdu-frame to the picc, and wait for a response.
+    @brief   encrypt the FULL mode iv for cmd_counter with SesAuthENCKey.
 
-    @param *cla                   CLA/ISO prefix
-    @param *ins                   Instruction or command
-    @param *p1                    Parameter 1
-    @param *p2                    Parameter 2
-    @param *cmd_header            command header
-    @param cmd_header_length      length of command_header
-    @param *cmd_data              command data
-    @param cmd_data_length        length of command data
-    @param le                     TODO: check if needed.
-    @param comm_mode              Communication mode: NTAG424_COMM_MODE_PLAIN,
-   NTAG424_COMM_MODE_MAC or NTAG424_COMM_MODE_FULL
-    @param *response              response buffer
-    @param response_le            size of response buffer
-    @return length of response
+    @param   type         NTAG424_IV_CMD (A5 5A) or NTAG424_IV_RESP (5A A5)
+    @param   cmd_counter  command counter to build the iv for
+    @param   ive          outputbuffer for the encrypted iv (16 byte)
 */
 /**************************************************************************/
-uint8_t Adafruit_PN532::ntag424_apdu_send(
-    uint8_t *cla, uint8_t *ins, uint8_t *p1, uint8_t *p2, uint8_t *cmd_header,
-    uint8_t cmd_header_length, uint8_t *cmd_data, uint8_t cmd_data_length,
-    uint8_t le, uint8_t comm_mode, uint8_t *response, uint8_t response_le)
+void Adafruit_PN532::ntag424_compute_iv(uint8_t type, int cmd_counter,
+                                        uint8_t *ive)
 {
-  Serial.print("cmd_counter: ");
-  Serial.println(ntag424_Session.cmd_counter);
-  uint8_t apdusize = 8 + (7 + cmd_header_length + cmd_data_length + 2) & 0xff;
-  uint8_t apdu[apdusize];
-  uint8_t offset = 0;
-  apdu[0] = PN532_COMMAND_INDATAEXCHANGE;
-  apdu[1] = 0x01;
-  apdu[2] = cla[0];
-  apdu[3] = ins[0];
-  apdu[4] = p1[0];
-  apdu[5] = p2[0];
-  apdu[6] = cmd_data_length + cmd_header_length;
-  uint8_t offset_lc = 6;
-  offset = 7;
-  // apdu[4] = cmd_data_length + cmd_header_length;
-  memcpy(apdu + offset, cmd_header, cmd_header_length);
-  offset += cmd_header_length;
-
-  if (comm_mode == NTAG424_COMM_MODE_PLAIN)
-  {
-    // we are done
-    memcpy(apdu + offset, cmd_data, cmd_data_length);
-    offset += cmd_data_length;
-  }
-  else if (comm_mode == NTAG424_COMM_MODE_MAC)
-  {
-    memcpy(apdu + offset, cmd_data, cmd_data_length);
-    offset += cmd_data_length;
-    uint8_t cmac_short[8];
-    Adafruit_PN532::ntag424_MAC(ins, cmd_header, cmd_header_length, cmd_data,
-                                cmd_data_length, cmac_short);
-#ifdef NTAG424DEBUG
-    Serial.println("CMAC NEW:");
-    Adafruit_PN532::PrintHexChar(cmac_short, 8);
-#endif
-    memcpy(apdu + offset, cmac_short, 8);
-    offset += 8;
-    apdu[offset_lc] += 8;
-  }
-  else if (comm_mode == NTAG424_COMM_MODE_FULL)
-  {
-#ifdef NTAG424DEBUG
-    Serial.println("ENC NEW:");
-    Serial.println("APDU UNENC:");
-    Adafruit_PN532::PrintHexChar(apdu, offset);
-#endif
-    uint8_t cmac_short[8];
-    uint8_t padded_payload_length = 16 + cmd_data_length;
-    uint8_t payload_padded[padded_payload_length];
-    if (cmd_data_length > 0)
-    {
-      // Add padding to the cmddata
-      memcpy(payload_padded, cmd_data, cmd_data_length);
-      padded_payload_length = Adafruit_PN532::ntag424_addpadding(
-          cmd_data_length, 16, payload_padded);
-#ifdef NTAG424DEBUG
-      Serial.print("CMDDATA Length:");
-      Serial.println(cmd_data_length);
-      Adafruit_PN532::PrintHexChar(payload_padded, cmd_data_length);
-      Serial.println("CMDDATA Padded:");
-      Serial.println(padded_payload_length);
-      Adafruit_PN532::PrintHexChar(payload_padded, padded_payload_length);
-#endif
-      // assemble iv
-      uint8_t iv[32];
-      uint8_t ive[16];
-      iv[0] = 0xA5;
-      iv[1] = 0x5A;
-      memcpy(iv + 2, ntag424_authresponse_TI, 4);
-      iv[6] = ntag424_Session.cmd_counter & 0xff;
-      iv[7] = (ntag424_Session.cmd_counter >> 8) & 0xff;
-      memset(iv + 7, 0, 24); // was 25
-#ifdef NTAG424DEBUG
-      Serial.println("IV-init:");
-      Adafruit_PN532::PrintHex(iv, 16);
-#endif
-      Adafruit_PN532::ntag424_encrypt(ntag424_Session.session_key_enc,
-                                      sizeof(iv), iv, ive);
-      // encrypt cmd_data using SesAuthENCKey
-      // padded_payload_length
-      // uint8_t payload_encrypted[32];
-      uint8_t payload_encrypted[52];
-      Adafruit_PN532::ntag424_encrypt(ntag424_Session.session_key_enc, ive,
-                                      padded_payload_length, payload_padded,
-                                      payload_encrypted);
-      memcpy(apdu + offset, payload_encrypted, padded_payload_length);
-#ifdef NTAG424DEBUG
-      Serial.println("APDU Payload:");
-      Adafruit_PN532::PrintHexChar(apdu, offset);
-      Serial.println("CMDDATA ENC:");
-      Serial.println(padded_payload_length);
-      Serial.println("CMD:");
-      Serial.println(ins[0], HEX);
-      Adafruit_PN532::PrintHex(payload_encrypted, padded_payload_length);
-#endif
-      offset += padded_payload_length;
-#ifdef NTAG424DEBUG
-      Serial.println("APDU PREMAC:");
-      Adafruit_PN532::PrintHexChar(apdu, offset);
-#endif
-      // add CMAC
-      Adafruit_PN532::ntag424_MAC(
-          ntag424_Session.session_key_mac, ins, cmd_header, cmd_header_length,
-          payload_encrypted, padded_payload_length, cmac_short);
-      memcpy(apdu + offset, cmac_short, 8);
-      offset += 8;
-      apdu[offset_lc] = cmd_header_length + padded_payload_length + 8;
-#ifdef NTAG424DEBUG
-      Serial.println("APDU AFTERMAC:");
-      Adafruit_PN532::PrintHexChar(apdu, offset);
-#endif
-    }
-    else
-    {
-      Adafruit_PN532::ntag424_MAC(ntag424_Session.session_key_mac, ins,
-                                  cmd_header, cmd_header_length, cmd_data,
-                                  cmd_data_length, cmac_short);
-      memcpy(apdu + offset, cmac_short, 8);
-      offset += 8;
-      apdu[offset_lc] += 8;
-#ifdef NTAG424DEBUG
-      Serial.println("APDU AFTERMAC:");
-      Adafruit_PN532::PrintHexChar(apdu, offset);
-#endif
-    }
+  // assemble iv: A5 5A / 5A A5 || TI || CmdCounter || 0x00 * 8
+  uint8_t iv[16];
+  iv[0] = (type == NTAG424_IV_CMD) ? 0xA5 : 0x5A;
+  iv[1] = (type == NTAG424_IV_CMD) ? 0x5A : 0xA5;
+  memcpy(iv + 2, ntag424_authresponse_TI, 4);
+  iv[6] = cmd_counter & 0xff;
+  iv[7] = (cmd_counter >> 8) & 0xff;
+  memset(iv + 8, 0, 8);
 #ifdef NTAG424DEBUG
-    Serial.println(offset);
-    Serial.println("APDU ENC:");
-    Adafruit_PN532::PrintHexChar(apdu, offset);
+  PN532DEBUGPRINT.print(F("IV-init: "));
+  Adafruit_PN532::PrintHex(iv, 16);
 #endif
-  }
-  if (apdu[3] != NTAG424_CMD_ISOUPDATEBINARY)
+  Adafruit_PN532::ntag424_encrypt(ntag424_Session.session_key_enc, sizeof(iv),
+                                  iv, ive);
+}
+
+/**************************************************************************/
+/*!
+    @brief   get the encrypted iv for the current cmd_counter, from the cache
+   if waitready() already computed it.
+
+    @param   type   NTAG424_IV_CMD or NTAG424_IV_RESP
+    @param   ive    outputbuffer for the encrypted iv (16 byte)
+*/
+/**************************************************************************/
+void Adafruit_PN532::ntag424_session_iv(uint8_t type, uint8_t *ive)
+{
+  ntag424_IVCacheType *cache = &ntag424_Session.ivcache;
+  if (cache->cmd_counter != ntag424_Session.cmd_counter)
   {
-    apdu[offset] = le;
-    offset++;
+    cache->cmd_counter = ntag424_Session.cmd_counter;
+    cache->valid = 0;
   }
-  apdusize = offset;
-  // #ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("PCD->PICC:"));
-  Adafruit_PN532::PrintHexChar(apdu + 2, apdusize - 2);
-  // #endif
-  if (!sendCommandCheckAck((uint8_t *)apdu, apdusize))
+  if (!(cache->valid & (1 << type)))
   {
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Failed to receive ACK for write command"));
-#endif
-    return 0;
+    ntag424_compute_iv(type, cache->cmd_counter, cache->iv[type]);
+    cache->valid |= (1 << type);
   }
-  /* Read the response packet */
-  // readdata(pn532_packetbuffer, 41);
-  readdata(pn532_packetbuffer, response_le);
-  // #ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("PCD<-PICC: "));
-  // Adafruit_PN532::PrintHexChar(pn532_packetbuffer + 8, 5 +
-  // pn532_packetbuffer[3] - 8);
-  Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 5 + pn532_packetbuffer[3]);
-  // #endif
-  //  increase cmd_counter
-  ntag424_Session.cmd_counter += 1;
-
-  uint8_t response_length = pn532_packetbuffer[3] - 3;
-  memcpy(response, pn532_packetbuffer + 8, response_length);
 #ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("RESPONSE: "));
-  Adafruit_PN532::PrintHexChar(response, response_length);
-#endif
-  uint8_t resp_cmac_ok = 0;
-  // check the responsemac if there is a MAC
-  if ((response_length >= 10) && ((comm_mode == NTAG424_COMM_MODE_FULL) ||
-                                  (comm_mode == NTAG424_COMM_MODE_MAC)))
+  else
   {
-    uint8_t respcmac[8];
-    memcpy(respcmac, response + (response_length - 10), 8);
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.print(F("response cmac:"));
-    Adafruit_PN532::PrintHex(respcmac, 8);
+    PN532DEBUGPRINT.println(F("IV from cache"));
+  }
 #endif
+  memcpy(ive, cache->iv[type], NTAG424_SESSION_KEYSIZE);
+}
 
-    uint8_t *checkmacin = (uint8_t *)malloc(response_length + 6);
-    uint8_t maclength = 0;
-    checkmacin[0] = response[response_length - 1];
-    checkmacin[1] = ntag424_Session.cmd_counter & 0xff;
-    checkmacin[2] = (ntag424_Session.cmd_counter >> 8) & 0xff;
-    memcpy(checkmacin + 3, ntag424_authresponse_TI,
-           NTAG424_AUTHRESPONSE_TI_SIZE);
-    uint8_t padded_respdata_length = 0;
-    uint8_t *respdata = (uint8_t *)malloc(response_length - 10);
-    if (response_length > 10)
-    {
-      memcpy(respdata, response, response_length - 10);
-      // padded_respdata_length =
-      // Adafruit_PN532::ntag424_addpadding(response_length - 10 ,16, respdata);
-      padded_respdata_length = response_length - 10;
-      memcpy(checkmacin + 3 + NTAG424_AUTHRESPONSE_TI_SIZE, respdata,
-             padded_respdata_length);
-    }
-    maclength = 3 + NTAG424_AUTHRESPONSE_TI_SIZE + padded_respdata_length;
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.print(F("checkcmac input: "));
-    Adafruit_PN532::PrintHex(checkmacin, maclength);
-#endif
-    uint8_t checkmac[8];
+/**************************************************************************/
+/*!
+    @brief   compute the missing ivs of a pending FULL mode command. Called
+   from waitready() while the picc is busy, so the response iv and the iv of
+   the next command are ready when the response arrives.
 
-    Adafruit_PN532::ntag424_cmac_short(ntag424_Session.session_key_mac,
-                                       checkmacin, maclength, checkmac);
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.print(F("checkcmac:"));
-    Adafruit_PN532::PrintHex(checkmac, 8);
-#endif
-    free(respdata);
-    free(checkmacin);
-    for (int i = 0; i < 8; i++)
+    @return  true if an iv was computed
+*/
+/**************************************************************************/
+bool Adafruit_PN532::ntag424_precompute_iv()
+{
+  ntag424_IVCacheType *cache = &ntag424_Session.ivcache;
+  if (!cache->pending)
+  {
+    return false;
+  }
+  // both blocks on the first busy poll: polls are 10 ms apart and a short
+  // exchange sees a single one, an iv left for the next poll would be
+  // computed on the critical path again
+  bool computed = false;
+  for (uint8_t type = NTAG424_IV_CMD; type <= NTAG424_IV_RESP; type++)
+  {
+    if (!(cache->valid & (1 << type)))
     {
-      if (respcmac[i] != checkmac[i])
-      {
-#ifdef NTAG424DEBUG
-        PN532DEBUGPRINT.println(
-            F("Response CMAC integrity error! (picc <> pcd)"));
-        Adafruit_PN532::PrintHex(respcmac, 8);
-        PN532DEBUGPRINT.print(F(" <> "));
-        Adafruit_PN532::PrintHex(checkmac, 8);
-#endif
-        return 0;
-      }
+      ntag424_compute_iv(type, cache->cmd_counter, cache->iv[type]);
+      cache->valid |= (1 << type);
+      computed = true;
     }
-    PN532DEBUGPRINT.println(F("Response CMAC ok! (picc == pcd)"));
-  }
-  // decrypt the response in mode.full
-  if ((response_length >= 10) && (comm_mode == NTAG424_COMM_MODE_FULL))
-  {
-    uint8_t ivd[32];
-    uint8_t ivde[16];
-    ivd[0] = 0x5A;
-    ivd[1] = 0xA5;
-    memcpy(ivd + 2, ntag424_authresponse_TI, 4);
-    ivd[6] = ntag424_Session.cmd_counter & 0xff;
-    ivd[7] = (ntag424_Session.cmd_counter >> 8) & 0xff;
-    memset(ivd + 7, 0, 25);
-    // Serial.println("IV-init:");
-    // Adafruit_PN532::PrintHex(iv, 16);
-    Adafruit_PN532::ntag424_encrypt(ntag424_Session.session_key_enc,
-                                    sizeof(ivd), ivd, ivde);
-    uint8_t *respplain = (uint8_t *)malloc(response_length - 10);
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Encrypted Response(pcd < picc)"));
-    Adafruit_PN532::PrintHex(response, response_length - 10);
-#endif
-    Adafruit_PN532::ntag424_decrypt(ntag424_Session.session_key_enc, ivde,
-                                    response_length - 10, response, respplain);
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Decrypted Response(pcd < picc)"));
-    Adafruit_PN532::PrintHex(respplain, response_length - 10);
-#endif
-    // 10 byte = cmac+responsecode
-    // Serial.println(response_length);
-    memcpy(response, respplain, response_length - 10);
-    uint8_t resp_no_padding = response_length - 10;
-    if (response_length > 10)
-    {
-      for (uint8_t i = response_length - 10 - 1; i >= 0; i--)
-      {
-        // Serial.println(i);
-        if (response[i] == 0x00)
-        {
-          resp_no_padding = i;
-        }
-        else if (response[i] == 0x80)
-        {
-          resp_no_padding = i;
-          break;
-        }
-        else
-        {
-          // nopadding?
-          break;
-        }
-      }
-    }
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(resp_no_padding);
-#endif
-    free(respplain);
-    memcpy(response + resp_no_padding, response + response_length - 2, 2);
-    resp_no_padding += 2;
-    memset(response + resp_no_padding, 0, response_length - resp_no_padding);
-    response_length = resp_no_padding;
   }
-  return response_length;
+  cache->pending = false;
+  return computed;
 }
 
 /**************************************************************************/
 /*!
-    @brief   add padding to a buffer.
+    @brief   encrypt or decrypt FULL mode blocks with SesAuthENCKey. AES
+   sessions chain CBC through the iv of the stream, LRP sessions use LRICB
+   with EncCtr, which counts the blocks of commands and responses alike.
 
-    @param   inputlength
-    @param   paddinglength
-    @param   buffer input & outputbuffer needs to be big enough for inputlength
-   + padding worstcase
+    @param   mode     NTAG424_AES_ENCRYPT or NTAG424_AES_DECRYPT
+    @param   length   length of input (multiple of 16)
+    @param   input    inputbuffer
+    @param   output   outputbuffer
 
-    @return  the new length of buffer including the added zeroes
+    @return  1 = success; 0 = failed
 */
 /**************************************************************************/
-uint8_t Adafruit_PN532::ntag424_addpadding(uint8_t inputlength,
-                                           uint8_t paddinglength,
-                                           uint8_t *buffer)
+uint8_t Adafruit_PN532::ntag424_session_crypt(uint8_t mode, uint8_t length,
+                                              uint8_t *input, uint8_t *output)
 {
-  uint8_t zeroestoadd = paddinglength - (inputlength % paddinglength);
-  memset(buffer + inputlength, 0, zeroestoadd);
-  if (zeroestoadd > 0)
+  if (ntag424_Session.lrp)
+  {
+    return ntag424_lrp_lricb(&ntag424_Session.lrp_keys, NTAG424_LRP_KEY_ENC,
+                             &ntag424_Session.enc_counter, input, output,
+                             length, mode);
+  }
+  uint8_t *iv = ntag424_Workspace.stream.iv;
+  return (mode == NTAG424_AES_ENCRYPT)
+             ? Adafruit_PN532::ntag424_encrypt(ntag424_Session.session_key_enc,
+                                               iv, length, input, output)
+             : Adafruit_PN532::ntag424_decrypt(ntag424_Session.session_key_enc,
+                                               iv, length, input, output);
+}
+
+/**************************************************************************/
+/*!
+    @brief   collect response data in the caller buffer of a
+   ntag424_BufferType.
+
+    @param context                ntag424_BufferType
+    @param *data                  chunk of response data
+    @param length                 length of the chunk
+    @return false if the buffer is full
+*/
+/**************************************************************************/
+bool ntag424_buffer_write(void *context, const uint8_t *data, uint8_t length)
+{
+  ntag424_BufferType *buffer = (ntag424_BufferType *)context;
+  if (buffer->length + length > buffer->size)
   {
-    buffer[inputlength] = 0x80;
+    return false;
   }
-  return inputlength + zeroestoadd;
+  memcpy(buffer->data + buffer->length, data, length);
+  buffer->length += length;
+  return true;
 }
 
 /**************************************************************************/
 /*!
-    @brief   wrapper for ntag424_encrypt with standard iv.
-
-    @param   key    encryption key
-    @param   length  sizeof input
-    @param   input inputbuffer
-    @param   output outputbuffer
+    @brief   build the descriptor of a command passed to ntag424_apdu_send().
 
-    @return
+    @param cla                    CLA/ISO prefix
+    @param ins                    Instruction or command
+    @param p1                     Parameter 1
+    @param p2                     Parameter 2
+    @param cmd_header_length      length of command_header
+    @param le                     Le
+    @param comm_mode              Communication mode
+    @return command descriptor
 */
 /**************************************************************************/
-uint8_t Adafruit_PN532::ntag424_encrypt(uint8_t *key, uint8_t length,
-                                        uint8_t *input, uint8_t *output)
+static ntag424_CommandType ntag424_apdu_command(uint8_t cla, uint8_t ins,
+                                                uint8_t p1, uint8_t p2,
+                                                uint8_t cmd_header_length,
+                                                uint8_t le, uint8_t comm_mode)
 {
-  uint8_t iv[16];
-  memset(iv, 0, sizeof(iv));
-  return ntag424_encrypt(key, iv, length, input, output);
+  ntag424_CommandType cmd = {cla,
+                             ins,
+                             p1,
+                             p2,
+                             cmd_header_length,
+                             (ntag424_CommMode)comm_mode,
+                             le,
+                             ins != NTAG424_CMD_ISOUPDATEBINARY,
+                             0,
+                             0x91,
+                             0x00};
+  return cmd;
 }
 
 /**************************************************************************/
 /*!
-    @brief   encrypt input's lengths bytes with aes 128 cbc into output.
+    @brief   send an apdu-frame to the picc, and wait for a response. Runtime
+   wrapper around ntag424_send() for callers with a variable comm_mode.
 
-    @param   key    encryption key
-    @param   iv     initialization vector
-    @param   length sizeof input
-    @param   input  inputbuffer
-    @param   output outputbuffer
-
-    @return
+    @param *cla                   CLA/ISO prefix
+    @param *ins                   Instruction or command
+    @param *p1                    Parameter 1
+    @param *p2                    Parameter 2
+    @param *cmd_header            command header
+    @param cmd_header_length      length of command_header
+    @param *cmd_data              command data
+    @param cmd_data_length        length of command data
+    @param le                     Le
+    @param comm_mode              Communication mode: NTAG424_COMM_MODE_PLAIN,
+   NTAG424_COMM_MODE_MAC or NTAG424_COMM_MODE_FULL
+    @param *response              response buffer
+    @param response_le            size of response buffer
+    @return length of response
 */
 /**************************************************************************/
-// encrypt input's lengths bytes with aes 128 cbc into output
-uint8_t Adafruit_PN532::ntag424_encrypt(uint8_t *key, uint8_t *iv,
-                                        uint8_t length, uint8_t *input,
-                                        uint8_t *output)
+uint8_t Adafruit_PN532::ntag424_apdu_send(
+    uint8_t *cla, uint8_t *ins, uint8_t *p1, uint8_t *p2, uint8_t *cmd_header,
+    uint8_t cmd_header_length, uint8_t *cmd_data, uint8_t cmd_data_length,
+    uint8_t le, uint8_t comm_mode, uint8_t *response, uint8_t response_le)
 {
-  mbedtls_aes_context ctx;
-  mbedtls_aes_init(&ctx);
-  // Set the key for the AES context
-  if (mbedtls_aes_setkey_dec(&ctx, key, 128) != 0)
-  {
-    // Error setting key
-    mbedtls_aes_free(&ctx);
-    return 0;
-  }
-  mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_ENCRYPT, length, iv, (uint8_t *)input,
-                        (uint8_t *)output);
-  mbedtls_aes_free(&ctx);
-  return 1;
+  ntag424_CommandType cmd = ntag424_apdu_command(
+      cla[0], ins[0], p1[0], p2[0], cmd_header_length, le, comm_mode);
+  return ntag424_send(cmd, cmd.comm_mode, cmd_header, cmd_data,
+                      cmd_data_length, response, response_le);
 }
 
 /**************************************************************************/
 /*!
-    @brief   wrapper for ntag424_decrypt with standard iv.
-
-    @param   key    encryption key
-    @param   length  sizeof input
-    @param   input inputbuffer
-    @param   output outputbuffer
+    @brief   send an apdu-frame to the picc and stream the response data into
+   sink, following additional frames (91 AF) in both directions.
 
-    @return
+    @param *cla                   CLA/ISO prefix
+    @param *ins                   Instruction or command
+    @param *p1                    Parameter 1
+    @param *p2                    Parameter 2
+    @param *cmd_header            command header
+    @param cmd_header_length      length of command_header
+    @param *cmd_data              command data
+    @param cmd_data_length        length of command data
+    @param le                     Le
+    @param comm_mode              Communication mode: NTAG424_COMM_MODE_PLAIN,
+   NTAG424_COMM_MODE_MAC or NTAG424_COMM_MODE_FULL
+    @param sink                   receives the (decrypted) response data
+    @return status word SW1 SW2, 0 = failed
 */
 /**************************************************************************/
-uint8_t Adafruit_PN532::ntag424_decrypt(uint8_t *key, uint8_t length,
-                                        uint8_t *input, uint8_t *output)
+uint16_t Adafruit_PN532::ntag424_apdu_send(
+    uint8_t *cla, uint8_t *ins, uint8_t *p1, uint8_t *p2, uint8_t *cmd_header,
+    uint8_t cmd_header_length, uint8_t *cmd_data, uint8_t cmd_data_length,
+    uint8_t le, uint8_t comm_mode, const ntag424_SinkType &sink)
 {
-  uint8_t iv[16];
-  memset(iv, 0, sizeof(iv));
-  return ntag424_decrypt(key, iv, length, input, output);
+  ntag424_CommandType cmd = ntag424_apdu_command(
+      cla[0], ins[0], p1[0], p2[0], cmd_header_length, le, comm_mode);
+  return ntag424_send(cmd, cmd.comm_mode, cmd_header, cmd_data,
+                      cmd_data_length, sink);
 }
 
 /**************************************************************************/
 /*!
-    @brief   decrypt input's lengths bytes with aes 128 cbc into output.
-
-    @param   key    encryption key
-    @param   iv     initialization vector
-    @param   length sizeof input
-    @param   input  inputbuffer
-    @param   output outputbuffer
+    @brief   send the command cmd with a comm mode only known at runtime,
+   e.g. from the file settings.
 
-    @return
+    @param cmd                    command descriptor, e.g. NTAG424_APDU_*
+    @param mode                   communication mode
+    @param *cmd_header            command header (cmd.header_length byte)
+    @param *cmd_data              command data
+    @param cmd_data_length        length of command data
+    @param *response              response buffer
+    @param response_le            size of response buffer
+    @return length of response, 0 = failed
 */
 /**************************************************************************/
-uint8_t Adafruit_PN532::ntag424_decrypt(uint8_t *key, uint8_t *iv,
-                                        uint8_t length, uint8_t *input,
-                                        uint8_t *output)
+uint8_t Adafruit_PN532::ntag424_send(const ntag424_CommandType &cmd,
+                                     ntag424_CommMode mode,
+                                     uint8_t *cmd_header, uint8_t *cmd_data,
+                                     uint8_t cmd_data_length,
+                                     uint8_t *response, uint8_t response_le)
 {
-  mbedtls_aes_context ctx;
-  mbedtls_aes_init(&ctx);
-  // Set the key for the AES context
-  if (mbedtls_aes_setkey_dec(&ctx, key, 128) != 0)
-  {
-    // Error setting key
-    mbedtls_aes_free(&ctx);
-    return 0;
-  }
-  if (mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_DECRYPT, length, iv,
-                            (uint8_t *)input, (uint8_t *)output) != 0)
-  {
-    return 0;
+  switch (mode)
+  {
+  case ntag424_CommMode::Mac:
+    return ntag424_send<ntag424_CommMode::Mac>(
+        cmd, cmd_header, cmd_data, cmd_data_length, response, response_le);
+  case ntag424_CommMode::Full:
+    return ntag424_send<ntag424_CommMode::Full>(
+        cmd, cmd_header, cmd_data, cmd_data_length, response, response_le);
+  default:
+    return ntag424_send<ntag424_CommMode::Plain>(
+        cmd, cmd_header, cmd_data, cmd_data_length, response, response_le);
   }
-  mbedtls_aes_free(&ctx);
-  return 1;
 }
 
 /**************************************************************************/
 /*!
-    @brief   create short cmac by returning the uneven bytes (1,3,5,7,9).
-
-    @param   key    signing key
-    @param   input  inputbuffer
-    @param   length length of inputbuffer
-    @param   cmac   outputbuffer (>=8 bytes)
+    @brief   send the command cmd with a comm mode only known at runtime and
+   stream the response data into sink.
 
-    @return
+    @param cmd                    command descriptor, e.g. NTAG424_APDU_*
+    @param mode                   communication mode
+    @param *cmd_header            command header (cmd.header_length byte)
+    @param *cmd_data              command data
+    @param cmd_data_length        length of command data
+    @param sink                   receives the (decrypted) response data
+    @param response_le            max. raw response length (data, MAC, SW)
+    @return status word SW1 SW2, 0 = failed
 */
 /**************************************************************************/
-uint8_t Adafruit_PN532::ntag424_cmac_short(uint8_t *key, uint8_t *input,
-                                           uint8_t length, uint8_t *cmac)
+uint16_t Adafruit_PN532::ntag424_send(const ntag424_CommandType &cmd,
+                                      ntag424_CommMode mode,
+                                      uint8_t *cmd_header, uint8_t *cmd_data,
+                                      uint8_t cmd_data_length,
+                                      const ntag424_SinkType &sink,
+                                      uint16_t response_le)
 {
-  uint8_t regularcmac[16];
-  Adafruit_PN532::ntag424_cmac(key, input, length, regularcmac);
-  uint8_t c = 0;
-  for (int i = 1; i < 16; i += 2)
-  {
-    cmac[c] = regularcmac[i];
-    c++;
+  switch (mode)
+  {
+  case ntag424_CommMode::Mac:
+    return ntag424_send<ntag424_CommMode::Mac>(
+        cmd, cmd_header, cmd_data, cmd_data_length, sink, response_le);
+  case ntag424_CommMode::Full:
+    return ntag424_send<ntag424_CommMode::Full>(
+        cmd, cmd_header, cmd_data, cmd_data_length, sink, response_le);
+  default:
+    return ntag424_send<ntag424_CommMode::Plain>(
+        cmd, cmd_header, cmd_data, cmd_data_length, sink, response_le);
   }
+}
 
-#ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("INPUT: "));
-  Adafruit_PN532::PrintHexChar(input, length);
-  PN532DEBUGPRINT.print(F("CMAC: "));
-  Adafruit_PN532::PrintHexChar(regularcmac, 16);
-  PN532DEBUGPRINT.print(F("CMAC_SHORT: "));
-  Adafruit_PN532::PrintHexChar(cmac, 8);
-#endif
-  return 0;
+/**************************************************************************/
+/*!
+    @brief   check the status word at the end of a response against the
+   success status of the command.
+
+    @param cmd                    command descriptor
+    @param *response              response incl. status
+    @param response_length        length of response
+    @return true = command succeeded
+*/
+/**************************************************************************/
+bool Adafruit_PN532::ntag424_status_ok(const ntag424_CommandType &cmd,
+                                       uint8_t *response,
+                                       uint8_t response_length)
+{
+  return (response_length >= 2) &&
+         (response[response_length - 2] == cmd.sw1) &&
+         (response[response_length - 1] == cmd.sw2);
 }
 
 /**************************************************************************/
 /*!
-    @brief   create aes128-cmac.
+    @brief   write InDataExchange, CLA INS P1 P2 Lc and the command header of
+   an apdu into the workspace. Lc covers the command header only,
+   ntag424_send() adds the rest.
 
-    @param   key    signing key
-    @param   input  inputbuffer
-    @param   length length of inputbuffer
-    @param   cmac   outputbuffer (>=16 bytes)
+    @param cmd                    command descriptor
+    @param *cmd_header            command header (cmd.header_length byte)
+    @return offset behind the command header
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_apdu_header(const ntag424_CommandType &cmd,
+                                            uint8_t *cmd_header)
+{
+  uint8_t *apdu = ntag424_Workspace.apdu;
+  apdu[0] = PN532_COMMAND_INDATAEXCHANGE;
+  apdu[1] = 0x01;
+  apdu[2] = cmd.cla;
+  apdu[3] = cmd.ins;
+  apdu[4] = cmd.p1;
+  apdu[5] = cmd.p2;
+  apdu[NTAG424_APDU_HEADERSIZE - 1] = cmd.header_length;
+  memcpy(apdu + NTAG424_APDU_HEADERSIZE, cmd_header, cmd.header_length);
+  return NTAG424_APDU_HEADERSIZE + cmd.header_length;
+}
 
-    @return
+/**************************************************************************/
+/*!
+    @brief   start a MAC over code || CmdCounter || TI in the session cmac
+   engine. code is the command for requests and the return code for
+   responses.
+
+    @param code                   Cmd or RC
 */
 /**************************************************************************/
-uint8_t Adafruit_PN532::ntag424_cmac(uint8_t *key, uint8_t *input,
-                                     uint8_t length, uint8_t *cmac)
+void Adafruit_PN532::ntag424_stream_mac_begin(uint8_t code)
 {
-  int ret = 0;
-  const mbedtls_cipher_info_t *cipher_info;
-  cipher_info = mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_ECB);
-  mbedtls_cipher_context_t ctx;
-  mbedtls_cipher_init(&ctx);
-  if ((ret = mbedtls_cipher_setup(&ctx, cipher_info)) != 0)
-  {
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("could not setup cipher "));
-#endif
-    goto exit;
-  }
-  ret = mbedtls_cipher_cmac_starts(&ctx, key, 128);
-  if (ret != 0)
-  {
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("could not start cmac "));
-#endif
-    goto exit;
-  }
-  ret = mbedtls_cipher_cmac_update(&ctx, input, length);
-  if (ret != 0)
-  {
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("error while updateing cmac "));
-#endif
-    goto exit;
-  }
-  ret = mbedtls_cipher_cmac_finish(&ctx, cmac);
-#ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("cmac key: "));
-  Adafruit_PN532::PrintHexChar(key, 16);
-  PN532DEBUGPRINT.print(F("cmac input: "));
-  Adafruit_PN532::PrintHexChar(input, length);
-  PN532DEBUGPRINT.print(F("cmac output: "));
-  Adafruit_PN532::PrintHexChar(cmac, 16);
-#endif
-  return 1;
-exit:
-  mbedtls_cipher_free(&ctx);
-  return 0;
+  uint8_t counter[2] = {(uint8_t)(ntag424_Session.cmd_counter & 0xff),
+                        (uint8_t)((ntag424_Session.cmd_counter >> 8) & 0xff)};
+  ntag424_cmac_reset(&ntag424_Session.cmac);
+  ntag424_cmac_update(&ntag424_Session.cmac, &code, 1);
+  ntag424_cmac_update(&ntag424_Session.cmac, counter, sizeof(counter));
+  ntag424_cmac_update(&ntag424_Session.cmac, ntag424_authresponse_TI,
+                      NTAG424_AUTHRESPONSE_TI_SIZE);
 }
 
 /**************************************************************************/
 /*!
-    @brief   sign the supplied data and return the size.
-
-    @param   cmd              apducmd
-    @param   cmdheader        buffer containing the commandheader
-    @param   cmdheader_length length of commandheader
-    @param   cmddata          buffer containing the command data
-    @param   cmddata_length   length of commanddata. set to 0 if n/a
-    @param   signature        outputbuffer for the signature
+    @brief   prepare the request stream of a command: plain data, data + MAC
+   or padded cryptogram + MAC. The MAC starts over Cmd || CmdCounter || TI ||
+   CmdHeader and collects the data while it is sent.
 
-    @return
+    @param cmd                    command descriptor
+    @param *cmd_header            command header (cmd.header_length byte)
+    @param *cmd_data              command data
+    @param cmd_data_length        length of command data
 */
 /**************************************************************************/
-uint8_t Adafruit_PN532::ntag424_MAC(uint8_t *cmd, uint8_t *cmdheader,
-                                    uint8_t cmdheader_length, uint8_t *cmddata,
-                                    uint8_t cmddata_length,
-                                    uint8_t *signature)
+template <ntag424_CommMode mode>
+void Adafruit_PN532::ntag424_request_begin(const ntag424_CommandType &cmd,
+                                           uint8_t *cmd_header,
+                                           uint8_t *cmd_data,
+                                           uint8_t cmd_data_length)
 {
-  return ntag424_MAC(ntag424_Session.session_key_mac, cmd, cmdheader,
-                     cmdheader_length, cmddata, cmddata_length, signature);
+  ntag424_StreamType *stream = &ntag424_Workspace.stream;
+  stream->data = cmd_data;
+  stream->data_length = cmd_data_length;
+  stream->length = cmd_data_length;
+  stream->position = 0;
+  stream->mac_length = 0;
+  if (mode == ntag424_CommMode::Plain)
+  {
+    return;
+  }
+  ntag424_stream_mac_begin(cmd.ins);
+  ntag424_cmac_update(&ntag424_Session.cmac, cmd_header, cmd.header_length);
+  if ((mode == ntag424_CommMode::Full) && (cmd_data_length > 0))
+  {
+    // ISO/IEC 9797-1 padding method 2 always adds 0x80
+    stream->length = (cmd_data_length / 16 + 1) * 16;
+    // iv: E(SesAuthENCKey, A5 5A || TI || CmdCounter || 0x00 * 8), LRP
+    // counts the blocks with EncCtr instead
+    if (!ntag424_Session.lrp)
+    {
+      ntag424_session_iv(NTAG424_IV_CMD, stream->iv);
+    }
+  }
+  stream->length += 8;
 }
 
 /**************************************************************************/
 /*!
-    @brief   sign the supplied data.
-
-    @param   key              mac-key
-    @param   cmd              apducmd
-    @param   cmdheader        buffer containing the commandheader
-    @param   cmdheader_length length of commandheader
-    @param   cmddata          buffer containing the command data
-    @param   cmddata_length   length of commanddata. set to 0 if n/a
-    @param   signature        outputbuffer for the signature
+    @brief   append the next plain command data of the request stream.
 
-    @return
+    @param *output                end of the apdu in the workspace
+    @param room                   free space in the apdu
+    @return bytes appended
 */
 /**************************************************************************/
-uint8_t Adafruit_PN532::ntag424_MAC(uint8_t *key, uint8_t *cmd,
-                                    uint8_t *cmdheader,
-                                    uint8_t cmdheader_length, uint8_t *cmddata,
-                                    uint8_t cmddata_length,
-                                    uint8_t *signature)
+template <>
+uint8_t Adafruit_PN532::ntag424_request_update<ntag424_CommMode::Plain>(
+    uint8_t *output, uint8_t room)
 {
-  // counter is LSB
-  uint8_t counter[2] = {(uint8_t)(ntag424_Session.cmd_counter & 0xff),
-                        (uint8_t)((ntag424_Session.cmd_counter >> 8) & 0xff)};
-  uint8_t msglen = 1 + sizeof(counter) + NTAG424_AUTHRESPONSE_TI_SIZE +
-                   cmdheader_length + cmddata_length;
-#ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("mesglen: "));
-  Serial.println(msglen);
-#endif
-  uint8_t mesg[msglen];
-  uint8_t cmac_short[8];
-
-  mesg[0] = cmd[0];
-  memcpy(mesg + 1, counter, sizeof(counter));
-  memcpy(mesg + 1 + sizeof(counter), ntag424_authresponse_TI,
-         NTAG424_AUTHRESPONSE_TI_SIZE);
-  memcpy(mesg + 1 + sizeof(counter) + NTAG424_AUTHRESPONSE_TI_SIZE, cmdheader,
-         cmdheader_length);
-  if (cmddata_length > 0)
+  ntag424_StreamType *stream = &ntag424_Workspace.stream;
+  uint8_t n = stream->length - stream->position;
+  if (n > room)
   {
-    memcpy(mesg + 1 + sizeof(counter) + NTAG424_AUTHRESPONSE_TI_SIZE +
-               cmdheader_length,
-           cmddata, cmddata_length);
+    n = room;
   }
-#ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("mesg: padded: "));
-  Adafruit_PN532::PrintHexChar(mesg, msglen);
-#endif
-  Adafruit_PN532::ntag424_cmac_short(key, mesg, msglen, signature);
-  return 0;
+  memcpy(output, stream->data + stream->position, n);
+  stream->position += n;
+  return n;
 }
 
 /**************************************************************************/
 /*!
-    @brief   derive sessionskeys from RndA and RNDB.
-
-    @param   key         mac-key
-    @param   RndA        RndA
-    @param   RndB        RndB
+    @brief   append the next plain command data of the request stream, and
+   the MAC behind the last data.
 
-    @return
+    @param *output                end of the apdu in the workspace
+    @param room                   free space in the apdu
+    @return bytes appended
 */
 /**************************************************************************/
-void Adafruit_PN532::ntag424_derive_session_keys(uint8_t *key, uint8_t *RndA,
-                                                 uint8_t *RndB)
+template <>
+uint8_t Adafruit_PN532::ntag424_request_update<ntag424_CommMode::Mac>(
+    uint8_t *output, uint8_t room)
 {
-  uint8_t f1[2];
-  uint8_t f2[6];
-  uint8_t f3[6];
-  uint8_t f4[10];
-  uint8_t f5[8];
-  uint8_t f2xor3[6];
-  memcpy(&f1, RndA, 2);
-  memcpy(&f2, RndA + 2, 6);
-  memcpy(&f3, RndB, 6);
-  memcpy(&f4, RndB + 6, 10);
-  memcpy(&f5, RndA + 8, 8);
-  // xor f2 & f3
-  for (int i = 0; i < 6; ++i)
+  ntag424_StreamType *stream = &ntag424_Workspace.stream;
+  uint8_t n = 0;
+  if (stream->position < stream->data_length)
   {
-    f2xor3[i] = f2[i] ^ f3[i];
+    n = stream->data_length - stream->position;
+    if (n > room)
+    {
+      n = room;
+    }
+    memcpy(output, stream->data + stream->position, n);
+    ntag424_cmac_update(&ntag424_Session.cmac, output, n);
+    stream->position += n;
   }
-#ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.println(F("DERIVE SESSIONKEYS: "));
-  PN532DEBUGPRINT.print(F("RndA: "));
-  Adafruit_PN532::PrintHexChar(RndA, 16);
-  PN532DEBUGPRINT.print(F("RndB: "));
-  Adafruit_PN532::PrintHexChar(RndB, 16);
-  PN532DEBUGPRINT.print(F("f1: "));
-  Adafruit_PN532::PrintHexChar(f1, 2);
-  PN532DEBUGPRINT.print(F("f2: "));
-  Adafruit_PN532::PrintHexChar(f2, 6);
-  PN532DEBUGPRINT.print(F("f3: "));
-  Adafruit_PN532::PrintHexChar(f3, 6);
-  PN532DEBUGPRINT.print(F("f4: "));
-  Adafruit_PN532::PrintHexChar(f4, 10);
-  PN532DEBUGPRINT.print(F("f5: "));
-  Adafruit_PN532::PrintHexChar(f5, 8);
-  PN532DEBUGPRINT.print(F("f2xorf3: "));
-  Adafruit_PN532::PrintHexChar(f2xor3, 6);
-#endif
-  uint8_t sv1[32] = {
-      0xA5, 0x5A, 0x00, 0x01, 0x00, 0x80, f1[0],
-      f1[1], f2xor3[0], f2xor3[1], f2xor3[2], f2xor3[3], f2xor3[4], f2xor3[5],
-      f4[0], f4[1], f4[2], f4[3], f4[4], f4[5], f4[6],
-      f4[7], f4[8], f4[9], f5[0], f5[1], f5[2], f5[3],
-      f5[4], f5[5], f5[6], f5[7]};
-  uint8_t sv2[32] = {
-      0x5A, 0xA5, 0x00, 0x01, 0x00, 0x80, f1[0],
-      f1[1], f2xor3[0], f2xor3[1], f2xor3[2], f2xor3[3], f2xor3[4], f2xor3[5],
-      f4[0], f4[1], f4[2], f4[3], f4[4], f4[5], f4[6],
-      f4[7], f4[8], f4[9], f5[0], f5[1], f5[2], f5[3],
-      f5[4], f5[5], f5[6], f5[7]};
-#ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("SV1: "));
-  Adafruit_PN532::PrintHexChar(sv1, 32);
-  PN532DEBUGPRINT.print(F("SV2: "));
-  Adafruit_PN532::PrintHexChar(sv2, 32);
-#endif
+  if (stream->position == stream->data_length)
+  {
+    n += ntag424_request_mac(output + n, room - n);
+  }
+  return n;
+}
 
-  Adafruit_PN532::ntag424_cmac(key, sv1, 32, ntag424_Session.session_key_enc);
-  Adafruit_PN532::ntag424_cmac(key, sv2, 32, ntag424_Session.session_key_mac);
+/**************************************************************************/
+/*!
+    @brief   append the next blocks of the padded and encrypted command data,
+   and the MAC over the cryptogram behind the last block. The cryptogram is
+   CBC chained across frames.
 
+    @param *output                end of the apdu in the workspace
+    @param room                   free space in the apdu
+    @return bytes appended
+*/
+/**************************************************************************/
+template <>
+uint8_t Adafruit_PN532::ntag424_request_update<ntag424_CommMode::Full>(
+    uint8_t *output, uint8_t room)
+{
+  ntag424_StreamType *stream = &ntag424_Workspace.stream;
+  uint8_t *payload = ntag424_Workspace.payload;
+  uint16_t cryptogram_length = stream->length - 8;
+  uint8_t n = 0;
+  if (stream->position < cryptogram_length)
+  {
+    // whole blocks only, the cryptogram length is a multiple of 16
+    n = room & 0xF0;
+    if (n > cryptogram_length - stream->position)
+    {
+      n = cryptogram_length - stream->position;
+    }
+    for (uint8_t i = 0; i < n; i++)
+    {
+      uint16_t index = stream->position + i;
+      payload[i] = (index < stream->data_length)    ? stream->data[index]
+                   : (index == stream->data_length) ? 0x80
+                                                    : 0x00;
+    }
 #ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("session_key_mac: "));
-  Adafruit_PN532::PrintHexChar(ntag424_Session.session_key_mac,
-                               NTAG424_SESSION_KEYSIZE);
-  PN532DEBUGPRINT.print(F("session_key_enc: "));
-  Adafruit_PN532::PrintHexChar(ntag424_Session.session_key_enc,
-                               NTAG424_SESSION_KEYSIZE);
+    PN532DEBUGPRINT.println(F("CMDDATA Padded:"));
+    Adafruit_PN532::PrintHexChar(payload, n);
 #endif
+    // encrypt with SesAuthENCKey straight into the apdu, stream->iv or
+    // EncCtr keeps the chaining value for the next frame
+    ntag424_session_crypt(NTAG424_AES_ENCRYPT, n, payload, output);
+    ntag424_cmac_update(&ntag424_Session.cmac, output, n);
+    stream->position += n;
+  }
+  if (stream->position == cryptogram_length)
+  {
+    n += ntag424_request_mac(output + n, room - n);
+  }
+  return n;
 }
 
 /**************************************************************************/
 /*!
-    @brief   calculate and return the crc32 of data.
-
-    @param   data      databuffer needs to be of size datalength
-    @param   datalength
+    @brief   finish the request MAC and append it. The MAC is never split,
+   it moves to the next frame if it does not fit.
 
-    @return  uint32 crc
+    @param *output                end of the apdu in the workspace
+    @param room                   free space in the apdu
+    @return bytes appended
 */
 /**************************************************************************/
-
-uint32_t Adafruit_PN532::ntag424_crc32(uint8_t *data, uint8_t datalength)
+uint8_t Adafruit_PN532::ntag424_request_mac(uint8_t *output, uint8_t room)
 {
-  Adafruit_PN532::PrintHexChar((uint8_t const *)data, datalength);
-  uint32_t const crc32_res = crc32.calc((uint8_t const *)data, datalength);
-  Serial.println(crc32_res, HEX);
-  return crc32_res;
+  ntag424_StreamType *stream = &ntag424_Workspace.stream;
+  if (stream->mac_length == 0)
+  {
+    uint8_t regularcmac[16];
+    ntag424_cmac_finish(&ntag424_Session.cmac, regularcmac);
+    ntag424_cmac_truncate(regularcmac, stream->mac);
+    stream->mac_length = 8;
+#ifdef NTAG424DEBUG
+    Serial.println("CMAC NEW:");
+    Adafruit_PN532::PrintHexChar(stream->mac, 8);
+#endif
+  }
+  if ((room < 8) || (stream->position == stream->length))
+  {
+    return 0;
+  }
+  memcpy(output, stream->mac, 8);
+  stream->position += 8;
+  return 8;
 }
 
 /**************************************************************************/
 /*!
-    @brief   left-rotate the bufferlen bytes of input by rotation bytes into
-   output.
-
-    @param   input      inputbuffer needs to be of size bufferlen
-    @param   output     outputbuffer needs to be of size bufferlen
-    @param   bufferlen  size of input & output-buffer
-    @param   rotation     number of random bytes to rotate
+    @brief   largest command/response data length which fits into room
+   together with the MAC and the FULL mode padding, i.e. the chunk size of
+   a read or write which shall need one frame per command.
 
-    @return
+    @param mode                   communication mode
+    @param room                   bytes of a frame left for data, MAC, padding
+    @return chunk size
 */
 /**************************************************************************/
-
-uint8_t Adafruit_PN532::ntag424_rotl(uint8_t *input, uint8_t *output,
-                                     uint8_t bufferlen, uint8_t rotation)
+uint8_t Adafruit_PN532::ntag424_chunk_size(ntag424_CommMode mode,
+                                           uint8_t room)
 {
-  uint8_t overlap[16];
-  if ((rotation > 16) || (bufferlen < rotation))
+  if (mode == ntag424_CommMode::Plain)
   {
-    // no overflow
-    PN532DEBUGPRINT.print(F("rotation-error: overflow or negative rotation"));
-    return 0;
+    return room;
   }
-
-#ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("rotation-before: "));
-  Adafruit_PN532::PrintHexChar(input, bufferlen);
-#endif
-
-  for (int i = 0; i < bufferlen; i++)
+  room -= 8;
+  if (mode == ntag424_CommMode::Mac)
   {
-    int z = i - rotation;
-    if (z < 0)
-    {
-      z = bufferlen + z;
-    }
-    output[z] = input[i];
+    return room;
   }
-#ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("rotation-after: "));
-  Adafruit_PN532::PrintHexChar(output, bufferlen);
-#endif
-  return 1;
+  // whole blocks, padding adds at least one byte
+  return (room & 0xF0) - 1;
 }
 
+/**************************************************************************/
 /*!
-    @brief   Authenticate to start encrypted or signed communication.
+    @brief   send the apdu in the workspace and read the response frame into
+   the workspace. The response starts at ntag424_Workspace.frame + 8.
 
-    @param   key      encryption key
-    @param   keyno   number of key to authenticate against (0-4)
-    @param   cmd      0x71 or 0x77
-
-    @return  1 = success; 0 = failed
+    @param apdusize               size of the apdu in the workspace
+    @param response_le            max. response length incl. status
+    @return length of response incl. status, 0 = failed
 */
 /**************************************************************************/
-
-uint8_t Adafruit_PN532::ntag424_Authenticate(uint8_t *key, uint8_t keyno,
-                                             uint8_t cmd)
+uint8_t Adafruit_PN532::ntag424_apdu_exchange(uint8_t apdusize,
+                                              uint16_t response_le)
 {
-
+  uint8_t *apdu = ntag424_Workspace.apdu;
+  uint8_t *frame = ntag424_Workspace.frame;
 #ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("Authenticating with key: "));
-  PN532DEBUGPRINT.println((char *)key);
+  PN532DEBUGPRINT.print(F("PCD->PICC:"));
+  Adafruit_PN532::PrintHexChar(apdu + 2, apdusize - 2);
 #endif
-
-// 1.) IsoSelectFile
-#ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.println(F("1.) ISOSelectFile"));
-#endif
-  int cmd_len = 15;
-  uint8_t cmd_select[cmd_len] = {PN532_COMMAND_INDATAEXCHANGE,
-                                 0x01,
-                                 0x00,
-                                 0xA4,
-                                 0x04,
-                                 0x00,
-                                 0x07,
-                                 0xD2,
-                                 0x76,
-                                 0x00,
-                                 0x00,
-                                 0x85,
-                                 0x01,
-                                 0x01,
-                                 0x00};
-  /* Prepare the command */
-  /* Send the command */
-  if (!sendCommandCheckAck((uint8_t *)cmd_select, cmd_len))
+  if (!sendCommandCheckAck((uint8_t *)apdu, apdusize))
   {
 #ifdef NTAG424DEBUG
     PN532DEBUGPRINT.println(F("Failed to receive ACK for write command"));
 #endif
+    ntag424_forget_target(ntag424_Selection.target);
     return 0;
   }
-  /* Read the response packet */
-  readdata(pn532_packetbuffer, 26);
+  ntag424_Session.ivcache.pending = false;
+  /* Read the response packet: preamble(8) + response + checksum/postamble */
+  uint8_t framesize = NTAG424_FRAME_MAXSIZE;
+  if (response_le < NTAG424_FRAME_MAXSIZE - 10)
+  {
+    framesize = response_le + 10;
+  }
+  readdata(frame, framesize);
 #ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("CMD: "));
-  Adafruit_PN532::PrintHexChar(cmd_select, cmd_len);
-  PN532DEBUGPRINT.println(strlen((char *)cmd_select));
-  PN532DEBUGPRINT.print(F("Received: "));
-  Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 26);
+  PN532DEBUGPRINT.print(F("PCD<-PICC: "));
+  Adafruit_PN532::PrintHexChar(frame, 5 + frame[3]);
 #endif
 
-  /* If byte 8 isn't 0x00 we probably have an error, also byte 8 & 9 should be
-   * 0x9000 */
-  if (pn532_packetbuffer[7] != 0x00 || pn532_packetbuffer[8] != 0x90 ||
-      pn532_packetbuffer[9] != 0x00)
+  if ((frame[3] < 3) || ((frame[7] & 0x3f) != 0))
   {
 #ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("ISOSelectFile ResultError"));
+    PN532DEBUGPRINT.println(F("InDataExchange failed, target lost?"));
 #endif
+    // after a timeout or rf error the card may have left the field
+    ntag424_forget_target(ntag424_Selection.target);
     return 0;
   }
-
-// 2.) AuthenticateFirst part 1
-#ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.println(F("2.) AuthenticateFirst part 1"));
-#endif
-  cmd_len = 13;
-  uint8_t cmd_auth1[cmd_len] = {PN532_COMMAND_INDATAEXCHANGE,
-                                0x01,
-                                0x90,
-                                cmd,
-                                0x00,
-                                0x00,
-                                0x05,
-                                keyno,
-                                0x03,
-                                0x00,
-                                0x00,
-                                0x00,
-                                0x00};
-  /* Prepare the command */
-  /* Send the command */
-  if (!sendCommandCheckAck((uint8_t *)cmd_auth1, cmd_len))
+  if ((frame[3] < 3 + 2) || (frame[3] - 3 > framesize - 10))
   {
 #ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Failed to receive ACK for write command"));
+    PN532DEBUGPRINT.println(F("Response exceeds the response buffer"));
 #endif
     return 0;
   }
-  /* Read the response packet */
-  readdata(pn532_packetbuffer, 26);
-#ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("> AUTH 1: "));
-  Adafruit_PN532::PrintHexChar(cmd_auth1, cmd_len);
-  PN532DEBUGPRINT.print(F("Received: "));
-  Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 26);
-#endif
+  return frame[3] - 3;
+}
 
-  /* If byte 8 isn't 0x00 we probably have an error, also byte 8 & 9 should be
-   * 0x91AF */
-  if (pn532_packetbuffer[7] != 0x00 || pn532_packetbuffer[24] != 0x91 ||
-      pn532_packetbuffer[25] != 0xAF)
+/**************************************************************************/
+/*!
+    @brief   reset the response stream. The response MAC starts over RC ||
+   CmdCounter || TI, RC is 00 for every response which carries a MAC.
+*/
+/**************************************************************************/
+template <ntag424_CommMode mode> void Adafruit_PN532::ntag424_response_begin()
+{
+  ntag424_StreamType *stream = &ntag424_Workspace.stream;
+  stream->block_length = 0;
+  stream->plain_valid = false;
+  stream->mac_length = 0;
+  if (mode == ntag424_CommMode::Plain)
   {
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("AuthenticateFirst part 1 ResultError"));
-#endif
-    return 0;
+    return;
+  }
+  ntag424_stream_mac_begin(0x00);
+  if ((mode == ntag424_CommMode::Full) && !ntag424_Session.lrp)
+  {
+    // iv: E(SesAuthENCKey, 5A A5 || TI || CmdCounter || 0x00 * 8)
+    ntag424_session_iv(NTAG424_IV_RESP, stream->iv);
   }
+}
 
-  /*
-   * prepare the answer
-   */
+/**************************************************************************/
+/*!
+    @brief   pass the data of a plain response frame to the sink.
+
+    @param *data                  response data of one frame w/o status
+    @param length                 length of data
+    @param sink                   receives the response data
+    @return false = sink aborted
+*/
+/**************************************************************************/
+template <>
+bool Adafruit_PN532::ntag424_response_update<ntag424_CommMode::Plain>(
+    const uint8_t *data, uint8_t length, const ntag424_SinkType &sink)
+{
+  return (length == 0) || sink.write(sink.context, data, length);
+}
+
+/**************************************************************************/
+/*!
+    @brief   add MAC'd data to the response MAC and pass it to the sink.
+
+    @param *data                  response data (not MAC)
+    @param length                 length of data
+    @param sink                   receives the response data
+    @return false = sink aborted
+*/
+/**************************************************************************/
+template <>
+bool Adafruit_PN532::ntag424_response_data<ntag424_CommMode::Mac>(
+    const uint8_t *data, uint8_t length, const ntag424_SinkType &sink)
+{
+  if (length == 0)
+  {
+    return true;
+  }
+  ntag424_cmac_update(&ntag424_Session.cmac, data, length);
+  return sink.write(sink.context, data, length);
+}
+
+/**************************************************************************/
+/*!
+    @brief   add cryptogram to the response MAC and decrypt it. An incomplete
+   block waits for the next frame, so blocks may span frames.
+
+    @param *data                  response cryptogram (not MAC)
+    @param length                 length of data
+    @param sink                   receives the decrypted response data
+    @return false = sink aborted
+*/
+/**************************************************************************/
+template <>
+bool Adafruit_PN532::ntag424_response_data<ntag424_CommMode::Full>(
+    const uint8_t *data, uint8_t length, const ntag424_SinkType &sink)
+{
+  ntag424_StreamType *stream = &ntag424_Workspace.stream;
+  uint8_t *payload = ntag424_Workspace.payload;
+  ntag424_cmac_update(&ntag424_Session.cmac, data, length);
+  while (length > 0)
+  {
+    uint8_t n;
+    if ((stream->block_length > 0) || (length < 16))
+    {
+      n = 16 - stream->block_length;
+      if (n > length)
+      {
+        n = length;
+      }
+      memcpy(stream->block + stream->block_length, data, n);
+      stream->block_length += n;
+      data += n;
+      length -= n;
+      if (stream->block_length < 16)
+      {
+        break;
+      }
+      stream->block_length = 0;
+      ntag424_session_crypt(NTAG424_AES_DECRYPT, 16, stream->block, payload);
+      n = 16;
+    }
+    else
+    {
+      // whole blocks straight from the frame
+      n = length & 0xF0;
+      if (n > (NTAG424_FRAME_MAXSIZE & 0xF0))
+      {
+        n = NTAG424_FRAME_MAXSIZE & 0xF0;
+      }
+      ntag424_session_crypt(NTAG424_AES_DECRYPT, n, (uint8_t *)data,
+                            payload);
+      data += n;
+      length -= n;
+    }
+    if (!ntag424_response_plain(payload, n, sink))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief   pass decrypted blocks to the sink. The last block is held back,
+   ntag424_response_finish() removes the padding from it.
+
+    @param *data                  decrypted blocks
+    @param length                 length of data (multiple of 16)
+    @param sink                   receives the response data
+    @return false = sink aborted
+*/
+/**************************************************************************/
+bool Adafruit_PN532::ntag424_response_plain(const uint8_t *data,
+                                            uint8_t length,
+                                            const ntag424_SinkType &sink)
+{
+  ntag424_StreamType *stream = &ntag424_Workspace.stream;
+  if (stream->plain_valid && !sink.write(sink.context, stream->plain, 16))
+  {
+    return false;
+  }
+  if ((length > 16) && !sink.write(sink.context, data, length - 16))
+  {
+    return false;
+  }
+  memcpy(stream->plain, data + length - 16, 16);
+  stream->plain_valid = true;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief   take the data of one MAC'd or encrypted response frame. The MAC
+   is the last 8 byte of the whole response, so the last 8 byte received are
+   held back until the next frame shows they are data.
+
+    @param *data                  response data of one frame w/o status
+    @param length                 length of data
+    @param sink                   receives the response data
+    @return false = sink aborted
+*/
+/**************************************************************************/
+template <ntag424_CommMode mode>
+bool Adafruit_PN532::ntag424_response_update(const uint8_t *data,
+                                             uint8_t length,
+                                             const ntag424_SinkType &sink)
+{
+  ntag424_StreamType *stream = &ntag424_Workspace.stream;
+  if (length >= 8)
+  {
+    if (!ntag424_response_data<mode>(stream->mac, stream->mac_length, sink) ||
+        !ntag424_response_data<mode>(data, length - 8, sink))
+    {
+      return false;
+    }
+    memcpy(stream->mac, data + length - 8, 8);
+    stream->mac_length = 8;
+    return true;
+  }
+  uint8_t spill = 0;
+  if (stream->mac_length + length > 8)
+  {
+    spill = stream->mac_length + length - 8;
+  }
+  if (!ntag424_response_data<mode>(stream->mac, spill, sink))
+  {
+    return false;
+  }
+  memmove(stream->mac, stream->mac + spill, stream->mac_length - spill);
+  stream->mac_length -= spill;
+  memcpy(stream->mac + stream->mac_length, data, length);
+  stream->mac_length += length;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief   plain responses are complete after the last frame.
+
+    @return true
+*/
+/**************************************************************************/
+template <>
+bool Adafruit_PN532::ntag424_response_finish<ntag424_CommMode::Plain>(
+    const ntag424_SinkType &, bool)
+{
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief   check the MAC over RC || CmdCounter || TI || RespData and pass
+   the unpadded last block of an encrypted response to the sink. A
+   successful response carries the MAC, only error responses shorter than a
+   MAC are passed on as they are.
+
+    @param sink                   receives the response data
+    @param mac_required           false = error status, or ChangeKey of the
+   session key (no MAC, the session has ended)
+    @return false = MAC missing or wrong, or sink aborted
+*/
+/**************************************************************************/
+template <ntag424_CommMode mode>
+bool Adafruit_PN532::ntag424_response_finish(const ntag424_SinkType &sink,
+                                             bool mac_required)
+{
+  ntag424_StreamType *stream = &ntag424_Workspace.stream;
+  if (stream->mac_length < 8)
+  {
+    if (mac_required)
+    {
+#ifdef NTAG424DEBUG
+      PN532DEBUGPRINT.println(F("Response CMAC missing"));
+#endif
+      return false;
+    }
+    return (stream->mac_length == 0) ||
+           sink.write(sink.context, stream->mac, stream->mac_length);
+  }
+  uint8_t checkmac[8];
+  uint8_t regularcmac[16];
+  ntag424_cmac_finish(&ntag424_Session.cmac, regularcmac);
+  ntag424_cmac_truncate(regularcmac, checkmac);
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.print(F("response cmac:"));
+  Adafruit_PN532::PrintHex(stream->mac, 8);
+  PN532DEBUGPRINT.print(F("checkcmac:"));
+  Adafruit_PN532::PrintHex(checkmac, 8);
+#endif
+  if (memcmp(stream->mac, checkmac, 8) != 0)
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("Response CMAC integrity error! (picc <> pcd)"));
+#endif
+    return false;
+  }
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.println(F("Response CMAC ok! (picc == pcd)"));
+#endif
+  if ((mode != ntag424_CommMode::Full) || !stream->plain_valid)
+  {
+    return true;
+  }
+  if (stream->block_length != 0)
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("Cryptogram is not a multiple of 16"));
+#endif
+    return false;
+  }
+  // strip 80 00 .. 00
+  uint8_t resp_no_padding = 16;
+  for (int i = 15; i >= 0; i--)
+  {
+    if (stream->plain[i] == 0x00)
+    {
+      resp_no_padding = i;
+    }
+    else if (stream->plain[i] == 0x80)
+    {
+      resp_no_padding = i;
+      break;
+    }
+    else
+    {
+      // nopadding?
+      break;
+    }
+  }
+  return (resp_no_padding == 0) ||
+         sink.write(sink.context, stream->plain, resp_no_padding);
+}
+
+/**************************************************************************/
+/*!
+    @brief   encode the command cmd with secure messaging for mode, send it
+   to the picc and stream the response data into sink. Command data which
+   does not fit into one frame is sent in additional frames (90 AF), and
+   additional response frames (91 AF) are requested until the picc is done.
+   MAC and encryption run across all frames of a command, so the command
+   counter counts the command once. Each mode is compiled separately, so
+   plain commands carry no crypto code.
+
+    @param cmd                    command descriptor, e.g. NTAG424_APDU_*
+    @param *cmd_header            command header (cmd.header_length byte)
+    @param *cmd_data              command data
+    @param cmd_data_length        length of command data
+    @param sink                   receives the (decrypted) response data
+    @param response_le            max. raw response length (data, MAC, SW)
+    @return status word SW1 SW2, 0 = failed
+*/
+/**************************************************************************/
+template <ntag424_CommMode mode>
+uint16_t Adafruit_PN532::ntag424_send(const ntag424_CommandType &cmd,
+                                      uint8_t *cmd_header, uint8_t *cmd_data,
+                                      uint8_t cmd_data_length,
+                                      const ntag424_SinkType &sink,
+                                      uint16_t response_le)
+{
+  uint8_t *apdu = ntag424_Workspace.apdu;
+  uint8_t *response = ntag424_Workspace.frame + 8;
+  ntag424_StreamType *stream = &ntag424_Workspace.stream;
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.print(F("cmd_counter: "));
+  PN532DEBUGPRINT.println(ntag424_Session.cmd_counter);
+#endif
+  // the command header and the MAC have to fit into the first frame
+  if (NTAG424_APDU_HEADERSIZE + cmd.header_length + 8 + 1 >
+      NTAG424_FRAME_MAXSIZE)
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("APDU length too long for workspace"));
+#endif
+    return 0;
+  }
+  ntag424_request_begin<mode>(cmd, cmd_header, cmd_data, cmd_data_length);
+  uint8_t offset = ntag424_apdu_header(cmd, cmd_header);
+  uint8_t response_length;
+  while (true)
+  {
+    uint8_t n = ntag424_request_update<mode>(
+        apdu + offset, NTAG424_FRAME_MAXSIZE - 1 - offset);
+    offset += n;
+    apdu[NTAG424_APDU_HEADERSIZE - 1] += n;
+    bool last = (stream->position == stream->length);
+    if (!last && (cmd.cla != NTAG424_COM_CLA))
+    {
+#ifdef NTAG424DEBUG
+      PN532DEBUGPRINT.println(F("APDU length too long for workspace"));
+#endif
+      return 0;
+    }
+    if (apdu[NTAG424_APDU_HEADERSIZE - 1] == 0)
+    {
+      // neither command header nor data: no Lc (ISO case 2)
+      offset--;
+    }
+    if (cmd.has_le)
+    {
+      apdu[offset] = cmd.le;
+      offset++;
+    }
+    if (last && (mode == ntag424_CommMode::Full) && !ntag424_Session.lrp)
+    {
+      // response iv and next command iv both use the incremented counter,
+      // let waitready() compute them while the picc is working
+      ntag424_IVCacheType *cache = &ntag424_Session.ivcache;
+      cache->cmd_counter = ntag424_Session.cmd_counter + 1;
+      cache->valid = 0;
+      cache->pending = true;
+    }
+    response_length = ntag424_apdu_exchange(offset, last ? response_le : 2);
+    if (response_length == 0)
+    {
+      return 0;
+    }
+    // anything but 91 AF ends the command early
+    if (last || (response_length != 2) || (response[0] != 0x91) ||
+        (response[1] != NTAG424_CMD_NEXTFRAME))
+    {
+      break;
+    }
+    offset = ntag424_apdu_header(NTAG424_APDU_NEXTFRAME, NULL);
+  }
+  //  increase cmd_counter
+  ntag424_Session.cmd_counter += 1;
+
+  ntag424_response_begin<mode>();
+  // 91 AF is the success status of the first authentication part, the
+  // caller continues that one itself
+  bool chained = (cmd.sw1 != 0x91) || (cmd.sw2 != NTAG424_CMD_NEXTFRAME);
+  while (true)
+  {
+    uint8_t sw1 = response[response_length - 2];
+    uint8_t sw2 = response[response_length - 1];
+    if (response_length > response_le)
+    {
+#ifdef NTAG424DEBUG
+      PN532DEBUGPRINT.println(F("Response exceeds the response buffer"));
+#endif
+      return 0;
+    }
+    response_le -= response_length - 2;
+    if (!ntag424_response_update<mode>(response, response_length - 2, sink))
+    {
+      return 0;
+    }
+    if (!chained || (sw1 != 0x91) || (sw2 != NTAG424_CMD_NEXTFRAME))
+    {
+      bool mac_required = (sw2 == 0x00) && ((sw1 == 0x91) || (sw1 == 0x90));
+      if ((cmd.ins == NTAG424_COM_CHANGEKEY) &&
+          (cmd_header[0] == ntag424_Session.keyno))
+      {
+        mac_required = false;
+      }
+      if (!ntag424_response_finish<mode>(sink, mac_required))
+      {
+        return 0;
+      }
+      return ((uint16_t)sw1 << 8) | sw2;
+    }
+    // picc has more data
+    offset = ntag424_apdu_header(NTAG424_APDU_NEXTFRAME, NULL) - 1;
+    apdu[offset] = NTAG424_APDU_NEXTFRAME.le;
+    offset++;
+    response_length = ntag424_apdu_exchange(offset, response_le);
+    if (response_length == 0)
+    {
+      return 0;
+    }
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   encode the command cmd with secure messaging for mode, send it
+   to the picc and collect the response in a buffer. The MAC is removed from
+   the response and FULL mode data is decrypted and unpadded.
+
+    @param cmd                    command descriptor, e.g. NTAG424_APDU_*
+    @param *cmd_header            command header (cmd.header_length byte)
+    @param *cmd_data              command data
+    @param cmd_data_length        length of command data
+    @param *response              response buffer
+    @param response_le            size of response buffer
+    @return length of response data + SW1 SW2, 0 = failed
+*/
+/**************************************************************************/
+template <ntag424_CommMode mode>
+uint8_t Adafruit_PN532::ntag424_send(const ntag424_CommandType &cmd,
+                                     uint8_t *cmd_header, uint8_t *cmd_data,
+                                     uint8_t cmd_data_length,
+                                     uint8_t *response, uint8_t response_le)
+{
+  if (response_le < 2)
+  {
+    return 0;
+  }
+  ntag424_BufferType buffer = {response, (uint16_t)(response_le - 2), 0};
+  ntag424_SinkType sink = {ntag424_buffer_write, &buffer};
+  uint16_t sw = ntag424_send<mode>(cmd, cmd_header, cmd_data,
+                                   cmd_data_length, sink, response_le);
+  if (sw == 0)
+  {
+    return 0;
+  }
+  response[buffer.length] = sw >> 8;
+  response[buffer.length + 1] = sw & 0xff;
+  return buffer.length + 2;
+}
+
+template uint8_t Adafruit_PN532::ntag424_send<ntag424_CommMode::Plain>(
+    const ntag424_CommandType &, uint8_t *, uint8_t *, uint8_t, uint8_t *,
+    uint8_t);
+template uint8_t Adafruit_PN532::ntag424_send<ntag424_CommMode::Mac>(
+    const ntag424_CommandType &, uint8_t *, uint8_t *, uint8_t, uint8_t *,
+    uint8_t);
+template uint8_t Adafruit_PN532::ntag424_send<ntag424_CommMode::Full>(
+    const ntag424_CommandType &, uint8_t *, uint8_t *, uint8_t, uint8_t *,
+    uint8_t);
+template uint16_t Adafruit_PN532::ntag424_send<ntag424_CommMode::Plain>(
+    const ntag424_CommandType &, uint8_t *, uint8_t *, uint8_t,
+    const ntag424_SinkType &, uint16_t);
+template uint16_t Adafruit_PN532::ntag424_send<ntag424_CommMode::Mac>(
+    const ntag424_CommandType &, uint8_t *, uint8_t *, uint8_t,
+    const ntag424_SinkType &, uint16_t);
+template uint16_t Adafruit_PN532::ntag424_send<ntag424_CommMode::Full>(
+    const ntag424_CommandType &, uint8_t *, uint8_t *, uint8_t,
+    const ntag424_SinkType &, uint16_t);
+
+/**************************************************************************/
+/*!
+    @brief   add padding to a buffer.
+
+    @param   inputlength
+    @param   paddinglength
+    @param   buffer input & outputbuffer needs to be big enough for inputlength
+   + padding worstcase
+
+    @return  the new length of buffer including the added zeroes
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_addpadding(uint8_t inputlength,
+                                           uint8_t paddinglength,
+                                           uint8_t *buffer)
+{
+  uint8_t zeroestoadd = paddinglength - (inputlength % paddinglength);
+  memset(buffer + inputlength, 0, zeroestoadd);
+  if (zeroestoadd > 0)
+  {
+    buffer[inputlength] = 0x80;
+  }
+  return inputlength + zeroestoadd;
+}
+
+/**************************************************************************/
+/*!
+    @brief   wrapper for ntag424_encrypt with standard iv.
+
+    @param   key    encryption key
+    @param   length  sizeof input
+    @param   input inputbuffer
+    @param   output outputbuffer
+
+    @return
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_encrypt(uint8_t *key, uint8_t length,
+                                        uint8_t *input, uint8_t *output)
+{
+  uint8_t iv[16];
+  memset(iv, 0, sizeof(iv));
+  return ntag424_encrypt(key, iv, length, input, output);
+}
+
+/**************************************************************************/
+/*!
+    @brief   encrypt input's lengths bytes with aes 128 cbc into output.
+
+    @param   key    encryption key
+    @param   iv     initialization vector
+    @param   length sizeof input
+    @param   input  inputbuffer
+    @param   output outputbuffer
+
+    @return
+*/
+/**************************************************************************/
+// encrypt input's lengths bytes with aes 128 cbc into output
+uint8_t Adafruit_PN532::ntag424_encrypt(uint8_t *key, uint8_t *iv,
+                                        uint8_t length, uint8_t *input,
+                                        uint8_t *output)
+{
+  if (length % NTAG424_AES_BLOCKSIZE != 0)
+  {
+    return 0;
+  }
+  ntag424_AESType ctx;
+  // Set the key for the AES context
+  if (ntag424_aes_setkey(&ctx, ntag424_Crypto, key, NTAG424_AES_ENCRYPT) == 0)
+  {
+    // Error setting key
+    ntag424_aes_free(&ctx);
+    return 0;
+  }
+  ntag424_Crypto->aes_cbc(&ctx, iv, input, output, length);
+  ntag424_aes_free(&ctx);
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   wrapper for ntag424_decrypt with standard iv.
+
+    @param   key    encryption key
+    @param   length  sizeof input
+    @param   input inputbuffer
+    @param   output outputbuffer
+
+    @return
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_decrypt(uint8_t *key, uint8_t length,
+                                        uint8_t *input, uint8_t *output)
+{
+  uint8_t iv[16];
+  memset(iv, 0, sizeof(iv));
+  return ntag424_decrypt(key, iv, length, input, output);
+}
+
+/**************************************************************************/
+/*!
+    @brief   decrypt input's lengths bytes with aes 128 cbc into output.
+
+    @param   key    encryption key
+    @param   iv     initialization vector
+    @param   length sizeof input
+    @param   input  inputbuffer
+    @param   output outputbuffer
+
+    @return
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_decrypt(uint8_t *key, uint8_t *iv,
+                                        uint8_t length, uint8_t *input,
+                                        uint8_t *output)
+{
+  if (length % NTAG424_AES_BLOCKSIZE != 0)
+  {
+    return 0;
+  }
+  ntag424_AESType ctx;
+  // Set the key for the AES context
+  if (ntag424_aes_setkey(&ctx, ntag424_Crypto, key, NTAG424_AES_DECRYPT) == 0)
+  {
+    // Error setting key
+    ntag424_aes_free(&ctx);
+    return 0;
+  }
+  ntag424_Crypto->aes_cbc(&ctx, iv, input, output, length);
+  ntag424_aes_free(&ctx);
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   create short cmac by returning the uneven bytes (1,3,5,7,9).
+
+    @param   key    signing key
+    @param   input  inputbuffer
+    @param   length length of inputbuffer
+    @param   cmac   outputbuffer (>=8 bytes)
+
+    @return
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_cmac_short(uint8_t *key, uint8_t *input,
+                                           uint8_t length, uint8_t *cmac)
+{
+  ntag424_CMACType engine;
+  ntag424_cmac_init(&engine, ntag424_Crypto);
+  if (!ntag424_cmac_setkey(&engine, key))
+  {
+    ntag424_cmac_free(&engine);
+    return 0;
+  }
+  uint8_t ret = Adafruit_PN532::ntag424_cmac_short(&engine, input, length, cmac);
+  ntag424_cmac_free(&engine);
+  return ret;
+}
+
+/**************************************************************************/
+/*!
+    @brief   create short cmac with an already keyed cmac engine (e.g. the
+   session engine) by returning the uneven bytes (1,3,5,7,9).
+
+    @param   engine cmac engine, keyed with ntag424_cmac_setkey()
+    @param   input  inputbuffer
+    @param   length length of inputbuffer
+    @param   cmac   outputbuffer (>=8 bytes)
+
+    @return
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_cmac_short(ntag424_CMACType *engine,
+                                           uint8_t *input, uint8_t length,
+                                           uint8_t *cmac)
+{
+  uint8_t regularcmac[16];
+  ntag424_cmac_update(engine, input, length);
+  ntag424_cmac_finish(engine, regularcmac);
+  ntag424_cmac_truncate(regularcmac, cmac);
+
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.print(F("INPUT: "));
+  Adafruit_PN532::PrintHexChar(input, length);
+  PN532DEBUGPRINT.print(F("CMAC: "));
+  Adafruit_PN532::PrintHexChar(regularcmac, 16);
+  PN532DEBUGPRINT.print(F("CMAC_SHORT: "));
+  Adafruit_PN532::PrintHexChar(cmac, 8);
+#endif
+  return 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief   create aes128-cmac.
+
+    @param   key    signing key
+    @param   input  inputbuffer
+    @param   length length of inputbuffer
+    @param   cmac   outputbuffer (>=16 bytes)
+
+    @return
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_cmac(uint8_t *key, uint8_t *input,
+                                     uint8_t length, uint8_t *cmac)
+{
+  ntag424_CMACType engine;
+  ntag424_cmac_init(&engine, ntag424_Crypto);
+  if (!ntag424_cmac_setkey(&engine, key))
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("could not setup cipher "));
+#endif
+    ntag424_cmac_free(&engine);
+    return 0;
+  }
+  ntag424_cmac_update(&engine, input, length);
+  ntag424_cmac_finish(&engine, cmac);
+  ntag424_cmac_free(&engine);
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.print(F("cmac key: "));
+  Adafruit_PN532::PrintHexChar(key, 16);
+  PN532DEBUGPRINT.print(F("cmac input: "));
+  Adafruit_PN532::PrintHexChar(input, length);
+  PN532DEBUGPRINT.print(F("cmac output: "));
+  Adafruit_PN532::PrintHexChar(cmac, 16);
+#endif
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   sign the supplied data and return the size.
+
+    @param   cmd              apducmd
+    @param   cmdheader        buffer containing the commandheader
+    @param   cmdheader_length length of commandheader
+    @param   cmddata          buffer containing the command data
+    @param   cmddata_length   length of commanddata. set to 0 if n/a
+    @param   signature        outputbuffer for the signature
+
+    @return
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_MAC(uint8_t *cmd, uint8_t *cmdheader,
+                                    uint8_t cmdheader_length, uint8_t *cmddata,
+                                    uint8_t cmddata_length,
+                                    uint8_t *signature)
+{
+  return ntag424_MAC(&ntag424_Session.cmac, cmd, cmdheader, cmdheader_length,
+                     cmddata, cmddata_length, signature);
+}
+
+/**************************************************************************/
+/*!
+    @brief   sign the supplied data.
+
+    @param   key              mac-key
+    @param   cmd              apducmd
+    @param   cmdheader        buffer containing the commandheader
+    @param   cmdheader_length length of commandheader
+    @param   cmddata          buffer containing the command data
+    @param   cmddata_length   length of commanddata. set to 0 if n/a
+    @param   signature        outputbuffer for the signature
+
+    @return
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_MAC(uint8_t *key, uint8_t *cmd,
+                                    uint8_t *cmdheader,
+                                    uint8_t cmdheader_length, uint8_t *cmddata,
+                                    uint8_t cmddata_length,
+                                    uint8_t *signature)
+{
+  ntag424_CMACType engine;
+  ntag424_cmac_init(&engine, ntag424_Crypto);
+  ntag424_cmac_setkey(&engine, key);
+  uint8_t ret = ntag424_MAC(&engine, cmd, cmdheader, cmdheader_length, cmddata,
+                            cmddata_length, signature);
+  ntag424_cmac_free(&engine);
+  return ret;
+}
+
+/**************************************************************************/
+/*!
+    @brief   sign the supplied data with an already keyed cmac engine.
+
+    @param   engine           cmac engine keyed with the mac-key
+    @param   cmd              apducmd
+    @param   cmdheader        buffer containing the commandheader
+    @param   cmdheader_length length of commandheader
+    @param   cmddata          buffer containing the command data
+    @param   cmddata_length   length of commanddata. set to 0 if n/a
+    @param   signature        outputbuffer for the signature
+
+    @return
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_MAC(ntag424_CMACType *engine, uint8_t *cmd,
+                                    uint8_t *cmdheader,
+                                    uint8_t cmdheader_length, uint8_t *cmddata,
+                                    uint8_t cmddata_length,
+                                    uint8_t *signature)
+{
+  // counter is LSB
+  uint8_t counter[2] = {(uint8_t)(ntag424_Session.cmd_counter & 0xff),
+                        (uint8_t)((ntag424_Session.cmd_counter >> 8) & 0xff)};
+  // Cmd || CmdCounter || TI || CmdHeader || CmdData, MAC'd where they are
+  ntag424_SegmentType mesg[5] = {
+      {cmd, 1},
+      {counter, sizeof(counter)},
+      {ntag424_authresponse_TI, NTAG424_AUTHRESPONSE_TI_SIZE},
+      {cmdheader, cmdheader_length},
+      {cmddata, cmddata_length}};
+  uint8_t regularcmac[16];
+  ntag424_cmac_segments(engine, mesg, 5, regularcmac);
+  ntag424_cmac_truncate(regularcmac, signature);
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.print(F("mesg: cmd: "));
+  Adafruit_PN532::PrintHexChar(cmd, 1);
+  PN532DEBUGPRINT.print(F("mesg: header: "));
+  Adafruit_PN532::PrintHexChar(cmdheader, cmdheader_length);
+  PN532DEBUGPRINT.print(F("mesg: data: "));
+  Adafruit_PN532::PrintHexChar(cmddata, cmddata_length);
+  PN532DEBUGPRINT.print(F("CMAC_SHORT: "));
+  Adafruit_PN532::PrintHexChar(signature, 8);
+#endif
+  return 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief   derive sessionskeys from RndA and RNDB.
+
+    @param   key         mac-key
+    @param   RndA        RndA
+    @param   RndB        RndB
+
+    @return
+*/
+/**************************************************************************/
+void Adafruit_PN532::ntag424_derive_session_keys(uint8_t *key, uint8_t *RndA,
+                                                 uint8_t *RndB)
+{
+  uint8_t f1[2];
+  uint8_t f2[6];
+  uint8_t f3[6];
+  uint8_t f4[10];
+  uint8_t f5[8];
+  uint8_t f2xor3[6];
+  memcpy(&f1, RndA, 2);
+  memcpy(&f2, RndA + 2, 6);
+  memcpy(&f3, RndB, 6);
+  memcpy(&f4, RndB + 6, 10);
+  memcpy(&f5, RndA + 8, 8);
+  // xor f2 & f3
+  for (int i = 0; i < 6; ++i)
+  {
+    f2xor3[i] = f2[i] ^ f3[i];
+  }
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.println(F("DERIVE SESSIONKEYS: "));
+  PN532DEBUGPRINT.print(F("RndA: "));
+  Adafruit_PN532::PrintHexChar(RndA, 16);
+  PN532DEBUGPRINT.print(F("RndB: "));
+  Adafruit_PN532::PrintHexChar(RndB, 16);
+  PN532DEBUGPRINT.print(F("f1: "));
+  Adafruit_PN532::PrintHexChar(f1, 2);
+  PN532DEBUGPRINT.print(F("f2: "));
+  Adafruit_PN532::PrintHexChar(f2, 6);
+  PN532DEBUGPRINT.print(F("f3: "));
+  Adafruit_PN532::PrintHexChar(f3, 6);
+  PN532DEBUGPRINT.print(F("f4: "));
+  Adafruit_PN532::PrintHexChar(f4, 10);
+  PN532DEBUGPRINT.print(F("f5: "));
+  Adafruit_PN532::PrintHexChar(f5, 8);
+  PN532DEBUGPRINT.print(F("f2xorf3: "));
+  Adafruit_PN532::PrintHexChar(f2xor3, 6);
+#endif
+  uint8_t sv1[32] = {
+      0xA5, 0x5A, 0x00, 0x01, 0x00, 0x80, f1[0],
+      f1[1], f2xor3[0], f2xor3[1], f2xor3[2], f2xor3[3], f2xor3[4], f2xor3[5],
+      f4[0], f4[1], f4[2], f4[3], f4[4], f4[5], f4[6],
+      f4[7], f4[8], f4[9], f5[0], f5[1], f5[2], f5[3],
+      f5[4], f5[5], f5[6], f5[7]};
+  uint8_t sv2[32] = {
+      0x5A, 0xA5, 0x00, 0x01, 0x00, 0x80, f1[0],
+      f1[1], f2xor3[0], f2xor3[1], f2xor3[2], f2xor3[3], f2xor3[4], f2xor3[5],
+      f4[0], f4[1], f4[2], f4[3], f4[4], f4[5], f4[6],
+      f4[7], f4[8], f4[9], f5[0], f5[1], f5[2], f5[3],
+      f5[4], f5[5], f5[6], f5[7]};
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.print(F("SV1: "));
+  Adafruit_PN532::PrintHexChar(sv1, 32);
+  PN532DEBUGPRINT.print(F("SV2: "));
+  Adafruit_PN532::PrintHexChar(sv2, 32);
+#endif
+
+  // both session keys are cmacs with the same key, so derive K1/K2 only once
+  ntag424_CMACType engine;
+  ntag424_cmac_init(&engine, ntag424_Crypto);
+  ntag424_cmac_setkey(&engine, key);
+  ntag424_cmac_update(&engine, sv1, sizeof(sv1));
+  ntag424_cmac_finish(&engine, ntag424_Session.session_key_enc);
+  ntag424_cmac_update(&engine, sv2, sizeof(sv2));
+  ntag424_cmac_finish(&engine, ntag424_Session.session_key_mac);
+  ntag424_cmac_free(&engine);
+
+  // key the session engine once, every MAC'd apdu reuses it
+  ntag424_cmac_setkey(&ntag424_Session.cmac, ntag424_Session.session_key_mac);
+  ntag424_Session.lrp = false;
+  // cached ivs belong to the old SesAuthENCKey/TI
+  ntag424_Session.ivcache.valid = 0;
+  ntag424_Session.ivcache.pending = false;
+
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.print(F("session_key_mac: "));
+  Adafruit_PN532::PrintHexChar(ntag424_Session.session_key_mac,
+                               NTAG424_SESSION_KEYSIZE);
+  PN532DEBUGPRINT.print(F("session_key_enc: "));
+  Adafruit_PN532::PrintHexChar(ntag424_Session.session_key_enc,
+                               NTAG424_SESSION_KEYSIZE);
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief   derive the LRP session from RndA and RndB: KSesAuthMaster is the
+   LRP-CMAC of SV with Kx, its plaintexts and updated keys are kept for the
+   session. Updated key 0 is SesAuthMACKey, updated key 1 SesAuthENCKey.
+
+    @param   key         Kx
+    @param   RndA        RndA
+    @param   RndB        RndB
+
+    @return  1 = success; 0 = failed
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_derive_session_keys_lrp(uint8_t *key,
+                                                        uint8_t *RndA,
+                                                        uint8_t *RndB)
+{
+  // SV = 00 01 00 80 || RndA[15..14] || (RndA[13..8] ^ RndB[15..10]) ||
+  //      RndB[9..0] || RndA[7..0] || 96 69
+  uint8_t sv[32] = {0x00, 0x01, 0x00, 0x80};
+  memcpy(sv + 4, RndA, 2);
+  for (int i = 0; i < 6; ++i)
+  {
+    sv[6 + i] = RndA[2 + i] ^ RndB[i];
+  }
+  memcpy(sv + 12, RndB + 6, 10);
+  memcpy(sv + 22, RndA + 8, 8);
+  sv[30] = 0x96;
+  sv[31] = 0x69;
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.print(F("SV: "));
+  Adafruit_PN532::PrintHexChar(sv, sizeof(sv));
+#endif
+
+  ntag424_LRPType *lrp = &ntag424_Session.lrp_keys;
+  uint8_t master[NTAG424_SESSION_KEYSIZE];
+  ntag424_CMACType engine;
+  ntag424_cmac_init(&engine, ntag424_Crypto);
+  uint8_t ok = ntag424_lrp_setkey(lrp, key) &&
+               ntag424_cmac_setkey_lrp(&engine, lrp, 0);
+  if (ok)
+  {
+    ntag424_cmac_update(&engine, sv, sizeof(sv));
+    ntag424_cmac_finish(&engine, master);
+  }
+  ntag424_cmac_free(&engine);
+  // the tables of KSesAuthMaster serve every apdu of the session
+  ok = ok && ntag424_lrp_setkey(lrp, master);
+  mbedtls_platform_zeroize(master, sizeof(master));
+  if (!ok || !ntag424_cmac_setkey_lrp(&ntag424_Session.cmac, lrp,
+                                      NTAG424_LRP_KEY_MAC))
+  {
+    return 0;
+  }
+  memcpy(ntag424_Session.session_key_mac,
+         lrp->updated_keys[NTAG424_LRP_KEY_MAC], NTAG424_SESSION_KEYSIZE);
+  memcpy(ntag424_Session.session_key_enc,
+         lrp->updated_keys[NTAG424_LRP_KEY_ENC], NTAG424_SESSION_KEYSIZE);
+  ntag424_Session.lrp = true;
+  ntag424_Session.enc_counter = 0;
+  ntag424_Session.ivcache.valid = 0;
+  ntag424_Session.ivcache.pending = false;
+
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.print(F("session_key_mac: "));
+  Adafruit_PN532::PrintHexChar(ntag424_Session.session_key_mac,
+                               NTAG424_SESSION_KEYSIZE);
+  PN532DEBUGPRINT.print(F("session_key_enc: "));
+  Adafruit_PN532::PrintHexChar(ntag424_Session.session_key_enc,
+                               NTAG424_SESSION_KEYSIZE);
+#endif
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   calculate and return the crc32 of data.
+
+    @param   data      databuffer needs to be of size datalength
+    @param   datalength
+
+    @return  uint32 crc
+*/
+/**************************************************************************/
+
+uint32_t Adafruit_PN532::ntag424_crc32(const uint8_t *data,
+                                       uint8_t datalength)
+{
+  return ::ntag424_crc32(data, datalength);
+}
+
+/**************************************************************************/
+/*!
+    @brief   left-rotate the bufferlen bytes of input by rotation bytes into
+   output.
+
+    @param   input      inputbuffer needs to be of size bufferlen
+    @param   output     outputbuffer needs to be of size bufferlen
+    @param   bufferlen  size of input & output-buffer
+    @param   rotation     number of random bytes to rotate
+
+    @return
+*/
+/**************************************************************************/
+
+uint8_t Adafruit_PN532::ntag424_rotl(uint8_t *input, uint8_t *output,
+                                     uint8_t bufferlen, uint8_t rotation)
+{
+  uint8_t overlap[16];
+  if ((rotation > 16) || (bufferlen < rotation))
+  {
+    // no overflow
+    PN532DEBUGPRINT.print(F("rotation-error: overflow or negative rotation"));
+    return 0;
+  }
+
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.print(F("rotation-before: "));
+  Adafruit_PN532::PrintHexChar(input, bufferlen);
+#endif
+
+  for (int i = 0; i < bufferlen; i++)
+  {
+    int z = i - rotation;
+    if (z < 0)
+    {
+      z = bufferlen + z;
+    }
+    output[z] = input[i];
+  }
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.print(F("rotation-after: "));
+  Adafruit_PN532::PrintHexChar(output, bufferlen);
+#endif
+  return 1;
+}
+
+/*!
+    @brief   Authenticate to start encrypted or signed communication.
+
+    @param   key      encryption key
+    @param   keyno   number of key to authenticate against (0-4)
+    @param   cmd      0x71 or 0x77
+
+    @return  1 = success; 0 = failed
+*/
+/**************************************************************************/
+
+uint8_t Adafruit_PN532::ntag424_Authenticate(uint8_t *key, uint8_t keyno,
+                                             uint8_t cmd)
+{
+
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.print(F("Authenticating with key: "));
+  PN532DEBUGPRINT.println((char *)key);
+#endif
+  bool nonfirst = (cmd == NTAG424_CMD_AUTHENTICATEEV2NONFIRST);
+  if (nonfirst && (!ntag424_Session.authenticated || ntag424_Session.lrp))
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("AuthenticateNonFirst needs an AES session"));
+#endif
+    return 0;
+  }
+  // NonFirst keeps TI and CmdCounter, a failed attempt ends the session
+  int cmd_counter = ntag424_Session.cmd_counter;
+  ntag424_Session.authenticated = false;
+
+  // 1.) IsoSelectFile, a running session has the application selected
+  if (!nonfirst)
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("1.) ISOSelectFile"));
+#endif
+    uint8_t dfn[7] = {0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01};
+    if (!ntag424_ISOSelectFileByDFN(dfn))
+    {
+#ifdef NTAG424DEBUG
+      PN532DEBUGPRINT.println(F("ISOSelectFile ResultError"));
+#endif
+      return 0;
+    }
+  }
+
+// 2.) AuthenticateFirst part 1
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.println(F("2.) AuthenticateFirst part 1"));
+#endif
+  ntag424_CommandType auth1 = NTAG424_APDU_AUTHENTICATE_PART1;
+  auth1.ins = cmd;
+  // KeyNo || LenCap || PCDcap2.1-3, NonFirst sends KeyNo only
+  uint8_t auth1_data[5] = {keyno, 0x03, 0x00, 0x00, 0x00};
+  uint8_t response[ntag424_response_size(NTAG424_APDU_AUTHENTICATE_PART2)];
+  uint8_t resp_size = ntag424_send<NTAG424_APDU_AUTHENTICATE_PART1.comm_mode>(
+      auth1, NULL, auth1_data, nonfirst ? 1 : sizeof(auth1_data), response,
+      ntag424_response_size(NTAG424_APDU_AUTHENTICATE_PART1));
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.print(F("> AUTH 1: "));
+  Adafruit_PN532::PrintHexChar(ntag424_Workspace.apdu, 13);
+  PN532DEBUGPRINT.print(F("Received: "));
+  Adafruit_PN532::PrintHexChar(response, resp_size);
+#endif
+
+  /* The answer is RndBEnc(16) and 0x91AF */
+  if ((resp_size != NTAG424_APDU_AUTHENTICATE_PART1.response_length + 2) ||
+      !ntag424_status_ok(auth1, response, resp_size))
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("AuthenticateFirst part 1 ResultError"));
+#endif
+    return 0;
+  }
+
+  /*
+   * prepare the answer
+   */
   // copy the encrypted RndB
   uint8_t blocklength = 16;
   uint8_t RndA[16];
@@ -2300,7 +3238,7 @@ uint8_t Adafruit_PN532::ntag424_Authenticate(uint8_t *key, uint8_t keyno,
   uint8_t RndBRotl[16];
   uint8_t answer[32];
   uint8_t answer_enc[32];
-  memcpy(&RndBEnc, pn532_packetbuffer + 8, blocklength);
+  memcpy(&RndBEnc, response, blocklength);
 #ifdef NTAG424DEBUG
   PN532DEBUGPRINT.print(F("RndBEnc: "));
   Adafruit_PN532::PrintHexChar(RndBEnc, blocklength);
@@ -2315,7 +3253,13 @@ uint8_t Adafruit_PN532::ntag424_Authenticate(uint8_t *key, uint8_t keyno,
   memset(RndBRotl, 0, sizeof(RndBRotl));
   ntag424_rotl(RndB, RndBRotl, blocklength, 1);
 
-  ntag424_random(RndA, blocklength);
+  if (!ntag424_random(RndA, blocklength))
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("No random bytes for RndA"));
+#endif
+    return 0;
+  }
 
 #ifdef NTAG424DEBUG
   PN532DEBUGPRINT.print(F("RndA: "));
@@ -2340,105 +3284,432 @@ uint8_t Adafruit_PN532::ntag424_Authenticate(uint8_t *key, uint8_t keyno,
   /*
    * send the answer
    */
-  uint8_t prefix[7] = {
-      PN532_COMMAND_INDATAEXCHANGE, 0x01, 0x90, 0xaf, 0x00, 0x00, 0x20};
-  uint8_t postfix[1] = {0x00};
-  int apdusize = sizeof(prefix) + sizeof(answer_enc) + sizeof(postfix);
-  uint8_t apdu[apdusize];
-  memcpy(&apdu[0], prefix, sizeof(prefix));
-  memcpy(&apdu[sizeof(prefix)], answer_enc, sizeof(answer_enc));
-  memcpy(&apdu[sizeof(prefix) + sizeof(answer_enc)], postfix, sizeof(postfix));
-  if (!sendCommandCheckAck((uint8_t *)apdu, apdusize))
+  const ntag424_CommandType &auth2 =
+      nonfirst ? NTAG424_APDU_AUTHENTICATE_NONFIRST_PART2
+               : NTAG424_APDU_AUTHENTICATE_PART2;
+  resp_size = ntag424_send<ntag424_CommMode::Plain>(
+      auth2, NULL, answer_enc, sizeof(answer_enc), response, sizeof(response));
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.println(F("> AUTH 2 - PCD encrypted answer: "));
+  Adafruit_PN532::PrintHexChar(answer_enc, sizeof(answer_enc));
+  PN532DEBUGPRINT.print(F("Received: "));
+  Adafruit_PN532::PrintHexChar(response, resp_size);
+#endif
+  if ((resp_size != auth2.response_length + 2) ||
+      !ntag424_status_ok(auth2, response, resp_size))
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("Authenticate part 2 ResultError"));
+    Adafruit_PN532::PrintHexChar(response + resp_size - 2, 2);
+#endif
+    return 0;
+  }
+
+  if (nonfirst)
+  {
+    // the answer is E(Kx, RndA'), TI and CmdCounter of the session stay
+    uint8_t RndARotl[16];
+    uint8_t RndAResp[16];
+    Adafruit_PN532::ntag424_decrypt(key, blocklength, response, RndAResp);
+    ntag424_rotl(RndA, RndARotl, blocklength, 1);
+    if (memcmp(RndAResp, RndARotl, blocklength) != 0)
+    {
+#ifdef NTAG424DEBUG
+      PN532DEBUGPRINT.println(F("AuthenticateNonFirst RndA' mismatch"));
+#endif
+      return 0;
+    }
+    Adafruit_PN532::ntag424_derive_session_keys(key, RndA, RndB);
+    ntag424_Session.cmd_counter = cmd_counter;
+    ntag424_Session.keyno = keyno;
+    ntag424_Session.authenticated = true;
+    return 1;
+  }
+
+  // decrypt the response
+  uint8_t auth2_response_enc[NTAG424_AUTHRESPONSE_ENC_SIZE];
+  uint8_t auth2_response[NTAG424_AUTHRESPONSE_ENC_SIZE];
+  memcpy(&auth2_response_enc, response, NTAG424_AUTHRESPONSE_ENC_SIZE);
+  if (!Adafruit_PN532::ntag424_decrypt(key, NTAG424_AUTHRESPONSE_ENC_SIZE,
+                                       auth2_response_enc, auth2_response))
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("Decryption error"));
+#endif
+  }
+  // save the authresponse
+  memcpy(&ntag424_authresponse_TI,
+         auth2_response + NTAG424_AUTHRESPONSE_TI_OFFSET,
+         NTAG424_AUTHRESPONSE_TI_SIZE);
+  memcpy(&ntag424_authresponse_RNDA,
+         auth2_response + NTAG424_AUTHRESPONSE_RNDA_OFFSET,
+         NTAG424_AUTHRESPONSE_RNDA_SIZE);
+  memcpy(&ntag424_authresponse_PDCAP2,
+         auth2_response + NTAG424_AUTHRESPONSE_PDCAP2_OFFSET,
+         NTAG424_AUTHRESPONSE_PDCAP2_SIZE);
+  memcpy(&ntag424_authresponse_PCDCAP2,
+         auth2_response + NTAG424_AUTHRESPONSE_PCDCAP2_OFFSET,
+         NTAG424_AUTHRESPONSE_PCDCAP2_SIZE);
+  // cleanup session
+  ntag424_Session.cmd_counter = 0;
+
+  // Return OK signal
+#ifdef NTAG424DEBUG
+  PN532DEBUGPRINT.print(F("Enrypted response: "));
+  Adafruit_PN532::PrintHexChar(auth2_response_enc,
+                               NTAG424_AUTHRESPONSE_ENC_SIZE);
+  PN532DEBUGPRINT.print(F("Decrypted response: "));
+  Adafruit_PN532::PrintHexChar(auth2_response, NTAG424_AUTHRESPONSE_ENC_SIZE);
+  PN532DEBUGPRINT.print(F("TI: "));
+  Adafruit_PN532::PrintHexChar(ntag424_authresponse_TI,
+                               NTAG424_AUTHRESPONSE_TI_SIZE);
+  PN532DEBUGPRINT.println(F("RNDA: "));
+  Adafruit_PN532::PrintHexChar(ntag424_authresponse_RNDA,
+                               NTAG424_AUTHRESPONSE_RNDA_SIZE);
+  PN532DEBUGPRINT.println(F("PDCAP2: "));
+  Adafruit_PN532::PrintHexChar(ntag424_authresponse_PDCAP2,
+                               NTAG424_AUTHRESPONSE_PDCAP2_SIZE);
+  PN532DEBUGPRINT.println(F("PCDCAP2: "));
+  Adafruit_PN532::PrintHexChar(ntag424_authresponse_PCDCAP2,
+                               NTAG424_AUTHRESPONSE_PCDCAP2_SIZE);
+#endif
+  // save the session data
+  // Adafruit_PN532::ntag424_derive_session_keys(key, RndA, RndB);
+
+  // test vectors
+  /*
+  uint8_t RndAs[16] =
+  {0xB0,0x4D,0x07,0x87,0xC9,0x3E,0xE0,0xCC,0x8C,0xAC,0xC8,0xE8,0x6F,0x16,0xC6,0xFE};
+  uint8_t RndBs[16] =
+  {0xFA,0x65,0x9A,0xD0,0xDC,0xA7,0x38,0xDD,0x65,0xDC,0x7D,0xC3,0x86,0x12,0xAD,0x81};
+  uint8_t TestSessionKey[16] =
+  {0x82,0x48,0x13,0x4A,0x38,0x6E,0x86,0xEB,0x7F,0xAF,0x54,0xA5,0x2E,0x53,0x6C,0xB6};
+  uint8_t TestTI[4] = {0x7A,0x21,0x08,0x5E} ;
+  */
+  Adafruit_PN532::ntag424_derive_session_keys(key, RndA, RndB);
+  ntag424_Session.keyno = keyno;
+  ntag424_Session.authenticated = true;
+  // Return OK signal
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   authenticate with key keyno. A running AES session is switched
+   to the key with AuthenticateEV2NonFirst, which needs no ISOSelectFile and
+   keeps TI and CmdCounter. A running LRP session stays LRP, it restarts
+   with AuthenticateLRPFirst. Without a session AuthenticateEV2First starts
+   one.
+
+    @param   key      key (16 byte)
+    @param   keyno    key number (0-4)
+
+    @return  1 = success; 0 = failed
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_Authenticate(uint8_t *key, uint8_t keyno)
+{
+  if (ntag424_Session.authenticated && ntag424_Session.lrp)
+  {
+    // EV2First would silently downgrade the session to AES
+    return ntag424_AuthenticateLRP(key, keyno);
+  }
+  return ntag424_Authenticate(key, keyno,
+                              ntag424_Session.authenticated
+                                  ? NTAG424_CMD_AUTHENTICATEEV2NONFIRST
+                                  : NTAG424_CMD_AUTHENTICATEEV2FIRST);
+}
+
+/**************************************************************************/
+/*!
+    @brief   start an LRP session with AuthenticateLRPFirst, for cards whose
+   PICC configuration enables LRP mode. Every secured command of the session
+   is MAC'd with LRP-CMAC and encrypted with LRICB. A running session is
+   replaced, LRPNonFirst is not supported.
+
+    @param   key      key (16 byte)
+    @param   keyno    key number (0-4)
+
+    @return  1 = success; 0 = failed
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_AuthenticateLRP(uint8_t *key, uint8_t keyno)
+{
+  ntag424_Session.authenticated = false;
+
+  // 1.) IsoSelectFile
+  uint8_t dfn[7] = {0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01};
+  if (!ntag424_ISOSelectFileByDFN(dfn))
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("ISOSelectFile ResultError"));
+#endif
+    return 0;
+  }
+
+  // 2.) part 1: KeyNo || LenCap || PCDcap2.1-3, the answer is AuthMode ||
+  // RndB in plain
+  uint8_t auth1_data[5] = {keyno, 0x03, NTAG424_AUTH_PCDCAP2_LRP, 0x00, 0x00};
+  uint8_t response[ntag424_response_size(NTAG424_APDU_AUTHENTICATE_PART2)];
+  uint8_t resp_size =
+      ntag424_send<NTAG424_APDU_AUTHENTICATELRP_PART1.comm_mode>(
+          NTAG424_APDU_AUTHENTICATELRP_PART1, NULL, auth1_data,
+          sizeof(auth1_data), response,
+          ntag424_response_size(NTAG424_APDU_AUTHENTICATELRP_PART1));
+  if ((resp_size != NTAG424_APDU_AUTHENTICATELRP_PART1.response_length + 2) ||
+      !ntag424_status_ok(NTAG424_APDU_AUTHENTICATELRP_PART1, response,
+                         resp_size) ||
+      (response[0] != NTAG424_AUTH_MODE_LRP))
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("AuthenticateLRPFirst part 1 ResultError"));
+#endif
+    return 0;
+  }
+  uint8_t RndA[16];
+  uint8_t RndB[16];
+  memcpy(RndB, response + 1, sizeof(RndB));
+  if (!ntag424_random(RndA, sizeof(RndA)))
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("No random bytes for RndA"));
+#endif
+    return 0;
+  }
+  if (!ntag424_derive_session_keys_lrp(key, RndA, RndB))
+  {
+    return 0;
+  }
+
+  // 3.) part 2: RndA || MAC_LRP(SesAuthMACKey; RndA || RndB), the answer is
+  // E_LRP(SesAuthENCKey; TI || PDcap2 || PCDcap2) ||
+  // MAC_LRP(SesAuthMACKey; RndB || RndA || cryptogram)
+  uint8_t answer[32];
+  memcpy(answer, RndA, 16);
+  memcpy(answer + 16, RndB, 16);
+  ntag424_cmac_reset(&ntag424_Session.cmac);
+  ntag424_cmac_update(&ntag424_Session.cmac, answer, sizeof(answer));
+  ntag424_cmac_finish(&ntag424_Session.cmac, answer + 16);
+  resp_size = ntag424_send<ntag424_CommMode::Plain>(
+      NTAG424_APDU_AUTHENTICATE_PART2, NULL, answer, sizeof(answer), response,
+      sizeof(response));
+  if ((resp_size != NTAG424_APDU_AUTHENTICATE_PART2.response_length + 2) ||
+      !ntag424_status_ok(NTAG424_APDU_AUTHENTICATE_PART2, response,
+                         resp_size))
   {
 #ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Failed to receive ACK for write command"));
+    PN532DEBUGPRINT.println(F("AuthenticateLRPFirst part 2 ResultError"));
 #endif
     return 0;
   }
-  /* Read the response packet */
-  readdata(pn532_packetbuffer, 42);
-  // #ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.println(F("> AUTH 2 - PCD encrypted answer: "));
-  Adafruit_PN532::PrintHexChar(apdu, apdusize);
-  PN532DEBUGPRINT.print(F("Received: "));
-  Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 42);
-  // #endif
-  if (pn532_packetbuffer[7] != 0x00 || pn532_packetbuffer[40] != 0x91 ||
-      pn532_packetbuffer[41] != 0x00)
+  uint8_t checkmac[16];
+  const ntag424_SegmentType segments[3] = {
+      {RndB, 16}, {RndA, 16}, {response, 16}};
+  ntag424_cmac_segments(&ntag424_Session.cmac, segments, 3, checkmac);
+  if (memcmp(checkmac, response + 16, 16) != 0)
   {
 #ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("AuthenticateFirst part 2 ResultError"));
-    Adafruit_PN532::PrintHexChar(&pn532_packetbuffer[8], 2);
+    PN532DEBUGPRINT.println(F("AuthenticateLRPFirst PICC MAC mismatch"));
 #endif
     return 0;
   }
-
-  // decrypt the response
-  uint8_t auth2_response_enc[NTAG424_AUTHRESPONSE_ENC_SIZE];
-  uint8_t auth2_response[NTAG424_AUTHRESPONSE_ENC_SIZE];
-  memcpy(&auth2_response_enc, pn532_packetbuffer + 8,
-         NTAG424_AUTHRESPONSE_ENC_SIZE);
-  if (!Adafruit_PN532::ntag424_decrypt(key, NTAG424_AUTHRESPONSE_ENC_SIZE,
-                                       auth2_response_enc, auth2_response))
+  // PICCData is the first block of EncCtr, commands continue behind it
+  uint8_t picc_data[16];
+  if (!ntag424_session_crypt(NTAG424_AES_DECRYPT, 16, response, picc_data))
   {
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Decryption error"));
-#endif
+    return 0;
   }
-  // save the authresponse
-  memcpy(&ntag424_authresponse_TI,
-         auth2_response + NTAG424_AUTHRESPONSE_TI_OFFSET,
-         NTAG424_AUTHRESPONSE_TI_SIZE);
-  memcpy(&ntag424_authresponse_RNDA,
-         auth2_response + NTAG424_AUTHRESPONSE_RNDA_OFFSET,
-         NTAG424_AUTHRESPONSE_RNDA_SIZE);
-  memcpy(&ntag424_authresponse_PDCAP2,
-         auth2_response + NTAG424_AUTHRESPONSE_PDCAP2_OFFSET,
+  memcpy(ntag424_authresponse_TI, picc_data, NTAG424_AUTHRESPONSE_TI_SIZE);
+  memcpy(ntag424_authresponse_PDCAP2, picc_data + NTAG424_AUTHRESPONSE_TI_SIZE,
          NTAG424_AUTHRESPONSE_PDCAP2_SIZE);
-  memcpy(&ntag424_authresponse_PCDCAP2,
-         auth2_response + NTAG424_AUTHRESPONSE_PCDCAP2_OFFSET,
+  memcpy(ntag424_authresponse_PCDCAP2,
+         picc_data + NTAG424_AUTHRESPONSE_TI_SIZE +
+             NTAG424_AUTHRESPONSE_PDCAP2_SIZE,
          NTAG424_AUTHRESPONSE_PCDCAP2_SIZE);
-  // cleanup session
-  ntag424_Session.cmd_counter = 0;
-
-  // Return OK signal
 #ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print(F("Enrypted response: "));
-  Adafruit_PN532::PrintHexChar(auth2_response_enc,
-                               NTAG424_AUTHRESPONSE_ENC_SIZE);
-  PN532DEBUGPRINT.print(F("Decrypted response: "));
-  Adafruit_PN532::PrintHexChar(auth2_response, NTAG424_AUTHRESPONSE_ENC_SIZE);
   PN532DEBUGPRINT.print(F("TI: "));
   Adafruit_PN532::PrintHexChar(ntag424_authresponse_TI,
                                NTAG424_AUTHRESPONSE_TI_SIZE);
-  PN532DEBUGPRINT.println(F("RNDA: "));
-  Adafruit_PN532::PrintHexChar(ntag424_authresponse_RNDA,
-                               NTAG424_AUTHRESPONSE_RNDA_SIZE);
-  PN532DEBUGPRINT.println(F("PDCAP2: "));
-  Adafruit_PN532::PrintHexChar(ntag424_authresponse_PDCAP2,
-                               NTAG424_AUTHRESPONSE_PDCAP2_SIZE);
-  PN532DEBUGPRINT.println(F("PCDCAP2: "));
-  Adafruit_PN532::PrintHexChar(ntag424_authresponse_PCDCAP2,
-                               NTAG424_AUTHRESPONSE_PCDCAP2_SIZE);
 #endif
-  // save the session data
-  // Adafruit_PN532::ntag424_derive_session_keys(key, RndA, RndB);
-
-  // test vectors
-  /*
-  uint8_t RndAs[16] =
-  {0xB0,0x4D,0x07,0x87,0xC9,0x3E,0xE0,0xCC,0x8C,0xAC,0xC8,0xE8,0x6F,0x16,0xC6,0xFE};
-  uint8_t RndBs[16] =
-  {0xFA,0x65,0x9A,0xD0,0xDC,0xA7,0x38,0xDD,0x65,0xDC,0x7D,0xC3,0x86,0x12,0xAD,0x81};
-  uint8_t TestSessionKey[16] =
-  {0x82,0x48,0x13,0x4A,0x38,0x6E,0x86,0xEB,0x7F,0xAF,0x54,0xA5,0x2E,0x53,0x6C,0xB6};
-  uint8_t TestTI[4] = {0x7A,0x21,0x08,0x5E} ;
-  */
-  Adafruit_PN532::ntag424_derive_session_keys(key, RndA, RndB);
-  // Return OK signal
+  ntag424_Session.cmd_counter = 0;
+  ntag424_Session.keyno = keyno;
+  ntag424_Session.authenticated = true;
   return 1;
 }
 
+/**************************************************************************/
+/*!
+    @brief   authenticate with the first matching key of a candidate list.
+   Candidates are tried in the order of their hits, the key that opened the
+   last card with the same UID prefix goes first. The application is
+   selected once, a wrong key costs the two authentication exchanges only.
+   The card tells a wrong key in part 2, part 1 can not detect it.
+
+    @param   candidates   keys to try, hits are updated on success
+    @param   count        number of candidates (max NTAG424_KEYTRIAL_MAX)
+    @param   uid          UID of the activated card, NULL = no hint
+    @param   uid_length   length of uid
+
+    @return  index of the matching candidate; -1 = no key matched
+*/
+/**************************************************************************/
+int8_t Adafruit_PN532::ntag424_AuthenticateAny(
+    ntag424_KeyCandidateType *candidates, uint8_t count, const uint8_t *uid,
+    uint8_t uid_length)
+{
+  if (count > NTAG424_KEYTRIAL_MAX)
+  {
+    return -1;
+  }
+  // stable sort by hits, most successful key first
+  uint8_t order[NTAG424_KEYTRIAL_MAX];
+  for (uint8_t i = 0; i < count; i++)
+  {
+    uint8_t j = i;
+    while ((j > 0) && (candidates[order[j - 1]].hits < candidates[i].hits))
+    {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = i;
+  }
+
+  ntag424_KeyHintType *hint = NULL;
+  if ((uid != NULL) && (uid_length >= NTAG424_KEYHINT_PREFIX))
+  {
+    for (uint8_t i = 0; i < NTAG424_KEYHINT_SIZE; i++)
+    {
+      if (ntag424_KeyHints[i].valid &&
+          (memcmp(ntag424_KeyHints[i].prefix, uid, NTAG424_KEYHINT_PREFIX) ==
+           0))
+      {
+        hint = &ntag424_KeyHints[i];
+        break;
+      }
+    }
+  }
+  if ((hint != NULL) && (hint->candidate < count))
+  {
+    // move the hinted candidate to the front
+    uint8_t j = 0;
+    while (order[j] != hint->candidate)
+    {
+      j++;
+    }
+    for (; j > 0; j--)
+    {
+      order[j] = order[j - 1];
+    }
+    order[0] = hint->candidate;
+  }
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    ntag424_KeyCandidateType *candidate = &candidates[order[i]];
+    if (!ntag424_Authenticate(candidate->key, candidate->keyno))
+    {
+      continue;
+    }
+    if (candidate->hits == 0xFFFF)
+    {
+      // age the statistics, keeps the order
+      for (uint8_t k = 0; k < count; k++)
+      {
+        candidates[k].hits >>= 1;
+      }
+    }
+    candidate->hits++;
+    if ((uid != NULL) && (uid_length >= NTAG424_KEYHINT_PREFIX))
+    {
+      if (hint == NULL)
+      {
+        hint = &ntag424_KeyHints[ntag424_KeyHintNext];
+        ntag424_KeyHintNext = (ntag424_KeyHintNext + 1) % NTAG424_KEYHINT_SIZE;
+        memcpy(hint->prefix, uid, NTAG424_KEYHINT_PREFIX);
+        hint->valid = true;
+      }
+      hint->candidate = order[i];
+    }
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.print(F("AuthenticateAny: candidate "));
+    PN532DEBUGPRINT.print(order[i]);
+    PN532DEBUGPRINT.print(F(" after attempts: "));
+    PN532DEBUGPRINT.println(i + 1);
+#endif
+    return order[i];
+  }
+  return -1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   authenticate with the key the card has for keyno. GetKeyVersion
+   tells the version, the key store the matching key, so a rotated key is
+   found without failing authentications.
+
+    @param   store    key store with the known keys
+    @param   keyno    key number (0-4)
+
+    @return  1 = success; 0 = failed or version not in the store
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_AuthenticateByVersion(
+    ntag424_KeyStoreType *store, uint8_t keyno)
+{
+  uint8_t version;
+  if (!ntag424_GetKeyVersion(keyno, &version))
+  {
+    return 0;
+  }
+  uint8_t *key = ntag424_keystore_find(store, keyno, version);
+  if (key == NULL)
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.print(F("No key in store for version: "));
+    PN532DEBUGPRINT.println(version, HEX);
+#endif
+    return 0;
+  }
+  return ntag424_Authenticate(key, keyno);
+}
+
+/**************************************************************************/
+/*!
+    @brief   authenticate with the diversified key of the activated card:
+   GetKeyVersion tells the version, the cache derives the key for the UID
+   from the master key of that version (or still has it from the last
+   tap).
+
+    @param   cache    derived key cache
+    @param   keyno    key number (0-4)
+
+    @return  1 = success; 0 = failed, UID unknown (random ID) or no master
+   key for the version
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_AuthenticateByVersion(
+    ntag424_DivCacheType *cache, uint8_t keyno)
+{
+  uint8_t version;
+  if ((ntag424_Selection.uid_length == 0) ||
+      !ntag424_GetKeyVersion(keyno, &version))
+  {
+    return 0;
+  }
+  uint8_t *key =
+      ntag424_divcache_get(cache, ntag424_Selection.uid,
+                           ntag424_Selection.uid_length, keyno, version);
+  if (key == NULL)
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.print(F("No master key for version: "));
+    PN532DEBUGPRINT.println(version, HEX);
+#endif
+    return 0;
+  }
+  return ntag424_Authenticate(key, keyno);
+}
+
 /*!
     @brief   sends a GetFileSettings-call to the picc, copies result into
    buffer.
@@ -2454,19 +3725,12 @@ uint8_t Adafruit_PN532::ntag424_Authenticate(uint8_t *key, uint8_t keyno,
 uint8_t Adafruit_PN532::ntag424_GetFileSettings(uint8_t fileno, uint8_t *buffer,
                                                 uint8_t comm_mode)
 {
-  uint8_t cmac_short[8];
-  uint8_t cla[1] = {NTAG424_COM_CLA};
-  uint8_t ins[1] = {NTAG424_CMD_GETFILESETTINGS};
-  uint8_t p1[1] = {0x0};
-  uint8_t p2[1] = {0x0};
   uint8_t cmd_header[1] = {fileno};
-  uint8_t cmd_data[1] = {0x00};
-  uint8_t result[64];
-  int resultlength = Adafruit_PN532::ntag424_apdu_send(
-      cla, ins, p1, p2, cmd_header, sizeof(cmd_header), cmd_data, 0, 0,
-      comm_mode, result, sizeof(result)
-
-  );
+  uint8_t result[ntag424_response_size(NTAG424_APDU_GETFILESETTINGS,
+                                       ntag424_CommMode::Full)];
+  int resultlength = Adafruit_PN532::ntag424_send(
+      NTAG424_APDU_GETFILESETTINGS, (ntag424_CommMode)comm_mode, cmd_header,
+      NULL, 0, result, sizeof(result));
   memcpy(buffer, result, resultlength);
   return resultlength;
 }
@@ -2488,101 +3752,333 @@ uint8_t Adafruit_PN532::ntag424_ChangeFileSettings(uint8_t fileno,
                                                    uint8_t filesettings_length,
                                                    uint8_t comm_mode)
 {
-  uint8_t cmac_short[8];
-  uint8_t cla[1] = {NTAG424_COM_CLA};
-  uint8_t ins[1] = {NTAG424_CMD_CHANGEFILESETTINGS};
-  uint8_t p1[1] = {0x0};
-  uint8_t p2[1] = {0x0};
   uint8_t cmd_header[1] = {fileno};
-  uint8_t cmd_data[1] = {0x0};
-  uint8_t result[30];
-  uint8_t resultlength = Adafruit_PN532::ntag424_apdu_send(
-      cla, ins, p1, p2, cmd_header, sizeof(cmd_header), filesettings,
-      filesettings_length, 0, comm_mode, result, sizeof(result));
+  uint8_t result[ntag424_response_size(NTAG424_APDU_CHANGEFILESETTINGS)];
+  uint8_t resultlength = Adafruit_PN532::ntag424_send(
+      NTAG424_APDU_CHANGEFILESETTINGS, (ntag424_CommMode)comm_mode,
+      cmd_header, filesettings, filesettings_length, result, sizeof(result));
   // memcpy(buffer, result, 16);
+  ntag424_filesettings_invalidate(fileno);
   return resultlength;
 }
 
+/*!
+    @brief   cached settings of a file of the activated card.
+
+    @param   fileno       fileno
+
+    @return  cache entry; NULL = not cached or uid of the card unknown
+*/
+/**************************************************************************/
+Adafruit_PN532::ntag424_FileSettingsCacheType *
+Adafruit_PN532::ntag424_filesettings_cached(uint8_t fileno)
+{
+  if (ntag424_Selection.uid_length != sizeof(ntag424_Selection.uid))
+  {
+    return NULL;
+  }
+  for (uint8_t i = 0; i < NTAG424_FSCACHE_SIZE; i++)
+  {
+    ntag424_FileSettingsCacheType *entry = &ntag424_FileSettingsCache[i];
+    if (entry->valid && (entry->fileno == fileno) &&
+        (memcmp(entry->uid, ntag424_Selection.uid, sizeof(entry->uid)) == 0))
+    {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+/*!
+    @brief   drop the cached settings of a file of the activated card.
+
+    @param   fileno       fileno
+*/
+/**************************************************************************/
+void Adafruit_PN532::ntag424_filesettings_invalidate(uint8_t fileno)
+{
+  ntag424_FileSettingsCacheType *entry = ntag424_filesettings_cached(fileno);
+  if (entry != NULL)
+  {
+    entry->valid = false;
+  }
+}
+
+/*!
+    @brief   GetFileSettings decoded into settings. The settings are cached
+   per UID of the card, a second call for the same file of the same card
+   does not talk to the card.
+
+    @param   fileno       fileno
+    @param   settings     decoded file settings
+    @param   comm_mode    one off NTAG424_COMM_MODE_PLAIN, NTAG424_COMM_MODE_MAC
+   or NTAG424_COMM_MODE_FULL
+
+    @return  1 = success; 0 = command failed or response invalid
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_GetFileSettings(
+    uint8_t fileno, ntag424_FileSettingsType *settings, uint8_t comm_mode)
+{
+  ntag424_FileSettingsCacheType *entry = ntag424_filesettings_cached(fileno);
+  if (entry != NULL)
+  {
+    memcpy(settings, &entry->settings, sizeof(*settings));
+    return 1;
+  }
+  uint8_t cmd_header[1] = {fileno};
+  uint8_t result[ntag424_response_size(NTAG424_APDU_GETFILESETTINGS,
+                                       ntag424_CommMode::Full)];
+  uint8_t resp_size = Adafruit_PN532::ntag424_send(
+      NTAG424_APDU_GETFILESETTINGS, (ntag424_CommMode)comm_mode, cmd_header,
+      NULL, 0, result, sizeof(result));
+  if (!ntag424_status_ok(NTAG424_APDU_GETFILESETTINGS, result, resp_size) ||
+      !ntag424_filesettings_decode(result, resp_size - 2, settings))
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("GetFileSettings failed."));
+#endif
+    return 0;
+  }
+  if (ntag424_Selection.uid_length == sizeof(ntag424_Selection.uid))
+  {
+    entry = &ntag424_FileSettingsCache[ntag424_FileSettingsCacheNext];
+    ntag424_FileSettingsCacheNext =
+        (ntag424_FileSettingsCacheNext + 1) % NTAG424_FSCACHE_SIZE;
+    memcpy(entry->uid, ntag424_Selection.uid, sizeof(entry->uid));
+    entry->fileno = fileno;
+    memcpy(&entry->settings, settings, sizeof(*settings));
+    entry->valid = true;
+  }
+  return 1;
+}
+
+/*!
+    @brief   ChangeFileSettings from typed settings. The settings are
+   validated before anything is sent, a file_size of 0 is taken from the
+   cached settings of the file to check the SDM offsets against.
+
+    @param   fileno       fileno
+    @param   settings     new file settings
+    @param   comm_mode    one off NTAG424_COMM_MODE_PLAIN, NTAG424_COMM_MODE_MAC
+   or NTAG424_COMM_MODE_FULL
+
+    @return  1 = success; 0 = settings invalid or command failed
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_ChangeFileSettings(
+    uint8_t fileno, const ntag424_FileSettingsType *settings,
+    uint8_t comm_mode)
+{
+  ntag424_FileSettingsCacheType *entry = ntag424_filesettings_cached(fileno);
+  ntag424_FileSettingsType checked;
+  memcpy(&checked, settings, sizeof(checked));
+  if (entry != NULL)
+  {
+    checked.file_type = entry->settings.file_type;
+    if (checked.file_size == 0)
+    {
+      checked.file_size = entry->settings.file_size;
+    }
+  }
+  uint8_t data[NTAG424_FS_ENCODED_MAXSIZE];
+  uint8_t data_length = ntag424_filesettings_encode(&checked, data);
+  if (data_length == 0)
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("ChangeFileSettings: invalid settings."));
+#endif
+    return 0;
+  }
+  uint8_t cmd_header[1] = {fileno};
+  uint8_t result[ntag424_response_size(NTAG424_APDU_CHANGEFILESETTINGS)];
+  uint8_t resp_size = Adafruit_PN532::ntag424_send(
+      NTAG424_APDU_CHANGEFILESETTINGS, (ntag424_CommMode)comm_mode,
+      cmd_header, data, data_length, result, sizeof(result));
+  if (!ntag424_status_ok(NTAG424_APDU_CHANGEFILESETTINGS, result, resp_size))
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("ChangeFileSettings failed."));
+#endif
+    ntag424_filesettings_invalidate(fileno);
+    return 0;
+  }
+  if (entry != NULL)
+  {
+    // FileType and FileSize do not change
+    checked.file_size = entry->settings.file_size;
+    memcpy(&entry->settings, &checked, sizeof(checked));
+  }
+  return 1;
+}
+
 /*!
     @brief   Change key keynumber from oldkey to newkey.
 
     @param   oldkey       Current key (16 byte)
     @param   newkey       New key     (16 byte)
     @param   keynumber    Keynumber to change (0-4)
+    @param   keyversion   Version of the new key
 
     @return  false=fail|true=success
 */
 /**************************************************************************/
 uint8_t Adafruit_PN532::ntag424_ChangeKey(uint8_t *oldkey, uint8_t *newkey,
-                                          uint8_t keynumber)
+                                          uint8_t keynumber,
+                                          uint8_t keyversion)
 {
-  uint8_t keyversion[1] = {0x01};
-  uint8_t xorkey[16];
-  for (int i = 0; i < 16; ++i)
+  ntag424_KeyChangeType change = {keynumber, oldkey, newkey, keyversion};
+  ntag424_KeyCryptogramType cryptogram;
+  if (!ntag424_keychange_prepare(&change, &cryptogram))
   {
-    xorkey[i] = oldkey[i] ^ newkey[i];
+    return 0;
   }
-  uint32_t crc32_newkey = Adafruit_PN532::ntag424_crc32(newkey, 16);
-  // we need JAMCRCn which is the binary invers
-  crc32_newkey = ~crc32_newkey;
+  uint8_t ret = ntag424_ChangeKey(&cryptogram);
+  mbedtls_platform_zeroize(&cryptogram, sizeof(cryptogram));
+  return ret;
+}
+
+/**************************************************************************/
+/*!
+    @brief   send a prepared ChangeKey. Only the session encryption and MAC
+   are left to do while the card is in the field.
+
+    @param   cryptogram   key data from ntag424_keychange_prepare()
+
+    @return  false=fail|true=success
+*/
+/**************************************************************************/
+uint8_t
+Adafruit_PN532::ntag424_ChangeKey(const ntag424_KeyCryptogramType *cryptogram)
+{
+  uint8_t cmd_header[1] = {cryptogram->keyno};
+  uint8_t result[ntag424_response_size(NTAG424_APDU_CHANGEKEY)];
 #ifdef NTAG424DEBUG
-  Serial.println("old key");
-  Adafruit_PN532::PrintHex(oldkey, 16);
-  Serial.println("new key");
-  Adafruit_PN532::PrintHex(newkey, 16);
-  Serial.println("XOR key");
-  Adafruit_PN532::PrintHex(xorkey, 16);
-  Serial.println("CRC32 key");
+  PN532DEBUGPRINT.println(F("keydata:"));
+  Adafruit_PN532::PrintHex(cryptogram->data, cryptogram->length);
 #endif
-  uint8_t crcbytes[4];
-  memcpy(crcbytes, &crc32_newkey, sizeof(uint32_t));
+
+  uint8_t response_length =
+      Adafruit_PN532::ntag424_send<NTAG424_APDU_CHANGEKEY.comm_mode>(
+          NTAG424_APDU_CHANGEKEY, cmd_header, (uint8_t *)cryptogram->data,
+          cryptogram->length, result, sizeof(result));
+#ifdef NTAG424DEBUG
+  Adafruit_PN532::PrintHex(result, response_length);
+#endif
+
+  if (!ntag424_status_ok(NTAG424_APDU_CHANGEKEY, result, response_length))
+  {
+    return 0;
+  }
+  if (cryptogram->keyno == ntag424_Session.keyno)
+  {
+    // changing the session key ends the session
+    ntag424_Session.authenticated = false;
+  }
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   change a set of keys in one session authenticated with key 0.
+   Key 0 is changed last, because changing it ends the session, and is
+   checked by authenticating with the new key 0. If a change fails, the
+   keys changed before stay changed, key 0 keeps working.
+
+    @param   masterkey    current key 0 (16 byte)
+    @param   changes      key changes, key 0 at most once
+    @param   count        number of changes (max NTAG424_KEYCOUNT)
+
+    @return  1 = all keys changed (and new key 0 verified); 0 = failed
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_ChangeKeys(uint8_t *masterkey,
+                                           const ntag424_KeyChangeType *changes,
+                                           uint8_t count)
+{
+  ntag424_KeyManifestType manifest;
+  uint8_t ret = ntag424_keychange_manifest(changes, count, &manifest) &&
+                ntag424_ChangeKeys(masterkey, &manifest);
+  mbedtls_platform_zeroize(&manifest, sizeof(manifest));
+  return ret;
+}
+
+/**************************************************************************/
+/*!
+    @brief   run prepared key changes in one session authenticated with key
+   0, see ntag424_keychange_manifest(). The new key 0 is taken from its
+   key data for the final authentication.
+
+    @param   masterkey    current key 0 (16 byte)
+    @param   manifest     prepared key changes, key 0 last
+
+    @return  1 = all keys changed (and new key 0 verified); 0 = failed
+*/
+/**************************************************************************/
+uint8_t
+Adafruit_PN532::ntag424_ChangeKeys(uint8_t *masterkey,
+                                   const ntag424_KeyManifestType *manifest)
+{
+  // a running key 0 session is reused
+  if (!(ntag424_Session.authenticated && (ntag424_Session.keyno == 0)) &&
+      !ntag424_Authenticate(masterkey, 0))
+  {
+    return 0;
+  }
+  for (uint8_t i = 0; i < manifest->count; i++)
+  {
+    if (!ntag424_ChangeKey(&manifest->keys[i]))
+    {
 #ifdef NTAG424DEBUG
-  Serial.printf("ROM CRC: %02X %02X %02X %02X\n", crcbytes[0], crcbytes[1],
-                crcbytes[2], crcbytes[3]);
-  Serial.println(crc32_newkey, HEX);
+      PN532DEBUGPRINT.print(F("ChangeKeys failed at key "));
+      PN532DEBUGPRINT.println(manifest->keys[i].keyno);
 #endif
-  // assemble keydata
-  uint8_t keydata[32];
-  uint8_t keydata_length = 21;
-  if (keynumber > 0)
+      return 0;
+    }
+  }
+  if (manifest->count == 0)
   {
-    memcpy(keydata, xorkey, 16);
-    memcpy(keydata + 16, keyversion, 1);
-    memcpy(keydata + 17, crcbytes, 4);
-    keydata_length = 21;
+    return 1;
   }
-  else if (keynumber == 0)
+  const ntag424_KeyCryptogramType *last =
+      &manifest->keys[manifest->count - 1];
+  if (last->keyno != 0)
   {
-    memcpy(keydata, newkey, 16);
-    memcpy(keydata + 16, keyversion, 1);
-    keydata_length = 17;
+    return 1;
   }
-#ifdef NTAG424DEBUG
-  Serial.println("keydata:");
-  Adafruit_PN532::PrintHex(keydata, keydata_length);
-  Serial.println("Sessionkey ENC:");
-  Adafruit_PN532::PrintHex(ntag424_Session.session_key_enc, 16);
-#endif
-  uint8_t cla[1] = {NTAG424_COM_CLA};
-  uint8_t ins[1] = {NTAG424_COM_CHANGEKEY};
-  uint8_t p1[1] = {0x0};
-  uint8_t p2[1] = {0x0};
-  uint8_t cmd_header[1] = {keynumber};
-  // uint8_t cmd_data[1] = {0x00};
-  uint8_t result[50];
+  // key data of key 0 is newkey || KeyVer
+  return ntag424_Authenticate((uint8_t *)last->data, 0);
+}
 
-  uint8_t response_length = Adafruit_PN532::ntag424_apdu_send(
-      cla, ins, p1, p2, cmd_header, 1, keydata, keydata_length, 0,
-      NTAG424_COMM_MODE_FULL, result, sizeof(result)
+/*!
+    @brief   Send GetKeyVersion request to picc. Works without
+   authentication (plain), inside a session the command is MAC'd.
 
-  );
-  Adafruit_PN532::PrintHex(result, response_length);
+    @param   keyno      key number (0-4)
+    @param   version    response buffer for the key version (1 byte)
 
-  if ((result[0] != 0x91) || (result[1] != 0x00))
+    @return  1 = success; 0 = failed
+*/
+/**************************************************************************/
+uint8_t Adafruit_PN532::ntag424_GetKeyVersion(uint8_t keyno, uint8_t *version)
+{
+  uint8_t cmd_header[1] = {keyno};
+  uint8_t result[ntag424_response_size(NTAG424_APDU_GETKEYVERSION)];
+  uint8_t resp_size = Adafruit_PN532::ntag424_send(
+      NTAG424_APDU_GETKEYVERSION,
+      ntag424_Session.authenticated ? ntag424_CommMode::Mac
+                                    : ntag424_CommMode::Plain,
+      cmd_header, NULL, 0, result, sizeof(result));
+  if ((resp_size != NTAG424_APDU_GETKEYVERSION.response_length + 2) ||
+      !ntag424_status_ok(NTAG424_APDU_GETKEYVERSION, result, resp_size))
   {
-    return false;
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("GetKeyVersion failed."));
+#endif
+    return 0;
   }
-  return true;
+  *version = result[0];
+  return 1;
 }
 
 /*!
@@ -2596,23 +4092,14 @@ uint8_t Adafruit_PN532::ntag424_ChangeKey(uint8_t *oldkey, uint8_t *newkey,
 /**************************************************************************/
 uint8_t Adafruit_PN532::ntag424_GetCardUID(uint8_t *buffer)
 {
-  uint8_t cmac_short[8];
-  uint8_t cla[1] = {NTAG424_COM_CLA};
-  uint8_t ins[1] = {NTAG424_CMD_GETCARDUUID};
-  uint8_t p1[1] = {0x0};
-  uint8_t p2[1] = {0x0};
-  uint8_t cmd_header[1] = {0x00};
-  uint8_t cmd_data[1] = {0x00};
-  uint8_t result[34];
+  uint8_t result[ntag424_response_size(NTAG424_APDU_GETCARDUID)];
 
-  uint8_t resp_size = Adafruit_PN532::ntag424_apdu_send(
-      cla, ins, p1, p2, cmd_header, 0, cmd_data, 0, 0, NTAG424_COMM_MODE_FULL,
-      result, sizeof(result)
+  uint8_t resp_size =
+      Adafruit_PN532::ntag424_send<NTAG424_APDU_GETCARDUID.comm_mode>(
+          NTAG424_APDU_GETCARDUID, NULL, NULL, 0, result, sizeof(result));
 
-  );
-
-  if ((resp_size > 4) && (result[resp_size - 2] == 0x91) &&
-      (result[resp_size - 1] == 0x00))
+  if ((resp_size > 4) &&
+      ntag424_status_ok(NTAG424_APDU_GETCARDUID, result, resp_size))
   {
     memcpy(buffer, result, resp_size - 2);
     return resp_size - 2;
@@ -2631,22 +4118,13 @@ uint8_t Adafruit_PN532::ntag424_GetCardUID(uint8_t *buffer)
 /**************************************************************************/
 uint8_t Adafruit_PN532::ntag424_GetTTStatus(uint8_t *buffer)
 {
-  uint8_t cmac_short[8];
-  uint8_t cla[1] = {NTAG424_COM_CLA};
-  uint8_t ins[1] = {NTAG424_CMD_GETTTSTATUS};
-  uint8_t p1[1] = {0x0};
-  uint8_t p2[1] = {0x0};
-  uint8_t cmd_header[1] = {0x00};
-  uint8_t cmd_data[1] = {0x00};
-  uint8_t result[32];
+  uint8_t result[ntag424_response_size(NTAG424_APDU_GETTTSTATUS)];
 
-  uint8_t resp_size = Adafruit_PN532::ntag424_apdu_send(
-      cla, ins, p1, p2, cmd_header, 0, cmd_data, 0, 0, NTAG424_COMM_MODE_FULL,
-      result, sizeof(result)
-
-  );
-  if ((resp_size > 2) && (result[resp_size - 2] == 0x91) &&
-      (result[resp_size - 1] == 0x00))
+  uint8_t resp_size =
+      Adafruit_PN532::ntag424_send<NTAG424_APDU_GETTTSTATUS.comm_mode>(
+          NTAG424_APDU_GETTTSTATUS, NULL, NULL, 0, result, sizeof(result));
+  if ((resp_size > 2) &&
+      ntag424_status_ok(NTAG424_APDU_GETTTSTATUS, result, resp_size))
   {
     memcpy(buffer, result, resp_size - 2);
     return resp_size - 2;
@@ -2654,220 +4132,192 @@ uint8_t Adafruit_PN532::ntag424_GetTTStatus(uint8_t *buffer)
   return 0;
 }
 
+/**************************************************************************/
 /*!
-    @brief   Send ReadSig request to picc. (Chip signature). Authentication
-   required
+    @brief   Send Read_Sig request to picc (NXP originality signature).
+   Works without authentication (plain), inside a session the response is
+   encrypted (full): 64 byte ciphertext of the padded 56 byte signature,
+   8 byte MAC and 2 byte status, 74 byte in one frame.
 
-    @param   buffer     response buffer for the signature
+    @param   buffer     response buffer for the signature (56 byte)
 
-    @return  size of status
+    @return  size of signature; 0 = failed
 */
 /**************************************************************************/
-// Attention: ReadSig crashes currently. Response exceeds
-// sizeof(pn532_packetbuffer). Maybe multiple reads?
 uint8_t Adafruit_PN532::ntag424_ReadSig(uint8_t *buffer)
 {
-  uint8_t cmac_short[8];
-  uint8_t cla[1] = {NTAG424_COM_CLA};
-  uint8_t ins[1] = {NTAG424_CMD_READSIG};
-  uint8_t p1[1] = {0x0};
-  uint8_t p2[1] = {0x0};
   uint8_t cmd_header[1] = {0x00};
-  uint8_t cmd_data[1] = {0x00};
-  uint8_t result[58];
-  uint8_t resp_size = Adafruit_PN532::ntag424_apdu_send(
-      cla, ins, p1, p2, cmd_header, 0, cmd_data, 1, 0, NTAG424_COMM_MODE_MAC,
-      result, sizeof(result));
-  memcpy(buffer, result, resp_size);
-  return resp_size;
+  uint8_t result[ntag424_response_size(NTAG424_APDU_READSIG,
+                                       ntag424_CommMode::Full)];
+  uint8_t resp_size = Adafruit_PN532::ntag424_send(
+      NTAG424_APDU_READSIG,
+      ntag424_Session.authenticated ? ntag424_CommMode::Full
+                                    : ntag424_CommMode::Plain,
+      cmd_header, NULL, 0, result, sizeof(result));
+  if ((resp_size != NTAG424_APDU_READSIG.response_length + 2) ||
+      !ntag424_status_ok(NTAG424_APDU_READSIG, result, resp_size))
+  {
+#ifdef NTAG424DEBUG
+    PN532DEBUGPRINT.println(F("Read_Sig failed."));
+#endif
+    return 0;
+  }
+  memcpy(buffer, result, NTAG424_APDU_READSIG.response_length);
+  return NTAG424_APDU_READSIG.response_length;
 }
 
 /*!
-    @brief   Send ReadData request to picc.
+    @brief   Read the originality signature of the activated card and verify
+   it against the UID. Inside a session the UID is taken from GetCardUID, so
+   cards with random UID work as well; otherwise the UID of the anticollision
+   is used.
 
-    @param   buffer     buffer for the read data
-    @param   fileno     fileno to read
-    @param   offset     offset where to start to read from
-    @param   size       number of bytes to read
+    @param   ctx        originality context, see ntag424_originality_init()
 
-    @return  size of status
+    @return  1 = signature valid; 0 = invalid or reading failed
 */
 /**************************************************************************/
-uint8_t Adafruit_PN532::ntag424_ReadData(uint8_t *buffer, int fileno,
-                                         int offset, int size)
+uint8_t
+Adafruit_PN532::ntag424_VerifyOriginality(const ntag424_OriginalityType *ctx)
 {
-  /*
-  uint8_t cmd[1] = {NTAG424_CMD_READDATA};
-  uint8_t cmd_header[7] = {fileno,  offset & 0xff, (offset >> 8) & 0xff, (offset
-  >> 16) & 0xff, size & 0xff, (size >> 8) & 0xff,  (size >> 16) & 0xff}; uint8_t
-  signature[8]; Adafruit_PN532::ntag424_MAC(cmd, cmd_header, sizeof(cmd_header),
-  cmd_header, 0 , signature);
-  */
-  /* Prepare the command */
-  pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-  pn532_packetbuffer[1] = 1; /* Card number */
-  pn532_packetbuffer[2] = NTAG424_COM_CLA;
-  pn532_packetbuffer[3] = NTAG424_CMD_READDATA;
-  pn532_packetbuffer[4] = 0;
-  pn532_packetbuffer[5] = 0;
-  // Lc
-  pn532_packetbuffer[6] = 0x07;
-  // FileNo
-  pn532_packetbuffer[7] = fileno;
-  // offset
-  pn532_packetbuffer[8] = offset & 0xff;
-  pn532_packetbuffer[9] = (offset >> 8) & 0xff;
-  pn532_packetbuffer[10] = (offset >> 16) & 0xff;
-  // length
-  pn532_packetbuffer[11] = size & 0xff;
-  pn532_packetbuffer[12] = (size >> 8) & 0xff;
-  pn532_packetbuffer[13] = (size >> 16) & 0xff;
-
-  // memcpy(&pn532_packetbuffer + 14, signature, 8);
-
-  // Le
-  // pn532_packetbuffer[14 + 8] = 0;
-  pn532_packetbuffer[14] = 0;
-#ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.println(F("> ReadData - PCD apdu: "));
-  Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 15);
-#endif
+  uint8_t uid[sizeof(ntag424_Selection.uid)];
+  uint8_t uid_length;
+  uint8_t signature[NTAG424_ECC_SIG_SIZE];
 
-  /* Send the command */
-  if (!sendCommandCheckAck(pn532_packetbuffer, 15))
+  if (ntag424_Session.authenticated)
+  {
+    uid_length = ntag424_GetCardUID(uid);
+  }
+  else
+  {
+    uid_length = ntag424_Selection.uid_length;
+    memcpy(uid, ntag424_Selection.uid, uid_length);
+  }
+  if ((uid_length == 0) || (ntag424_ReadSig(signature) != sizeof(signature)))
   {
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Failed to receive ACK for write command"));
-#endif
     return 0;
   }
-
-  /* Read the response packet */
-  readdata(pn532_packetbuffer, 17 + size);
+  uint8_t valid = ntag424_originality_verify(ctx, uid, uid_length, signature);
 #ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.println(F("Received: "));
-  Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 80);
-#endif
-  uint8_t datasize = pn532_packetbuffer[12];
-  uint8_t offsetPW = 8 + size;
-  /* If byte 8 isn't 0x00 we probably have an error */
-  if ((pn532_packetbuffer[7] == 0x00) &&
-      (pn532_packetbuffer[offsetPW] == 0x91) &&
-      (pn532_packetbuffer[offsetPW + 1] == 0x00))
+  if (!valid)
   {
-#ifdef NTAG424DEBUG
-    Adafruit_PN532::PrintHexChar(pn532_packetbuffer + 17, datasize);
-    Adafruit_PN532::PrintHexChar(pn532_packetbuffer + offsetPW, 1);
-    Adafruit_PN532::PrintHexChar(pn532_packetbuffer + offsetPW + 1, 1);
-    Serial.println(datasize);
-#endif
-    memcpy(buffer, pn532_packetbuffer + 17, datasize);
+    PN532DEBUGPRINT.println(F("Originality signature invalid."));
   }
-  else
-  {
+#endif
+  return valid;
+}
+
+/*!
+    @brief   Send ReadData requests to picc. The read is split into commands
+   whose responses fit into one frame of the workspace, each one secured with
+   comm_mode.
+
+    @param   buffer     buffer for the read data (size byte)
+    @param   fileno     fileno to read
+    @param   offset     offset where to start to read from
+    @param   size       number of bytes to read (> 0)
+    @param   comm_mode  comm mode of the file settings, the same enum as
+   ntag424_WriteData()
+
+    @return  number of bytes read, 0 = failed
+*/
+/**************************************************************************/
+uint16_t Adafruit_PN532::ntag424_ReadData(uint8_t *buffer, int fileno,
+                                          int offset, int size,
+                                          ntag424_CommMode comm_mode)
+{
+  // response frame: preamble(8) + data + MAC/padding + SW(2) + postamble(2)
+  uint8_t chunksize =
+      ntag424_chunk_size(comm_mode, NTAG424_FRAME_MAXSIZE - 10 - 2);
+  int bytesread = 0;
+  while (bytesread < size)
+  {
+    uint8_t length = chunksize;
+    if (size - bytesread < length)
+    {
+      length = size - bytesread;
+    }
+    int position = offset + bytesread;
+    uint8_t cmd_header[7] = {(uint8_t)fileno,
+                             (uint8_t)(position & 0xff),
+                             (uint8_t)((position >> 8) & 0xff),
+                             (uint8_t)((position >> 16) & 0xff),
+                             length,
+                             0x00,
+                             0x00};
+    ntag424_BufferType chunk = {buffer + bytesread, length, 0};
+    ntag424_SinkType sink = {ntag424_buffer_write, &chunk};
+    uint16_t sw = Adafruit_PN532::ntag424_send(
+        NTAG424_APDU_READDATA, comm_mode, cmd_header, NULL, 0, sink);
+    if ((sw != ((NTAG424_APDU_READDATA.sw1 << 8) | NTAG424_APDU_READDATA.sw2)) ||
+        (chunk.length != length))
+    {
 #ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Unexpected response reading block: "));
-    Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 26);
+      PN532DEBUGPRINT.print(F("ReadData failed at offset "));
+      PN532DEBUGPRINT.println(position);
 #endif
-    return 0;
+      return 0;
+    }
+    bytesread += length;
   }
-  // Return OK signal
-  return datasize;
+  return bytesread;
 }
 
 /**
- * @brief   Send WriteData request to PICC, with MAC signature
+ * @brief   Send WriteData requests to PICC. The write is split into commands
+ * which fit into one frame of the workspace, each one secured with comm_mode
+ * and counted by the command counter on its own.
  *
  * @param   data       buffer of bytes to write
  * @param   fileno     file number (0x01: CC, 0x02: NDEF, 0x03: Proprietary)
  * @param   offset     offset to start writing at (in bytes)
  * @param   size       number of bytes to write
- * @param   keyNo      AppKey number (0-4) to authorize the write
+ * @param   comm_mode  comm mode of the file settings. Takes the enum, not
+ * a uint8_t, so calls that still pass the former keyNo argument no longer
+ * compile.
  *
- * @return  size of status (bytes returned), or 0 on error
+ * @return  number of bytes written, < size if a chunk failed
  */
-uint8_t Adafruit_PN532::ntag424_WriteData(const uint8_t *data,
-                                          int fileno,
-                                          int offset,
-                                          int size,
-                                          uint8_t keyNo)
-{
-  // 1. Build command header (FileNo + Offset[3] + Length[3])
-  uint8_t cmd_header[7] = {
-      (uint8_t)fileno,
-      (uint8_t)(offset & 0xFF),
-      (uint8_t)((offset >> 8) & 0xFF),
-      (uint8_t)((offset >> 16) & 0xFF),
-      (uint8_t)(size & 0xFF),
-      (uint8_t)((size >> 8) & 0xFF),
-      (uint8_t)((size >> 16) & 0xFF)};
-
-  // 2. Prepare key and command for MAC
-  uint8_t key_buf[1] = {keyNo};
-  uint8_t mac_cmd[1] = {NTAG424_CMD_WRITEDATA};
-  uint8_t signature[8];
-
-  // 3. Calculate MAC signature over header + payload
-  ntag424_MAC(key_buf,
-              mac_cmd,
-              cmd_header, sizeof(cmd_header),
-              (uint8_t *)data, size,
-              signature);
-
-  // 4. Prepare full APDU in PN532 packet buffer
-  // Lc = header (7) + payload (size) + signature (8)
-  uint8_t Lc = 7 + size + 8;
-
-  pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-  pn532_packetbuffer[1] = 1; // target card #
-  pn532_packetbuffer[2] = NTAG424_COM_CLA;
-  pn532_packetbuffer[3] = NTAG424_CMD_WRITEDATA;
-  pn532_packetbuffer[4] = 0x00; // P1
-  pn532_packetbuffer[5] = 0x00; // P2
-  pn532_packetbuffer[6] = Lc;   // Lc byte count
-
-  // 5. Copy header, payload, and signature
-  memcpy(pn532_packetbuffer + 7, cmd_header, 7);
-  memcpy(pn532_packetbuffer + 14, data, size);
-  memcpy(pn532_packetbuffer + 14 + size, signature, 8);
-
-  // 6. Le = 0 (expect status only)
-  pn532_packetbuffer[7 + Lc] = 0x00;
-#ifdef NTAG424DEBUG
-  Serial.println(F("> WriteData - PCD APDU:"));
-  PrintHexChar(pn532_packetbuffer, 8 + Lc);
-#endif
-
-  // 7. Send and ACK
-  if (!sendCommandCheckAck(pn532_packetbuffer, 8 + Lc))
-  {
-#ifdef NTAG424DEBUG
-    Serial.println(F("WriteData: no ACK"));
-#endif
-    return 0;
-  }
-
-  // 8. Read response (status APDU)
-  // Response length = header(8) + status bytes(2)
-  uint8_t response_len = 8 + 2;
-  readdata(pn532_packetbuffer, response_len);
-
-  // 9. Check SW1/SW2 at end of packet
-  uint8_t sw1 = pn532_packetbuffer[response_len - 2];
-  uint8_t sw2 = pn532_packetbuffer[response_len - 1];
+uint16_t Adafruit_PN532::ntag424_WriteData(const uint8_t *data, int fileno,
+                                           int offset, int size,
+                                           ntag424_CommMode comm_mode)
+{
+  // command frame: apdu header + command header + data/MAC/padding + Le
+  uint8_t chunksize = ntag424_chunk_size(
+      comm_mode, NTAG424_FRAME_MAXSIZE - NTAG424_APDU_HEADERSIZE -
+                     NTAG424_APDU_WRITEDATA.header_length - 1);
+  uint8_t result[ntag424_response_size(NTAG424_APDU_WRITEDATA,
+                                       ntag424_CommMode::Full)];
+  int byteswritten = 0;
+  while (byteswritten < size)
+  {
+    uint8_t length = chunksize;
+    if (size - byteswritten < length)
+    {
+      length = size - byteswritten;
+    }
+    int position = offset + byteswritten;
+    uint8_t cmd_header[7] = {(uint8_t)fileno,
+                             (uint8_t)(position & 0xff),
+                             (uint8_t)((position >> 8) & 0xff),
+                             (uint8_t)((position >> 16) & 0xff),
+                             length,
+                             0x00,
+                             0x00};
+    uint8_t resp_size = Adafruit_PN532::ntag424_send(
+        NTAG424_APDU_WRITEDATA, comm_mode, cmd_header,
+        (uint8_t *)data + byteswritten, length, result, sizeof(result));
+    if (!ntag424_status_ok(NTAG424_APDU_WRITEDATA, result, resp_size))
+    {
 #ifdef NTAG424DEBUG
-  Serial.print(F("SW1: "));
-  Serial.println(sw1, HEX);
-  Serial.print(F("SW2: "));
-  Serial.println(sw2, HEX);
+      PN532DEBUGPRINT.print(F("WriteData failed at offset "));
+      PN532DEBUGPRINT.println(position);
 #endif
-
-  // 0x91 0x00 indicates success
-  if (sw1 == 0x91 && sw2 == 0x00)
-  {
-    return 2; // return status length
+      break;
+    }
+    byteswritten += length;
   }
-  return 0;
+  return byteswritten;
 }
 
 /*!
@@ -2897,110 +4347,46 @@ uint8_t Adafruit_PN532::ntag424_isNTAG424()
 /**************************************************************************/
 uint8_t Adafruit_PN532::ntag424_GetVersion()
 {
-  /* Prepare the command */
-  pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-  pn532_packetbuffer[1] = 1; /* Card number */
-  pn532_packetbuffer[2] = NTAG424_COM_CLA;
-  pn532_packetbuffer[3] = NTAG424_CMD_GETVERSION;
-  pn532_packetbuffer[4] = 0x0;
-  pn532_packetbuffer[5] = 0x0;
-  pn532_packetbuffer[6] = 0x0;
-
-  /* Send the command */
-  if (!sendCommandCheckAck(pn532_packetbuffer, 7))
-  {
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Failed to receive ACK for write command"));
-#endif
-    return 0;
-  }
-  readdata(pn532_packetbuffer, 15);
-  ntag424_VersionInfo.VendorID = pn532_packetbuffer[8];
-  ntag424_VersionInfo.HWType = pn532_packetbuffer[9];
-  ntag424_VersionInfo.HWSubType = pn532_packetbuffer[10];
-  ntag424_VersionInfo.HWMajorVersion = pn532_packetbuffer[11];
-  ntag424_VersionInfo.HWMinorVersion = pn532_packetbuffer[12];
-  ntag424_VersionInfo.HWStorageSize = pn532_packetbuffer[13];
-  ntag424_VersionInfo.HWProtocol = pn532_packetbuffer[14];
-
-  if (!pn532_packetbuffer[14] == 0xaf)
-  {
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Missing additional frame request 1."));
-#endif
-    return 0;
-  }
-  pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-  pn532_packetbuffer[1] = 1; /* Card number */
-  pn532_packetbuffer[2] = NTAG424_COM_CLA;
-  pn532_packetbuffer[3] = NTAG424_CMD_NEXTFRAME;
-  pn532_packetbuffer[4] = 0x0;
-  pn532_packetbuffer[5] = 0x0;
-  pn532_packetbuffer[6] = 0x0;
-  /* Send the command */
-  if (!sendCommandCheckAck(pn532_packetbuffer, 7))
-  {
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Failed to receive ACK for write command"));
-#endif
-    return 0;
-  }
-  readdata(pn532_packetbuffer, 15);
-  ntag424_VersionInfo.VendorID = pn532_packetbuffer[8];
-  ntag424_VersionInfo.SWType = pn532_packetbuffer[9];
-  ntag424_VersionInfo.SWSubType = pn532_packetbuffer[10];
-  ntag424_VersionInfo.SWMajorVersion = pn532_packetbuffer[11];
-  ntag424_VersionInfo.SWMinorVersion = pn532_packetbuffer[12];
-  ntag424_VersionInfo.SWStorageSize = pn532_packetbuffer[13];
-  ntag424_VersionInfo.SWProtocol = pn532_packetbuffer[14];
-
-  if (!pn532_packetbuffer[14] == 0xaf)
-  {
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Missing additional frame request 2."));
-#endif
-    return 0;
-  }
-  pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-  pn532_packetbuffer[1] = 1; /* Card number */
-  pn532_packetbuffer[2] = NTAG424_COM_CLA;
-  pn532_packetbuffer[3] = NTAG424_CMD_NEXTFRAME;
-  pn532_packetbuffer[4] = 0x0;
-  pn532_packetbuffer[5] = 0x0;
-  pn532_packetbuffer[6] = 0x0;
-  /* Send the command */
-  if (!sendCommandCheckAck(pn532_packetbuffer, 7))
+  // hardware (7) || software (7) || production (14, FabKeyID optional),
+  // ntag424_send() collects the three frames
+  uint8_t result[ntag424_response_size(NTAG424_APDU_GETVERSION)];
+  uint8_t resp_size =
+      Adafruit_PN532::ntag424_send<NTAG424_APDU_GETVERSION.comm_mode>(
+          NTAG424_APDU_GETVERSION, NULL, NULL, 0, result, sizeof(result));
+  if ((resp_size < 7 + 7 + 14 + 2) ||
+      !ntag424_status_ok(NTAG424_APDU_GETVERSION, result, resp_size))
   {
 #ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Failed to receive ACK for write command"));
+    PN532DEBUGPRINT.println(F("GetVersion failed."));
 #endif
     return 0;
   }
-  readdata(pn532_packetbuffer, 15);
-  memcpy(&ntag424_VersionInfo.UID, (uint8_t *)pn532_packetbuffer + 8, 7);
-  uint8_t BatchNo[5] = {pn532_packetbuffer[15], pn532_packetbuffer[16],
-                        pn532_packetbuffer[17], pn532_packetbuffer[18],
-                        (byte)(pn532_packetbuffer[19] & 0xf0)};
-  memcpy(&ntag424_VersionInfo.BatchNo, BatchNo, 5);
-  uint8_t FabKey[5] = {(byte)(pn532_packetbuffer[19] & 0x0f),
-                       pn532_packetbuffer[20],
-                       (byte)(pn532_packetbuffer[21] & 0x80)};
-  memcpy(&ntag424_VersionInfo.FabKey, FabKey, 5);
-  ntag424_VersionInfo.CWProd = (byte)(pn532_packetbuffer[21] & 0x3f);
-  ntag424_VersionInfo.YearProd = pn532_packetbuffer[22];
-  if (pn532_packetbuffer[23] != 0x91)
-  {
-    ntag424_VersionInfo.FabKeyID = pn532_packetbuffer[23];
-  }
-  else
-  {
-    ntag424_VersionInfo.FabKeyID = 0;
-  }
+  ntag424_VersionInfo.VendorID = result[0];
+  ntag424_VersionInfo.HWType = result[1];
+  ntag424_VersionInfo.HWSubType = result[2];
+  ntag424_VersionInfo.HWMajorVersion = result[3];
+  ntag424_VersionInfo.HWMinorVersion = result[4];
+  ntag424_VersionInfo.HWStorageSize = result[5];
+  ntag424_VersionInfo.HWProtocol = result[6];
+  ntag424_VersionInfo.SWType = result[8];
+  ntag424_VersionInfo.SWSubType = result[9];
+  ntag424_VersionInfo.SWMajorVersion = result[10];
+  ntag424_VersionInfo.SWMinorVersion = result[11];
+  ntag424_VersionInfo.SWStorageSize = result[12];
+  ntag424_VersionInfo.SWProtocol = result[13];
+  memcpy(&ntag424_VersionInfo.UID, result + 14, 7);
+  memcpy(&ntag424_VersionInfo.BatchNo, result + 21, 4);
+  ntag424_VersionInfo.BatchNo[4] = result[25] & 0xf0;
+  ntag424_VersionInfo.FabKey[0] = result[25] & 0x0f;
+  ntag424_VersionInfo.FabKey[1] = result[26] & 0x80;
+  ntag424_VersionInfo.CWProd = result[26] & 0x7f;
+  ntag424_VersionInfo.YearProd = result[27];
+  ntag424_VersionInfo.FabKeyID = (resp_size > 7 + 7 + 14 + 2) ? result[28] : 0;
 #ifdef NTAG424DEBUG
-  Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 18);
+  Adafruit_PN532::PrintHexChar(result, resp_size);
 #endif
 
-  if (pn532_packetbuffer[9] == NTAG424_RESPONE_GETVERSION_HWTYPE_NTAG424)
+  if (ntag424_VersionInfo.HWType == NTAG424_RESPONE_GETVERSION_HWTYPE_NTAG424)
   {
     return 1;
   }
@@ -3015,16 +4401,11 @@ uint8_t Adafruit_PN532::ntag424_GetVersion()
 /**************************************************************************/
 bool Adafruit_PN532::ntag424_FormatNDEF()
 {
-  uint8_t cmac_short[8];
-  uint8_t cla[1] = {NTAG424_COM_ISOCLA};
-  uint8_t ins[1] = {NTAG424_CMD_ISOUPDATEBINARY};
-  uint8_t p1[1] = {0x84};
-  uint8_t p2[1] = {0x0};
-  uint8_t cmd_header[1] = {0x00};
+  ntag424_CommandType cmd = NTAG424_APDU_ISOUPDATEBINARY;
   uint8_t ndefdata[PN532_PACKBUFFSIZ - 10];
   uint8_t memsize = 248;
   memset(ndefdata, 0, sizeof(ndefdata));
-  uint8_t result[12];
+  uint8_t result[ntag424_response_size(NTAG424_APDU_ISOUPDATEBINARY)];
   bool ret = true;
   uint8_t offset = 0;
   uint8_t datalen = sizeof(ndefdata);
@@ -3033,17 +4414,14 @@ bool Adafruit_PN532::ntag424_FormatNDEF()
     Serial.print(i);
     Serial.print(": ");
     Serial.println(offset);
-    p2[0] = offset;
+    cmd.p2 = offset;
     if ((offset + datalen) > memsize)
     {
       datalen = memsize - offset;
     }
-    uint8_t bytesread = Adafruit_PN532::ntag424_apdu_send(
-        cla, ins, p1, p2, cmd_header, 0, ndefdata, datalen, 0,
-        NTAG424_COMM_MODE_PLAIN, result, sizeof(result)
-
-    );
-    if ((result[0] != 0x90) || (result[1] != 0x00))
+    uint8_t bytesread = Adafruit_PN532::ntag424_send<ntag424_CommMode::Plain>(
+        cmd, NULL, ndefdata, datalen, result, sizeof(result));
+    if (!ntag424_status_ok(cmd, result, bytesread))
     {
       ret = false;
     }
@@ -3066,14 +4444,9 @@ bool Adafruit_PN532::ntag424_FormatNDEF()
 bool Adafruit_PN532::ntag424_ISOUpdateBinary(uint8_t *data_to_write,
                                              uint8_t length)
 {
-  uint8_t cmac_short[8];
-  uint8_t cla[1] = {NTAG424_COM_ISOCLA};
-  uint8_t ins[1] = {NTAG424_CMD_ISOUPDATEBINARY};
-  uint8_t p1[1] = {0x84};
-  uint8_t p2[1] = {0x0};
-  uint8_t cmd_header[1] = {0x00};
-  uint8_t cmd_data[1] = {0x00};
-  uint8_t result[12];
+  ntag424_CommandType cmd = NTAG424_APDU_ISOUPDATEBINARY;
+  uint8_t result[ntag424_response_size(NTAG424_APDU_ISOUPDATEBINARY)];
+  uint8_t bytesread = 0;
 
   uint8_t offset = 0;
   uint8_t datalen = PN532_PACKBUFFSIZ - 10;
@@ -3082,26 +4455,19 @@ bool Adafruit_PN532::ntag424_ISOUpdateBinary(uint8_t *data_to_write,
     Serial.print(i);
     Serial.print(": ");
     Serial.println(offset);
-    p2[0] = offset;
+    cmd.p2 = offset;
     if ((offset + datalen) > length)
     {
       datalen = length - offset;
     }
     if (datalen > 0)
     {
-      uint8_t bytesread = Adafruit_PN532::ntag424_apdu_send(
-          cla, ins, p1, p2, cmd_header, 0, data_to_write + offset, datalen, 0,
-          NTAG424_COMM_MODE_PLAIN, result, sizeof(result)
-
-      );
+      bytesread = Adafruit_PN532::ntag424_send<ntag424_CommMode::Plain>(
+          cmd, NULL, data_to_write + offset, datalen, result, sizeof(result));
     }
     offset += datalen;
   }
-  if ((result[0] != 0x90) || (result[1] != 0x00))
-  {
-    return false;
-  }
-  return true;
+  return ntag424_status_ok(cmd, result, bytesread);
 }
 
 /*!
@@ -3114,27 +4480,35 @@ bool Adafruit_PN532::ntag424_ISOUpdateBinary(uint8_t *data_to_write,
 /**************************************************************************/
 bool Adafruit_PN532::ntag424_ISOSelectFileById(int fileid)
 {
+  if ((ntag424_Selection.target != 0) && (ntag424_Selection.ef == fileid))
+  {
+    // already selected, save the round trip
+    return true;
+  }
   // Select the default ISO-7816-4 name of the application file
   /* Prepare the command */
-  uint8_t cmac_short[8];
-  uint8_t cla[1] = {NTAG424_COM_ISOCLA};
-  uint8_t ins[1] = {NTAG424_CMD_ISOSELECTFILE};
-  uint8_t p1[1] = {0x0};
-  uint8_t p2[1] = {0x0};
-  uint8_t cmd_header[1] = {0x00};
   uint8_t cmd_data[2] = {(byte)((fileid >> 8) & 0xff), (byte)(fileid & 0xff)};
-  uint8_t result[12];
+  uint8_t result[ntag424_response_size(NTAG424_APDU_ISOSELECTFILE_ID)];
 
   /* Send the command */
-  Adafruit_PN532::ntag424_apdu_send(cla, ins, p1, p2, cmd_header, 0, cmd_data,
-                                    2, 0, NTAG424_COMM_MODE_PLAIN, result,
-                                    sizeof(result)
-
-  );
-  if ((result[0] != 0x90) || (result[1] != 0x00))
+  uint8_t resp_size =
+      Adafruit_PN532::ntag424_send<NTAG424_APDU_ISOSELECTFILE_ID.comm_mode>(
+          NTAG424_APDU_ISOSELECTFILE_ID, NULL, cmd_data, 2, result,
+          sizeof(result));
+  if (!ntag424_status_ok(NTAG424_APDU_ISOSELECTFILE_ID, result, resp_size))
   {
+    ntag424_selection_reset(ntag424_Selection.target);
     return false;
   }
+  if ((fileid == NTAG424_ISO_MF_ID) || (fileid == NTAG424_ISO_DF_ID))
+  {
+    // a DF selected by id has no known DF name, select by name next time
+    ntag424_selection_reset(ntag424_Selection.target);
+  }
+  else
+  {
+    ntag424_Selection.ef = fileid;
+  }
   return true;
 }
 
@@ -3149,26 +4523,70 @@ bool Adafruit_PN532::ntag424_ISOSelectFileById(int fileid)
 /**************************************************************************/
 bool Adafruit_PN532::ntag424_ISOSelectFileByDFN(uint8_t *dfn)
 {
+  if ((ntag424_Selection.target != 0) && ntag424_Selection.df_valid &&
+      (memcmp(ntag424_Selection.dfn, dfn, NTAG424_DFN_SIZE) == 0))
+  {
+    // already selected, save the round trip
+    return true;
+  }
   /* Prepare the command */
-  uint8_t cmac_short[8];
-  uint8_t cla[1] = {NTAG424_COM_ISOCLA};
-  uint8_t ins[1] = {NTAG424_CMD_ISOSELECTFILE};
-  uint8_t p1[1] = {0x4};
-  uint8_t p2[1] = {0x0};
-  uint8_t cmd_header[1] = {0x00};
-  uint8_t result[12];
+  uint8_t result[ntag424_response_size(NTAG424_APDU_ISOSELECTFILE_DFN)];
 
   /* Send the command */
-  Adafruit_PN532::ntag424_apdu_send(cla, ins, p1, p2, cmd_header, 0, dfn, 7, 0,
-                                    NTAG424_COMM_MODE_PLAIN, result,
-                                    sizeof(result));
-  if ((result[0] != 0x90) || (result[1] != 0x00))
+  uint8_t resp_size =
+      Adafruit_PN532::ntag424_send<NTAG424_APDU_ISOSELECTFILE_DFN.comm_mode>(
+          NTAG424_APDU_ISOSELECTFILE_DFN, NULL, dfn, NTAG424_DFN_SIZE, result,
+          sizeof(result));
+  // selecting a DF deselects the EF, a failed select leaves it unknown
+  ntag424_selection_reset(ntag424_Selection.target);
+  if (!ntag424_status_ok(NTAG424_APDU_ISOSELECTFILE_DFN, result, resp_size))
   {
     return false;
   }
+  memcpy(ntag424_Selection.dfn, dfn, NTAG424_DFN_SIZE);
+  ntag424_Selection.df_valid = true;
   return true;
 }
 
+/**************************************************************************/
+/*!
+    @brief   forget which files are selected, the next ISOSelectFile is sent
+   to the card. Called on every activation and when the target may have
+   left the field.
+
+    @param   target   Tg of the activated target, 0 = no target
+*/
+/**************************************************************************/
+void Adafruit_PN532::ntag424_selection_reset(uint8_t target)
+{
+  ntag424_Selection.target = target;
+  ntag424_Selection.df_valid = false;
+  ntag424_Selection.ef = NTAG424_SELECTION_NONE;
+  if (target == 0)
+  {
+    ntag424_Selection.uid_length = 0;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   forget the target: end the session, drop the cached ivs, the
+   file selection and the UID. Called on every activation and when the
+   target may have left the field, the next authentication then starts
+   with AuthenticateEV2First.
+
+    @param   target   Tg of the activated target, 0 = no target
+*/
+/**************************************************************************/
+void Adafruit_PN532::ntag424_forget_target(uint8_t target)
+{
+  ntag424_Session.authenticated = false;
+  ntag424_Session.ivcache.valid = 0;
+  ntag424_Session.ivcache.pending = false;
+  ntag424_selection_reset(target);
+  ntag424_Selection.uid_length = 0;
+}
+
 /*!
     @brief   read the default ISO-7816-4 dedicated file / read the tag for
    example ndef-data.
@@ -3185,69 +4603,22 @@ uint8_t Adafruit_PN532::ntag424_ISOReadFile(uint8_t *buffer)
   PN532DEBUGPRINT.println(F("ISOGetFileSettings"));
 #endif
   // call getfilesettings
-  /* Prepare the command */
-  pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-  pn532_packetbuffer[1] = 1; /* Card number */
-  pn532_packetbuffer[2] = NTAG424_COM_CLA;
-  pn532_packetbuffer[3] = NTAG424_CMD_GETFILESETTINGS;
-  pn532_packetbuffer[4] = 0x0;
-  pn532_packetbuffer[5] = 0x0;
-  pn532_packetbuffer[6] = 0x1;
-  pn532_packetbuffer[7] = 0x2;
-  pn532_packetbuffer[8] = 0x0;
-  /* Send the command */
-  if (!sendCommandCheckAck(pn532_packetbuffer, 9))
-  {
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Failed to receive ACK for write command"));
-#endif
-    return 0;
-  }
-  readdata(pn532_packetbuffer, 26);
+  uint8_t response[ntag424_response_size(NTAG424_APDU_ISOREADBINARY)];
+  uint8_t fileno[1] = {0x2};
+  uint8_t resp_size = ntag424_send<ntag424_CommMode::Plain>(
+      NTAG424_APDU_GETFILESETTINGS, fileno, NULL, 0, response,
+      sizeof(response));
 #ifdef NTAG424DEBUG
-  Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 26);
+  Adafruit_PN532::PrintHexChar(response, resp_size);
   PN532DEBUGPRINT.println(F("ISOReadFile"));
   PN532DEBUGPRINT.println(F("ISOSelectFile1"));
 #endif
   // Select the default ISO-7816-4 DF name of the application file
-  /* Prepare the command */
-  pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-  pn532_packetbuffer[1] = 1; /* Card number */
-  pn532_packetbuffer[2] = NTAG424_COM_ISOCLA;
-  pn532_packetbuffer[3] = NTAG424_CMD_ISOSELECTFILE;
-  pn532_packetbuffer[4] = 0x4;
-  pn532_packetbuffer[5] = 0x0;
-  pn532_packetbuffer[6] = 0x7;
-  pn532_packetbuffer[7] = 0xd2;
-  pn532_packetbuffer[8] = 0x76;
-  pn532_packetbuffer[9] = 0x0;
-  pn532_packetbuffer[10] = 0x0;
-  pn532_packetbuffer[11] = 0x85;
-  pn532_packetbuffer[12] = 0x01;
-  pn532_packetbuffer[13] = 0x01;
-  pn532_packetbuffer[14] = 0x0;
-  /* Send the command */
-  if (!sendCommandCheckAck(pn532_packetbuffer, 15))
-  {
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Failed to receive ACK for write command"));
-#endif
-    return 0;
-  }
-
-  /* Read the response packet */
-  readdata(pn532_packetbuffer, 26);
-#ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.println(F("Received: "));
-  Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 26);
-#endif
-
-  /* If byte 8 isn't 0x00 we probably have an error */
-  if (!((pn532_packetbuffer[7] == 0x00) && (pn532_packetbuffer[8] == 0x90)))
+  uint8_t dfn[7] = {0xd2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01};
+  if (!ntag424_ISOSelectFileByDFN(dfn))
   {
 #ifdef NTAG424DEBUG
     PN532DEBUGPRINT.println(F("Error while selecting iso-file 1: "));
-    Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 26);
 #endif
     return 0;
   }
@@ -3255,75 +4626,36 @@ uint8_t Adafruit_PN532::ntag424_ISOReadFile(uint8_t *buffer)
 #ifdef NTAG424DEBUG
   PN532DEBUGPRINT.println(F("ISOSelectFile2"));
 #endif
-  // Select the default ISO-7816-4 DF name of the application file
-  /* Prepare the command */
-  pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-  pn532_packetbuffer[1] = 1; /* Card number */
-  pn532_packetbuffer[2] = NTAG424_COM_ISOCLA;
-  pn532_packetbuffer[3] = NTAG424_CMD_ISOSELECTFILE;
-  pn532_packetbuffer[4] = 0x0;
-  pn532_packetbuffer[5] = 0x0;
-  pn532_packetbuffer[6] = 0x2;
-  pn532_packetbuffer[7] = 0xe1;
-  pn532_packetbuffer[8] = 0x04;
-  pn532_packetbuffer[9] = 0x0;
-  /* Send the command */
-  if (!sendCommandCheckAck(pn532_packetbuffer, 10))
-  {
-#ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Failed to receive ACK for write command"));
-#endif
-    return 0;
-  }
-
-  /* Read the response packet */
-  readdata(pn532_packetbuffer, 26);
-#ifdef NTAG424DEBUG
-  PN532DEBUGPRINT.print("GetFileInfo: ");
-  Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 26);
-#endif
-
-  /* If byte 8 isn't 0x00 we probably have an error */
-  if (!((pn532_packetbuffer[7] == 0x00) && (pn532_packetbuffer[8] == 0x90)))
+  if (!ntag424_ISOSelectFileById(0xe104))
   {
 #ifdef NTAG424DEBUG
     PN532DEBUGPRINT.println(F("Error while selecting iso-file 2"));
-    Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 26);
 #endif
     return 0;
   }
 #ifdef NTAG424DEBUG
   PN532DEBUGPRINT.println(F("ISOReadBinary1 to get the filesize"));
 #endif
-  // Select the default ISO-7816-4 DF name of the application file
-  /* Prepare the command */
-  pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-  pn532_packetbuffer[1] = 1; /* Card number */
-  pn532_packetbuffer[2] = NTAG424_COM_ISOCLA;
-  pn532_packetbuffer[3] = NTAG424_CMD_ISOREADBINARY;
-  pn532_packetbuffer[4] = 0x0;
-  pn532_packetbuffer[5] = 0x0;
-  pn532_packetbuffer[6] = 0x3;
-
-  /* Send the command */
-  if (!sendCommandCheckAck(pn532_packetbuffer, 7))
+  ntag424_CommandType readbinary = NTAG424_APDU_ISOREADBINARY;
+  readbinary.le = 0x3;
+  resp_size = ntag424_send<NTAG424_APDU_ISOREADBINARY.comm_mode>(
+      readbinary, NULL, NULL, 0, response, sizeof(response));
+  if (resp_size < 2)
   {
 #ifdef NTAG424DEBUG
-    PN532DEBUGPRINT.println(F("Failed to receive ACK for write command"));
+    PN532DEBUGPRINT.println(F("Failed to read the filesize"));
 #endif
     return 0;
   }
-  /* Read the response packet */
-  readdata(pn532_packetbuffer, 26);
-  int filesize = (int)pn532_packetbuffer[9] - 5;
+  int filesize = (int)response[1] - 5;
 
 #ifdef NTAG424DEBUG
   PN532DEBUGPRINT.print("filesize: ");
   PN532DEBUGPRINT.println(filesize);
-  Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 26);
+  Adafruit_PN532::PrintHexChar(response, resp_size);
 #endif
 
-  uint8_t pagesize = 32;
+  uint8_t pagesize = NTAG424_APDU_ISOREADBINARY.response_length;
   uint8_t pages = (filesize / pagesize) + 1;
   uint8_t offset = 0;
 #ifdef NTAG424DEBUG
@@ -3342,38 +4674,18 @@ uint8_t Adafruit_PN532::ntag424_ISOReadFile(uint8_t *buffer)
     PN532DEBUGPRINT.print(F("ISOReadBinary2-"));
     PN532DEBUGPRINT.println(i);
 #endif
-
-    // Select the default ISO-7816-4 DF name of the application file
-    /* Prepare the command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1; /* Card number */
-    pn532_packetbuffer[2] = NTAG424_COM_ISOCLA;
-    pn532_packetbuffer[3] = NTAG424_CMD_ISOREADBINARY;
-    pn532_packetbuffer[4] = 0x0;
-    pn532_packetbuffer[5] = 7 + offset;
-    pn532_packetbuffer[6] = pagesize;
-
-    /* Send the command */
-    if (!sendCommandCheckAck(pn532_packetbuffer, 7))
-    {
-#ifdef NTAG424DEBUG
-      PN532DEBUGPRINT.println(F("Failed to receive ACK for write command"));
-#endif
-      return 0;
-    }
-
-    /* Read the response packet */
-    readdata(pn532_packetbuffer, 64);
+    readbinary.p2 = 7 + offset;
+    readbinary.le = pagesize;
+    resp_size = ntag424_send<NTAG424_APDU_ISOREADBINARY.comm_mode>(
+        readbinary, NULL, NULL, 0, response, sizeof(response));
 #ifdef NTAG424DEBUG
     PN532DEBUGPRINT.println(F("Received: "));
-    Adafruit_PN532::PrintHexChar(pn532_packetbuffer, 64);
+    Adafruit_PN532::PrintHexChar(response, resp_size);
 #endif
-    /* If byte 8 isn't 0x00 we probably have an error */
-    if (pn532_packetbuffer[7] == 0x00)
+    if (resp_size >= pagesize)
     {
       /* Copy the the data bytes to the output buffer         */
-      /* Block content starts at byte 9 of a valid response */
-      memcpy(&buffer[offset], pn532_packetbuffer + 8, pagesize);
+      memcpy(&buffer[offset], response, pagesize);
     }
     else
     {
@@ -3713,6 +5025,12 @@ bool Adafruit_PN532::waitready(uint16_t timeout)
   uint16_t timer = 0;
   while (!isready())
   {
+    // the picc is busy, precompute the ivs of a pending FULL mode command
+    // or top up the random pool
+    if (!ntag424_precompute_iv())
+    {
+      ntag424_rng_refill(&ntag424_RNG);
+    }
     if (timeout != 0)
     {
       timer += 10;
@@ -19,7 +19,15 @@
 #include <Adafruit_SPIDevice.h>
 #include "mbedtls/aes.h"
 #include "mbedtlscmac.h"
-#include <Arduino_CRC32.h>
+#include "ntag424_cmac.h"
+#include "ntag424_crc32.h"
+#include "ntag424_crypto.h"
+#include "ntag424_diversify.h"
+#include "ntag424_filesettings.h"
+#include "ntag424_keystore.h"
+#include "ntag424_lrp.h"
+#include "ntag424_originality.h"
+#include "ntag424_rng.h"
 
 #define PN532_PREAMBLE (0x00)   ///< Command sequence start, byte 1/3
 #define PN532_STARTCODE1 (0x00) ///< Command sequence start, byte 2/3
@@ -96,6 +104,18 @@
 #define NTAG424_CMD_WRITEDATA (0x8D)          ///< Writedata
 #define NTAG424_CMD_GETVERSION (0x60)         ///< GetVersion
 #define NTAG424_CMD_NEXTFRAME (0xAF)          ///< Nextframe
+#define NTAG424_CMD_GETKEYVERSION (0x64)      ///< GetKeyVersion
+
+/**
+ * @brief Communication mode of a NTAG424 command, as template argument of
+ * Adafruit_PN532::ntag424_send().
+ */
+enum class ntag424_CommMode : uint8_t
+{
+  Plain = NTAG424_COMM_MODE_PLAIN, ///< no secure messaging
+  Mac = NTAG424_COMM_MODE_MAC,     ///< MAC'd command and response
+  Full = NTAG424_COMM_MODE_FULL    ///< encrypted and MAC'd data
+};
 
 #define NTAG424_RESPONE_GETVERSION_HWTYPE_NTAG424 \
   (0x04) ///< Response value HWType NTAG 424
@@ -104,6 +124,169 @@
 #define NTAG424_CMD_ISOSELECTFILE (0xA4)   ///< ISOSelectFile
 #define NTAG424_CMD_ISOREADBINARY (0xB0)   ///< ISOReadBinary
 #define NTAG424_CMD_ISOUPDATEBINARY (0xD6) ///< ISOUpdateBinary
+#define NTAG424_CMD_AUTHENTICATEEV2FIRST (0x71)    ///< AuthenticateEV2First
+#define NTAG424_CMD_AUTHENTICATEEV2NONFIRST (0x77) ///< AuthenticateEV2NonFirst
+#define NTAG424_CMD_AUTHENTICATELRPFIRST (0x71)    ///< AuthenticateLRPFirst
+#define NTAG424_AUTH_PCDCAP2_LRP (0x02) ///< PCDcap2.1: request LRP mode
+#define NTAG424_AUTH_MODE_LRP (0x01)    ///< AuthMode of an LRP part 1 answer
+#define NTAG424_ISO_MF_ID (0x3F00) ///< ISO file id of the PICC level (MF)
+#define NTAG424_ISO_DF_ID (0xE110) ///< ISO file id of the NDEF application
+
+/**
+ * @brief Constant part of a NTAG424 apdu. ntag424_send() encodes every
+ * command from one of the descriptors below, so the frame prefixes live in
+ * flash instead of being rebuilt on the stack.
+ */
+struct ntag424_CommandType
+{
+  uint8_t cla;                ///< CLA
+  uint8_t ins;                ///< INS
+  uint8_t p1;                 ///< P1
+  uint8_t p2;                 ///< P2
+  uint8_t header_length;      ///< length of the command header
+  ntag424_CommMode comm_mode; ///< default communication mode
+  uint8_t le;                 ///< Le
+  bool has_le;                ///< false = apdu is sent without Le
+  uint8_t response_length;    ///< (max) response data length w/o MAC and SW
+  uint8_t sw1;                ///< status word 1 on success
+  uint8_t sw2;                ///< status word 2 on success
+};
+
+// NTAG424 command descriptors
+// clang-format off
+constexpr ntag424_CommandType NTAG424_APDU_ISOSELECTFILE_DFN = {
+    NTAG424_COM_ISOCLA, NTAG424_CMD_ISOSELECTFILE, 0x04, 0x00, 0,
+    ntag424_CommMode::Plain, 0x00, true, 0, 0x90, 0x00}; ///< select by DF name
+constexpr ntag424_CommandType NTAG424_APDU_ISOSELECTFILE_ID = {
+    NTAG424_COM_ISOCLA, NTAG424_CMD_ISOSELECTFILE, 0x00, 0x00, 0,
+    ntag424_CommMode::Plain, 0x00, true, 0, 0x90, 0x00}; ///< select by fileid
+constexpr ntag424_CommandType NTAG424_APDU_ISOREADBINARY = {
+    NTAG424_COM_ISOCLA, NTAG424_CMD_ISOREADBINARY, 0x00, 0x00, 0,
+    ntag424_CommMode::Plain, 0x00, true, 32, 0x90, 0x00}; ///< ISOReadBinary
+constexpr ntag424_CommandType NTAG424_APDU_ISOUPDATEBINARY = {
+    NTAG424_COM_ISOCLA, NTAG424_CMD_ISOUPDATEBINARY, 0x84, 0x00, 0,
+    ntag424_CommMode::Plain, 0x00, false, 0, 0x90, 0x00}; ///< ISOUpdateBinary
+constexpr ntag424_CommandType NTAG424_APDU_AUTHENTICATE_PART1 = {
+    NTAG424_COM_CLA, NTAG424_CMD_AUTHENTICATEEV2FIRST, 0x00, 0x00, 0,
+    ntag424_CommMode::Plain, 0x00, true, 16, 0x91, 0xAF}; ///< Auth part 1
+constexpr ntag424_CommandType NTAG424_APDU_AUTHENTICATE_PART2 = {
+    NTAG424_COM_CLA, NTAG424_CMD_NEXTFRAME, 0x00, 0x00, 0,
+    ntag424_CommMode::Plain, 0x00, true, 32, 0x91, 0x00}; ///< Auth part 2
+constexpr ntag424_CommandType NTAG424_APDU_AUTHENTICATELRP_PART1 = {
+    NTAG424_COM_CLA, NTAG424_CMD_AUTHENTICATELRPFIRST, 0x00, 0x00, 0,
+    ntag424_CommMode::Plain, 0x00, true, 17, 0x91, 0xAF}; ///< LRP part 1
+constexpr ntag424_CommandType NTAG424_APDU_AUTHENTICATE_NONFIRST_PART2 = {
+    NTAG424_COM_CLA, NTAG424_CMD_NEXTFRAME, 0x00, 0x00, 0,
+    ntag424_CommMode::Plain, 0x00, true, 16, 0x91, 0x00}; ///< NonFirst part 2
+constexpr ntag424_CommandType NTAG424_APDU_NEXTFRAME = {
+    NTAG424_COM_CLA, NTAG424_CMD_NEXTFRAME, 0x00, 0x00, 0,
+    ntag424_CommMode::Plain, 0x00, true, 0, 0x91, 0x00}; ///< AdditionalFrame
+constexpr ntag424_CommandType NTAG424_APDU_GETVERSION = {
+    NTAG424_COM_CLA, NTAG424_CMD_GETVERSION, 0x00, 0x00, 0,
+    ntag424_CommMode::Plain, 0x00, true, 29, 0x91, 0x00}; ///< GetVersion
+constexpr ntag424_CommandType NTAG424_APDU_GETCARDUID = {
+    NTAG424_COM_CLA, NTAG424_CMD_GETCARDUUID, 0x00, 0x00, 0,
+    ntag424_CommMode::Full, 0x00, true, 7, 0x91, 0x00}; ///< GetCardUID
+constexpr ntag424_CommandType NTAG424_APDU_GETTTSTATUS = {
+    NTAG424_COM_CLA, NTAG424_CMD_GETTTSTATUS, 0x00, 0x00, 0,
+    ntag424_CommMode::Full, 0x00, true, 2, 0x91, 0x00}; ///< GetTTStatus
+constexpr ntag424_CommandType NTAG424_APDU_READSIG = {
+    NTAG424_COM_CLA, NTAG424_CMD_READSIG, 0x00, 0x00, 1,
+    ntag424_CommMode::Plain, 0x00, true, 56, 0x91, 0x00}; ///< Read_Sig
+constexpr ntag424_CommandType NTAG424_APDU_GETFILESETTINGS = {
+    NTAG424_COM_CLA, NTAG424_CMD_GETFILESETTINGS, 0x00, 0x00, 1,
+    ntag424_CommMode::Mac, 0x00, true, 32, 0x91, 0x00}; ///< GetFileSettings
+constexpr ntag424_CommandType NTAG424_APDU_CHANGEFILESETTINGS = {
+    NTAG424_COM_CLA, NTAG424_CMD_CHANGEFILESETTINGS, 0x00, 0x00, 1,
+    ntag424_CommMode::Full, 0x00, true, 0, 0x91, 0x00}; ///< ChangeFileSettings
+constexpr ntag424_CommandType NTAG424_APDU_GETKEYVERSION = {
+    NTAG424_COM_CLA, NTAG424_CMD_GETKEYVERSION, 0x00, 0x00, 1,
+    ntag424_CommMode::Mac, 0x00, true, 1, 0x91, 0x00}; ///< GetKeyVersion
+constexpr ntag424_CommandType NTAG424_APDU_CHANGEKEY = {
+    NTAG424_COM_CLA, NTAG424_COM_CHANGEKEY, 0x00, 0x00, 1,
+    ntag424_CommMode::Full, 0x00, true, 0, 0x91, 0x00}; ///< ChangeKey
+constexpr ntag424_CommandType NTAG424_APDU_READDATA = {
+    NTAG424_COM_CLA, NTAG424_CMD_READDATA, 0x00, 0x00, 7,
+    ntag424_CommMode::Plain, 0x00, true, 0, 0x91, 0x00}; ///< ReadData
+constexpr ntag424_CommandType NTAG424_APDU_WRITEDATA = {
+    NTAG424_COM_CLA, NTAG424_CMD_WRITEDATA, 0x00, 0x00, 7,
+    ntag424_CommMode::Plain, 0x00, true, 0, 0x91, 0x00}; ///< WriteData
+// clang-format on
+
+/**
+ * @brief Exact response buffer size for a command descriptor in mode:
+ * data (padded to 16 byte in FULL mode) + MAC + SW1 SW2.
+ */
+constexpr uint8_t ntag424_response_size(const ntag424_CommandType &cmd,
+                                        ntag424_CommMode mode)
+{
+  return (mode == ntag424_CommMode::Full)
+             ? ((cmd.response_length == 0)
+                    ? 8 + 2
+                    : (cmd.response_length / 16 + 1) * 16 + 8 + 2)
+         : (mode == ntag424_CommMode::Mac) ? cmd.response_length + 8 + 2
+                                           : cmd.response_length + 2;
+}
+
+/**
+ * @brief Exact response buffer size for a command in its default mode.
+ */
+constexpr uint8_t ntag424_response_size(const ntag424_CommandType &cmd)
+{
+  return ntag424_response_size(cmd, cmd.comm_mode);
+}
+
+/**
+ * @brief Receives the response data of a command chunk by chunk, while
+ * ntag424_send() follows the additional frames. The data is passed on
+ * before the MAC of the whole response is checked, discard it if
+ * ntag424_send() fails.
+ *
+ * @return false to abort the command
+ */
+typedef bool (*ntag424_SinkFunction)(void *context, const uint8_t *data,
+                                     uint8_t length);
+
+/**
+ * @brief Response data consumer of ntag424_send().
+ */
+struct ntag424_SinkType
+{
+  ntag424_SinkFunction write; ///< called for every chunk of response data
+  void *context;              ///< first argument of write
+};
+
+/**
+ * @brief Context of ntag424_buffer_write(): collects the response in a
+ * caller buffer.
+ */
+struct ntag424_BufferType
+{
+  uint8_t *data;   ///< caller buffer
+  uint16_t size;   ///< size of the caller buffer
+  uint16_t length; ///< bytes written so far
+};
+
+bool ntag424_buffer_write(void *context, const uint8_t *data, uint8_t length);
+
+#define NTAG424_RESPONSE_UNLIMITED \
+  (0xFFFF) ///< no limit for the response length, the sink decides
+
+/**
+ * @brief One key Adafruit_PN532::ntag424_AuthenticateAny() may try. The
+ * caller keeps the list, hits is the learned statistics and should live as
+ * long as the list.
+ */
+struct ntag424_KeyCandidateType
+{
+  uint8_t *key;  ///< 16 byte aes key
+  uint8_t keyno; ///< key number (0-4)
+  uint16_t hits; ///< successful authentications, updated by the driver
+};
+
+#define NTAG424_KEYTRIAL_MAX 8    ///< Max number of candidates per trial
+#define NTAG424_KEYHINT_SIZE 8    ///< Number of remembered UID prefixes
+#define NTAG424_KEYHINT_PREFIX 3  ///< UID bytes that identify a batch
 
 // Mifare Commands
 #define MIFARE_CMD_AUTH_A (0x60)           ///< Auth A
@@ -168,12 +351,18 @@
 class Adafruit_PN532
 {
 public:
-  Adafruit_PN532(uint8_t clk, uint8_t miso, uint8_t mosi,
-                 uint8_t ss);                          // Software SPI
-  Adafruit_PN532(uint8_t ss, SPIClass *theSPI = &SPI); // Hardware SPI
-  Adafruit_PN532(uint8_t irq, uint8_t reset,
-                 TwoWire *theWire = &Wire);              // Hardware I2C
-  Adafruit_PN532(uint8_t reset, HardwareSerial *theSer); // Hardware UART
+  Adafruit_PN532(uint8_t clk, uint8_t miso, uint8_t mosi, uint8_t ss,
+                 const ntag424_CryptoProviderType *crypto =
+                     NULL); // Software SPI
+  Adafruit_PN532(uint8_t ss, SPIClass *theSPI = &SPI,
+                 const ntag424_CryptoProviderType *crypto =
+                     NULL); // Hardware SPI
+  Adafruit_PN532(uint8_t irq, uint8_t reset, TwoWire *theWire = &Wire,
+                 const ntag424_CryptoProviderType *crypto =
+                     NULL); // Hardware I2C
+  Adafruit_PN532(uint8_t reset, HardwareSerial *theSer,
+                 const ntag424_CryptoProviderType *crypto =
+                     NULL); // Hardware UART
   bool begin(void);
 
   void reset(void);
@@ -224,7 +413,55 @@ public:
                             uint8_t cmd_data_length, uint8_t le,
                             uint8_t comm_mode, uint8_t *response,
                             uint8_t response_le);
-  uint32_t ntag424_crc32(uint8_t *data, uint8_t datalength);
+  uint16_t ntag424_apdu_send(uint8_t *cla, uint8_t *ins, uint8_t *p1,
+                             uint8_t *p2, uint8_t *cmd_header,
+                             uint8_t cmd_header_length, uint8_t *cmd_data,
+                             uint8_t cmd_data_length, uint8_t le,
+                             uint8_t comm_mode, const ntag424_SinkType &sink);
+  template <ntag424_CommMode mode>
+  uint8_t ntag424_send(const ntag424_CommandType &cmd, uint8_t *cmd_header,
+                       uint8_t *cmd_data, uint8_t cmd_data_length,
+                       uint8_t *response, uint8_t response_le);
+  template <ntag424_CommMode mode>
+  uint16_t ntag424_send(const ntag424_CommandType &cmd, uint8_t *cmd_header,
+                        uint8_t *cmd_data, uint8_t cmd_data_length,
+                        const ntag424_SinkType &sink,
+                        uint16_t response_le = NTAG424_RESPONSE_UNLIMITED);
+  uint8_t ntag424_send(const ntag424_CommandType &cmd, ntag424_CommMode mode,
+                       uint8_t *cmd_header, uint8_t *cmd_data,
+                       uint8_t cmd_data_length, uint8_t *response,
+                       uint8_t response_le);
+  uint16_t ntag424_send(const ntag424_CommandType &cmd, ntag424_CommMode mode,
+                        uint8_t *cmd_header, uint8_t *cmd_data,
+                        uint8_t cmd_data_length, const ntag424_SinkType &sink,
+                        uint16_t response_le = NTAG424_RESPONSE_UNLIMITED);
+  bool ntag424_status_ok(const ntag424_CommandType &cmd, uint8_t *response,
+                         uint8_t response_length);
+  uint8_t ntag424_apdu_header(const ntag424_CommandType &cmd,
+                              uint8_t *cmd_header);
+  void ntag424_stream_mac_begin(uint8_t code);
+  template <ntag424_CommMode mode>
+  void ntag424_request_begin(const ntag424_CommandType &cmd,
+                             uint8_t *cmd_header, uint8_t *cmd_data,
+                             uint8_t cmd_data_length);
+  template <ntag424_CommMode mode>
+  uint8_t ntag424_request_update(uint8_t *output, uint8_t room);
+  uint8_t ntag424_request_mac(uint8_t *output, uint8_t room);
+  uint8_t ntag424_chunk_size(ntag424_CommMode mode, uint8_t room);
+  uint8_t ntag424_apdu_exchange(uint8_t apdusize, uint16_t response_le);
+  template <ntag424_CommMode mode> void ntag424_response_begin();
+  template <ntag424_CommMode mode>
+  bool ntag424_response_update(const uint8_t *data, uint8_t length,
+                               const ntag424_SinkType &sink);
+  template <ntag424_CommMode mode>
+  bool ntag424_response_data(const uint8_t *data, uint8_t length,
+                             const ntag424_SinkType &sink);
+  bool ntag424_response_plain(const uint8_t *data, uint8_t length,
+                              const ntag424_SinkType &sink);
+  template <ntag424_CommMode mode>
+  bool ntag424_response_finish(const ntag424_SinkType &sink,
+                               bool mac_required);
+  uint32_t ntag424_crc32(const uint8_t *data, uint8_t datalength);
   uint8_t ntag424_addpadding(uint8_t inputlength, uint8_t paddinglength,
                              uint8_t *buffer);
   uint8_t ntag424_encrypt(uint8_t *key, uint8_t length, uint8_t *input,
@@ -237,6 +474,8 @@ public:
                           uint8_t *input, uint8_t *output);
   uint8_t ntag424_cmac_short(uint8_t *key, uint8_t *input, uint8_t length,
                              uint8_t *cmac);
+  uint8_t ntag424_cmac_short(ntag424_CMACType *engine, uint8_t *input,
+                             uint8_t length, uint8_t *cmac);
   uint8_t ntag424_cmac(uint8_t *key, uint8_t *input, uint8_t length,
                        uint8_t *cmac);
   uint8_t ntag424_MAC(uint8_t *cmd, uint8_t *cmdheader,
@@ -245,16 +484,48 @@ public:
   uint8_t ntag424_MAC(uint8_t *key, uint8_t *cmd, uint8_t *cmdheader,
                       uint8_t cmdheader_length, uint8_t *cmddata,
                       uint8_t cmddata_length, uint8_t *signature);
-  void ntag424_random(uint8_t *output, uint8_t bytecount);
+  uint8_t ntag424_MAC(ntag424_CMACType *engine, uint8_t *cmd,
+                      uint8_t *cmdheader, uint8_t cmdheader_length,
+                      uint8_t *cmddata, uint8_t cmddata_length,
+                      uint8_t *signature);
+  uint8_t ntag424_random(uint8_t *output, uint8_t bytecount);
   void ntag424_derive_session_keys(uint8_t *key, uint8_t *RndA, uint8_t *RndB);
+  uint8_t ntag424_derive_session_keys_lrp(uint8_t *key, uint8_t *RndA,
+                                          uint8_t *RndB);
+  uint8_t ntag424_session_crypt(uint8_t mode, uint8_t length, uint8_t *input,
+                                uint8_t *output);
+  void ntag424_compute_iv(uint8_t type, int cmd_counter, uint8_t *ive);
+  void ntag424_session_iv(uint8_t type, uint8_t *ive);
+  bool ntag424_precompute_iv();
   uint8_t ntag424_rotl(uint8_t *input, uint8_t *output, uint8_t bufferlen,
                        uint8_t rotation);
-  uint8_t ntag424_ReadData(uint8_t *buffer, int fileno, int offset, int size);
-  uint8_t ntag424_WriteData(const uint8_t *data, int fileno, int offset, int size, uint8_t keyNo);
+  uint16_t ntag424_ReadData(
+      uint8_t *buffer, int fileno, int offset, int size,
+      ntag424_CommMode comm_mode = ntag424_CommMode::Plain);
+  uint16_t ntag424_WriteData(
+      const uint8_t *data, int fileno, int offset, int size,
+      ntag424_CommMode comm_mode = ntag424_CommMode::Plain);
   uint8_t ntag424_Authenticate(uint8_t *key, uint8_t keyno, uint8_t cmd);
+  uint8_t ntag424_Authenticate(uint8_t *key, uint8_t keyno);
+  uint8_t ntag424_AuthenticateLRP(uint8_t *key, uint8_t keyno);
+  int8_t ntag424_AuthenticateAny(ntag424_KeyCandidateType *candidates,
+                                 uint8_t count, const uint8_t *uid = NULL,
+                                 uint8_t uid_length = 0);
+  uint8_t ntag424_AuthenticateByVersion(ntag424_KeyStoreType *store,
+                                        uint8_t keyno);
+  uint8_t ntag424_AuthenticateByVersion(ntag424_DivCacheType *cache,
+                                        uint8_t keyno);
   uint8_t ntag424_ChangeKey(uint8_t *oldkey, uint8_t *newkey,
-                            uint8_t keynumber);
+                            uint8_t keynumber, uint8_t keyversion = 0x01);
+  uint8_t ntag424_ChangeKey(const ntag424_KeyCryptogramType *cryptogram);
+  uint8_t ntag424_ChangeKeys(uint8_t *masterkey,
+                             const ntag424_KeyChangeType *changes,
+                             uint8_t count);
+  uint8_t ntag424_ChangeKeys(uint8_t *masterkey,
+                             const ntag424_KeyManifestType *manifest);
+  uint8_t ntag424_GetKeyVersion(uint8_t keyno, uint8_t *version);
   uint8_t ntag424_ReadSig(uint8_t *buffer);
+  uint8_t ntag424_VerifyOriginality(const ntag424_OriginalityType *ctx);
   uint8_t ntag424_GetTTStatus(uint8_t *buffer);
   uint8_t ntag424_GetCardUID(uint8_t *buffer);
   uint8_t ntag424_GetFileSettings(uint8_t fileno, uint8_t *buffer,
@@ -262,11 +533,19 @@ public:
   uint8_t ntag424_ChangeFileSettings(uint8_t fileno, uint8_t *filesettings,
                                      uint8_t filesettings_length,
                                      uint8_t comm_mode);
+  uint8_t ntag424_GetFileSettings(uint8_t fileno,
+                                  ntag424_FileSettingsType *settings,
+                                  uint8_t comm_mode);
+  uint8_t ntag424_ChangeFileSettings(uint8_t fileno,
+                                     const ntag424_FileSettingsType *settings,
+                                     uint8_t comm_mode);
   uint8_t ntag424_ISOReadFile(uint8_t *buffer);
   bool ntag424_FormatNDEF();
   bool ntag424_ISOUpdateBinary(uint8_t *buffer, uint8_t length);
   bool ntag424_ISOSelectFileById(int fileid);
   bool ntag424_ISOSelectFileByDFN(uint8_t *dfn);
+  void ntag424_selection_reset(uint8_t target);
+  void ntag424_forget_target(uint8_t target);
   uint8_t ntag424_isNTAG424();
   uint8_t ntag424_GetVersion();
 
@@ -297,19 +576,122 @@ public:
       [NTAG424_AUTHRESPONSE_PCDCAP2_SIZE]; ///< PCDCAP2 Buffer
 
 #define NTAG424_SESSION_KEYSIZE 16 ///< Size of auth aes keys in byte
+#define NTAG424_IV_CMD 0  ///< Command IV:  E(Kenc, A5 5A || TI || CmdCtr)
+#define NTAG424_IV_RESP 1 ///< Response IV: E(Kenc, 5A A5 || TI || CmdCtr)
+
+  struct ntag424_IVCacheType
+  {
+    int cmd_counter; ///< cmd_counter the cached ivs were computed for
+    uint8_t valid;   ///< bit (1 << NTAG424_IV_CMD/RESP) set = iv is cached
+    bool pending;    ///< true = waitready() may precompute missing ivs
+    uint8_t iv[2][NTAG424_SESSION_KEYSIZE]; ///< encrypted command/response iv
+  }; ///< encrypted ivs of one cmd_counter, precomputed during RF time
 
   struct ntag424_SessionType
   {
     bool authenticated; ///< true = authenticated
     int cmd_counter;    ///< command counter
+    uint8_t keyno;      ///< key number the session is authenticated with
     uint8_t
         session_key_enc[NTAG424_SESSION_KEYSIZE];     ///< session encryption key
     uint8_t session_key_mac[NTAG424_SESSION_KEYSIZE]; ///< session mac key
+    ntag424_CMACType cmac; ///< cmac engine keyed with session_key_mac
+    struct ntag424_IVCacheType ivcache; ///< ivs for FULL mode, see above
+    bool lrp;                 ///< true = LRP secure messaging
+    uint32_t enc_counter;     ///< LRP: EncCtr, blocks encrypted so far
+    ntag424_LRPType lrp_keys; ///< LRP: tables of the session master key
   }; ///< struct type foir the authentication session data
 
   struct ntag424_SessionType
       ntag424_Session; ///< authentication session data are stored here
 
+#define NTAG424_DFN_SIZE 7          ///< Size of the ISO DF name in byte
+#define NTAG424_SELECTION_NONE (-1) ///< no EF selected / EF unknown
+
+  struct ntag424_SelectionType
+  {
+    uint8_t target;                ///< Tg of the activated target, 0 = none
+    bool df_valid;                 ///< true = dfn is the selected DF
+    uint8_t dfn[NTAG424_DFN_SIZE]; ///< DF name of the selected application
+    int ef;                        ///< selected EF, NTAG424_SELECTION_NONE
+    uint8_t uid[7];                ///< UID of the activated target
+    uint8_t uid_length;            ///< length of uid, 0 = unknown
+  }; ///< ISOSelectFile state of the activated target as far as known
+
+  struct ntag424_SelectionType
+      ntag424_Selection; ///< files selected on the activated target
+
+#define NTAG424_FSCACHE_SIZE 4 ///< Number of cached file settings
+
+  struct ntag424_FileSettingsCacheType
+  {
+    bool valid;                        ///< true = entry is used
+    uint8_t uid[7];                    ///< UID of the card
+    uint8_t fileno;                    ///< file number
+    ntag424_FileSettingsType settings; ///< settings of the file
+  }; ///< file settings of one file of one card, see GetFileSettings
+
+  struct ntag424_FileSettingsCacheType
+      ntag424_FileSettingsCache[NTAG424_FSCACHE_SIZE]; ///< per UID settings
+  uint8_t ntag424_FileSettingsCacheNext; ///< next cache slot to overwrite
+
+  ntag424_FileSettingsCacheType *ntag424_filesettings_cached(uint8_t fileno);
+  void ntag424_filesettings_invalidate(uint8_t fileno);
+
+  struct ntag424_KeyHintType
+  {
+    uint8_t prefix[NTAG424_KEYHINT_PREFIX]; ///< first bytes of the UID
+    uint8_t candidate; ///< index of the candidate that matched last time
+    bool valid;        ///< true = entry is used
+  }; ///< key that opened the last card of a UID prefix
+
+  struct ntag424_KeyHintType
+      ntag424_KeyHints[NTAG424_KEYHINT_SIZE]; ///< per UID prefix hints
+  uint8_t ntag424_KeyHintNext; ///< next hint slot to overwrite
+
+  const ntag424_CryptoProviderType
+      *ntag424_Crypto; ///< AES/RNG provider chosen at construction
+  ntag424_RNGPoolType ntag424_RNG; ///< RndA pool, refilled in waitready()
+
+// Every buffer ntag424_apdu_send() needs lives in ntag424_Workspace, so a
+// secured apdu does no heap allocation and no length dependent stack
+// allocation. 120 byte keep a PN532 frame plus the I2C RDY byte inside the
+// 128 byte Wire buffer of the ESP32 core.
+#define NTAG424_FRAME_MAXSIZE 120 ///< Max size of a PN532 frame for NTAG424
+#define NTAG424_APDU_HEADERSIZE 7 ///< InDataExchange Tg CLA INS P1 P2 Lc
+
+  struct ntag424_StreamType
+  {
+    uint8_t *data;        ///< request: command data
+    uint8_t data_length;  ///< request: length of the command data
+    uint16_t length;      ///< request: data/cryptogram + MAC to send
+    uint16_t position;    ///< request: bytes of length sent so far
+    uint8_t iv[NTAG424_SESSION_KEYSIZE];    ///< CBC chaining value
+    uint8_t block[NTAG424_SESSION_KEYSIZE]; ///< response: partial cryptogram
+    uint8_t block_length;                   ///< response: bytes in block
+    uint8_t plain[NTAG424_SESSION_KEYSIZE]; ///< response: last plain block
+    bool plain_valid;                       ///< response: plain is set
+    uint8_t mac[8];     ///< request: MAC / response: last 8 byte received
+    uint8_t mac_length; ///< bytes in mac
+  }; ///< state of a command while it is split into frames
+
+  // 440 byte on a 64 bit host, 432 on the ESP32. Stack of one command incl.
+  // ntag424_send(), writecommand()/readdata() and the AES calls, measured
+  // by test/test_send with gcc 12 on x86-64, -Og as in `pio test` (-O0):
+  // GetVersion (plain, three frames) 648 (1048) byte, GetCardUID (FULL)
+  // 1024 (2352) byte, AuthenticateEV2First 1168 (2144) byte. None of them
+  // allocates.
+  struct ntag424_WorkspaceType
+  {
+    uint8_t apdu[NTAG424_FRAME_MAXSIZE];    ///< outgoing InDataExchange frame
+    uint8_t frame[NTAG424_FRAME_MAXSIZE];   ///< incoming PN532 frame
+    uint8_t payload[NTAG424_FRAME_MAXSIZE]; ///< padded/decrypted payload
+    struct ntag424_StreamType stream;       ///< chaining state, see above
+  }; ///< fixed working set of the secure messaging layer
+
+  struct ntag424_WorkspaceType
+      ntag424_Workspace; ///< per instance secure messaging workspace
+
   struct ntag424_VersionInfoType
   {
     uint8_t VendorID;       ///< VendorID
@@ -335,26 +717,6 @@ public:
 
   struct ntag424_VersionInfoType ntag424_VersionInfo; ///< global version info
 
-  struct ntag424_FileSettings
-  {
-    ///<  complex :-(
-    uint8_t FileType;          ///< FileType
-    uint8_t FileOption;        ///< FileOption
-    uint8_t AccessRights;      ///< AccessRights
-    uint8_t FileSize;          ///< FileSize
-    uint8_t SDMOptions;        ///< SDMOptions
-    uint8_t SMDAccessRights;   ///< SMDAccessRights
-    uint8_t UIDOffset;         ///< UIDOffset
-    uint8_t SDMReadCtrOffset;  ///< SDMReadCtrOffset
-    uint8_t PICCDataOffset;    ///< PICCDataOffset
-    uint8_t TTStatusOffset;    ///< TTStatusOffset
-    uint8_t SDMMACInputOffset; ///< SDMMACInputOffset
-    uint8_t SDMENCOffset;      ///< SDMENCOffset
-    uint8_t SDMENCLength;      ///< SDMENCLength
-    uint8_t SDMMACOffset;      ///< SDMMACOffset
-    uint8_t SDMReadCtrlLimit;  ///< SDMReadCtrlLimit
-  }; ///<  currently not used. filesettings are more
-
   // NTAG2xx functions
   uint8_t ntag2xx_ReadPage(uint8_t page, uint8_t *buffer);
   uint8_t ntag2xx_WritePage(uint8_t page, uint8_t *data);
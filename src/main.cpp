@@ -22,7 +22,8 @@ uint8_t defaultKey[16] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 
 // !!! WARNING: FIXED PRODUCTION KEYS - INSECURE FOR REAL DEPLOYMENT !!!
 // These keys are fixed for easy recovery during development/testing.
-// In a real application, keys should be diversified per card and managed securely.
+// In a real application, keys should be diversified per card and managed securely,
+// see ntag424_divcache_get() and ntag424_AuthenticateByVersion(ntag424_DivCacheType *, ...).
 uint8_t fixedProdKey0[16] = {0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
                              0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F}; // Master Key
 uint8_t fixedProdKey1[16] = {0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
@@ -36,8 +37,12 @@ uint8_t fixedProdKey4[16] = {0xD0, 0xD1, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7,
 
 // Key number to use for authentication
 const uint8_t AUTH_KEY_NO = 0;
-// Authentication command (0x71 = AuthenticateEV2First)
-const uint8_t AUTH_CMD = 0x71;
+
+// Key 0 of blank and enrolled cards, ntag424_AuthenticateAny() learns which
+// one to try first
+ntag424_KeyCandidateType key0Candidates[] = {{defaultKey, 0, 0},
+                                             {fixedProdKey0, 0, 0}};
+#define KEY0_CANDIDATES (sizeof(key0Candidates) / sizeof(key0Candidates[0]))
 
 // Initialize the PN532 interface for SPI
 // Use the base class Adafruit_PN532, NTAG424 functions are added by the include
@@ -192,19 +197,17 @@ void enrollCard()
     return;
   }
 
-  // --- Step 1: Authenticate with Default Key ---
-  Serial.println("Attempting authentication with default key (0x00)...");
-  if (!nfc.ntag424_Authenticate(defaultKey, 0, AUTH_CMD))
-  { // Try authenticating Key 0
-    Serial.println("Authentication with default key failed. Is the card blank?");
-    Serial.println("Attempting authentication with the fixed production Key 0...");
-    // If default key auth fails, maybe it was already partially programmed? Try fixed key 0.
-    if (!nfc.ntag424_Authenticate(fixedProdKey0, 0, AUTH_CMD))
-    {
-      Serial.println("Authentication with fixed production Key 0 also failed.");
-      Serial.println("Enrollment aborted. Card might be locked or use different keys.");
-      return;
-    }
+  // --- Step 1: Authenticate with Default Key or fixed production Key 0 ---
+  Serial.println("Attempting authentication with default key (0x00) or fixed production Key 0...");
+  int8_t key0Index = nfc.ntag424_AuthenticateAny(key0Candidates, KEY0_CANDIDATES, uid, uidLength);
+  if (key0Index < 0)
+  {
+    Serial.println("Authentication with default key and fixed production Key 0 failed.");
+    Serial.println("Enrollment aborted. Card might be locked or use different keys.");
+    return;
+  }
+  if (key0Candidates[key0Index].key == fixedProdKey0)
+  {
     Serial.println("Authentication with fixed production Key 0 successful (Card might have been partially enrolled). Proceeding...");
     // If we authenticated with the fixed key 0, we can proceed to potentially set the other keys if needed.
     // Note: We will attempt to change all keys regardless, using the *authenticated* key as the 'old key'.
@@ -215,104 +218,26 @@ void enrollCard()
   }
 
   // --- Step 2: Change Keys ---
-  // IMPORTANT: You must authenticate with the key you are about to change (except for Key 0, which needs Key 0 auth)
-  // Since we authenticated with Key 0 (or the fixed Key 0), we can now change Key 0.
-  Serial.println("Changing Key 0 (Master Key)...");
-  // If default auth succeeded, oldKey is defaultKey. If fixed key auth succeeded, oldKey is fixedProdKey0.
-  // However, ntag424_ChangeKey only needs the *new* key when changing key 0 after authenticating with key 0.
-  // Let's check the library source or docs for the exact `ntag424_ChangeKey` behaviour for Key 0.
-  // Assuming it requires the *new key* and *current key* (which must be key 0 for changing key 0)
-  // Let's refine this based on library specifics if needed. The example just showed changing key 1.
-  // Let's assume for now `ChangeKey` needs old and new for all keys.
-  // We need to figure out which key we authenticated with.
-  // For simplicity, let's *try* changing from default first, then from fixed if that fails.
-
-  bool changeKeySuccess = false;
-  uint8_t *authKeyUsed = defaultKey; // Assume default first
-
-  if (nfc.ntag424_Authenticate(defaultKey, 0, AUTH_CMD))
-  {
-    authKeyUsed = defaultKey;
-    Serial.println("Re-authenticated with default key 0.");
-  }
-  else if (nfc.ntag424_Authenticate(fixedProdKey0, 0, AUTH_CMD))
-  {
-    authKeyUsed = fixedProdKey0;
-    Serial.println("Re-authenticated with fixed key 0.");
-  }
-  else
-  {
-    Serial.println("Failed to re-authenticate before changing Key 0. Aborting enrollment.");
-    return;
-  }
-
-  // Change Key 0
-  Serial.print("Changing Key 0... ");
-  // Pass the authenticated key (authKeyUsed) as the 'old key' parameter.
-  // NOTE: The library might have a specific way to handle Key 0 change.
-  // This implementation assumes `ntag424_ChangeKey` works like other keys but requires prior Key 0 auth.
-  if (nfc.ntag424_ChangeKey(authKeyUsed, fixedProdKey0, 0))
+  // All keys are changed in one session authenticated with Key 0. ntag424_ChangeKeys() changes
+  // Key 0 last (that ends the session) and authenticates with the new Key 0 afterwards.
+  // We assume the 'old key' for App Keys 1-4 is the default key (0x00) for a blank card.
+  uint8_t *authKeyUsed = key0Candidates[key0Index].key;
+  ntag424_KeyChangeType keyChanges[] = {
+      {0, authKeyUsed, fixedProdKey0, 0x01},
+      {1, defaultKey, fixedProdKey1, 0x01},
+      {2, defaultKey, fixedProdKey2, 0x01},
+      {3, defaultKey, fixedProdKey3, 0x01},
+      {4, defaultKey, fixedProdKey4, 0x01}};
+  Serial.print("Changing Keys 0-4... ");
+  bool changeKeySuccess = nfc.ntag424_ChangeKeys(authKeyUsed, keyChanges, sizeof(keyChanges) / sizeof(keyChanges[0]));
+  if (changeKeySuccess)
   {
     Serial.println("OK");
-    changeKeySuccess = true; // At least Key 0 changed
-
-    // Now authenticate with the NEW Key 0 to change other keys
-    Serial.println("Authenticating with NEW Key 0 to change other keys...");
-    if (!nfc.ntag424_Authenticate(fixedProdKey0, 0, AUTH_CMD))
-    {
-      Serial.println("FATAL: Failed to authenticate with the new Key 0. Enrollment failed partially.");
-      return; // Stop here, card is in an intermediate state
-    }
-    Serial.println("Authentication with new Key 0 successful.");
-
-    // Change Key 1
-    Serial.print("Changing Key 1... ");
-    // Changing Key 1 requires prior auth with Key 1 (default 0x00) or Key 0 (if Key 1 doesn't exist yet/is default)
-    // Since we are authenticated with NEW Key 0, we can change other keys.
-    // We assume the 'old key' for App Keys 1-4 is the default key (0x00) for a blank card.
-    if (nfc.ntag424_ChangeKey(defaultKey, fixedProdKey1, 1))
-      Serial.println("OK");
-    else
-    {
-      Serial.println("Failed!");
-      changeKeySuccess = false;
-    }
-
-    // Change Key 2
-    Serial.print("Changing Key 2... ");
-    if (nfc.ntag424_ChangeKey(defaultKey, fixedProdKey2, 2))
-      Serial.println("OK");
-    else
-    {
-      Serial.println("Failed!");
-      changeKeySuccess = false;
-    }
-
-    // Change Key 3
-    Serial.print("Changing Key 3... ");
-    if (nfc.ntag424_ChangeKey(defaultKey, fixedProdKey3, 3))
-      Serial.println("OK");
-    else
-    {
-      Serial.println("Failed!");
-      changeKeySuccess = false;
-    }
-
-    // Change Key 4
-    Serial.print("Changing Key 4... ");
-    if (nfc.ntag424_ChangeKey(defaultKey, fixedProdKey4, 4))
-      Serial.println("OK");
-    else
-    {
-      Serial.println("Failed!");
-      changeKeySuccess = false;
-    }
   }
   else
   {
-    Serial.println("Failed to change Key 0!");
-    Serial.println("Enrollment failed. Card keys remain unchanged (either default or previous state).");
-    changeKeySuccess = false;
+    Serial.println("Failed!");
+    Serial.println("Enrollment failed. Keys 1-4 may be changed partially, Key 0 is changed last.");
   }
 
   if (changeKeySuccess)
@@ -320,15 +245,17 @@ void enrollCard()
     Serial.println(); // Start with a newline
     Serial.println("All keys changed successfully!");
 
-    if (!nfc.ntag424_Authenticate(fixedProdKey0, 0, AUTH_CMD))
-    {
-      Serial.println("Failed to authenticate with the new Key 0.");
-      return;
-    }
-
+    // ntag424_ChangeKeys() left us authenticated with the new Key 0
     uint8_t NDEF_FILE_ID = 0x02;
-    uint8_t fileSettings[2] = {0x11, 0x11};
-    if (!nfc.ntag424_ChangeFileSettings(NDEF_FILE_ID, fileSettings, 2, NTAG424_COMM_MODE_FULL))
+    // NDEF file: CommMode.MAC, free read, write with Key 1, change with Key 0
+    ntag424_FileSettingsType fileSettings;
+    memset(&fileSettings, 0, sizeof(fileSettings));
+    fileSettings.comm_mode = NTAG424_COMM_MODE_MAC;
+    fileSettings.read = NTAG424_FS_ACCESS_FREE;
+    fileSettings.write = 1;
+    fileSettings.read_write = 1;
+    fileSettings.change = 0;
+    if (!nfc.ntag424_ChangeFileSettings(NDEF_FILE_ID, &fileSettings, NTAG424_COMM_MODE_FULL))
     {
       Serial.println("Failed to change NDEF File settings");
     }
@@ -338,14 +265,16 @@ void enrollCard()
       Serial.println("NDEF File settings changed successfully.");
     }
 
-    if (!nfc.ntag424_Authenticate(fixedProdKey1, 1, AUTH_CMD))
+    if (!nfc.ntag424_Authenticate(fixedProdKey1, 1))
     {
       Serial.println("Failed to authenticate with the new Key 1.");
       return;
     }
 
     uint8_t data[2] = {0x44, 0x55};
-    if (!nfc.ntag424_WriteData(data, NDEF_FILE_ID, 0, 2, AUTH_KEY_NO))
+    // the file settings above select CommMode.MAC for the NDEF file
+    if (nfc.ntag424_WriteData(data, NDEF_FILE_ID, 0, sizeof(data),
+                              ntag424_CommMode::Mac) != sizeof(data))
     {
       Serial.println("Failed to write NDEF data to card.");
     }
@@ -391,7 +320,7 @@ void authenticateCard()
   Serial.print("...");
 
   // Use the defined key number and authentication command
-  if (nfc.ntag424_Authenticate(fixedProdKey0, AUTH_KEY_NO, AUTH_CMD))
+  if (nfc.ntag424_Authenticate(fixedProdKey0, AUTH_KEY_NO))
   {
     Serial.println(" SUCCESS!");
     Serial.println("Card authenticated successfully.");
@@ -437,21 +366,16 @@ void resetCard()
 
   Serial.println("Resetting card...");
 
-  if (nfc.ntag424_Authenticate(fixedProdKey0, 0, AUTH_CMD))
-  {
-    Serial.println("Authenticated with fixed production key 0.");
-  }
-  else if (nfc.ntag424_Authenticate(defaultKey, 0, AUTH_CMD))
-  {
-    Serial.println("Authenticated with default key 0.");
-  }
-  else
+  int8_t key0Index = nfc.ntag424_AuthenticateAny(key0Candidates, KEY0_CANDIDATES, uid, uidLength);
+  if (key0Index < 0)
   {
     Serial.println("Failed to authenticate with fixed production key 0.");
     return;
   }
+  Serial.println(key0Candidates[key0Index].key == fixedProdKey0 ? "Authenticated with fixed production key 0."
+                                                                : "Authenticated with default key 0.");
 
-  if (nfc.ntag424_ChangeKey(fixedProdKey0, defaultKey, 0))
+  if (nfc.ntag424_ChangeKey(key0Candidates[key0Index].key, defaultKey, 0))
   {
     Serial.println("Key 0 changed to default key.");
   }
@@ -462,7 +386,7 @@ void resetCard()
 
   /*
     // re-authenticate with now default key 0
-    if (nfc.ntag424_Authenticate(defaultKey, 0, AUTH_CMD))
+    if (nfc.ntag424_Authenticate(defaultKey, 0))
     {
       Serial.println("Re-authenticated with default key 0.");
     }
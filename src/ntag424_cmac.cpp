@@ -0,0 +1,321 @@
+/**************************************************************************/
+/*!
+    @file ntag424_cmac.cpp
+
+    AES-128 CMAC engine with precomputed subkeys, see ntag424_cmac.h.
+*/
+/**************************************************************************/
+
+#include "ntag424_cmac.h"
+
+#include <string.h>
+
+#include "mbedtls/platform_util.h"
+
+/**************************************************************************/
+/*!
+    @brief   multiply a block by x in GF(2^128) (subkey generation).
+
+    @param   input   block to shift
+    @param   output  shifted block (may not alias input)
+*/
+/**************************************************************************/
+static void ntag424_cmac_dbl(const uint8_t *input, uint8_t *output)
+{
+  uint8_t carry = 0;
+  for (int i = NTAG424_CMAC_BLOCKSIZE - 1; i >= 0; i--)
+  {
+    output[i] = (uint8_t)((input[i] << 1) | carry);
+    carry = input[i] >> 7;
+  }
+  // constant Rb for 128 bit blocks, applied in constant time
+  output[NTAG424_CMAC_BLOCKSIZE - 1] ^= (uint8_t)(0x87 & (0 - carry));
+}
+
+/**************************************************************************/
+/*!
+    @brief   run CBC-MAC rounds: state = E(K, state ^ block) for every block.
+   LRP-CMAC replaces E(K, x) by the finalized EvalLRP of x.
+
+    @param   ctx     cmac engine
+    @param   input   16 byte input blocks
+    @param   blocks  number of blocks
+*/
+/**************************************************************************/
+static void ntag424_cmac_process(ntag424_CMACType *ctx, const uint8_t *input,
+                                 size_t blocks)
+{
+  if (ctx->lrp == NULL)
+  {
+    ctx->aes.provider->cbc_mac(&ctx->aes, ctx->state, input, blocks);
+    return;
+  }
+  for (size_t b = 0; b < blocks; b++)
+  {
+    for (int i = 0; i < NTAG424_CMAC_BLOCKSIZE; i++)
+    {
+      ctx->state[i] ^= input[i];
+    }
+    ntag424_lrp_eval(ctx->lrp, ctx->lrp_key, ctx->state,
+                     2 * NTAG424_CMAC_BLOCKSIZE, true, ctx->state);
+    input += NTAG424_CMAC_BLOCKSIZE;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   initialize an empty cmac engine.
+
+    @param   ctx        cmac engine
+    @param   provider   crypto provider, NULL = ntag424_crypto_default()
+*/
+/**************************************************************************/
+void ntag424_cmac_init(ntag424_CMACType *ctx,
+                       const ntag424_CryptoProviderType *provider)
+{
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->aes.provider = provider;
+}
+
+/**************************************************************************/
+/*!
+    @brief   load an aes128 key, expand it and derive the subkeys K1/K2.
+
+    @param   ctx    cmac engine, initialized with ntag424_cmac_init()
+    @param   key    16 byte key
+
+    @return  1 = success; 0 = failed
+*/
+/**************************************************************************/
+uint8_t ntag424_cmac_setkey(ntag424_CMACType *ctx, const uint8_t *key)
+{
+  uint8_t L[NTAG424_CMAC_BLOCKSIZE];
+
+  ctx->ready = false;
+  ctx->lrp = NULL;
+  if (ntag424_aes_setkey(&ctx->aes, ctx->aes.provider, key,
+                         NTAG424_AES_ENCRYPT) == 0)
+  {
+    return 0;
+  }
+  memset(L, 0, sizeof(L));
+  ctx->aes.provider->aes_ecb(&ctx->aes, L, L);
+  ntag424_cmac_dbl(L, ctx->k1);
+  ntag424_cmac_dbl(ctx->k1, ctx->k2);
+  mbedtls_platform_zeroize(L, sizeof(L));
+
+  ntag424_cmac_reset(ctx);
+  ctx->ready = true;
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   switch the engine to LRP-CMAC with updated key u of lrp. The
+   subkeys are derived from the finalized EvalLRP of the zero block. lrp is
+   referenced, not copied, and has to outlive the engine's use.
+
+    @param   ctx    cmac engine, initialized with ntag424_cmac_init()
+    @param   lrp    LRP context with key loaded
+    @param   u      updated key (0 - NTAG424_LRP_UPDATEDKEYS-1)
+
+    @return  1 = success; 0 = failed
+*/
+/**************************************************************************/
+uint8_t ntag424_cmac_setkey_lrp(ntag424_CMACType *ctx,
+                                const ntag424_LRPType *lrp, uint8_t u)
+{
+  uint8_t L[NTAG424_CMAC_BLOCKSIZE];
+
+  ctx->ready = false;
+  ntag424_aes_free(&ctx->aes);
+  memset(L, 0, sizeof(L));
+  if (!ntag424_lrp_eval(lrp, u, L, 2 * NTAG424_CMAC_BLOCKSIZE, true, L))
+  {
+    return 0;
+  }
+  ctx->lrp = lrp;
+  ctx->lrp_key = u;
+  ntag424_cmac_dbl(L, ctx->k1);
+  ntag424_cmac_dbl(ctx->k1, ctx->k2);
+  mbedtls_platform_zeroize(L, sizeof(L));
+
+  ntag424_cmac_reset(ctx);
+  ctx->ready = true;
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   discard any partial message and start a new one with the same
+   key.
+
+    @param   ctx    cmac engine
+*/
+/**************************************************************************/
+void ntag424_cmac_reset(ntag424_CMACType *ctx)
+{
+  memset(ctx->state, 0, sizeof(ctx->state));
+  memset(ctx->block, 0, sizeof(ctx->block));
+  ctx->block_length = 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief   feed length bytes of input into the running cmac. Can be called
+   repeatedly.
+
+    @param   ctx     cmac engine
+    @param   input   inputbuffer
+    @param   length  length of inputbuffer
+*/
+/**************************************************************************/
+void ntag424_cmac_update(ntag424_CMACType *ctx, const uint8_t *input,
+                         size_t length)
+{
+  while (length > 0)
+  {
+    // the last block is held back until finish() knows which subkey to use
+    if (ctx->block_length == NTAG424_CMAC_BLOCKSIZE)
+    {
+      ntag424_cmac_process(ctx, ctx->block, 1);
+      ctx->block_length = 0;
+    }
+    // whole blocks straight from input in one provider call
+    if (ctx->block_length == 0 && length > NTAG424_CMAC_BLOCKSIZE)
+    {
+      size_t blocks = (length - 1) / NTAG424_CMAC_BLOCKSIZE;
+      ntag424_cmac_process(ctx, input, blocks);
+      input += blocks * NTAG424_CMAC_BLOCKSIZE;
+      length -= blocks * NTAG424_CMAC_BLOCKSIZE;
+    }
+    size_t n = NTAG424_CMAC_BLOCKSIZE - ctx->block_length;
+    if (n > length)
+    {
+      n = length;
+    }
+    memcpy(ctx->block + ctx->block_length, input, n);
+    ctx->block_length += n;
+    input += n;
+    length -= n;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   finish the cmac and reset the engine for the next message.
+
+    @param   ctx    cmac engine
+    @param   cmac   outputbuffer (>=16 bytes)
+*/
+/**************************************************************************/
+void ntag424_cmac_finish(ntag424_CMACType *ctx, uint8_t *cmac)
+{
+  const uint8_t *subkey = ctx->k1;
+  if (ctx->block_length < NTAG424_CMAC_BLOCKSIZE)
+  {
+    ctx->block[ctx->block_length] = 0x80;
+    memset(ctx->block + ctx->block_length + 1, 0,
+           NTAG424_CMAC_BLOCKSIZE - ctx->block_length - 1);
+    subkey = ctx->k2;
+  }
+  for (int i = 0; i < NTAG424_CMAC_BLOCKSIZE; i++)
+  {
+    ctx->block[i] ^= subkey[i];
+  }
+  ntag424_cmac_process(ctx, ctx->block, 1);
+  memcpy(cmac, ctx->state, NTAG424_CMAC_BLOCKSIZE);
+  ntag424_cmac_reset(ctx);
+}
+
+/**************************************************************************/
+/*!
+    @brief   cmac over count scattered segments, as if they were one
+   contiguous buffer. Avoids copying the fields of an apdu together.
+
+    @param   ctx       cmac engine
+    @param   segments  list of (pointer,length) pairs
+    @param   count     number of segments
+    @param   cmac      outputbuffer (>=16 bytes)
+*/
+/**************************************************************************/
+void ntag424_cmac_segments(ntag424_CMACType *ctx,
+                           const ntag424_SegmentType *segments, uint8_t count,
+                           uint8_t *cmac)
+{
+  ntag424_cmac_reset(ctx);
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (segments[i].length > 0)
+    {
+      ntag424_cmac_update(ctx, segments[i].data, segments[i].length);
+    }
+  }
+  ntag424_cmac_finish(ctx, cmac);
+}
+
+/**************************************************************************/
+/*!
+    @brief   cmac of count independent (key, message) jobs. Providers with a
+   multi-buffer kernel run the jobs in parallel lanes, the others get one
+   engine that is rekeyed for every job.
+
+    @param   jobs      list of jobs, every job writes its own cmac
+    @param   count     number of jobs
+    @param   provider  crypto provider, NULL = ntag424_crypto_default()
+*/
+/**************************************************************************/
+void ntag424_cmac_batch(const ntag424_CMACJobType *jobs, size_t count,
+                        const ntag424_CryptoProviderType *provider)
+{
+  if (provider == NULL)
+  {
+    provider = ntag424_crypto_default();
+  }
+  if (provider->cmac_batch != NULL)
+  {
+    provider->cmac_batch(jobs, count);
+    return;
+  }
+  ntag424_CMACType engine;
+  ntag424_cmac_init(&engine, provider);
+  for (size_t i = 0; i < count; i++)
+  {
+    ntag424_cmac_setkey(&engine, jobs[i].key);
+    ntag424_cmac_update(&engine, jobs[i].data, jobs[i].length);
+    ntag424_cmac_finish(&engine, jobs[i].cmac);
+  }
+  ntag424_cmac_free(&engine);
+}
+
+/**************************************************************************/
+/*!
+    @brief   truncate a cmac to the 8 uneven bytes (1,3,5,7,...) used by
+   NTAG424 secure messaging.
+
+    @param   cmac        16 byte cmac
+    @param   cmac_short  outputbuffer (>=8 bytes)
+*/
+/**************************************************************************/
+void ntag424_cmac_truncate(const uint8_t *cmac, uint8_t *cmac_short)
+{
+  for (int i = 0; i < NTAG424_CMAC_SHORTSIZE; i++)
+  {
+    cmac_short[i] = cmac[2 * i + 1];
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   release the engine and wipe key material.
+
+    @param   ctx    cmac engine
+*/
+/**************************************************************************/
+void ntag424_cmac_free(ntag424_CMACType *ctx)
+{
+  const ntag424_CryptoProviderType *provider = ctx->aes.provider;
+  ntag424_aes_free(&ctx->aes);
+  mbedtls_platform_zeroize(ctx, sizeof(*ctx));
+  ctx->aes.provider = provider;
+}
@@ -0,0 +1,69 @@
+/**************************************************************************/
+/*!
+    @file ntag424_cmac.h
+
+    AES-128 CMAC (NIST SP800-38B / RFC 4493) engine used by the NTAG424
+    secure messaging. The AES key schedule and the subkeys K1/K2 are derived
+    once in ntag424_cmac_setkey() and reused for every following message, so
+    a session MAC costs only the CBC-MAC blocks of the message itself. The
+    AES work is done by the crypto provider given to ntag424_cmac_init().
+    Keyed with ntag424_cmac_setkey_lrp() the same engine computes the
+    LRP-CMAC, with the finalized EvalLRP as block function.
+*/
+/**************************************************************************/
+
+#ifndef NTAG424_CMAC_H
+#define NTAG424_CMAC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ntag424_crypto.h"
+#include "ntag424_lrp.h"
+
+#define NTAG424_CMAC_BLOCKSIZE 16 ///< AES block size in byte
+#define NTAG424_CMAC_SHORTSIZE 8  ///< Size of the truncated NTAG424 MAC
+
+/**
+ * @brief CMAC engine state. Keep one per key, reuse it for every message.
+ */
+struct ntag424_CMACType
+{
+  ntag424_AESType aes;                         ///< expanded AES key
+  uint8_t k1[NTAG424_CMAC_BLOCKSIZE];          ///< subkey K1
+  uint8_t k2[NTAG424_CMAC_BLOCKSIZE];          ///< subkey K2
+  uint8_t state[NTAG424_CMAC_BLOCKSIZE];       ///< running CBC-MAC state
+  uint8_t block[NTAG424_CMAC_BLOCKSIZE];       ///< not yet processed input
+  uint8_t block_length;                        ///< bytes used in block
+  bool ready;                                  ///< true = key is loaded
+  const ntag424_LRPType *lrp;                  ///< LRP tables, NULL = AES
+  uint8_t lrp_key;                             ///< LRP updated key
+};
+
+/**
+ * @brief One (pointer,length) piece of a scattered cmac input.
+ */
+struct ntag424_SegmentType
+{
+  const uint8_t *data; ///< start of the segment, may be NULL if length is 0
+  size_t length;       ///< length of the segment in byte
+};
+
+void ntag424_cmac_init(ntag424_CMACType *ctx,
+                       const ntag424_CryptoProviderType *provider = NULL);
+uint8_t ntag424_cmac_setkey(ntag424_CMACType *ctx, const uint8_t *key);
+uint8_t ntag424_cmac_setkey_lrp(ntag424_CMACType *ctx,
+                                const ntag424_LRPType *lrp, uint8_t u);
+void ntag424_cmac_reset(ntag424_CMACType *ctx);
+void ntag424_cmac_update(ntag424_CMACType *ctx, const uint8_t *input,
+                         size_t length);
+void ntag424_cmac_finish(ntag424_CMACType *ctx, uint8_t *cmac);
+void ntag424_cmac_segments(ntag424_CMACType *ctx,
+                           const ntag424_SegmentType *segments, uint8_t count,
+                           uint8_t *cmac);
+void ntag424_cmac_batch(const ntag424_CMACJobType *jobs, size_t count,
+                        const ntag424_CryptoProviderType *provider = NULL);
+void ntag424_cmac_truncate(const uint8_t *cmac, uint8_t *cmac_short);
+void ntag424_cmac_free(ntag424_CMACType *ctx);
+
+#endif
@@ -0,0 +1,26 @@
+/**************************************************************************/
+/*!
+    @file ntag424_crc32.h
+
+    CRC32 (IEEE 802.3, reflected, polynomial 0xEDB88320) and JAMCRC used by
+    NTAG424 ChangeKey. Portable slice-by-8 tables on the MCU, ARMv8 CRC32
+    instructions or PCLMULQDQ folding on hosts that have them.
+*/
+/**************************************************************************/
+
+#ifndef NTAG424_CRC32_H
+#define NTAG424_CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NTAG424_CRC32_INIT (0xFFFFFFFFUL) ///< Initial CRC32 register value
+
+uint32_t ntag424_crc32_update(uint32_t crc, const uint8_t *data,
+                              size_t length);
+uint32_t ntag424_crc32(const uint8_t *data, size_t length);
+uint32_t ntag424_jamcrc(const uint8_t *data, size_t length);
+void ntag424_jamcrc_batch(const uint8_t *data, size_t length, size_t stride,
+                          size_t count, uint32_t *crcs);
+
+#endif
@@ -0,0 +1,236 @@
+/**************************************************************************/
+/*!
+    @file ntag424_crypto.cpp
+
+    mbedtls crypto provider and provider selection, see ntag424_crypto.h.
+*/
+/**************************************************************************/
+
+#include "ntag424_crypto.h"
+
+#include <string.h>
+
+#include "mbedtls/platform_util.h"
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#ifdef ESP_PLATFORM
+#if __has_include("esp_random.h")
+#include "esp_random.h"
+#else
+#include "esp_system.h"
+#endif
+#endif
+#elif defined(__linux__)
+#include <errno.h>
+#include <sys/random.h>
+#endif
+
+/**************************************************************************/
+/*!
+    @brief   mbedtls: expand key for mode.
+
+    @param   ctx    key context
+    @param   key    16 byte key
+    @param   mode   NTAG424_AES_ENCRYPT or NTAG424_AES_DECRYPT
+
+    @return  1 = success; 0 = failed
+*/
+/**************************************************************************/
+static uint8_t ntag424_mbedtls_setkey(ntag424_AESType *ctx,
+                                      const uint8_t *key, uint8_t mode)
+{
+  mbedtls_aes_init(&ctx->u.mbedtls);
+  int ret = (mode == NTAG424_AES_ENCRYPT)
+                ? mbedtls_aes_setkey_enc(&ctx->u.mbedtls, key, 128)
+                : mbedtls_aes_setkey_dec(&ctx->u.mbedtls, key, 128);
+  return (ret == 0) ? 1 : 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief   mbedtls: one block in the direction of ctx.
+
+    @param   ctx      key context
+    @param   input    16 byte input
+    @param   output   16 byte output (may alias input)
+*/
+/**************************************************************************/
+static void ntag424_mbedtls_ecb(const ntag424_AESType *ctx,
+                                const uint8_t *input, uint8_t *output)
+{
+  mbedtls_aes_crypt_ecb((mbedtls_aes_context *)&ctx->u.mbedtls,
+                        (ctx->mode == NTAG424_AES_ENCRYPT) ? MBEDTLS_AES_ENCRYPT
+                                                           : MBEDTLS_AES_DECRYPT,
+                        input, output);
+}
+
+/**************************************************************************/
+/*!
+    @brief   mbedtls: cbc in the direction of ctx.
+
+    @param   ctx      key context
+    @param   iv       16 byte iv, updated
+    @param   input    inputbuffer
+    @param   output   outputbuffer (may alias input)
+    @param   length   multiple of 16
+*/
+/**************************************************************************/
+static void ntag424_mbedtls_cbc(const ntag424_AESType *ctx, uint8_t *iv,
+                                const uint8_t *input, uint8_t *output,
+                                size_t length)
+{
+  mbedtls_aes_crypt_cbc((mbedtls_aes_context *)&ctx->u.mbedtls,
+                        (ctx->mode == NTAG424_AES_ENCRYPT) ? MBEDTLS_AES_ENCRYPT
+                                                           : MBEDTLS_AES_DECRYPT,
+                        length, iv, input, output);
+}
+
+/**************************************************************************/
+/*!
+    @brief   mbedtls: CBC-MAC over blocks full blocks.
+
+    @param   ctx      encryption key context
+    @param   state    16 byte CBC-MAC state, updated
+    @param   input    blocks * 16 byte
+    @param   blocks   number of blocks
+*/
+/**************************************************************************/
+static void ntag424_mbedtls_cbc_mac(const ntag424_AESType *ctx,
+                                    uint8_t *state, const uint8_t *input,
+                                    size_t blocks)
+{
+  while (blocks-- > 0)
+  {
+    for (int i = 0; i < NTAG424_AES_BLOCKSIZE; i++)
+    {
+      state[i] ^= input[i];
+    }
+    mbedtls_aes_crypt_ecb((mbedtls_aes_context *)&ctx->u.mbedtls,
+                          MBEDTLS_AES_ENCRYPT, state, state);
+    input += NTAG424_AES_BLOCKSIZE;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   mbedtls: release ctx.
+
+    @param   ctx      key context
+*/
+/**************************************************************************/
+static void ntag424_mbedtls_free(ntag424_AESType *ctx)
+{
+  mbedtls_aes_free(&ctx->u.mbedtls);
+}
+
+/**************************************************************************/
+/*!
+    @brief   random bytes of the platform: the hardware RNG of the ESP32
+   (esp_fill_random()), getrandom() on Linux hosts. Other boards have no
+   source the code can trust (random() is not cryptographic), they build
+   with NTAG424_ENTROPY_HOOK and provide ntag424_entropy(). Shared by every
+   provider.
+
+    @param   output   outputbuffer
+    @param   length   number of bytes
+
+    @return  1 = success; 0 = the entropy source failed (getrandom() with
+   an error other than EINTR)
+*/
+/**************************************************************************/
+uint8_t ntag424_platform_random(uint8_t *output, size_t length)
+{
+#if defined(NTAG424_ENTROPY_HOOK)
+  return ntag424_entropy(output, length);
+#elif defined(ARDUINO) && defined(ESP_PLATFORM)
+  esp_fill_random(output, length);
+#elif defined(ARDUINO)
+#error "no entropy source on this board: build with -DNTAG424_ENTROPY_HOOK \
+and provide ntag424_entropy() (hardware RNG, ...), random() is not safe"
+#elif defined(__linux__)
+  while (length > 0)
+  {
+    ssize_t n = getrandom(output, length, 0);
+    if (n > 0)
+    {
+      output += n;
+      length -= n;
+    }
+    else if ((n < 0) && (errno != EINTR))
+    {
+      // ENOSYS, EFAULT, ...: retrying would spin forever
+      return 0;
+    }
+  }
+#else
+#error "no random source for this platform"
+#endif
+  return 1;
+}
+
+const ntag424_CryptoProviderType ntag424_crypto_mbedtls = {
+    "mbedtls",
+    ntag424_mbedtls_setkey,
+    ntag424_mbedtls_ecb,
+    ntag424_mbedtls_cbc,
+    ntag424_mbedtls_cbc_mac,
+    ntag424_mbedtls_free,
+    ntag424_platform_random,
+    NULL}; ///< mbedtls provider
+
+/**************************************************************************/
+/*!
+    @brief   fastest provider of this machine: AES-NI if the cpu has it,
+   mbedtls otherwise.
+
+    @return  provider
+*/
+/**************************************************************************/
+const ntag424_CryptoProviderType *ntag424_crypto_default()
+{
+#ifdef NTAG424_CRYPTO_AESNI
+  if (ntag424_crypto_aesni_available())
+  {
+    return &ntag424_crypto_aesni;
+  }
+#endif
+  return &ntag424_crypto_mbedtls;
+}
+
+/**************************************************************************/
+/*!
+    @brief   expand key with provider for mode.
+
+    @param   ctx        key context
+    @param   provider   crypto provider, NULL = ntag424_crypto_default()
+    @param   key        16 byte key
+    @param   mode       NTAG424_AES_ENCRYPT or NTAG424_AES_DECRYPT
+
+    @return  1 = success; 0 = failed
+*/
+/**************************************************************************/
+uint8_t ntag424_aes_setkey(ntag424_AESType *ctx,
+                           const ntag424_CryptoProviderType *provider,
+                           const uint8_t *key, uint8_t mode)
+{
+  ctx->provider = (provider != NULL) ? provider : ntag424_crypto_default();
+  ctx->mode = mode;
+  return ctx->provider->aes_setkey(ctx, key, mode);
+}
+
+/**************************************************************************/
+/*!
+    @brief   release ctx and wipe the key schedule.
+
+    @param   ctx        key context
+*/
+/**************************************************************************/
+void ntag424_aes_free(ntag424_AESType *ctx)
+{
+  if (ctx->provider != NULL)
+  {
+    ctx->provider->aes_free(ctx);
+  }
+  mbedtls_platform_zeroize(&ctx->u, sizeof(ctx->u));
+}
@@ -0,0 +1,114 @@
+/**************************************************************************/
+/*!
+    @file ntag424_crypto.h
+
+    Crypto provider interface of the NTAG424 code: AES-128 ECB/CBC with an
+    expanded key, the CBC-MAC core of the CMAC and random bytes. The mbedtls
+    provider is always available (on the ESP32 it uses the AES peripheral),
+    on x86 Linux hosts an AES-NI provider is added. Adafruit_PN532 takes the
+    provider in its constructor, NULL selects ntag424_crypto_default().
+
+    Random bytes come from the hardware RNG of the ESP32 or getrandom() on
+    Linux. Other Arduino boards do not build without an entropy source:
+    define NTAG424_ENTROPY_HOOK and implement ntag424_entropy() with the
+    hardware RNG of the board. random() must not be used, RndA of every
+    authentication is drawn from it.
+*/
+/**************************************************************************/
+
+#ifndef NTAG424_CRYPTO_H
+#define NTAG424_CRYPTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mbedtls/aes.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    defined(__linux__)
+#define NTAG424_CRYPTO_AESNI ///< AES-NI provider is built
+#endif
+
+#define NTAG424_AES_KEYSIZE 16   ///< AES-128 key size in byte
+#define NTAG424_AES_BLOCKSIZE 16 ///< AES block size in byte
+#define NTAG424_AES_ROUNDS 10    ///< AES-128 rounds
+#define NTAG424_AES_ENCRYPT 1    ///< expand the key for encryption
+#define NTAG424_AES_DECRYPT 0    ///< expand the key for decryption
+
+struct ntag424_CryptoProviderType;
+
+/**
+ * @brief One independent AES-CMAC computation of a batch.
+ */
+struct ntag424_CMACJobType
+{
+  const uint8_t *key;  ///< 16 byte key
+  const uint8_t *data; ///< message, may be NULL if length is 0
+  size_t length;       ///< length of the message in byte
+  uint8_t *cmac;       ///< outputbuffer (>=16 bytes)
+};
+
+/**
+ * @brief AES-128 key expanded by a provider for one direction.
+ */
+struct ntag424_AESType
+{
+  const ntag424_CryptoProviderType *provider; ///< provider that owns it
+  uint8_t mode; ///< NTAG424_AES_ENCRYPT or NTAG424_AES_DECRYPT
+  union
+  {
+    mbedtls_aes_context mbedtls; ///< mbedtls provider
+#ifdef NTAG424_CRYPTO_AESNI
+    /// AES-NI provider: round keys
+    uint8_t aesni[(NTAG424_AES_ROUNDS + 1) * NTAG424_AES_BLOCKSIZE]
+        __attribute__((aligned(16)));
+#endif
+  } u; ///< provider specific key schedule
+};
+
+/**
+ * @brief Operations of a crypto provider. Length arguments of the block
+ * operations are multiples of NTAG424_AES_BLOCKSIZE.
+ */
+struct ntag424_CryptoProviderType
+{
+  const char *name; ///< provider name for diagnostics
+  /// expand key for mode, 1 = success
+  uint8_t (*aes_setkey)(ntag424_AESType *ctx, const uint8_t *key,
+                        uint8_t mode);
+  /// one block in the direction of ctx
+  void (*aes_ecb)(const ntag424_AESType *ctx, const uint8_t *input,
+                  uint8_t *output);
+  /// cbc in the direction of ctx, iv is updated
+  void (*aes_cbc)(const ntag424_AESType *ctx, uint8_t *iv,
+                  const uint8_t *input, uint8_t *output, size_t length);
+  /// state = E(K, state ^ block) for every block (encrypt ctx)
+  void (*cbc_mac)(const ntag424_AESType *ctx, uint8_t *state,
+                  const uint8_t *input, size_t blocks);
+  /// release ctx
+  void (*aes_free)(ntag424_AESType *ctx);
+  /// fill output with random bytes, 1 = success, 0 = no entropy
+  uint8_t (*random)(uint8_t *output, size_t length);
+  /// full CMAC of count jobs in parallel lanes, NULL = not supported
+  void (*cmac_batch)(const ntag424_CMACJobType *jobs, size_t count);
+};
+
+extern const ntag424_CryptoProviderType ntag424_crypto_mbedtls;
+#ifdef NTAG424_CRYPTO_AESNI
+extern const ntag424_CryptoProviderType ntag424_crypto_aesni;
+bool ntag424_crypto_aesni_available();
+#endif
+
+const ntag424_CryptoProviderType *ntag424_crypto_default();
+uint8_t ntag424_platform_random(uint8_t *output, size_t length);
+#ifdef NTAG424_ENTROPY_HOOK
+/// entropy source of the board, 1 = output filled, 0 = failed
+uint8_t ntag424_entropy(uint8_t *output, size_t length);
+#endif
+
+uint8_t ntag424_aes_setkey(ntag424_AESType *ctx,
+                           const ntag424_CryptoProviderType *provider,
+                           const uint8_t *key, uint8_t mode);
+void ntag424_aes_free(ntag424_AESType *ctx);
+
+#endif
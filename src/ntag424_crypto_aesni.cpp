@@ -0,0 +1,629 @@
+/**************************************************************************/
+/*!
+    @file ntag424_crypto_aesni.cpp
+
+    AES-NI crypto provider for x86 Linux hosts, see ntag424_crypto.h. The
+    functions are compiled for the aes/ssse3 target only, so the rest of the
+    build needs no -maes; ntag424_crypto_aesni_available() checks the cpu
+    before ntag424_crypto_default() hands the provider out.
+*/
+/**************************************************************************/
+
+#include "ntag424_crypto.h"
+
+#ifdef NTAG424_CRYPTO_AESNI
+
+#include <immintrin.h>
+#include <string.h>
+
+#define NTAG424_AESNI_TARGET __attribute__((target("aes,ssse3")))
+
+/**************************************************************************/
+/*!
+    @brief   one step of the AES-128 key expansion. RotWord(w3) is broadcast
+   to all columns, so aesenclast (ShiftRows is a no-op then) yields
+   SubWord(RotWord(w3)) ^ rcon. Much faster than aeskeygenassist, which is
+   microcoded on many cores, and rcon may be a variable.
+
+    @param   key    round key i
+    @param   rcon   round constant in every column
+
+    @return  round key i+1
+*/
+/**************************************************************************/
+NTAG424_AESNI_TARGET static inline __m128i
+ntag424_aesni_expand_step(__m128i key, __m128i rcon)
+{
+  __m128i t = _mm_shuffle_epi8(key, _mm_set1_epi32(0x0c0f0e0d));
+  t = _mm_aesenclast_si128(t, rcon);
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  return _mm_xor_si128(key, t);
+}
+
+/**************************************************************************/
+/*!
+    @brief   round constant of the next expansion step.
+
+    @param   rcon   current round constant in every column
+
+    @return  rcon * x in GF(2^8)
+*/
+/**************************************************************************/
+NTAG424_AESNI_TARGET static inline __m128i ntag424_aesni_rcon_next(__m128i rcon)
+{
+  // 0x80 is the only constant that overflows for AES-128
+  return (_mm_cvtsi128_si32(rcon) == 0x80) ? _mm_set1_epi32(0x1b)
+                                           : _mm_slli_epi32(rcon, 1);
+}
+
+/**************************************************************************/
+/*!
+    @brief   AES-NI: expand key for mode. Decryption keys are stored in
+   reverse order and InvMixColumns'd for aesdec.
+
+    @param   ctx    key context
+    @param   key    16 byte key
+    @param   mode   NTAG424_AES_ENCRYPT or NTAG424_AES_DECRYPT
+
+    @return  1 = success
+*/
+/**************************************************************************/
+NTAG424_AESNI_TARGET static uint8_t
+ntag424_aesni_setkey(ntag424_AESType *ctx, const uint8_t *key, uint8_t mode)
+{
+  __m128i *rk = (__m128i *)ctx->u.aesni;
+  __m128i k[NTAG424_AES_ROUNDS + 1];
+  __m128i rcon = _mm_set1_epi32(0x01);
+  k[0] = _mm_loadu_si128((const __m128i *)key);
+  for (int i = 1; i <= NTAG424_AES_ROUNDS; i++)
+  {
+    k[i] = ntag424_aesni_expand_step(k[i - 1], rcon);
+    rcon = ntag424_aesni_rcon_next(rcon);
+  }
+  if (mode == NTAG424_AES_ENCRYPT)
+  {
+    for (int i = 0; i <= NTAG424_AES_ROUNDS; i++)
+    {
+      rk[i] = k[i];
+    }
+  }
+  else
+  {
+    rk[0] = k[NTAG424_AES_ROUNDS];
+    for (int i = 1; i < NTAG424_AES_ROUNDS; i++)
+    {
+      rk[i] = _mm_aesimc_si128(k[NTAG424_AES_ROUNDS - i]);
+    }
+    rk[NTAG424_AES_ROUNDS] = k[0];
+  }
+  memset(k, 0, sizeof(k));
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   encrypt one block in registers.
+
+    @param   rk     encryption round keys
+    @param   block  plain block
+
+    @return  encrypted block
+*/
+/**************************************************************************/
+NTAG424_AESNI_TARGET static inline __m128i
+ntag424_aesni_encrypt(const __m128i *rk, __m128i block)
+{
+  block = _mm_xor_si128(block, rk[0]);
+  for (int i = 1; i < NTAG424_AES_ROUNDS; i++)
+  {
+    block = _mm_aesenc_si128(block, rk[i]);
+  }
+  return _mm_aesenclast_si128(block, rk[NTAG424_AES_ROUNDS]);
+}
+
+/**************************************************************************/
+/*!
+    @brief   decrypt one block in registers.
+
+    @param   rk     decryption round keys
+    @param   block  encrypted block
+
+    @return  plain block
+*/
+/**************************************************************************/
+NTAG424_AESNI_TARGET static inline __m128i
+ntag424_aesni_decrypt(const __m128i *rk, __m128i block)
+{
+  block = _mm_xor_si128(block, rk[0]);
+  for (int i = 1; i < NTAG424_AES_ROUNDS; i++)
+  {
+    block = _mm_aesdec_si128(block, rk[i]);
+  }
+  return _mm_aesdeclast_si128(block, rk[NTAG424_AES_ROUNDS]);
+}
+
+/**************************************************************************/
+/*!
+    @brief   AES-NI: one block in the direction of ctx.
+
+    @param   ctx      key context
+    @param   input    16 byte input
+    @param   output   16 byte output (may alias input)
+*/
+/**************************************************************************/
+NTAG424_AESNI_TARGET static void ntag424_aesni_ecb(const ntag424_AESType *ctx,
+                                                   const uint8_t *input,
+                                                   uint8_t *output)
+{
+  const __m128i *rk = (const __m128i *)ctx->u.aesni;
+  __m128i block = _mm_loadu_si128((const __m128i *)input);
+  block = (ctx->mode == NTAG424_AES_ENCRYPT)
+              ? ntag424_aesni_encrypt(rk, block)
+              : ntag424_aesni_decrypt(rk, block);
+  _mm_storeu_si128((__m128i *)output, block);
+}
+
+/**************************************************************************/
+/*!
+    @brief   AES-NI: cbc in the direction of ctx. Decryption has no chaining
+   dependency and runs four blocks interleaved.
+
+    @param   ctx      key context
+    @param   iv       16 byte iv, updated
+    @param   input    inputbuffer
+    @param   output   outputbuffer (may alias input)
+    @param   length   multiple of 16
+*/
+/**************************************************************************/
+NTAG424_AESNI_TARGET static void
+ntag424_aesni_cbc(const ntag424_AESType *ctx, uint8_t *iv, const uint8_t *input,
+                  uint8_t *output, size_t length)
+{
+  const __m128i *rk = (const __m128i *)ctx->u.aesni;
+  __m128i chain = _mm_loadu_si128((const __m128i *)iv);
+  size_t blocks = length / NTAG424_AES_BLOCKSIZE;
+  const __m128i *in = (const __m128i *)input;
+  __m128i *out = (__m128i *)output;
+  if (ctx->mode == NTAG424_AES_ENCRYPT)
+  {
+    for (size_t i = 0; i < blocks; i++)
+    {
+      chain = ntag424_aesni_encrypt(
+          rk, _mm_xor_si128(_mm_loadu_si128(in + i), chain));
+      _mm_storeu_si128(out + i, chain);
+    }
+  }
+  else
+  {
+    size_t i = 0;
+    for (; i + 4 <= blocks; i += 4)
+    {
+      __m128i c0 = _mm_loadu_si128(in + i);
+      __m128i c1 = _mm_loadu_si128(in + i + 1);
+      __m128i c2 = _mm_loadu_si128(in + i + 2);
+      __m128i c3 = _mm_loadu_si128(in + i + 3);
+      __m128i p0 = _mm_xor_si128(c0, rk[0]);
+      __m128i p1 = _mm_xor_si128(c1, rk[0]);
+      __m128i p2 = _mm_xor_si128(c2, rk[0]);
+      __m128i p3 = _mm_xor_si128(c3, rk[0]);
+      for (int r = 1; r < NTAG424_AES_ROUNDS; r++)
+      {
+        p0 = _mm_aesdec_si128(p0, rk[r]);
+        p1 = _mm_aesdec_si128(p1, rk[r]);
+        p2 = _mm_aesdec_si128(p2, rk[r]);
+        p3 = _mm_aesdec_si128(p3, rk[r]);
+      }
+      p0 = _mm_aesdeclast_si128(p0, rk[NTAG424_AES_ROUNDS]);
+      p1 = _mm_aesdeclast_si128(p1, rk[NTAG424_AES_ROUNDS]);
+      p2 = _mm_aesdeclast_si128(p2, rk[NTAG424_AES_ROUNDS]);
+      p3 = _mm_aesdeclast_si128(p3, rk[NTAG424_AES_ROUNDS]);
+      _mm_storeu_si128(out + i, _mm_xor_si128(p0, chain));
+      _mm_storeu_si128(out + i + 1, _mm_xor_si128(p1, c0));
+      _mm_storeu_si128(out + i + 2, _mm_xor_si128(p2, c1));
+      _mm_storeu_si128(out + i + 3, _mm_xor_si128(p3, c2));
+      chain = c3;
+    }
+    for (; i < blocks; i++)
+    {
+      __m128i c = _mm_loadu_si128(in + i);
+      _mm_storeu_si128(out + i,
+                       _mm_xor_si128(ntag424_aesni_decrypt(rk, c), chain));
+      chain = c;
+    }
+  }
+  _mm_storeu_si128((__m128i *)iv, chain);
+}
+
+/**************************************************************************/
+/*!
+    @brief   AES-NI: CBC-MAC over blocks full blocks, state stays in a
+   register.
+
+    @param   ctx      encryption key context
+    @param   state    16 byte CBC-MAC state, updated
+    @param   input    blocks * 16 byte
+    @param   blocks   number of blocks
+*/
+/**************************************************************************/
+NTAG424_AESNI_TARGET static void
+ntag424_aesni_cbc_mac(const ntag424_AESType *ctx, uint8_t *state,
+                      const uint8_t *input, size_t blocks)
+{
+  const __m128i *rk = (const __m128i *)ctx->u.aesni;
+  const __m128i *in = (const __m128i *)input;
+  __m128i mac = _mm_loadu_si128((const __m128i *)state);
+  for (size_t i = 0; i < blocks; i++)
+  {
+    mac = ntag424_aesni_encrypt(rk, _mm_xor_si128(mac, _mm_loadu_si128(in + i)));
+  }
+  _mm_storeu_si128((__m128i *)state, mac);
+}
+
+/**************************************************************************/
+/*!
+    @brief   AES-NI: release ctx, the round keys are wiped by
+   ntag424_aes_free().
+
+    @param   ctx      key context
+*/
+/**************************************************************************/
+static void ntag424_aesni_free(ntag424_AESType *ctx) { (void)ctx; }
+
+#define NTAG424_VAES_BATCH __attribute__((target("vaes,avx2,aes,ssse3")))
+#define NTAG424_AESNI_LANES 8 ///< cmac lanes of the AES-NI kernel
+#define NTAG424_VAES_LANES 16 ///< cmac lanes of the VAES kernel
+
+/**************************************************************************/
+/*!
+    @brief   multiply a block by x in GF(2^128) (cmac subkey generation).
+
+    @param   block  block as loaded from memory, byte 0 is the msb
+
+    @return  shifted block
+*/
+/**************************************************************************/
+NTAG424_AESNI_TARGET static inline __m128i ntag424_aesni_dbl(__m128i block)
+{
+  const __m128i bswap =
+      _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  __m128i x = _mm_shuffle_epi8(block, bswap);
+  // all ones if the msb is set, the constant Rb is applied without a branch
+  __m128i msb = _mm_srai_epi32(_mm_shuffle_epi32(x, 0xff), 31);
+  __m128i carry = _mm_slli_si128(_mm_srli_epi64(x, 63), 8);
+  x = _mm_or_si128(_mm_slli_epi64(x, 1), carry);
+  x = _mm_xor_si128(x, _mm_and_si128(msb, _mm_set_epi32(0, 0, 0, 0x87)));
+  return _mm_shuffle_epi8(x, bswap);
+}
+
+/**
+ * @brief Per lane state of a cmac batch group.
+ */
+template <int LANES> struct ntag424_AESNILanesType
+{
+  __m128i rk[LANES][NTAG424_AES_ROUNDS + 1]; ///< encryption round keys
+  __m128i last[LANES];     ///< final block, padded and xor'ed with K1/K2
+  size_t blocks[LANES];    ///< message blocks incl. final block, 0 = unused
+  size_t maxblocks;        ///< largest blocks of the group
+};
+
+/**************************************************************************/
+/*!
+    @brief   expand the keys, derive the subkeys and build the final block
+   of up to LANES jobs, all lanes interleaved.
+
+    @param   jobs   jobs of this group
+    @param   count  number of jobs, <= LANES
+    @param   lanes  lane state to fill
+*/
+/**************************************************************************/
+template <int LANES>
+NTAG424_AESNI_TARGET static void
+ntag424_aesni_cmac_prepare(const ntag424_CMACJobType *jobs, size_t count,
+                           ntag424_AESNILanesType<LANES> *lanes)
+{
+  __m128i(*rk)[NTAG424_AES_ROUNDS + 1] = lanes->rk;
+  for (int l = 0; l < LANES; l++)
+  {
+    rk[l][0] = ((size_t)l < count)
+                   ? _mm_loadu_si128((const __m128i *)jobs[l].key)
+                   : _mm_setzero_si128();
+  }
+  __m128i rcon = _mm_set1_epi32(0x01);
+  for (int r = 1; r <= NTAG424_AES_ROUNDS; r++)
+  {
+    for (int l = 0; l < LANES; l++)
+    {
+      rk[l][r] = ntag424_aesni_expand_step(rk[l][r - 1], rcon);
+    }
+    rcon = ntag424_aesni_rcon_next(rcon);
+  }
+
+  // L = E(K, 0) for every lane at once
+  __m128i L[LANES];
+  for (int l = 0; l < LANES; l++)
+  {
+    L[l] = rk[l][0];
+  }
+  for (int r = 1; r < NTAG424_AES_ROUNDS; r++)
+  {
+    for (int l = 0; l < LANES; l++)
+    {
+      L[l] = _mm_aesenc_si128(L[l], rk[l][r]);
+    }
+  }
+  for (int l = 0; l < LANES; l++)
+  {
+    L[l] = _mm_aesenclast_si128(L[l], rk[l][NTAG424_AES_ROUNDS]);
+  }
+
+  lanes->maxblocks = 0;
+  for (int l = 0; l < LANES; l++)
+  {
+    lanes->blocks[l] = 0;
+    lanes->last[l] = _mm_setzero_si128();
+    if ((size_t)l >= count)
+    {
+      continue;
+    }
+    size_t length = jobs[l].length;
+    size_t blocks = (length == 0) ? 1
+                                  : (length + NTAG424_AES_BLOCKSIZE - 1) /
+                                        NTAG424_AES_BLOCKSIZE;
+    size_t rest = length - (blocks - 1) * NTAG424_AES_BLOCKSIZE;
+    __m128i k1 = ntag424_aesni_dbl(L[l]);
+    if (rest == NTAG424_AES_BLOCKSIZE)
+    {
+      lanes->last[l] = _mm_xor_si128(
+          _mm_loadu_si128((const __m128i *)(jobs[l].data + length - rest)),
+          k1);
+    }
+    else
+    {
+      uint8_t padded[NTAG424_AES_BLOCKSIZE];
+      memset(padded, 0, sizeof(padded));
+      if (rest > 0)
+      {
+        memcpy(padded, jobs[l].data + length - rest, rest);
+      }
+      padded[rest] = 0x80;
+      lanes->last[l] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)padded),
+                                     ntag424_aesni_dbl(k1));
+    }
+    lanes->blocks[l] = blocks;
+    if (blocks > lanes->maxblocks)
+    {
+      lanes->maxblocks = blocks;
+    }
+  }
+  memset(L, 0, sizeof(L));
+}
+
+/**************************************************************************/
+/*!
+    @brief   input block j of lane l: message, final block or (lane already
+   done) anything readable.
+
+    @param   jobs   jobs of this group
+    @param   lanes  lane state
+    @param   l      lane
+    @param   j      block index
+
+    @return  pointer to 16 readable bytes
+*/
+/**************************************************************************/
+template <int LANES>
+static inline const uint8_t *
+ntag424_aesni_cmac_block(const ntag424_CMACJobType *jobs,
+                         const ntag424_AESNILanesType<LANES> *lanes, int l,
+                         size_t j)
+{
+  return (j + 1 < lanes->blocks[l])
+             ? jobs[l].data + j * NTAG424_AES_BLOCKSIZE
+             : (const uint8_t *)&lanes->last[l];
+}
+
+/**************************************************************************/
+/*!
+    @brief   AES-NI: cmac of up to NTAG424_AESNI_LANES jobs, one xmm
+   register per lane so the aesenc latency of one lane is hidden by the
+   others.
+
+    @param   jobs   jobs of this group
+    @param   count  number of jobs
+*/
+/**************************************************************************/
+NTAG424_AESNI_TARGET static void
+ntag424_aesni_cmac_group(const ntag424_CMACJobType *jobs, size_t count)
+{
+  const int LANES = NTAG424_AESNI_LANES;
+  ntag424_AESNILanesType<LANES> lanes;
+  ntag424_aesni_cmac_prepare<LANES>(jobs, count, &lanes);
+
+  __m128i state[LANES];
+  for (int l = 0; l < LANES; l++)
+  {
+    state[l] = _mm_setzero_si128();
+  }
+  for (size_t j = 0; j < lanes.maxblocks; j++)
+  {
+    __m128i x[LANES];
+    for (int l = 0; l < LANES; l++)
+    {
+      x[l] = _mm_xor_si128(
+          _mm_xor_si128(state[l],
+                        _mm_loadu_si128((const __m128i *)
+                                            ntag424_aesni_cmac_block<LANES>(
+                                                jobs, &lanes, l, j))),
+          lanes.rk[l][0]);
+    }
+    for (int r = 1; r < NTAG424_AES_ROUNDS; r++)
+    {
+      for (int l = 0; l < LANES; l++)
+      {
+        x[l] = _mm_aesenc_si128(x[l], lanes.rk[l][r]);
+      }
+    }
+    for (int l = 0; l < LANES; l++)
+    {
+      x[l] = _mm_aesenclast_si128(x[l], lanes.rk[l][NTAG424_AES_ROUNDS]);
+      if (j < lanes.blocks[l])
+      {
+        state[l] = x[l];
+      }
+    }
+  }
+  for (size_t l = 0; l < count; l++)
+  {
+    _mm_storeu_si128((__m128i *)jobs[l].cmac, state[l]);
+  }
+  memset(&lanes, 0, sizeof(lanes));
+}
+
+/**************************************************************************/
+/*!
+    @brief   VAES: cmac of up to NTAG424_VAES_LANES jobs, two lanes per ymm
+   register.
+
+    @param   jobs   jobs of this group
+    @param   count  number of jobs
+*/
+/**************************************************************************/
+NTAG424_VAES_BATCH static void
+ntag424_vaes_cmac_group(const ntag424_CMACJobType *jobs, size_t count)
+{
+  const int LANES = NTAG424_VAES_LANES;
+  const int PAIRS = NTAG424_VAES_LANES / 2;
+  ntag424_AESNILanesType<LANES> lanes;
+  ntag424_aesni_cmac_prepare<LANES>(jobs, count, &lanes);
+
+  __m256i rk[PAIRS][NTAG424_AES_ROUNDS + 1];
+  __m256i state[PAIRS];
+  for (int p = 0; p < PAIRS; p++)
+  {
+    for (int r = 0; r <= NTAG424_AES_ROUNDS; r++)
+    {
+      rk[p][r] = _mm256_set_m128i(lanes.rk[2 * p + 1][r], lanes.rk[2 * p][r]);
+    }
+    state[p] = _mm256_setzero_si256();
+  }
+  for (size_t j = 0; j < lanes.maxblocks; j++)
+  {
+    __m256i x[PAIRS];
+    for (int p = 0; p < PAIRS; p++)
+    {
+      __m256i block = _mm256_set_m128i(
+          _mm_loadu_si128((const __m128i *)ntag424_aesni_cmac_block<LANES>(
+              jobs, &lanes, 2 * p + 1, j)),
+          _mm_loadu_si128((const __m128i *)ntag424_aesni_cmac_block<LANES>(
+              jobs, &lanes, 2 * p, j)));
+      x[p] = _mm256_xor_si256(_mm256_xor_si256(state[p], block), rk[p][0]);
+    }
+    for (int r = 1; r < NTAG424_AES_ROUNDS; r++)
+    {
+      for (int p = 0; p < PAIRS; p++)
+      {
+        x[p] = _mm256_aesenc_epi128(x[p], rk[p][r]);
+      }
+    }
+    for (int p = 0; p < PAIRS; p++)
+    {
+      x[p] = _mm256_aesenclast_epi128(x[p], rk[p][NTAG424_AES_ROUNDS]);
+      // lanes that are already done keep their state
+      __m256i active = _mm256_set_epi64x(
+          -(int64_t)(j < lanes.blocks[2 * p + 1]),
+          -(int64_t)(j < lanes.blocks[2 * p + 1]),
+          -(int64_t)(j < lanes.blocks[2 * p]), -(int64_t)(j < lanes.blocks[2 * p]));
+      state[p] = _mm256_blendv_epi8(state[p], x[p], active);
+    }
+  }
+  for (size_t l = 0; l < count; l++)
+  {
+    __m128i cmac = (l & 1) ? _mm256_extracti128_si256(state[l / 2], 1)
+                           : _mm256_castsi256_si128(state[l / 2]);
+    _mm_storeu_si128((__m128i *)jobs[l].cmac, cmac);
+  }
+  memset(rk, 0, sizeof(rk));
+  memset(&lanes, 0, sizeof(lanes));
+}
+
+/**************************************************************************/
+/*!
+    @brief   check once whether the cpu has VAES with AVX2.
+
+    @return  true = ntag424_vaes_cmac_group() may be used
+*/
+/**************************************************************************/
+static bool ntag424_vaes_available()
+{
+  static int8_t has_vaes = -1;
+  if (has_vaes < 0)
+  {
+    __builtin_cpu_init();
+    has_vaes =
+        (__builtin_cpu_supports("vaes") && __builtin_cpu_supports("avx2")) ? 1
+                                                                            : 0;
+  }
+  return has_vaes == 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   AES-NI: cmac of count jobs in groups of parallel lanes, VAES
+   groups if the cpu has it.
+
+    @param   jobs   list of jobs
+    @param   count  number of jobs
+*/
+/**************************************************************************/
+static void ntag424_aesni_cmac_batch(const ntag424_CMACJobType *jobs,
+                                     size_t count)
+{
+  size_t lanes = ntag424_vaes_available() ? NTAG424_VAES_LANES
+                                          : NTAG424_AESNI_LANES;
+  while (count > 0)
+  {
+    size_t n = (count < lanes) ? count : lanes;
+    if (lanes == NTAG424_VAES_LANES)
+    {
+      ntag424_vaes_cmac_group(jobs, n);
+    }
+    else
+    {
+      ntag424_aesni_cmac_group(jobs, n);
+    }
+    jobs += n;
+    count -= n;
+  }
+}
+
+const ntag424_CryptoProviderType ntag424_crypto_aesni = {
+    "aesni",
+    ntag424_aesni_setkey,
+    ntag424_aesni_ecb,
+    ntag424_aesni_cbc,
+    ntag424_aesni_cbc_mac,
+    ntag424_aesni_free,
+    ntag424_platform_random,
+    ntag424_aesni_cmac_batch}; ///< AES-NI provider
+
+/**************************************************************************/
+/*!
+    @brief   check once whether the cpu has AES-NI.
+
+    @return  true = ntag424_crypto_aesni may be used
+*/
+/**************************************************************************/
+bool ntag424_crypto_aesni_available()
+{
+  static int8_t has_aesni = -1;
+  if (has_aesni < 0)
+  {
+    __builtin_cpu_init();
+    has_aesni = __builtin_cpu_supports("aes") ? 1 : 0;
+  }
+  return has_aesni == 1;
+}
+
+#endif
@@ -0,0 +1,191 @@
+/**************************************************************************/
+/*!
+    @file ntag424_diversify.cpp
+
+    AN10922 key diversification and derived key cache, see
+    ntag424_diversify.h.
+*/
+/**************************************************************************/
+
+#include "ntag424_diversify.h"
+
+#include <string.h>
+
+#include "mbedtls/platform_util.h"
+
+/**************************************************************************/
+/*!
+    @brief   AES-128 diversification (AN10922 chapter 2.2): key =
+   CMAC(master, 0x01 || input), with the input padded to 32 byte and the
+   last block masked with K2 if padding was added. The padding to two
+   blocks differs from plain cmac for inputs below 16 byte, it is folded in
+   by masking the last block with K1 ^ K2, which the cmac engine then
+   turns into K2.
+
+    @param   ctx      cmac engine, initialized with ntag424_cmac_init()
+    @param   master   16 byte master key
+    @param   input    diversification input, e.g. UID || AID || SystemID
+    @param   length   length of input (1-31)
+    @param   key      outputbuffer for the diversified key (16 byte)
+
+    @return  1 = success; 0 = length invalid or aes failed
+*/
+/**************************************************************************/
+uint8_t ntag424_diversify(ntag424_CMACType *ctx, const uint8_t *master,
+                          const uint8_t *input, uint8_t length, uint8_t *key)
+{
+  uint8_t data[2 * NTAG424_CMAC_BLOCKSIZE];
+
+  if ((length == 0) || (length > NTAG424_DIVERSIFY_INPUT_MAXSIZE) ||
+      !ntag424_cmac_setkey(ctx, master))
+  {
+    return 0;
+  }
+  data[0] = NTAG424_DIVERSIFY_CONST;
+  memcpy(data + 1, input, length);
+  uint8_t used = length + 1;
+  if (used < sizeof(data))
+  {
+    data[used] = 0x80;
+    memset(data + used + 1, 0, sizeof(data) - used - 1);
+    for (int i = 0; i < NTAG424_CMAC_BLOCKSIZE; i++)
+    {
+      data[NTAG424_CMAC_BLOCKSIZE + i] ^= ctx->k1[i] ^ ctx->k2[i];
+    }
+  }
+  ntag424_cmac_update(ctx, data, sizeof(data));
+  ntag424_cmac_finish(ctx, key);
+  mbedtls_platform_zeroize(data, sizeof(data));
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   initialize an empty derived key cache on caller owned storage.
+
+    @param   cache              derived key cache
+    @param   masters            key store with the master keys
+    @param   system_id          system identifier, appended to the UID as
+   diversification input (NULL if system_id_length is 0)
+    @param   system_id_length   length of system_id
+    @param   entries            storage for size entries
+    @param   size               number of entries
+    @param   provider           crypto provider, NULL = default
+*/
+/**************************************************************************/
+void ntag424_divcache_init(ntag424_DivCacheType *cache,
+                           ntag424_KeyStoreType *masters,
+                           const uint8_t *system_id, uint8_t system_id_length,
+                           ntag424_DivKeyType *entries, uint8_t size,
+                           const ntag424_CryptoProviderType *provider)
+{
+  cache->masters = masters;
+  cache->system_id = system_id;
+  cache->system_id_length = system_id_length;
+  cache->entries = entries;
+  cache->size = size;
+  ntag424_cmac_init(&cache->cmac, provider);
+  ntag424_divcache_clear(cache);
+}
+
+/**************************************************************************/
+/*!
+    @brief   diversified key of a card. Served from the cache if the card
+   was seen before, otherwise derived from the master key for (keyno,
+   version) and stored in place of the least recently used entry.
+
+    @param   cache        derived key cache
+    @param   uid          UID of the card
+    @param   uid_length   length of uid
+    @param   keyno        key number
+    @param   version      key version
+
+    @return  16 byte key, valid until the next call; NULL = no master key
+   for (keyno, version) or UID/system identifier too long
+*/
+/**************************************************************************/
+uint8_t *ntag424_divcache_get(ntag424_DivCacheType *cache, const uint8_t *uid,
+                              uint8_t uid_length, uint8_t keyno,
+                              uint8_t version)
+{
+  if ((uid_length == 0) || (uid_length > NTAG424_DIVERSIFY_UID_MAXSIZE) ||
+      (uid_length + cache->system_id_length >
+       NTAG424_DIVERSIFY_INPUT_MAXSIZE))
+  {
+    return NULL;
+  }
+  ntag424_DivKeyType *victim = NULL;
+  for (uint8_t i = 0; i < cache->size; i++)
+  {
+    ntag424_DivKeyType *entry = &cache->entries[i];
+    if ((entry->uid_length == uid_length) && (entry->keyno == keyno) &&
+        (entry->version == version) &&
+        (memcmp(entry->uid, uid, uid_length) == 0))
+    {
+      entry->used = ++cache->tick;
+      cache->hits++;
+      return entry->key;
+    }
+    if ((victim == NULL) || (victim->uid_length != 0 &&
+                             (entry->uid_length == 0 ||
+                              entry->used < victim->used)))
+    {
+      victim = entry;
+    }
+  }
+
+  uint8_t *master = ntag424_keystore_find(cache->masters, keyno, version);
+  if ((master == NULL) || (victim == NULL))
+  {
+    return NULL;
+  }
+  uint8_t input[NTAG424_DIVERSIFY_INPUT_MAXSIZE];
+  memcpy(input, uid, uid_length);
+  if (cache->system_id_length > 0)
+  {
+    memcpy(input + uid_length, cache->system_id, cache->system_id_length);
+  }
+  if (!ntag424_diversify(&cache->cmac, master, input,
+                         uid_length + cache->system_id_length, victim->key))
+  {
+    victim->uid_length = 0;
+    return NULL;
+  }
+  memcpy(victim->uid, uid, uid_length);
+  victim->uid_length = uid_length;
+  victim->keyno = keyno;
+  victim->version = version;
+  victim->used = ++cache->tick;
+  cache->misses++;
+  return victim->key;
+}
+
+/**************************************************************************/
+/*!
+    @brief   remove all derived keys and wipe the key material. Call after
+   the master keys changed.
+
+    @param   cache    derived key cache
+*/
+/**************************************************************************/
+void ntag424_divcache_clear(ntag424_DivCacheType *cache)
+{
+  mbedtls_platform_zeroize(cache->entries,
+                           cache->size * sizeof(ntag424_DivKeyType));
+  cache->tick = 0;
+  cache->hits = 0;
+  cache->misses = 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief   wipe the cache and release the cmac engine.
+
+    @param   cache    derived key cache
+*/
+/**************************************************************************/
+void ntag424_divcache_free(ntag424_DivCacheType *cache)
+{
+  ntag424_divcache_clear(cache);
+  ntag424_cmac_free(&cache->cmac);
+}
@@ -0,0 +1,70 @@
+/**************************************************************************/
+/*!
+    @file ntag424_diversify.h
+
+    AES-128 key diversification after NXP AN10922: every card gets its own
+    keys, derived from a master key and the card UID with one cmac. The
+    derived keys are kept in a small LRU cache keyed by (UID, key number,
+    key version), so a card seen again costs a table lookup instead of a
+    key expansion and two aes blocks. The master keys come from a
+    ntag424_KeyStoreType, the caller provides the cache storage.
+*/
+/**************************************************************************/
+
+#ifndef NTAG424_DIVERSIFY_H
+#define NTAG424_DIVERSIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ntag424_cmac.h"
+#include "ntag424_keystore.h"
+
+#define NTAG424_DIVERSIFY_INPUT_MAXSIZE 31 ///< Max. diversification input
+#define NTAG424_DIVERSIFY_UID_MAXSIZE 10   ///< Max. UID size in the cache
+#define NTAG424_DIVERSIFY_CONST 0x01       ///< AES-128 derivation constant
+
+/**
+ * @brief One derived key of the cache.
+ */
+struct ntag424_DivKeyType
+{
+  uint8_t uid[NTAG424_DIVERSIFY_UID_MAXSIZE]; ///< UID of the card
+  uint8_t uid_length;                         ///< length of uid, 0 = unused
+  uint8_t keyno;                              ///< key number (0-4)
+  uint8_t version;                            ///< key version
+  uint32_t used;                              ///< tick of the last use
+  uint8_t key[NTAG424_KEYSTORE_KEYSIZE];      ///< diversified key
+};
+
+/**
+ * @brief Derived key cache, entries point to caller owned storage.
+ */
+struct ntag424_DivCacheType
+{
+  ntag424_KeyStoreType *masters; ///< master keys by (keyno, version)
+  const uint8_t *system_id;      ///< system identifier appended to the UID
+  uint8_t system_id_length;      ///< length of system_id, may be 0
+  ntag424_DivKeyType *entries;   ///< entry storage
+  uint8_t size;                  ///< number of entries the storage holds
+  uint32_t tick;                 ///< use counter for the LRU order
+  uint32_t hits;                 ///< lookups served from the cache
+  uint32_t misses;               ///< lookups that derived the key
+  ntag424_CMACType cmac;         ///< cmac engine for the derivation
+};
+
+uint8_t ntag424_diversify(ntag424_CMACType *ctx, const uint8_t *master,
+                          const uint8_t *input, uint8_t length,
+                          uint8_t *key);
+void ntag424_divcache_init(ntag424_DivCacheType *cache,
+                           ntag424_KeyStoreType *masters,
+                           const uint8_t *system_id, uint8_t system_id_length,
+                           ntag424_DivKeyType *entries, uint8_t size,
+                           const ntag424_CryptoProviderType *provider = NULL);
+uint8_t *ntag424_divcache_get(ntag424_DivCacheType *cache, const uint8_t *uid,
+                              uint8_t uid_length, uint8_t keyno,
+                              uint8_t version);
+void ntag424_divcache_clear(ntag424_DivCacheType *cache);
+void ntag424_divcache_free(ntag424_DivCacheType *cache);
+
+#endif
@@ -0,0 +1,410 @@
+/**************************************************************************/
+/*!
+    @file ntag424_filesettings.cpp
+
+    Typed NTAG424 file settings, see ntag424_filesettings.h.
+*/
+/**************************************************************************/
+
+#include "ntag424_filesettings.h"
+
+#include <string.h>
+
+#define NTAG424_FS_COMMBITS_PLAIN 0x00 ///< FileOption CommMode plain
+#define NTAG424_FS_COMMBITS_MAC 0x01   ///< FileOption CommMode MAC
+#define NTAG424_FS_COMMBITS_FULL 0x03  ///< FileOption CommMode full
+#define NTAG424_FS_SDM_RFU 0x0E        ///< SDMOptions bits that must be 0
+#define NTAG424_FS_FIELDS 8            ///< Number of 24 bit SDM fields
+#define NTAG424_FS_MODE_PLAIN 0x00     ///< NTAG424_COMM_MODE_PLAIN
+#define NTAG424_FS_MODE_MAC 0x01       ///< NTAG424_COMM_MODE_MAC
+#define NTAG424_FS_MODE_FULL 0x02      ///< NTAG424_COMM_MODE_FULL
+
+#define NTAG424_FS_HAS_UID 0x01          ///< UIDOffset present
+#define NTAG424_FS_HAS_READCTR 0x02      ///< SDMReadCtrOffset present
+#define NTAG424_FS_HAS_PICCDATA 0x04     ///< PICCDataOffset present
+#define NTAG424_FS_HAS_MACINPUT 0x08     ///< SDMMACInputOffset present
+#define NTAG424_FS_HAS_ENCOFFSET 0x10    ///< SDMENCOffset present
+#define NTAG424_FS_HAS_ENCLENGTH 0x20    ///< SDMENCLength present
+#define NTAG424_FS_HAS_MAC 0x40          ///< SDMMACOffset present
+#define NTAG424_FS_HAS_READCTRLIMIT 0x80 ///< SDMReadCtrLimit present
+
+/// 24 bit SDM fields in the order of the ChangeFileSettings data
+static uint32_t ntag424_FileSettingsType::*const ntag424_fs_fields
+    [NTAG424_FS_FIELDS] = {&ntag424_FileSettingsType::uid_offset,
+                           &ntag424_FileSettingsType::read_ctr_offset,
+                           &ntag424_FileSettingsType::picc_data_offset,
+                           &ntag424_FileSettingsType::mac_input_offset,
+                           &ntag424_FileSettingsType::enc_offset,
+                           &ntag424_FileSettingsType::enc_length,
+                           &ntag424_FileSettingsType::mac_offset,
+                           &ntag424_FileSettingsType::read_ctr_limit};
+
+/**************************************************************************/
+/*!
+    @brief   which of the 24 bit SDM fields are present for the options and
+   access rights of settings.
+
+    @param   settings   file settings
+
+    @return  NTAG424_FS_HAS_* bits, bit i = ntag424_fs_fields[i]
+*/
+/**************************************************************************/
+static uint8_t ntag424_fs_present(const ntag424_FileSettingsType *settings)
+{
+  uint8_t present = 0;
+  if (!settings->sdm_enabled)
+  {
+    return 0;
+  }
+  if (settings->sdm_meta_read == NTAG424_FS_ACCESS_FREE)
+  {
+    if (settings->sdm_options & NTAG424_FS_SDM_UID)
+    {
+      present |= NTAG424_FS_HAS_UID;
+    }
+    if (settings->sdm_options & NTAG424_FS_SDM_READCTR)
+    {
+      present |= NTAG424_FS_HAS_READCTR;
+    }
+  }
+  else if (settings->sdm_meta_read <= NTAG424_FS_MAXKEY)
+  {
+    present |= NTAG424_FS_HAS_PICCDATA;
+  }
+  if (settings->sdm_file_read != NTAG424_FS_ACCESS_NONE)
+  {
+    present |= NTAG424_FS_HAS_MACINPUT;
+    if (settings->sdm_options & NTAG424_FS_SDM_ENCFILEDATA)
+    {
+      present |= NTAG424_FS_HAS_ENCOFFSET | NTAG424_FS_HAS_ENCLENGTH;
+    }
+    present |= NTAG424_FS_HAS_MAC;
+  }
+  if (settings->sdm_options & NTAG424_FS_SDM_READCTRLIMIT)
+  {
+    present |= NTAG424_FS_HAS_READCTRLIMIT;
+  }
+  return present;
+}
+
+/**************************************************************************/
+/*!
+    @brief   true if access is a key number, E or F.
+
+    @param   access   access condition nibble
+
+    @return  true = valid
+*/
+/**************************************************************************/
+static bool ntag424_fs_access_valid(uint8_t access)
+{
+  return access <= NTAG424_FS_MAXKEY || access == NTAG424_FS_ACCESS_FREE ||
+         access == NTAG424_FS_ACCESS_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief   read a 24 bit LSB first value.
+
+    @param   buffer   3 bytes
+
+    @return  value
+*/
+/**************************************************************************/
+static uint32_t ntag424_fs_get24(const uint8_t *buffer)
+{
+  return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) |
+         ((uint32_t)buffer[2] << 16);
+}
+
+/**************************************************************************/
+/*!
+    @brief   write a 24 bit value LSB first.
+
+    @param   buffer   outputbuffer (3 bytes)
+    @param   value    value (<= 0xFFFFFF)
+*/
+/**************************************************************************/
+static void ntag424_fs_put24(uint8_t *buffer, uint32_t value)
+{
+  buffer[0] = (uint8_t)value;
+  buffer[1] = (uint8_t)(value >> 8);
+  buffer[2] = (uint8_t)(value >> 16);
+}
+
+/**************************************************************************/
+/*!
+    @brief   decode the response data of GetFileSettings.
+
+    @param   buffer     response data (without MAC and status)
+    @param   length     length of buffer
+    @param   settings   decoded settings, absent SDM fields are 0
+
+    @return  1 = success; 0 = length does not match the settings
+*/
+/**************************************************************************/
+uint8_t ntag424_filesettings_decode(const uint8_t *buffer, uint8_t length,
+                                    ntag424_FileSettingsType *settings)
+{
+  memset(settings, 0, sizeof(*settings));
+  if (length < 7)
+  {
+    return 0;
+  }
+  settings->file_type = buffer[0];
+  uint8_t option = buffer[1];
+  switch (option & NTAG424_FS_OPTION_COMMMODE)
+  {
+  case NTAG424_FS_COMMBITS_MAC:
+    settings->comm_mode = NTAG424_FS_MODE_MAC;
+    break;
+  case NTAG424_FS_COMMBITS_FULL:
+    settings->comm_mode = NTAG424_FS_MODE_FULL;
+    break;
+  default:
+    settings->comm_mode = NTAG424_FS_MODE_PLAIN;
+    break;
+  }
+  settings->sdm_enabled = (option & NTAG424_FS_OPTION_SDM) != 0;
+  settings->read_write = buffer[2] >> 4;
+  settings->change = buffer[2] & 0x0F;
+  settings->read = buffer[3] >> 4;
+  settings->write = buffer[3] & 0x0F;
+  settings->file_size = ntag424_fs_get24(buffer + 4);
+  uint8_t pos = 7;
+  if (!settings->sdm_enabled)
+  {
+    settings->sdm_meta_read = NTAG424_FS_ACCESS_NONE;
+    settings->sdm_file_read = NTAG424_FS_ACCESS_NONE;
+    settings->sdm_ctr_ret = NTAG424_FS_ACCESS_NONE;
+    return (length == pos) ? 1 : 0;
+  }
+  if (length < pos + 3)
+  {
+    return 0;
+  }
+  // SDMAccessRights: RFU || SDMCtrRet, then SDMMetaRead || SDMFileRead
+  settings->sdm_options = buffer[pos];
+  settings->sdm_ctr_ret = buffer[pos + 1] & 0x0F;
+  settings->sdm_meta_read = buffer[pos + 2] >> 4;
+  settings->sdm_file_read = buffer[pos + 2] & 0x0F;
+  pos += 3;
+  uint8_t present = ntag424_fs_present(settings);
+  for (int i = 0; i < NTAG424_FS_FIELDS; i++)
+  {
+    if (present & (1 << i))
+    {
+      if (length < pos + 3)
+      {
+        return 0;
+      }
+      settings->*ntag424_fs_fields[i] = ntag424_fs_get24(buffer + pos);
+      pos += 3;
+    }
+  }
+  return (length == pos) ? 1 : 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief   encode settings as ChangeFileSettings data (FileOption,
+   AccessRights and the SDM fields). FileType and FileSize can not be
+   changed and are not part of it.
+
+    @param   settings   file settings, must pass
+   ntag424_filesettings_validate()
+    @param   buffer     outputbuffer (>= NTAG424_FS_ENCODED_MAXSIZE bytes)
+
+    @return  length of the encoded data; 0 = settings invalid
+*/
+/**************************************************************************/
+uint8_t ntag424_filesettings_encode(const ntag424_FileSettingsType *settings,
+                                    uint8_t *buffer)
+{
+  if (!ntag424_filesettings_validate(settings))
+  {
+    return 0;
+  }
+  uint8_t option = NTAG424_FS_COMMBITS_PLAIN;
+  if (settings->comm_mode == NTAG424_FS_MODE_MAC)
+  {
+    option = NTAG424_FS_COMMBITS_MAC;
+  }
+  else if (settings->comm_mode == NTAG424_FS_MODE_FULL)
+  {
+    option = NTAG424_FS_COMMBITS_FULL;
+  }
+  if (settings->sdm_enabled)
+  {
+    option |= NTAG424_FS_OPTION_SDM;
+  }
+  buffer[0] = option;
+  buffer[1] = (uint8_t)((settings->read_write << 4) | settings->change);
+  buffer[2] = (uint8_t)((settings->read << 4) | settings->write);
+  uint8_t pos = 3;
+  if (!settings->sdm_enabled)
+  {
+    return pos;
+  }
+  buffer[pos++] = settings->sdm_options;
+  buffer[pos++] = (uint8_t)(0xF0 | settings->sdm_ctr_ret);
+  buffer[pos++] =
+      (uint8_t)((settings->sdm_meta_read << 4) | settings->sdm_file_read);
+  uint8_t present = ntag424_fs_present(settings);
+  for (int i = 0; i < NTAG424_FS_FIELDS; i++)
+  {
+    if (present & (1 << i))
+    {
+      ntag424_fs_put24(buffer + pos, settings->*ntag424_fs_fields[i]);
+      pos += 3;
+    }
+  }
+  return pos;
+}
+
+/**************************************************************************/
+/*!
+    @brief   check comm mode, access rights and the SDM configuration: the
+   options fit together, every mirrored field lies inside the file (if
+   file_size is known, i.e. not 0) and no two mirrored fields overlap.
+
+    @param   settings   file settings
+
+    @return  1 = valid; 0 = invalid
+*/
+/**************************************************************************/
+uint8_t ntag424_filesettings_validate(const ntag424_FileSettingsType *settings)
+{
+  if (settings->comm_mode > NTAG424_FS_MODE_FULL ||
+      !ntag424_fs_access_valid(settings->read) ||
+      !ntag424_fs_access_valid(settings->write) ||
+      !ntag424_fs_access_valid(settings->read_write) ||
+      !ntag424_fs_access_valid(settings->change) ||
+      settings->file_size > NTAG424_FS_MAX24)
+  {
+    return 0;
+  }
+  if (!settings->sdm_enabled)
+  {
+    return 1;
+  }
+  uint8_t options = settings->sdm_options;
+  if (settings->file_type != NTAG424_FS_FILETYPE_STANDARD ||
+      !(options & NTAG424_FS_SDM_ASCII) || (options & NTAG424_FS_SDM_RFU) ||
+      !ntag424_fs_access_valid(settings->sdm_meta_read) ||
+      !ntag424_fs_access_valid(settings->sdm_file_read) ||
+      !ntag424_fs_access_valid(settings->sdm_ctr_ret))
+  {
+    return 0;
+  }
+  uint8_t present = ntag424_fs_present(settings);
+  for (int i = 0; i < NTAG424_FS_FIELDS; i++)
+  {
+    if ((present & (1 << i)) &&
+        settings->*ntag424_fs_fields[i] > NTAG424_FS_MAX24)
+    {
+      return 0;
+    }
+  }
+  // encrypted PICCData needs something to encrypt
+  if ((present & NTAG424_FS_HAS_PICCDATA) &&
+      !(options & (NTAG424_FS_SDM_UID | NTAG424_FS_SDM_READCTR)))
+  {
+    return 0;
+  }
+  if (options & NTAG424_FS_SDM_ENCFILEDATA)
+  {
+    // SDMENCFileData is keyed with UID and SDMReadCtr and needs a MAC
+    if (settings->sdm_file_read == NTAG424_FS_ACCESS_NONE ||
+        (options & (NTAG424_FS_SDM_UID | NTAG424_FS_SDM_READCTR)) !=
+            (NTAG424_FS_SDM_UID | NTAG424_FS_SDM_READCTR) ||
+        settings->enc_length == 0 ||
+        settings->enc_length % (2 * NTAG424_AES_BLOCKSIZE) != 0 ||
+        settings->enc_offset < settings->mac_input_offset ||
+        settings->enc_offset + settings->enc_length > settings->mac_offset)
+    {
+      return 0;
+    }
+  }
+  if ((present & NTAG424_FS_HAS_MAC) &&
+      settings->mac_input_offset > settings->mac_offset)
+  {
+    return 0;
+  }
+
+  // mirrored fields: inside the file and not overlapping
+  struct
+  {
+    uint32_t offset;
+    uint32_t length;
+  } mirror[5];
+  uint8_t count = 0;
+  if (present & NTAG424_FS_HAS_UID)
+  {
+    mirror[count++] = {settings->uid_offset, 2 * NTAG424_SDM_UID_SIZE};
+  }
+  if (present & NTAG424_FS_HAS_READCTR)
+  {
+    mirror[count++] = {settings->read_ctr_offset, 2 * NTAG424_SDM_CTR_SIZE};
+  }
+  if (present & NTAG424_FS_HAS_PICCDATA)
+  {
+    mirror[count++] = {settings->picc_data_offset,
+                       2 * NTAG424_SDM_PICCDATA_SIZE};
+  }
+  if (present & NTAG424_FS_HAS_ENCOFFSET)
+  {
+    mirror[count++] = {settings->enc_offset, settings->enc_length};
+  }
+  if (present & NTAG424_FS_HAS_MAC)
+  {
+    mirror[count++] = {settings->mac_offset, 2 * NTAG424_SDM_MAC_SIZE};
+  }
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (settings->file_size != 0 &&
+        mirror[i].offset + mirror[i].length > settings->file_size)
+    {
+      return 0;
+    }
+    for (uint8_t j = i + 1; j < count; j++)
+    {
+      if (mirror[i].offset < mirror[j].offset + mirror[j].length &&
+          mirror[j].offset < mirror[i].offset + mirror[i].length)
+      {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   offsets of the mirrored fields for ntag424_sdm_parse().
+
+    @param   settings   file settings of the SDM file
+    @param   layout     layout, fields not mirrored are
+   NTAG424_SDM_OFFSET_NONE
+*/
+/**************************************************************************/
+void ntag424_filesettings_sdm_layout(const ntag424_FileSettingsType *settings,
+                                     ntag424_SDMLayoutType *layout)
+{
+  uint8_t present = ntag424_fs_present(settings);
+  const uint32_t none = NTAG424_SDM_OFFSET_NONE;
+  layout->uid_offset =
+      (present & NTAG424_FS_HAS_UID) ? settings->uid_offset : none;
+  layout->read_ctr_offset =
+      (present & NTAG424_FS_HAS_READCTR) ? settings->read_ctr_offset : none;
+  layout->picc_data_offset =
+      (present & NTAG424_FS_HAS_PICCDATA) ? settings->picc_data_offset : none;
+  layout->mac_input_offset =
+      (present & NTAG424_FS_HAS_MACINPUT) ? settings->mac_input_offset : none;
+  layout->enc_offset =
+      (present & NTAG424_FS_HAS_ENCOFFSET) ? settings->enc_offset : none;
+  layout->enc_length =
+      (present & NTAG424_FS_HAS_ENCLENGTH) ? settings->enc_length : 0;
+  layout->mac_offset =
+      (present & NTAG424_FS_HAS_MAC) ? settings->mac_offset : none;
+}
@@ -0,0 +1,74 @@
+/**************************************************************************/
+/*!
+    @file ntag424_filesettings.h
+
+    Typed NTAG424 file settings: decoding of the GetFileSettings response,
+    encoding of the ChangeFileSettings data including all SDM fields, and
+    validation of the SDM offsets against each other and the file size
+    (NT4H2421Gx datasheet chapter 10.7). Sizes and offsets are 24 bit.
+*/
+/**************************************************************************/
+
+#ifndef NTAG424_FILESETTINGS_H
+#define NTAG424_FILESETTINGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ntag424_sdm.h"
+
+#define NTAG424_FS_FILETYPE_STANDARD 0x00 ///< FileType: StandardData file
+#define NTAG424_FS_OPTION_SDM 0x40        ///< FileOption: SDM and mirroring
+#define NTAG424_FS_OPTION_COMMMODE 0x03   ///< FileOption: CommMode bits
+
+#define NTAG424_FS_SDM_UID 0x80          ///< SDMOptions: UID mirroring
+#define NTAG424_FS_SDM_READCTR 0x40      ///< SDMOptions: SDMReadCtr mirroring
+#define NTAG424_FS_SDM_READCTRLIMIT 0x20 ///< SDMOptions: SDMReadCtrLimit
+#define NTAG424_FS_SDM_ENCFILEDATA 0x10  ///< SDMOptions: SDMENCFileData
+#define NTAG424_FS_SDM_ASCII 0x01        ///< SDMOptions: ASCII encoding
+
+#define NTAG424_FS_ACCESS_FREE 0x0E ///< Access condition: free access
+#define NTAG424_FS_ACCESS_NONE 0x0F ///< Access condition: no access
+#define NTAG424_FS_MAXKEY 0x04      ///< Highest application key number
+#define NTAG424_FS_MAX24 0xFFFFFFUL ///< Largest 24 bit size or offset
+
+#define NTAG424_FS_ENCODED_MAXSIZE 27  ///< Max. size of ChangeFileSettings data
+#define NTAG424_FS_RESPONSE_MAXSIZE 31 ///< Max. size of GetFileSettings data
+
+/**
+ * @brief File settings of one file, the SDM fields are only used if
+ * sdm_enabled is set and the matching option/access right needs them.
+ */
+struct ntag424_FileSettingsType
+{
+  uint8_t file_type; ///< FileType, NTAG424_FS_FILETYPE_STANDARD
+  uint8_t comm_mode; ///< NTAG424_COMM_MODE_PLAIN, _MAC or _FULL
+  bool sdm_enabled;  ///< FileOption bit 6
+  uint8_t read;       ///< Read access condition (0-4, E, F)
+  uint8_t write;      ///< Write access condition
+  uint8_t read_write; ///< ReadWrite access condition
+  uint8_t change;     ///< Change access condition
+  uint32_t file_size; ///< FileSize (GetFileSettings only)
+  uint8_t sdm_options;      ///< SDMOptions, NTAG424_FS_SDM_*
+  uint8_t sdm_meta_read;    ///< SDMMetaRead access right
+  uint8_t sdm_file_read;    ///< SDMFileRead access right
+  uint8_t sdm_ctr_ret;      ///< SDMCtrRet access right
+  uint32_t uid_offset;       ///< UIDOffset (SDMMetaRead = E)
+  uint32_t read_ctr_offset;  ///< SDMReadCtrOffset (SDMMetaRead = E)
+  uint32_t picc_data_offset; ///< PICCDataOffset (SDMMetaRead = key)
+  uint32_t mac_input_offset; ///< SDMMACInputOffset (SDMFileRead != F)
+  uint32_t enc_offset;       ///< SDMENCOffset (SDMENCFileData)
+  uint32_t enc_length;       ///< SDMENCLength (SDMENCFileData)
+  uint32_t mac_offset;       ///< SDMMACOffset (SDMFileRead != F)
+  uint32_t read_ctr_limit;   ///< SDMReadCtrLimit (option set)
+};
+
+uint8_t ntag424_filesettings_decode(const uint8_t *buffer, uint8_t length,
+                                    ntag424_FileSettingsType *settings);
+uint8_t ntag424_filesettings_encode(const ntag424_FileSettingsType *settings,
+                                    uint8_t *buffer);
+uint8_t ntag424_filesettings_validate(const ntag424_FileSettingsType *settings);
+void ntag424_filesettings_sdm_layout(const ntag424_FileSettingsType *settings,
+                                     ntag424_SDMLayoutType *layout);
+
+#endif
@@ -0,0 +1,941 @@
+/**************************************************************************/
+/*!
+    @file ntag424_keystore.cpp
+
+    (key number, key version) -> key lookup and the keys.json / binary
+    loaders, see ntag424_keystore.h.
+*/
+/**************************************************************************/
+
+#include "ntag424_keystore.h"
+
+#include <string.h>
+
+#include "mbedtls/platform_util.h"
+#include "ntag424_crc32.h"
+
+/**************************************************************************/
+/*!
+    @brief   initialize an empty key store on caller owned storage.
+
+    @param   store    key store
+    @param   entries  storage for size entries
+    @param   size     number of entries
+*/
+/**************************************************************************/
+void ntag424_keystore_init(ntag424_KeyStoreType *store,
+                           ntag424_KeyEntryType *entries, uint8_t size)
+{
+  store->entries = entries;
+  store->size = size;
+  store->count = 0;
+  memset(store->index, 0, sizeof(store->index));
+}
+
+/**************************************************************************/
+/*!
+    @brief   add a key or replace the key stored for (keyno, version).
+
+    @param   store    key store
+    @param   keyno    key number
+    @param   version  key version
+    @param   key      16 byte key
+
+    @return  1 = success; 0 = store is full or keyno invalid
+*/
+/**************************************************************************/
+uint8_t ntag424_keystore_add(ntag424_KeyStoreType *store, uint8_t keyno,
+                             uint8_t version, const uint8_t *key)
+{
+  uint8_t *stored = ntag424_keystore_find(store, keyno, version);
+  if (stored == NULL)
+  {
+    if ((keyno >= NTAG424_KEYSTORE_SLOTS) || (store->count >= store->size) ||
+        (store->count == 0xFF))
+    {
+      return 0;
+    }
+    ntag424_KeyEntryType *entry = &store->entries[store->count++];
+    entry->keyno = keyno;
+    entry->version = version;
+    store->index[keyno][version] = store->count;
+    stored = entry->key;
+  }
+  memcpy(stored, key, NTAG424_KEYSTORE_KEYSIZE);
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   look up the key for (keyno, version).
+
+    @param   store    key store
+    @param   keyno    key number
+    @param   version  key version as reported by GetKeyVersion
+
+    @return  16 byte key; NULL = not in the store
+*/
+/**************************************************************************/
+uint8_t *ntag424_keystore_find(ntag424_KeyStoreType *store, uint8_t keyno,
+                               uint8_t version)
+{
+  if (keyno >= NTAG424_KEYSTORE_SLOTS)
+  {
+    return NULL;
+  }
+  uint8_t entry = store->index[keyno][version];
+  return (entry == 0) ? NULL : store->entries[entry - 1].key;
+}
+
+/**************************************************************************/
+/*!
+    @brief   add a key that is not in the store yet. A file that lists the
+   same (keyno, version) twice is ambiguous, it must not silently keep the
+   last key.
+
+    @param   store    key store
+    @param   keyno    key number
+    @param   version  key version
+    @param   key      16 byte key
+
+    @return  1 = added; 0 = already in the store, invalid keyno or store full
+*/
+/**************************************************************************/
+static uint8_t ntag424_keystore_add_new(ntag424_KeyStoreType *store,
+                                        uint8_t keyno, uint8_t version,
+                                        const uint8_t *key)
+{
+  return (ntag424_keystore_find(store, keyno, version) == NULL) &&
+         ntag424_keystore_add(store, keyno, version, key);
+}
+
+/**************************************************************************/
+/*!
+    @brief   remove all keys and wipe the key material.
+
+    @param   store    key store
+*/
+/**************************************************************************/
+void ntag424_keystore_clear(ntag424_KeyStoreType *store)
+{
+  mbedtls_platform_zeroize(store->entries,
+                           store->size * sizeof(ntag424_KeyEntryType));
+  memset(store->index, 0, sizeof(store->index));
+  store->count = 0;
+}
+
+/// key numbers of the named keys of the nfc-server keys.json
+static const struct
+{
+  const char *name; ///< json member name
+  uint8_t keyno;    ///< key number
+} ntag424_keystore_names[NTAG424_KEYSTORE_SLOTS] = {{"masterKey", 0},
+                                                    {"authKey", 1},
+                                                    {"readKey", 2},
+                                                    {"writeKey", 3},
+                                                    {"changeKey", 4}};
+
+/**
+ * @brief Read position of the json parser.
+ */
+struct ntag424_JsonType
+{
+  const char *pos; ///< next character
+  const char *end; ///< end of the document
+};
+
+/**************************************************************************/
+/*!
+    @brief   skip whitespace.
+
+    @param   json   parser
+*/
+/**************************************************************************/
+static void ntag424_json_space(ntag424_JsonType *json)
+{
+  while ((json->pos < json->end) &&
+         ((*json->pos == ' ') || (*json->pos == '\t') ||
+          (*json->pos == '\r') || (*json->pos == '\n')))
+  {
+    json->pos++;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   skip whitespace, then consume c if it is the next character.
+
+    @param   json   parser
+    @param   c      expected character
+
+    @return  true = c consumed
+*/
+/**************************************************************************/
+static bool ntag424_json_accept(ntag424_JsonType *json, char c)
+{
+  ntag424_json_space(json);
+  if ((json->pos < json->end) && (*json->pos == c))
+  {
+    json->pos++;
+    return true;
+  }
+  return false;
+}
+
+/**************************************************************************/
+/*!
+    @brief   parse a string, escapes are kept as they are.
+
+    @param   json     parser
+    @param   start    first character of the string
+    @param   length   length of the string
+
+    @return  true = success
+*/
+/**************************************************************************/
+static bool ntag424_json_string(ntag424_JsonType *json, const char **start,
+                                size_t *length)
+{
+  if (!ntag424_json_accept(json, '"'))
+  {
+    return false;
+  }
+  *start = json->pos;
+  while (json->pos < json->end)
+  {
+    if (*json->pos == '\\')
+    {
+      json->pos++;
+    }
+    else if (*json->pos == '"')
+    {
+      *length = json->pos - *start;
+      json->pos++;
+      return true;
+    }
+    json->pos++;
+  }
+  return false;
+}
+
+/**************************************************************************/
+/*!
+    @brief   parse a non negative integer.
+
+    @param   json    parser
+    @param   value   parsed value
+    @param   max     largest valid value
+
+    @return  true = success
+*/
+/**************************************************************************/
+static bool ntag424_json_number(ntag424_JsonType *json, uint16_t *value,
+                                uint16_t max)
+{
+  ntag424_json_space(json);
+  const char *start = json->pos;
+  uint32_t result = 0;
+  while ((json->pos < json->end) && (*json->pos >= '0') &&
+         (*json->pos <= '9'))
+  {
+    result = result * 10 + (*json->pos++ - '0');
+    if (result > max)
+    {
+      return false;
+    }
+  }
+  *value = (uint16_t)result;
+  return json->pos != start;
+}
+
+/**************************************************************************/
+/*!
+    @brief   skip any value: string, number, literal, object or array.
+
+    @param   json   parser
+
+    @return  true = success
+*/
+/**************************************************************************/
+static bool ntag424_json_skip(ntag424_JsonType *json)
+{
+  const char *value;
+  size_t length;
+  int depth = 0;
+  ntag424_json_space(json);
+  const char *start = json->pos;
+  while (json->pos < json->end)
+  {
+    char c = *json->pos;
+    if (c == '"')
+    {
+      if (!ntag424_json_string(json, &value, &length))
+      {
+        return false;
+      }
+      if (depth == 0)
+      {
+        return true;
+      }
+      continue;
+    }
+    if ((c == '{') || (c == '['))
+    {
+      depth++;
+    }
+    else if ((c == '}') || (c == ']'))
+    {
+      if (depth == 0)
+      {
+        // end of the enclosing container
+        return json->pos != start;
+      }
+      if (--depth == 0)
+      {
+        json->pos++;
+        return true;
+      }
+    }
+    else if ((depth == 0) && ((c == ',') || (c == ' ') || (c == '\t') ||
+                              (c == '\r') || (c == '\n')))
+    {
+      return json->pos != start;
+    }
+    json->pos++;
+  }
+  return false;
+}
+
+/**************************************************************************/
+/*!
+    @brief   decode a key given as 32 hex digits.
+
+    @param   hex      hex digits
+    @param   length   number of digits
+    @param   key      outputbuffer (16 byte)
+
+    @return  true = success
+*/
+/**************************************************************************/
+static bool ntag424_json_key(const char *hex, size_t length, uint8_t *key)
+{
+  if (length != 2 * NTAG424_KEYSTORE_KEYSIZE)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < length; i++)
+  {
+    char c = hex[i];
+    uint8_t nibble;
+    if ((c >= '0') && (c <= '9'))
+    {
+      nibble = c - '0';
+    }
+    else if ((c >= 'A') && (c <= 'F'))
+    {
+      nibble = c - 'A' + 10;
+    }
+    else if ((c >= 'a') && (c <= 'f'))
+    {
+      nibble = c - 'a' + 10;
+    }
+    else
+    {
+      return false;
+    }
+    key[i / 2] = (i & 1) ? (uint8_t)(key[i / 2] | nibble)
+                         : (uint8_t)(nibble << 4);
+  }
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief   parse the "keys" array: objects with "slot", "version" and
+   "key", added to the store.
+
+    @param   json    parser, positioned before the array
+    @param   store   key store
+
+    @return  true = success
+*/
+/**************************************************************************/
+static bool ntag424_json_keys(ntag424_JsonType *json,
+                              ntag424_KeyStoreType *store)
+{
+  if (!ntag424_json_accept(json, '['))
+  {
+    return false;
+  }
+  if (ntag424_json_accept(json, ']'))
+  {
+    return true;
+  }
+  do
+  {
+    uint16_t slot = 0xFFFF, version = 0xFFFF;
+    uint8_t key[NTAG424_KEYSTORE_KEYSIZE];
+    bool has_key = false;
+    if (!ntag424_json_accept(json, '{'))
+    {
+      return false;
+    }
+    do
+    {
+      const char *name, *value;
+      size_t name_length, value_length;
+      if (!ntag424_json_string(json, &name, &name_length) ||
+          !ntag424_json_accept(json, ':'))
+      {
+        return false;
+      }
+      if ((name_length == 4) && (memcmp(name, "slot", 4) == 0))
+      {
+        if (!ntag424_json_number(json, &slot, NTAG424_KEYSTORE_SLOTS - 1))
+        {
+          return false;
+        }
+      }
+      else if ((name_length == 7) && (memcmp(name, "version", 7) == 0))
+      {
+        if (!ntag424_json_number(json, &version,
+                                 NTAG424_KEYSTORE_VERSIONS - 1))
+        {
+          return false;
+        }
+      }
+      else if ((name_length == 3) && (memcmp(name, "key", 3) == 0))
+      {
+        if (!ntag424_json_string(json, &value, &value_length) ||
+            !ntag424_json_key(value, value_length, key))
+        {
+          return false;
+        }
+        has_key = true;
+      }
+      else if (!ntag424_json_skip(json))
+      {
+        return false;
+      }
+    } while (ntag424_json_accept(json, ','));
+    bool added = ntag424_json_accept(json, '}') && has_key &&
+                 (slot != 0xFFFF) && (version != 0xFFFF) &&
+                 ntag424_keystore_add_new(store, (uint8_t)slot,
+                                          (uint8_t)version, key);
+    mbedtls_platform_zeroize(key, sizeof(key));
+    if (!added)
+    {
+      return false;
+    }
+  } while (ntag424_json_accept(json, ','));
+  return ntag424_json_accept(json, ']');
+}
+
+/**************************************************************************/
+/*!
+    @brief   parse a keys.json document into the store. The named keys of
+   the nfc-server (masterKey, authKey, readKey, writeKey, changeKey) are
+   keys 0-4 with the version of the "version" member
+   (NTAG424_KEYSTORE_JSON_VERSION if absent), defaultKey is version 0 of
+   every key. A "keys" array adds more keys, e.g. the previous version of a
+   rotated key: [{"slot": 1, "version": 2, "key": "A0A1..."}, ...]. Other
+   members are ignored. A (slot, version) given twice, e.g. a named key and
+   a "keys" entry of the same version or a named key at "version": 0 next
+   to defaultKey, is rejected.
+
+    @param   store    key store, cleared first
+    @param   json     json document
+    @param   length   length of json
+
+    @return  1 = success; 0 = syntax error, invalid or duplicate key or store
+   full (the store is left empty)
+*/
+/**************************************************************************/
+uint8_t ntag424_keystore_load_json(ntag424_KeyStoreType *store,
+                                   const char *json, size_t length)
+{
+  ntag424_JsonType parser = {json, json + length};
+  uint8_t named[NTAG424_KEYSTORE_SLOTS + 1][NTAG424_KEYSTORE_KEYSIZE];
+  uint8_t named_set = 0;
+  uint16_t version = NTAG424_KEYSTORE_JSON_VERSION;
+  bool ok = ntag424_json_accept(&parser, '{');
+
+  ntag424_keystore_clear(store);
+  if (ok && !ntag424_json_accept(&parser, '}'))
+  {
+    do
+    {
+      const char *name, *value;
+      size_t name_length, value_length;
+      ok = ntag424_json_string(&parser, &name, &name_length) &&
+           ntag424_json_accept(&parser, ':');
+      if (!ok)
+      {
+        break;
+      }
+      // named keys go to named[keyno], defaultKey to named[SLOTS]
+      int slot = -1;
+      for (uint8_t i = 0; i < NTAG424_KEYSTORE_SLOTS; i++)
+      {
+        if ((strlen(ntag424_keystore_names[i].name) == name_length) &&
+            (memcmp(ntag424_keystore_names[i].name, name, name_length) == 0))
+        {
+          slot = ntag424_keystore_names[i].keyno;
+        }
+      }
+      if ((name_length == 10) && (memcmp(name, "defaultKey", 10) == 0))
+      {
+        slot = NTAG424_KEYSTORE_SLOTS;
+      }
+      if (slot >= 0)
+      {
+        ok = !(named_set & (1 << slot)) &&
+             ntag424_json_string(&parser, &value, &value_length) &&
+             ntag424_json_key(value, value_length, named[slot]);
+        named_set |= 1 << slot;
+      }
+      else if ((name_length == 7) && (memcmp(name, "version", 7) == 0))
+      {
+        ok = ntag424_json_number(&parser, &version,
+                                 NTAG424_KEYSTORE_VERSIONS - 1);
+      }
+      else if ((name_length == 4) && (memcmp(name, "keys", 4) == 0))
+      {
+        ok = ntag424_json_keys(&parser, store);
+      }
+      else
+      {
+        ok = ntag424_json_skip(&parser);
+      }
+    } while (ok && ntag424_json_accept(&parser, ','));
+    ok = ok && ntag424_json_accept(&parser, '}');
+  }
+
+  for (uint8_t slot = 0; ok && (slot < NTAG424_KEYSTORE_SLOTS); slot++)
+  {
+    if (named_set & (1 << slot))
+    {
+      ok = ntag424_keystore_add_new(store, slot, (uint8_t)version,
+                                    named[slot]);
+    }
+    if (ok && (named_set & (1 << NTAG424_KEYSTORE_SLOTS)))
+    {
+      ok = ntag424_keystore_add_new(store, slot, 0,
+                                    named[NTAG424_KEYSTORE_SLOTS]);
+    }
+  }
+  mbedtls_platform_zeroize(named, sizeof(named));
+  if (!ok)
+  {
+    ntag424_keystore_clear(store);
+    return 0;
+  }
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   load the binary export of ntag424_keystore_export(): "N4KS",
+   format, count, count records of keyno, version and key, CRC32 (LSB
+   first) of everything before it.
+
+    @param   store    key store, cleared first
+    @param   data     binary export
+    @param   length   length of data
+
+    @return  1 = success; 0 = format or CRC invalid, duplicate key or store
+   full (the store is left empty)
+*/
+/**************************************************************************/
+uint8_t ntag424_keystore_load_binary(ntag424_KeyStoreType *store,
+                                     const uint8_t *data, size_t length)
+{
+  ntag424_keystore_clear(store);
+  if ((length < NTAG424_KEYSTORE_HEADERSIZE + NTAG424_KEYSTORE_CRCSIZE) ||
+      (memcmp(data, NTAG424_KEYSTORE_MAGIC, 4) != 0) ||
+      (data[4] != NTAG424_KEYSTORE_FORMAT))
+  {
+    return 0;
+  }
+  uint8_t count = data[5];
+  size_t body = NTAG424_KEYSTORE_HEADERSIZE +
+                (size_t)count * NTAG424_KEYSTORE_RECORDSIZE;
+  if (length != body + NTAG424_KEYSTORE_CRCSIZE)
+  {
+    return 0;
+  }
+  uint32_t crc = (uint32_t)data[body] | ((uint32_t)data[body + 1] << 8) |
+                 ((uint32_t)data[body + 2] << 16) |
+                 ((uint32_t)data[body + 3] << 24);
+  if (crc != ntag424_crc32(data, body))
+  {
+    return 0;
+  }
+  const uint8_t *record = data + NTAG424_KEYSTORE_HEADERSIZE;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (!ntag424_keystore_add_new(store, record[0], record[1], record + 2))
+    {
+      ntag424_keystore_clear(store);
+      return 0;
+    }
+    record += NTAG424_KEYSTORE_RECORDSIZE;
+  }
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   write the keys of the store in the binary format of
+   ntag424_keystore_load_binary().
+
+    @param   store    key store
+    @param   buffer   outputbuffer
+    @param   size     size of buffer
+
+    @return  length of the export; 0 = buffer too small
+*/
+/**************************************************************************/
+size_t ntag424_keystore_export(const ntag424_KeyStoreType *store,
+                               uint8_t *buffer, size_t size)
+{
+  size_t body = NTAG424_KEYSTORE_HEADERSIZE +
+                (size_t)store->count * NTAG424_KEYSTORE_RECORDSIZE;
+  if (size < body + NTAG424_KEYSTORE_CRCSIZE)
+  {
+    return 0;
+  }
+  memcpy(buffer, NTAG424_KEYSTORE_MAGIC, 4);
+  buffer[4] = NTAG424_KEYSTORE_FORMAT;
+  buffer[5] = store->count;
+  uint8_t *record = buffer + NTAG424_KEYSTORE_HEADERSIZE;
+  for (uint8_t i = 0; i < store->count; i++)
+  {
+    record[0] = store->entries[i].keyno;
+    record[1] = store->entries[i].version;
+    memcpy(record + 2, store->entries[i].key, NTAG424_KEYSTORE_KEYSIZE);
+    record += NTAG424_KEYSTORE_RECORDSIZE;
+  }
+  uint32_t crc = ntag424_crc32(buffer, body);
+  for (int i = 0; i < NTAG424_KEYSTORE_CRCSIZE; i++)
+  {
+    buffer[body + i] = (uint8_t)(crc >> (8 * i));
+  }
+  return body + NTAG424_KEYSTORE_CRCSIZE;
+}
+
+/**************************************************************************/
+/*!
+    @brief   initialize a key ring on two initialized stores, first is in
+   use.
+
+    @param   ring     key ring
+    @param   first    store in use
+    @param   second   store for the next reload
+*/
+/**************************************************************************/
+void ntag424_keyring_init(ntag424_KeyRingType *ring,
+                          ntag424_KeyStoreType *first,
+                          ntag424_KeyStoreType *second)
+{
+  ring->stores[0] = first;
+  ring->stores[1] = second;
+  ring->active = 0;
+  ring->users[0] = 0;
+  ring->users[1] = 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief   hold the store to look keys up in for one card. A reload does
+   not touch a held store, release it when the card is done.
+
+    @param   ring     key ring
+
+    @return  key store in use
+*/
+/**************************************************************************/
+ntag424_KeyStoreType *ntag424_keyring_acquire(ntag424_KeyRingType *ring)
+{
+  for (;;)
+  {
+    uint8_t i = ring->active;
+    __sync_fetch_and_add(&ring->users[i], 1);
+    // a reload may have swapped in between, then hold the new store
+    if (ring->active == i)
+    {
+      return ring->stores[i];
+    }
+    __sync_fetch_and_sub(&ring->users[i], 1);
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   release a store of ntag424_keyring_acquire().
+
+    @param   ring     key ring
+    @param   store    store returned by ntag424_keyring_acquire()
+*/
+/**************************************************************************/
+void ntag424_keyring_release(ntag424_KeyRingType *ring,
+                             ntag424_KeyStoreType *store)
+{
+  __sync_fetch_and_sub(&ring->users[(store == ring->stores[0]) ? 0 : 1], 1);
+}
+
+/**************************************************************************/
+/*!
+    @brief   load new keys (keys.json or binary export, told apart by the
+   magic) into the inactive store and make it the active one. The inactive
+   store holds the keys in use before the previous reload; while a reader
+   still holds it nothing is loaded. If loading fails the keys in use stay
+   active. Only one thread may reload.
+
+    @param   ring     key ring
+    @param   data     keys.json or binary export
+    @param   length   length of data
+
+    @return  1 = success, new keys active; 0 = keys invalid or the inactive
+   store is still held (retry after the card is done)
+*/
+/**************************************************************************/
+uint8_t ntag424_keyring_reload(ntag424_KeyRingType *ring, const uint8_t *data,
+                               size_t length)
+{
+  uint8_t inactive = ring->active ^ 1;
+  ntag424_KeyStoreType *next = ring->stores[inactive];
+  uint8_t ok;
+  // a reader that acquires now sees active and leaves this store alone
+  __sync_synchronize();
+  if (ring->users[inactive] != 0)
+  {
+    return 0;
+  }
+  if ((length >= 4) && (memcmp(data, NTAG424_KEYSTORE_MAGIC, 4) == 0))
+  {
+    ok = ntag424_keystore_load_binary(next, data, length);
+  }
+  else
+  {
+    ok = ntag424_keystore_load_json(next, (const char *)data, length);
+  }
+  if (!ok)
+  {
+    return 0;
+  }
+  // the store must be complete before another core can see it
+  __sync_synchronize();
+  ring->active = inactive;
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   unload: wipe the keys of both stores.
+
+    @param   ring     key ring
+*/
+/**************************************************************************/
+void ntag424_keyring_clear(ntag424_KeyRingType *ring)
+{
+  ntag424_keystore_clear(ring->stores[0]);
+  ntag424_keystore_clear(ring->stores[1]);
+}
+
+/**************************************************************************/
+/*!
+    @brief   write the ChangeKey data of a change with a known JAMCRC of the
+   new key, see ntag424_keychange_prepare().
+
+    @param   change       key change, keyno checked by the caller
+    @param   jamcrc       JAMCRC32(newkey), unused for key 0
+    @param   cryptogram   outputbuffer for the key data
+*/
+/**************************************************************************/
+static void ntag424_keychange_keydata(const ntag424_KeyChangeType *change,
+                                      uint32_t jamcrc,
+                                      ntag424_KeyCryptogramType *cryptogram)
+{
+  uint8_t *keydata = cryptogram->data;
+  cryptogram->keyno = change->keyno;
+  if (change->keyno > 0)
+  {
+    for (int i = 0; i < 16; ++i)
+    {
+      keydata[i] = change->oldkey[i] ^ change->newkey[i];
+    }
+    keydata[16] = change->version;
+    // little endian
+    keydata[17] = (uint8_t)(jamcrc & 0xff);
+    keydata[18] = (uint8_t)((jamcrc >> 8) & 0xff);
+    keydata[19] = (uint8_t)((jamcrc >> 16) & 0xff);
+    keydata[20] = (uint8_t)((jamcrc >> 24) & 0xff);
+    cryptogram->length = 21;
+  }
+  else
+  {
+    memcpy(keydata, change->newkey, 16);
+    keydata[16] = change->version;
+    cryptogram->length = 17;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   precompute the session independent ChangeKey data: for key 1-4
+   (oldkey XOR newkey) || KeyVer || JamCRC32(newkey), for key 0 newkey ||
+   KeyVer. Padding, encryption and MAC depend on the session and are done by
+   Adafruit_PN532::ntag424_ChangeKey().
+
+    @param   change       key change
+    @param   cryptogram   outputbuffer for the key data
+
+    @return  1 = success; 0 = invalid key number
+*/
+/**************************************************************************/
+uint8_t ntag424_keychange_prepare(const ntag424_KeyChangeType *change,
+                                  ntag424_KeyCryptogramType *cryptogram)
+{
+  if (change->keyno >= NTAG424_KEYCOUNT)
+  {
+    return 0;
+  }
+  ntag424_keychange_keydata(
+      change, (change->keyno > 0) ? ntag424_jamcrc(change->newkey, 16) : 0,
+      cryptogram);
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   build a manifest, see ntag424_keychange_manifest().
+
+    @param   changes      key changes, key 0 at most once
+    @param   count        number of changes (max NTAG424_KEYCOUNT)
+    @param   jamcrcs      JAMCRC32 of every newkey; NULL = compute them
+    @param   manifest     outputbuffer for the prepared changes
+
+    @return  1 = success; 0 = invalid changes
+*/
+/**************************************************************************/
+static uint8_t ntag424_keychange_build(const ntag424_KeyChangeType *changes,
+                                       uint8_t count, const uint32_t *jamcrcs,
+                                       ntag424_KeyManifestType *manifest)
+{
+  const ntag424_KeyChangeType *masterchange = NULL;
+  manifest->count = 0;
+  if (count > NTAG424_KEYCOUNT)
+  {
+    return 0;
+  }
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (changes[i].keyno >= NTAG424_KEYCOUNT)
+    {
+      return 0;
+    }
+    if (changes[i].keyno == 0)
+    {
+      if (masterchange != NULL)
+      {
+        return 0;
+      }
+      masterchange = &changes[i];
+    }
+    else
+    {
+      ntag424_keychange_keydata(
+          &changes[i],
+          (jamcrcs != NULL) ? jamcrcs[i]
+                            : ntag424_jamcrc(changes[i].newkey, 16),
+          &manifest->keys[manifest->count++]);
+    }
+  }
+  if (masterchange != NULL)
+  {
+    ntag424_keychange_keydata(masterchange, 0,
+                              &manifest->keys[manifest->count++]);
+  }
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   precompute the key data of a set of key changes ahead of the
+   tap, in the order Adafruit_PN532::ntag424_ChangeKeys() sends them: key 0
+   last.
+
+    @param   changes      key changes, key 0 at most once
+    @param   count        number of changes (max NTAG424_KEYCOUNT)
+    @param   manifest     outputbuffer for the prepared changes
+
+    @return  1 = success; 0 = invalid changes
+*/
+/**************************************************************************/
+uint8_t ntag424_keychange_manifest(const ntag424_KeyChangeType *changes,
+                                   uint8_t count,
+                                   ntag424_KeyManifestType *manifest)
+{
+  return ntag424_keychange_build(changes, count, NULL, manifest);
+}
+
+/**************************************************************************/
+/*!
+    @brief   precompute the manifests of a batch of cards, e.g. on the host
+   before provisioning. Card c has the count changes starting at
+   changes[c * count], typically with its own diversified keys. The new
+   keys of NTAG424_KEYCHANGE_BATCH changes at a time are gathered and go
+   through ntag424_jamcrc_batch() together.
+
+    @param   changes      cards * count key changes
+    @param   count        number of changes per card (max NTAG424_KEYCOUNT)
+    @param   cards        number of cards
+    @param   manifests    outputbuffer for cards manifests
+
+    @return  1 = success; 0 = invalid changes (the manifests are wiped)
+*/
+/**************************************************************************/
+uint8_t ntag424_keychange_manifests(const ntag424_KeyChangeType *changes,
+                                    uint8_t count, size_t cards,
+                                    ntag424_KeyManifestType *manifests)
+{
+  uint8_t newkeys[NTAG424_KEYCHANGE_BATCH][NTAG424_KEYSTORE_KEYSIZE];
+  uint32_t jamcrcs[NTAG424_KEYCHANGE_BATCH];
+  // whole cards per chunk, an invalid count fails in the build
+  size_t per_chunk = ((count > 0) && (count <= NTAG424_KEYCOUNT))
+                         ? NTAG424_KEYCHANGE_BATCH / count
+                         : 1;
+  uint8_t ok = 1;
+  for (size_t c = 0; ok && (c < cards); c += per_chunk)
+  {
+    size_t chunk = (cards - c < per_chunk) ? cards - c : per_chunk;
+    const ntag424_KeyChangeType *first = changes + c * count;
+    size_t keys = (count <= NTAG424_KEYCOUNT) ? chunk * count : 0;
+    for (size_t k = 0; k < keys; k++)
+    {
+      // key 0 and invalid key numbers have no crc, their keys are not read
+      if ((first[k].keyno > 0) && (first[k].keyno < NTAG424_KEYCOUNT))
+      {
+        memcpy(newkeys[k], first[k].newkey, NTAG424_KEYSTORE_KEYSIZE);
+      }
+      else
+      {
+        memset(newkeys[k], 0, NTAG424_KEYSTORE_KEYSIZE);
+      }
+    }
+    ntag424_jamcrc_batch(newkeys[0], NTAG424_KEYSTORE_KEYSIZE,
+                         NTAG424_KEYSTORE_KEYSIZE, keys, jamcrcs);
+    for (size_t n = 0; ok && (n < chunk); n++)
+    {
+      ok = ntag424_keychange_build(first + n * count, count,
+                                   jamcrcs + n * count, &manifests[c + n]);
+    }
+  }
+  mbedtls_platform_zeroize(newkeys, sizeof(newkeys));
+  if (!ok)
+  {
+    mbedtls_platform_zeroize(manifests, cards * sizeof(manifests[0]));
+  }
+  return ok;
+}
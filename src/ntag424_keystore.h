@@ -0,0 +1,141 @@
+/**************************************************************************/
+/*!
+    @file ntag424_keystore.h
+
+    Key store for NTAG424 keys. Every entry maps a (key number, key version)
+    pair to its 16 byte aes key, so the key a card expects can be looked up
+    from the version GetKeyVersion reports instead of being guessed with
+    failing authentications. The caller provides the entry storage, a
+    (key number, key version) index makes every lookup a single table read.
+
+    Stores are filled from the keys.json of the nfc-server or from its
+    compact binary export ("N4KS"). A key ring of two stores reloads the
+    keys while cards are processed: the new keys are loaded into the
+    inactive store, then the stores are swapped. Readers hold the store of
+    a card with acquire/release, a reload does not overwrite a store that
+    is still held.
+
+    The session independent ChangeKey data of key changes is prepared here
+    too, without a reader: for one card, or as manifests for a whole batch
+    of cards ahead of provisioning.
+*/
+/**************************************************************************/
+
+#ifndef NTAG424_KEYSTORE_H
+#define NTAG424_KEYSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NTAG424_KEYSTORE_KEYSIZE 16     ///< Size of an aes128 key in byte
+#define NTAG424_KEYSTORE_SLOTS 5        ///< Key numbers of an application
+#define NTAG424_KEYSTORE_VERSIONS 256   ///< Key versions per key number
+#define NTAG424_KEYSTORE_JSON_VERSION 1 ///< Version of the named json keys
+
+#define NTAG424_KEYSTORE_MAGIC "N4KS"  ///< Magic of the binary export
+#define NTAG424_KEYSTORE_FORMAT 1      ///< Format version of the export
+#define NTAG424_KEYSTORE_HEADERSIZE 6  ///< Magic, format, count
+#define NTAG424_KEYSTORE_RECORDSIZE 18 ///< keyno, version, key
+#define NTAG424_KEYSTORE_CRCSIZE 4     ///< CRC32 over header and records
+
+/**
+ * @brief One key of the store.
+ */
+struct ntag424_KeyEntryType
+{
+  uint8_t keyno;                         ///< key number (0-4)
+  uint8_t version;                       ///< key version
+  uint8_t key[NTAG424_KEYSTORE_KEYSIZE]; ///< aes key
+};
+
+/**
+ * @brief Key store state, entries point to caller owned storage.
+ */
+struct ntag424_KeyStoreType
+{
+  ntag424_KeyEntryType *entries; ///< entry storage
+  uint8_t size;                  ///< number of entries the storage holds
+  uint8_t count;                 ///< number of entries used
+  uint8_t index[NTAG424_KEYSTORE_SLOTS]
+               [NTAG424_KEYSTORE_VERSIONS]; ///< entry + 1, 0 = no key
+};
+
+/**
+ * @brief Two key stores, one in use and one to load the next keys into.
+ */
+struct ntag424_KeyRingType
+{
+  ntag424_KeyStoreType *stores[2]; ///< the two stores
+  volatile uint8_t active;         ///< index of the store in use
+  volatile uint8_t users[2];       ///< readers holding each store
+};
+
+/**
+ * @brief One key change of Adafruit_PN532::ntag424_ChangeKeys().
+ */
+struct ntag424_KeyChangeType
+{
+  uint8_t keyno;   ///< key number (0-4)
+  uint8_t *oldkey; ///< current key (16 byte)
+  uint8_t *newkey; ///< new key (16 byte)
+  uint8_t version; ///< new key version
+};
+
+#define NTAG424_KEYCOUNT 5         ///< Number of application keys
+#define NTAG424_KEYDATA_MAXSIZE 21 ///< Size of the ChangeKey data of key 1-4
+#define NTAG424_KEYCHANGE_BATCH 20 ///< Keys per jamcrc batch of manifests
+
+/**
+ * @brief Session independent ChangeKey data, precomputed by
+ * ntag424_keychange_prepare().
+ */
+struct ntag424_KeyCryptogramType
+{
+  uint8_t keyno;                         ///< key number (0-4)
+  uint8_t length;                        ///< length of data (17 or 21)
+  uint8_t data[NTAG424_KEYDATA_MAXSIZE]; ///< key data before encryption
+};
+
+/**
+ * @brief Prepared key changes of one card, key 0 last.
+ */
+struct ntag424_KeyManifestType
+{
+  uint8_t count;                                   ///< number of changes
+  ntag424_KeyCryptogramType keys[NTAG424_KEYCOUNT]; ///< prepared changes
+};
+
+void ntag424_keystore_init(ntag424_KeyStoreType *store,
+                           ntag424_KeyEntryType *entries, uint8_t size);
+uint8_t ntag424_keystore_add(ntag424_KeyStoreType *store, uint8_t keyno,
+                             uint8_t version, const uint8_t *key);
+uint8_t *ntag424_keystore_find(ntag424_KeyStoreType *store, uint8_t keyno,
+                               uint8_t version);
+void ntag424_keystore_clear(ntag424_KeyStoreType *store);
+uint8_t ntag424_keystore_load_json(ntag424_KeyStoreType *store,
+                                   const char *json, size_t length);
+uint8_t ntag424_keystore_load_binary(ntag424_KeyStoreType *store,
+                                     const uint8_t *data, size_t length);
+size_t ntag424_keystore_export(const ntag424_KeyStoreType *store,
+                               uint8_t *buffer, size_t size);
+
+void ntag424_keyring_init(ntag424_KeyRingType *ring,
+                          ntag424_KeyStoreType *first,
+                          ntag424_KeyStoreType *second);
+ntag424_KeyStoreType *ntag424_keyring_acquire(ntag424_KeyRingType *ring);
+void ntag424_keyring_release(ntag424_KeyRingType *ring,
+                             ntag424_KeyStoreType *store);
+uint8_t ntag424_keyring_reload(ntag424_KeyRingType *ring, const uint8_t *data,
+                               size_t length);
+void ntag424_keyring_clear(ntag424_KeyRingType *ring);
+
+uint8_t ntag424_keychange_prepare(const ntag424_KeyChangeType *change,
+                                  ntag424_KeyCryptogramType *cryptogram);
+uint8_t ntag424_keychange_manifest(const ntag424_KeyChangeType *changes,
+                                   uint8_t count,
+                                   ntag424_KeyManifestType *manifest);
+uint8_t ntag424_keychange_manifests(const ntag424_KeyChangeType *changes,
+                                    uint8_t count, size_t cards,
+                                    ntag424_KeyManifestType *manifests);
+
+#endif
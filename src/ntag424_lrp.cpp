@@ -0,0 +1,281 @@
+/**************************************************************************/
+/*!
+    @file ntag424_lrp.cpp
+
+    Leakage Resilient Primitive with precomputed tables, see ntag424_lrp.h.
+*/
+/**************************************************************************/
+
+#include "ntag424_lrp.h"
+
+#include <string.h>
+
+#include "mbedtls/platform_util.h"
+
+/**************************************************************************/
+/*!
+    @brief   one LRP step: output = E(key, input).
+
+    @param   aes        scratch key context
+    @param   provider   crypto provider
+    @param   key        16 byte key
+    @param   input      16 byte block
+    @param   output     16 byte output (may alias key or input)
+
+    @return  1 = success; 0 = aes failed
+*/
+/**************************************************************************/
+static uint8_t ntag424_lrp_step(ntag424_AESType *aes,
+                                const ntag424_CryptoProviderType *provider,
+                                const uint8_t *key, const uint8_t *input,
+                                uint8_t *output)
+{
+  if (!ntag424_aes_setkey(aes, provider, key, NTAG424_AES_ENCRYPT))
+  {
+    return 0;
+  }
+  aes->provider->aes_ecb(aes, input, output);
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   nibble i of the LRICB counter, most significant first.
+
+    @param   counter   counter
+    @param   i         nibble index (0 - NTAG424_LRP_COUNTERNIBBLES-1)
+
+    @return  nibble value
+*/
+/**************************************************************************/
+static uint8_t ntag424_lrp_nibble(uint32_t counter, uint8_t i)
+{
+  return (counter >> (4 * (NTAG424_LRP_COUNTERNIBBLES - 1 - i))) & 0x0F;
+}
+
+/**************************************************************************/
+/*!
+    @brief   initialize an empty LRP context.
+
+    @param   ctx        LRP context
+    @param   provider   crypto provider, NULL = ntag424_crypto_default()
+*/
+/**************************************************************************/
+void ntag424_lrp_init(ntag424_LRPType *ctx,
+                      const ntag424_CryptoProviderType *provider)
+{
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->provider = provider;
+}
+
+/**************************************************************************/
+/*!
+    @brief   generate the plaintexts (AN12304 algorithm 1) and the updated
+   keys (algorithm 2) of key. Every chain value h is expanded once and used
+   for both blocks it encrypts.
+
+    @param   ctx    LRP context, initialized with ntag424_lrp_init()
+    @param   key    16 byte key
+
+    @return  1 = success; 0 = aes failed
+*/
+/**************************************************************************/
+uint8_t ntag424_lrp_setkey(ntag424_LRPType *ctx, const uint8_t *key)
+{
+  uint8_t c55[NTAG424_LRP_BLOCKSIZE];
+  uint8_t cAA[NTAG424_LRP_BLOCKSIZE];
+  uint8_t h[NTAG424_LRP_BLOCKSIZE];
+  ntag424_AESType aes;
+  uint8_t ok;
+
+  memset(c55, 0x55, sizeof(c55));
+  memset(cAA, 0xAA, sizeof(cAA));
+  aes.provider = NULL;
+  ctx->chain_valid = false;
+
+  // plaintexts: h = E(k, 55), p_i = E(h, AA), h = E(h, 55)
+  ok = ntag424_lrp_step(&aes, ctx->provider, key, c55, h);
+  for (uint8_t i = 0; ok && (i < NTAG424_LRP_PLAINTEXTS); i++)
+  {
+    ok = ntag424_aes_setkey(&aes, ctx->provider, h, NTAG424_AES_ENCRYPT);
+    if (ok)
+    {
+      aes.provider->aes_ecb(&aes, cAA, ctx->plaintexts[i]);
+      aes.provider->aes_ecb(&aes, c55, h);
+    }
+  }
+  // updated keys: h = E(k, AA), k'_i = E(h, AA), h = E(h, 55)
+  ok = ok && ntag424_lrp_step(&aes, ctx->provider, key, cAA, h);
+  for (uint8_t i = 0; ok && (i < NTAG424_LRP_UPDATEDKEYS); i++)
+  {
+    ok = ntag424_aes_setkey(&aes, ctx->provider, h, NTAG424_AES_ENCRYPT);
+    if (ok)
+    {
+      aes.provider->aes_ecb(&aes, cAA, ctx->updated_keys[i]);
+      aes.provider->aes_ecb(&aes, c55, h);
+    }
+  }
+  ntag424_aes_free(&aes);
+  mbedtls_platform_zeroize(h, sizeof(h));
+  return ok;
+}
+
+/**************************************************************************/
+/*!
+    @brief   EvalLRP (AN12304 algorithm 3): starting with updated key u,
+   every nibble of input (most significant first) selects the plaintext the
+   state is encrypted with next. final adds the encryption of a zero block.
+
+    @param   ctx       LRP context with key loaded
+    @param   u         updated key (0 - NTAG424_LRP_UPDATEDKEYS-1)
+    @param   input     input, nibbles/2 byte
+    @param   nibbles   number of input nibbles (32 for one block)
+    @param   final     true = finalize
+    @param   output    16 byte output (may alias input)
+
+    @return  1 = success; 0 = u invalid or aes failed
+*/
+/**************************************************************************/
+uint8_t ntag424_lrp_eval(const ntag424_LRPType *ctx, uint8_t u,
+                         const uint8_t *input, uint8_t nibbles, bool final,
+                         uint8_t *output)
+{
+  uint8_t y[NTAG424_LRP_BLOCKSIZE];
+  ntag424_AESType aes;
+  uint8_t ok = (u < NTAG424_LRP_UPDATEDKEYS);
+
+  if (!ok)
+  {
+    return 0;
+  }
+  aes.provider = NULL;
+  memcpy(y, ctx->updated_keys[u], sizeof(y));
+  for (uint8_t i = 0; ok && (i < nibbles); i++)
+  {
+    uint8_t nibble = (i & 1) ? (input[i / 2] & 0x0F) : (input[i / 2] >> 4);
+    ok = ntag424_lrp_step(&aes, ctx->provider, y, ctx->plaintexts[nibble], y);
+  }
+  if (ok && final)
+  {
+    uint8_t zero[NTAG424_LRP_BLOCKSIZE];
+    memset(zero, 0, sizeof(zero));
+    ok = ntag424_lrp_step(&aes, ctx->provider, y, zero, y);
+  }
+  if (ok)
+  {
+    memcpy(output, y, sizeof(y));
+  }
+  ntag424_aes_free(&aes);
+  mbedtls_platform_zeroize(y, sizeof(y));
+  return ok;
+}
+
+/**************************************************************************/
+/*!
+    @brief   block key of one LRICB counter: EvalLRP(counter, final). The
+   chain of the previous counter is reused up to the first nibble that
+   differs, an incremented counter mostly costs one step plus finalize.
+
+    @param   ctx       LRP context with key loaded
+    @param   aes       scratch key context
+    @param   u         updated key
+    @param   counter   counter value
+    @param   y         16 byte output
+
+    @return  1 = success; 0 = aes failed
+*/
+/**************************************************************************/
+static uint8_t ntag424_lrp_counter_key(ntag424_LRPType *ctx,
+                                       ntag424_AESType *aes, uint8_t u,
+                                       uint32_t counter, uint8_t *y)
+{
+  uint8_t keep = 0;
+  if (ctx->chain_valid && (ctx->chain_key == u))
+  {
+    while ((keep < NTAG424_LRP_COUNTERNIBBLES) &&
+           (ntag424_lrp_nibble(ctx->chain_counter, keep) ==
+            ntag424_lrp_nibble(counter, keep)))
+    {
+      keep++;
+    }
+  }
+  ctx->chain_valid = false;
+  const uint8_t *state = (keep == 0) ? ctx->updated_keys[u]
+                                     : ctx->chain[keep - 1];
+  for (uint8_t i = keep; i < NTAG424_LRP_COUNTERNIBBLES; i++)
+  {
+    if (!ntag424_lrp_step(aes, ctx->provider, state,
+                          ctx->plaintexts[ntag424_lrp_nibble(counter, i)],
+                          ctx->chain[i]))
+    {
+      return 0;
+    }
+    state = ctx->chain[i];
+  }
+  ctx->chain_counter = counter;
+  ctx->chain_key = u;
+  ctx->chain_valid = true;
+
+  uint8_t zero[NTAG424_LRP_BLOCKSIZE];
+  memset(zero, 0, sizeof(zero));
+  return ntag424_lrp_step(aes, ctx->provider, state, zero, y);
+}
+
+/**************************************************************************/
+/*!
+    @brief   LRICB (AN12304 algorithm 5/6): every block is encrypted or
+   decrypted with its own key EvalLRP(counter, final), the counter is
+   incremented per block. Padding is left to the caller.
+
+    @param   ctx       LRP context with key loaded
+    @param   u         updated key (0 - NTAG424_LRP_UPDATEDKEYS-1)
+    @param   counter   block counter, incremented by the number of blocks
+    @param   input     input blocks
+    @param   output    output blocks (may alias input)
+    @param   length    length of input (multiple of 16)
+    @param   mode      NTAG424_AES_ENCRYPT or NTAG424_AES_DECRYPT
+
+    @return  1 = success; 0 = u/length invalid or aes failed
+*/
+/**************************************************************************/
+uint8_t ntag424_lrp_lricb(ntag424_LRPType *ctx, uint8_t u, uint32_t *counter,
+                          const uint8_t *input, uint8_t *output,
+                          size_t length, uint8_t mode)
+{
+  uint8_t y[NTAG424_LRP_BLOCKSIZE];
+  ntag424_AESType aes;
+  uint8_t ok = 1;
+
+  if ((u >= NTAG424_LRP_UPDATEDKEYS) || (length % NTAG424_LRP_BLOCKSIZE))
+  {
+    return 0;
+  }
+  aes.provider = NULL;
+  for (size_t i = 0; ok && (i < length); i += NTAG424_LRP_BLOCKSIZE)
+  {
+    ok = ntag424_lrp_counter_key(ctx, &aes, u, *counter, y) &&
+         ntag424_aes_setkey(&aes, ctx->provider, y, mode);
+    if (ok)
+    {
+      aes.provider->aes_ecb(&aes, input + i, output + i);
+      (*counter)++;
+    }
+  }
+  ntag424_aes_free(&aes);
+  mbedtls_platform_zeroize(y, sizeof(y));
+  return ok;
+}
+
+/**************************************************************************/
+/*!
+    @brief   wipe the tables and the chain.
+
+    @param   ctx    LRP context
+*/
+/**************************************************************************/
+void ntag424_lrp_free(ntag424_LRPType *ctx)
+{
+  const ntag424_CryptoProviderType *provider = ctx->provider;
+  mbedtls_platform_zeroize(ctx, sizeof(*ctx));
+  ctx->provider = provider;
+}
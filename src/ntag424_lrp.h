@@ -0,0 +1,61 @@
+/**************************************************************************/
+/*!
+    @file ntag424_lrp.h
+
+    Leakage Resilient Primitive (NXP AN12304) as used by the NTAG424 LRP
+    secure messaging: plaintext and updated key generation, EvalLRP and
+    LRICB encryption. The 16 plaintexts and the updated keys of a key are
+    generated once in ntag424_lrp_setkey() and kept for the whole session.
+    LRICB keeps the evaluation chain of the last counter, consecutive
+    counters share all but the last nibbles and only evaluate those. The
+    LRP-CMAC is the cmac engine keyed with ntag424_cmac_setkey_lrp().
+*/
+/**************************************************************************/
+
+#ifndef NTAG424_LRP_H
+#define NTAG424_LRP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ntag424_crypto.h"
+
+#define NTAG424_LRP_BLOCKSIZE 16  ///< LRP block size in byte
+#define NTAG424_LRP_PLAINTEXTS 16 ///< 2^m plaintexts, m = 4 bit per step
+#define NTAG424_LRP_UPDATEDKEYS 2 ///< Updated keys generated by setkey
+#define NTAG424_LRP_COUNTERSIZE 4 ///< LRICB counter size (EncCtr) in byte
+#define NTAG424_LRP_COUNTERNIBBLES \
+  (2 * NTAG424_LRP_COUNTERSIZE) ///< LRICB counter size in nibbles
+
+#define NTAG424_LRP_KEY_MAC 0 ///< Updated key of the session MAC
+#define NTAG424_LRP_KEY_ENC 1 ///< Updated key of the session encryption
+
+/**
+ * @brief Precomputed tables of one LRP key and the LRICB counter chain.
+ */
+struct ntag424_LRPType
+{
+  const ntag424_CryptoProviderType *provider; ///< crypto provider
+  /// plaintexts p0..p15
+  uint8_t plaintexts[NTAG424_LRP_PLAINTEXTS][NTAG424_LRP_BLOCKSIZE];
+  /// updated keys k'0..k'(q-1)
+  uint8_t updated_keys[NTAG424_LRP_UPDATEDKEYS][NTAG424_LRP_BLOCKSIZE];
+  /// LRICB: EvalLRP state after each nibble of chain_counter
+  uint8_t chain[NTAG424_LRP_COUNTERNIBBLES][NTAG424_LRP_BLOCKSIZE];
+  uint32_t chain_counter; ///< LRICB: counter the chain belongs to
+  uint8_t chain_key;      ///< LRICB: updated key the chain started with
+  bool chain_valid;       ///< LRICB: false = chain is empty
+};
+
+void ntag424_lrp_init(ntag424_LRPType *ctx,
+                      const ntag424_CryptoProviderType *provider = NULL);
+uint8_t ntag424_lrp_setkey(ntag424_LRPType *ctx, const uint8_t *key);
+uint8_t ntag424_lrp_eval(const ntag424_LRPType *ctx, uint8_t u,
+                         const uint8_t *input, uint8_t nibbles, bool final,
+                         uint8_t *output);
+uint8_t ntag424_lrp_lricb(ntag424_LRPType *ctx, uint8_t u, uint32_t *counter,
+                          const uint8_t *input, uint8_t *output,
+                          size_t length, uint8_t mode);
+void ntag424_lrp_free(ntag424_LRPType *ctx);
+
+#endif
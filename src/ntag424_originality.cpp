@@ -0,0 +1,824 @@
+/**************************************************************************/
+/*!
+    @file ntag424_originality.cpp
+
+    secp224r1 ECDSA verification with comb tables, see
+    ntag424_originality.h.
+*/
+/**************************************************************************/
+
+#include "ntag424_originality.h"
+
+#include <string.h>
+
+#define NTAG424_ECC_BITS 224 ///< secp224r1 field/scalar size in bit
+#define NTAG424_ECC_COMB_COLUMNS                     \
+  ((NTAG424_ECC_BITS + NTAG424_ECC_COMB_TEETH - 1) / \
+   NTAG424_ECC_COMB_TEETH) ///< Bits per comb tooth
+
+#define W NTAG424_ECC_WORDS ///< local shorthand
+
+/// NXP originality key of NTAG 424 DNA (AN12196)
+const uint8_t ntag424_originality_nxp_key[NTAG424_ECC_PUBKEY_SIZE] = {
+    0x04, 0x8A, 0x9B, 0x38, 0x0A, 0xF2, 0xEE, 0x1B, 0x98, 0xDC, 0x41, 0x7F,
+    0xEC, 0xC2, 0x63, 0xF8, 0x44, 0x9C, 0x76, 0x25, 0xCE, 0xCE, 0x82, 0xD9,
+    0xB9, 0x16, 0xC9, 0x92, 0xDA, 0x20, 0x9D, 0x68, 0x42, 0x2B, 0x81, 0xEC,
+    0x20, 0xB6, 0x5A, 0x66, 0xB5, 0x10, 0x2A, 0x61, 0x59, 0x6A, 0xF3, 0x37,
+    0x92, 0x00, 0x59, 0x93, 0x16, 0xA0, 0x0A, 0x14, 0x10};
+
+// secp224r1 domain parameters (SEC 2), little endian words
+static const uint32_t ecc_p[W] = {0x00000001, 0x00000000, 0x00000000,
+                                  0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF,
+                                  0xFFFFFFFF};
+static const uint32_t ecc_n[W] = {0x5C5C2A3D, 0x13DD2945, 0xE0B8F03E,
+                                  0xFFFF16A2, 0xFFFFFFFF, 0xFFFFFFFF,
+                                  0xFFFFFFFF};
+static const uint32_t ecc_b[W] = {0x2355FFB4, 0x270B3943, 0xD7BFD8BA,
+                                  0x5044B0B7, 0xF5413256, 0x0C04B3AB,
+                                  0xB4050A85};
+static const ntag424_ECCPointType ecc_g = {
+    {0x115C1D21, 0x343280D6, 0x56C21122, 0x4A03C1D3, 0x321390B9, 0x6BB4BF7F,
+     0xB70E0CBD},
+    {0x85007E34, 0x44D58199, 0x5A074764, 0xCD4375A0, 0x4C22DFE6, 0xB5F723FB,
+     0xBD376388}};
+
+/**
+ * @brief Point in jacobian coordinates (X/Z^2, Y/Z^3).
+ */
+struct ntag424_ECCJacobianType
+{
+  uint32_t x[W]; ///< X
+  uint32_t y[W]; ///< Y
+  uint32_t z[W]; ///< Z
+  bool infinity; ///< true = point at infinity, x/y/z unused
+};
+
+/**************************************************************************/
+/*!
+    @brief   compare two numbers.
+
+    @return  -1, 0 or 1 for a < b, a == b, a > b
+*/
+/**************************************************************************/
+static int ecc_cmp(const uint32_t *a, const uint32_t *b)
+{
+  for (int i = W - 1; i >= 0; i--)
+  {
+    if (a[i] != b[i])
+    {
+      return (a[i] < b[i]) ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief   true if a is zero.
+*/
+/**************************************************************************/
+static bool ecc_is_zero(const uint32_t *a)
+{
+  uint32_t acc = 0;
+  for (int i = 0; i < W; i++)
+  {
+    acc |= a[i];
+  }
+  return acc == 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief   r = a + b.
+
+    @return  carry out
+*/
+/**************************************************************************/
+static uint32_t ecc_add(uint32_t *r, const uint32_t *a, const uint32_t *b)
+{
+  uint64_t c = 0;
+  for (int i = 0; i < W; i++)
+  {
+    c += (uint64_t)a[i] + b[i];
+    r[i] = (uint32_t)c;
+    c >>= 32;
+  }
+  return (uint32_t)c;
+}
+
+/**************************************************************************/
+/*!
+    @brief   r = a - b.
+
+    @return  borrow out
+*/
+/**************************************************************************/
+static uint32_t ecc_sub(uint32_t *r, const uint32_t *a, const uint32_t *b)
+{
+  int64_t c = 0;
+  for (int i = 0; i < W; i++)
+  {
+    c += (int64_t)a[i] - b[i];
+    r[i] = (uint32_t)c;
+    c >>= 32;
+  }
+  return (uint32_t)(c & 1);
+}
+
+/**************************************************************************/
+/*!
+    @brief   r = a >> 1, carry becomes the top bit.
+*/
+/**************************************************************************/
+static void ecc_shr1(uint32_t *r, const uint32_t *a, uint32_t carry)
+{
+  for (int i = 0; i < W; i++)
+  {
+    uint32_t next = (i + 1 < W) ? a[i + 1] : carry;
+    r[i] = (a[i] >> 1) | (next << 31);
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   big endian bytes to words.
+
+    @param   r        number
+    @param   bytes    big endian input
+    @param   length   length of bytes (max NTAG424_ECC_SIZE)
+*/
+/**************************************************************************/
+static void ecc_from_bytes(uint32_t *r, const uint8_t *bytes, uint8_t length)
+{
+  memset(r, 0, W * sizeof(uint32_t));
+  for (uint8_t i = 0; i < length; i++)
+  {
+    uint8_t bit = 8 * (length - 1 - i);
+    r[bit / 32] |= (uint32_t)bytes[i] << (bit % 32);
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   r = a + b mod p.
+*/
+/**************************************************************************/
+static void fe_add(uint32_t *r, const uint32_t *a, const uint32_t *b)
+{
+  if (ecc_add(r, a, b) || (ecc_cmp(r, ecc_p) >= 0))
+  {
+    ecc_sub(r, r, ecc_p);
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   r = a - b mod p.
+*/
+/**************************************************************************/
+static void fe_sub(uint32_t *r, const uint32_t *a, const uint32_t *b)
+{
+  if (ecc_sub(r, a, b))
+  {
+    ecc_add(r, r, ecc_p);
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   r = a * b mod p. The 448 bit product is reduced with the NIST
+   formula for p = 2^224 - 2^96 + 1 (FIPS 186-4 D.2.2), the carries left
+   over are folded back with 2^224 = 2^96 - 1.
+*/
+/**************************************************************************/
+static void fe_mul(uint32_t *r, const uint32_t *a, const uint32_t *b)
+{
+  uint32_t c[2 * W];
+  memset(c, 0, sizeof(c));
+  for (int i = 0; i < W; i++)
+  {
+    uint64_t carry = 0;
+    for (int j = 0; j < W; j++)
+    {
+      carry += (uint64_t)a[i] * b[j] + c[i + j];
+      c[i + j] = (uint32_t)carry;
+      carry >>= 32;
+    }
+    c[i + W] = (uint32_t)carry;
+  }
+
+  int64_t t[W];
+  t[0] = (int64_t)c[0] - c[7] - c[11];
+  t[1] = (int64_t)c[1] - c[8] - c[12];
+  t[2] = (int64_t)c[2] - c[9] - c[13];
+  t[3] = (int64_t)c[3] + c[7] + c[11] - c[10];
+  t[4] = (int64_t)c[4] + c[8] + c[12] - c[11];
+  t[5] = (int64_t)c[5] + c[9] + c[13] - c[12];
+  t[6] = (int64_t)c[6] + c[10] - c[13];
+  int64_t top;
+  do
+  {
+    for (int i = 0; i < W - 1; i++)
+    {
+      t[i + 1] += t[i] >> 32;
+      t[i] &= 0xFFFFFFFF;
+    }
+    top = t[W - 1] >> 32;
+    t[W - 1] &= 0xFFFFFFFF;
+    t[0] -= top;
+    t[3] += top;
+  } while (top != 0);
+  for (int i = 0; i < W; i++)
+  {
+    r[i] = (uint32_t)t[i];
+  }
+  while (ecc_cmp(r, ecc_p) >= 0)
+  {
+    ecc_sub(r, r, ecc_p);
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   r = a^-1 mod p (Fermat, a^(p-2)). Only used for the tables.
+*/
+/**************************************************************************/
+static void fe_inv(uint32_t *r, const uint32_t *a)
+{
+  uint32_t e[W];
+  uint32_t x[W] = {1};
+  const uint32_t two[W] = {2};
+  ecc_sub(e, ecc_p, two);
+  for (int bit = NTAG424_ECC_BITS - 1; bit >= 0; bit--)
+  {
+    fe_mul(x, x, x);
+    if ((e[bit / 32] >> (bit % 32)) & 1)
+    {
+      fe_mul(x, x, a);
+    }
+  }
+  memcpy(r, x, sizeof(x));
+}
+
+/**************************************************************************/
+/*!
+    @brief   r = a * b / 2^224 mod n (Montgomery, CIOS).
+*/
+/**************************************************************************/
+static void sc_mont_mul(const ntag424_OriginalityType *ctx, uint32_t *r,
+                        const uint32_t *a, const uint32_t *b)
+{
+  uint32_t t[W + 2];
+  memset(t, 0, sizeof(t));
+  for (int i = 0; i < W; i++)
+  {
+    uint64_t c = 0;
+    for (int j = 0; j < W; j++)
+    {
+      c += (uint64_t)a[j] * b[i] + t[j];
+      t[j] = (uint32_t)c;
+      c >>= 32;
+    }
+    c += t[W];
+    t[W] = (uint32_t)c;
+    t[W + 1] = (uint32_t)(c >> 32);
+
+    uint32_t m = t[0] * ctx->n0;
+    c = ((uint64_t)m * ecc_n[0] + t[0]) >> 32;
+    for (int j = 1; j < W; j++)
+    {
+      c += (uint64_t)m * ecc_n[j] + t[j];
+      t[j - 1] = (uint32_t)c;
+      c >>= 32;
+    }
+    c += t[W];
+    t[W - 1] = (uint32_t)c;
+    t[W] = t[W + 1] + (uint32_t)(c >> 32);
+  }
+  if (t[W] || (ecc_cmp(t, ecc_n) >= 0))
+  {
+    ecc_sub(t, t, ecc_n);
+  }
+  memcpy(r, t, W * sizeof(uint32_t));
+}
+
+/**************************************************************************/
+/*!
+    @brief   r = a * b mod n.
+*/
+/**************************************************************************/
+static void sc_mul(const ntag424_OriginalityType *ctx, uint32_t *r,
+                   const uint32_t *a, const uint32_t *b)
+{
+  uint32_t t[W];
+  sc_mont_mul(ctx, t, a, b);
+  sc_mont_mul(ctx, r, t, ctx->r2);
+}
+
+/**************************************************************************/
+/*!
+    @brief   r = a^-1 mod n, binary extended euclid (a in 1..n-1).
+*/
+/**************************************************************************/
+static void sc_inv(uint32_t *r, const uint32_t *a)
+{
+  uint32_t u[W], v[W], x1[W] = {1}, x2[W] = {0};
+  const uint32_t one[W] = {1};
+  memcpy(u, a, sizeof(u));
+  memcpy(v, ecc_n, sizeof(v));
+  while ((ecc_cmp(u, one) != 0) && (ecc_cmp(v, one) != 0))
+  {
+    while (!(u[0] & 1))
+    {
+      ecc_shr1(u, u, 0);
+      ecc_shr1(x1, x1, (x1[0] & 1) ? ecc_add(x1, x1, ecc_n) : 0);
+    }
+    while (!(v[0] & 1))
+    {
+      ecc_shr1(v, v, 0);
+      ecc_shr1(x2, x2, (x2[0] & 1) ? ecc_add(x2, x2, ecc_n) : 0);
+    }
+    if (ecc_cmp(u, v) >= 0)
+    {
+      ecc_sub(u, u, v);
+      if (ecc_sub(x1, x1, x2))
+      {
+        ecc_add(x1, x1, ecc_n);
+      }
+    }
+    else
+    {
+      ecc_sub(v, v, u);
+      if (ecc_sub(x2, x2, x1))
+      {
+        ecc_add(x2, x2, ecc_n);
+      }
+    }
+  }
+  memcpy(r, (ecc_cmp(u, one) == 0) ? x1 : x2, sizeof(x1));
+}
+
+/**************************************************************************/
+/*!
+    @brief   r = 2 * a, jacobian doubling for a = -3 (dbl-2001-b). r may
+   alias a.
+*/
+/**************************************************************************/
+static void ecc_double(ntag424_ECCJacobianType *r,
+                       const ntag424_ECCJacobianType *a)
+{
+  if (a->infinity || ecc_is_zero(a->y))
+  {
+    r->infinity = true;
+    return;
+  }
+  uint32_t delta[W], gamma[W], beta[W], alpha[W], t1[W], t2[W];
+  fe_mul(delta, a->z, a->z);
+  fe_mul(gamma, a->y, a->y);
+  fe_mul(beta, a->x, gamma);
+  // alpha = 3 * (X - delta) * (X + delta)
+  fe_sub(t1, a->x, delta);
+  fe_add(t2, a->x, delta);
+  fe_mul(t1, t1, t2);
+  fe_add(alpha, t1, t1);
+  fe_add(alpha, alpha, t1);
+  // Z3 = (Y + Z)^2 - gamma - delta
+  fe_add(t1, a->y, a->z);
+  fe_mul(t1, t1, t1);
+  fe_sub(t1, t1, gamma);
+  fe_sub(r->z, t1, delta);
+  // X3 = alpha^2 - 8 * beta
+  fe_add(beta, beta, beta);
+  fe_add(beta, beta, beta);
+  fe_mul(t1, alpha, alpha);
+  fe_add(t2, beta, beta);
+  fe_sub(r->x, t1, t2);
+  // Y3 = alpha * (4 * beta - X3) - 8 * gamma^2
+  fe_sub(t1, beta, r->x);
+  fe_mul(t1, alpha, t1);
+  fe_mul(gamma, gamma, gamma);
+  fe_add(gamma, gamma, gamma);
+  fe_add(gamma, gamma, gamma);
+  fe_add(gamma, gamma, gamma);
+  fe_sub(r->y, t1, gamma);
+  r->infinity = false;
+}
+
+/**************************************************************************/
+/*!
+    @brief   r = a + q with q affine (madd-2007-bl). r may alias a.
+*/
+/**************************************************************************/
+static void ecc_add_affine(ntag424_ECCJacobianType *r,
+                           const ntag424_ECCJacobianType *a,
+                           const ntag424_ECCPointType *q)
+{
+  if (a->infinity)
+  {
+    memcpy(r->x, q->x, sizeof(r->x));
+    memcpy(r->y, q->y, sizeof(r->y));
+    memset(r->z, 0, sizeof(r->z));
+    r->z[0] = 1;
+    r->infinity = false;
+    return;
+  }
+  uint32_t z1z1[W], u2[W], s2[W], h[W], hh[W], i[W], j[W], rr[W], v[W];
+  uint32_t t[W];
+  fe_mul(z1z1, a->z, a->z);
+  fe_mul(u2, q->x, z1z1);
+  fe_mul(s2, q->y, a->z);
+  fe_mul(s2, s2, z1z1);
+  fe_sub(h, u2, a->x);
+  fe_sub(rr, s2, a->y);
+  if (ecc_is_zero(h))
+  {
+    if (ecc_is_zero(rr))
+    {
+      ecc_double(r, a);
+    }
+    else
+    {
+      r->infinity = true;
+    }
+    return;
+  }
+  fe_mul(hh, h, h);
+  fe_add(i, hh, hh);
+  fe_add(i, i, i);
+  fe_mul(j, h, i);
+  fe_add(rr, rr, rr);
+  fe_mul(v, a->x, i);
+  // Z3 = (Z1 + H)^2 - Z1Z1 - HH
+  fe_add(t, a->z, h);
+  fe_mul(t, t, t);
+  fe_sub(t, t, z1z1);
+  fe_sub(r->z, t, hh);
+  // Y1 * J before Y1 is overwritten
+  fe_mul(s2, a->y, j);
+  // X3 = r^2 - J - 2 * V
+  fe_mul(t, rr, rr);
+  fe_sub(t, t, j);
+  fe_sub(t, t, v);
+  fe_sub(r->x, t, v);
+  // Y3 = r * (V - X3) - 2 * Y1 * J
+  fe_sub(t, v, r->x);
+  fe_mul(t, rr, t);
+  fe_add(s2, s2, s2);
+  fe_sub(r->y, t, s2);
+  r->infinity = false;
+}
+
+/**************************************************************************/
+/*!
+    @brief   affine coordinates of a jacobian point.
+
+    @return  1 = success; 0 = point at infinity
+*/
+/**************************************************************************/
+static uint8_t ecc_to_affine(ntag424_ECCPointType *r,
+                             const ntag424_ECCJacobianType *a)
+{
+  uint32_t zi[W], zi2[W];
+  if (a->infinity)
+  {
+    return 0;
+  }
+  fe_inv(zi, a->z);
+  fe_mul(zi2, zi, zi);
+  fe_mul(r->x, a->x, zi2);
+  fe_mul(zi2, zi2, zi);
+  fe_mul(r->y, a->y, zi2);
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   comb table of p: entry idx-1 holds sum(bit i of idx * 2^(i *
+   NTAG424_ECC_COMB_COLUMNS) * p) for idx = 1..NTAG424_ECC_COMB_POINTS.
+
+    @param   table   NTAG424_ECC_COMB_POINTS points
+    @param   p       affine point
+
+    @return  1 = success; 0 = an entry is the point at infinity
+*/
+/**************************************************************************/
+static uint8_t ecc_comb_build(ntag424_ECCPointType *table,
+                              const ntag424_ECCPointType *p)
+{
+  ntag424_ECCJacobianType j;
+  memcpy(j.x, p->x, sizeof(j.x));
+  memcpy(j.y, p->y, sizeof(j.y));
+  memset(j.z, 0, sizeof(j.z));
+  j.z[0] = 1;
+  j.infinity = false;
+
+  // teeth: table[2^i - 1] = 2^(i * columns) * p
+  table[0] = *p;
+  for (int i = 1; i < NTAG424_ECC_COMB_TEETH; i++)
+  {
+    for (int k = 0; k < NTAG424_ECC_COMB_COLUMNS; k++)
+    {
+      ecc_double(&j, &j);
+    }
+    if (!ecc_to_affine(&table[(1 << i) - 1], &j))
+    {
+      return 0;
+    }
+  }
+  // combinations: table[idx] = table[idx without top bit] + tooth
+  for (int idx = 3; idx <= NTAG424_ECC_COMB_POINTS; idx++)
+  {
+    int top = 1;
+    while ((top << 1) <= idx)
+    {
+      top <<= 1;
+    }
+    if (idx == top)
+    {
+      continue;
+    }
+    const ntag424_ECCPointType *rest = &table[(idx ^ top) - 1];
+    memcpy(j.x, rest->x, sizeof(j.x));
+    memcpy(j.y, rest->y, sizeof(j.y));
+    memset(j.z, 0, sizeof(j.z));
+    j.z[0] = 1;
+    j.infinity = false;
+    ecc_add_affine(&j, &j, &table[top - 1]);
+    if (!ecc_to_affine(&table[idx - 1], &j))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   comb index of column c of scalar k.
+*/
+/**************************************************************************/
+static int ecc_comb_index(const uint32_t *k, int c)
+{
+  int idx = 0;
+  for (int i = 0; i < NTAG424_ECC_COMB_TEETH; i++)
+  {
+    int bit = i * NTAG424_ECC_COMB_COLUMNS + c;
+    if ((bit < NTAG424_ECC_BITS) && ((k[bit / 32] >> (bit % 32)) & 1))
+    {
+      idx |= 1 << i;
+    }
+  }
+  return idx;
+}
+
+/**************************************************************************/
+/*!
+    @brief   r and s of a Read_Sig response and the message of the UID.
+
+    @return  1 = success; 0 = r or s out of range, or uid_length invalid
+*/
+/**************************************************************************/
+static uint8_t ecc_parse(const uint8_t *uid, uint8_t uid_length,
+                         const uint8_t *signature, uint32_t *r, uint32_t *s,
+                         uint32_t *e)
+{
+  if ((uid_length == 0) || (uid_length > NTAG424_ECC_SIZE))
+  {
+    return 0;
+  }
+  ecc_from_bytes(r, signature, NTAG424_ECC_SIZE);
+  ecc_from_bytes(s, signature + NTAG424_ECC_SIZE, NTAG424_ECC_SIZE);
+  ecc_from_bytes(e, uid, uid_length);
+  return !ecc_is_zero(r) && !ecc_is_zero(s) && (ecc_cmp(r, ecc_n) < 0) &&
+         (ecc_cmp(s, ecc_n) < 0);
+}
+
+/**************************************************************************/
+/*!
+    @brief   ECDSA check with w = 1/s already known: the x coordinate of
+   e*w*G + r*w*Q is r mod n. Both multiplications share the doublings of
+   one comb pass, the comparison is done without leaving jacobian
+   coordinates.
+
+    @return  1 = signature valid; 0 = invalid
+*/
+/**************************************************************************/
+static uint8_t ecc_verify_w(const ntag424_OriginalityType *ctx,
+                            const uint32_t *r, const uint32_t *e,
+                            const uint32_t *w)
+{
+  uint32_t u1[W], u2[W], z2[W], t[W];
+  ntag424_ECCJacobianType acc;
+
+  sc_mul(ctx, u1, e, w);
+  sc_mul(ctx, u2, r, w);
+  acc.infinity = true;
+  for (int c = NTAG424_ECC_COMB_COLUMNS - 1; c >= 0; c--)
+  {
+    ecc_double(&acc, &acc);
+    int idx = ecc_comb_index(u1, c);
+    if (idx)
+    {
+      ecc_add_affine(&acc, &acc, &ctx->base[idx - 1]);
+    }
+    idx = ecc_comb_index(u2, c);
+    if (idx)
+    {
+      ecc_add_affine(&acc, &acc, &ctx->key[idx - 1]);
+    }
+  }
+  if (acc.infinity)
+  {
+    return 0;
+  }
+  // x = X / Z^2, x mod n == r means x == r or x == r + n (if below p)
+  fe_mul(z2, acc.z, acc.z);
+  fe_mul(t, r, z2);
+  if (ecc_cmp(t, acc.x) == 0)
+  {
+    return 1;
+  }
+  if (ecc_add(t, r, ecc_n) || (ecc_cmp(t, ecc_p) >= 0))
+  {
+    return 0;
+  }
+  fe_mul(t, t, z2);
+  return ecc_cmp(t, acc.x) == 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief   load the public key and build the comb tables of the base
+   point and the key. Takes a while (about 2^teeth point conversions), do
+   it once at startup.
+
+    @param   ctx      originality context
+    @param   pubkey   uncompressed public key 04 || X || Y (57 byte),
+   NULL = ntag424_originality_nxp_key
+
+    @return  1 = success; 0 = key malformed or not on the curve
+*/
+/**************************************************************************/
+uint8_t ntag424_originality_init(ntag424_OriginalityType *ctx,
+                                 const uint8_t *pubkey)
+{
+  ntag424_ECCPointType q;
+  uint32_t lhs[W], rhs[W], t[W];
+
+  if (pubkey == NULL)
+  {
+    pubkey = ntag424_originality_nxp_key;
+  }
+  if (pubkey[0] != 0x04)
+  {
+    return 0;
+  }
+  ecc_from_bytes(q.x, pubkey + 1, NTAG424_ECC_SIZE);
+  ecc_from_bytes(q.y, pubkey + 1 + NTAG424_ECC_SIZE, NTAG424_ECC_SIZE);
+  if ((ecc_cmp(q.x, ecc_p) >= 0) || (ecc_cmp(q.y, ecc_p) >= 0))
+  {
+    return 0;
+  }
+  // y^2 = x^3 - 3x + b
+  fe_mul(lhs, q.y, q.y);
+  fe_mul(rhs, q.x, q.x);
+  fe_mul(rhs, rhs, q.x);
+  fe_add(t, q.x, q.x);
+  fe_add(t, t, q.x);
+  fe_sub(rhs, rhs, t);
+  fe_add(rhs, rhs, ecc_b);
+  if (ecc_cmp(lhs, rhs) != 0)
+  {
+    return 0;
+  }
+
+  // Montgomery constants of n: n0 = -1/n mod 2^32 (newton), r2 = 2^448
+  uint32_t inv = ecc_n[0];
+  for (int i = 0; i < 4; i++)
+  {
+    inv *= 2 - ecc_n[0] * inv;
+  }
+  ctx->n0 = 0 - inv;
+  memset(ctx->r2, 0, sizeof(ctx->r2));
+  ctx->r2[0] = 1;
+  for (int i = 0; i < 2 * NTAG424_ECC_BITS; i++)
+  {
+    if (ecc_add(ctx->r2, ctx->r2, ctx->r2) || (ecc_cmp(ctx->r2, ecc_n) >= 0))
+    {
+      ecc_sub(ctx->r2, ctx->r2, ecc_n);
+    }
+  }
+  return ecc_comb_build(ctx->base, &ecc_g) && ecc_comb_build(ctx->key, &q);
+}
+
+/**************************************************************************/
+/*!
+    @brief   verify the originality signature of a tag.
+
+    @param   ctx          originality context, see ntag424_originality_init()
+    @param   uid          UID of the tag (7 byte for NTAG424)
+    @param   uid_length   length of uid (1-28)
+    @param   signature    Read_Sig response r || s (56 byte)
+
+    @return  1 = signature valid; 0 = invalid
+*/
+/**************************************************************************/
+uint8_t ntag424_originality_verify(const ntag424_OriginalityType *ctx,
+                                   const uint8_t *uid, uint8_t uid_length,
+                                   const uint8_t *signature)
+{
+  uint32_t r[W], s[W], e[W], w[W];
+  if (!ecc_parse(uid, uid_length, signature, r, s, e))
+  {
+    return 0;
+  }
+  sc_inv(w, s);
+  return ecc_verify_w(ctx, r, e, w);
+}
+
+/**************************************************************************/
+/*!
+    @brief   verify many originality signatures. In rounds of
+   NTAG424_ECC_BATCH, the inverses of all s are taken from one inversion of
+   their product (Montgomery's trick).
+
+    @param   ctx       originality context, see ntag424_originality_init()
+    @param   jobs      UIDs and signatures
+    @param   count     number of jobs
+    @param   results   outputbuffer, true = signature of the job valid
+
+    @return  number of valid signatures
+*/
+/**************************************************************************/
+size_t ntag424_originality_verify_batch(const ntag424_OriginalityType *ctx,
+                                        const ntag424_SignatureJobType *jobs,
+                                        size_t count, bool *results)
+{
+  uint32_t r[NTAG424_ECC_BATCH][W], s[NTAG424_ECC_BATCH][W];
+  uint32_t e[NTAG424_ECC_BATCH][W], prod[NTAG424_ECC_BATCH][W];
+  uint32_t inv[W], w[W];
+  size_t valid = 0;
+
+  for (size_t base = 0; base < count; base += NTAG424_ECC_BATCH)
+  {
+    size_t n = count - base;
+    if (n > NTAG424_ECC_BATCH)
+    {
+      n = NTAG424_ECC_BATCH;
+    }
+    // prod[i] = product of s of all parsed jobs up to i
+    int last = -1;
+    for (size_t i = 0; i < n; i++)
+    {
+      const ntag424_SignatureJobType *job = &jobs[base + i];
+      results[base + i] = ecc_parse(job->uid, job->uid_length,
+                                    job->signature, r[i], s[i], e[i]);
+      if (!results[base + i])
+      {
+        continue;
+      }
+      if (last < 0)
+      {
+        memcpy(prod[i], s[i], sizeof(prod[i]));
+      }
+      else
+      {
+        sc_mul(ctx, prod[i], prod[last], s[i]);
+      }
+      last = (int)i;
+    }
+    if (last < 0)
+    {
+      continue;
+    }
+    sc_inv(inv, prod[last]);
+    // walk back: 1/s[i] = inv * prod[previous], then inv *= s[i]
+    for (int i = last; i >= 0; i--)
+    {
+      if (!results[base + i])
+      {
+        continue;
+      }
+      int prev = i - 1;
+      while ((prev >= 0) && !results[base + prev])
+      {
+        prev--;
+      }
+      if (prev < 0)
+      {
+        memcpy(w, inv, sizeof(w));
+      }
+      else
+      {
+        sc_mul(ctx, w, inv, prod[prev]);
+        sc_mul(ctx, inv, inv, s[i]);
+      }
+      results[base + i] = ecc_verify_w(ctx, r[i], e[i], w);
+      if (results[base + i])
+      {
+        valid++;
+      }
+    }
+  }
+  return valid;
+}
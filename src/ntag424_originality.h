@@ -0,0 +1,76 @@
+/**************************************************************************/
+/*!
+    @file ntag424_originality.h
+
+    Verification of the NXP originality signature returned by Read_Sig: an
+    ECDSA signature over the UID on secp224r1, the UID is the message as it
+    is, without hash (AN12196, NT4H2421Gx datasheet chapter 10.9). The
+    public key is static, so ntag424_originality_init() builds comb tables
+    of the base point and of the key once, every verification then costs
+    ceil(224 / teeth) doublings and twice as many mixed additions.
+    ntag424_originality_verify_batch() shares one modular inversion between
+    the signatures of a batch. All inputs are public, the arithmetic is not
+    constant time.
+*/
+/**************************************************************************/
+
+#ifndef NTAG424_ORIGINALITY_H
+#define NTAG424_ORIGINALITY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NTAG424_ECC_SIZE 28        ///< secp224r1 field/scalar size in byte
+#define NTAG424_ECC_WORDS 7        ///< 32 bit words of a field element
+#define NTAG424_ECC_PUBKEY_SIZE 57 ///< Uncompressed point 04 || X || Y
+#define NTAG424_ECC_SIG_SIZE 56    ///< Read_Sig signature r || s
+
+#ifndef NTAG424_ECC_COMB_TEETH
+#define NTAG424_ECC_COMB_TEETH 6 ///< Comb width, 8 suits hosts
+#endif
+#define NTAG424_ECC_COMB_POINTS \
+  ((1 << NTAG424_ECC_COMB_TEETH) - 1) ///< Points per comb table
+#define NTAG424_ECC_BATCH 16 ///< Signatures per round of verify_batch
+
+extern const uint8_t ntag424_originality_nxp_key[NTAG424_ECC_PUBKEY_SIZE];
+
+/**
+ * @brief Affine point, coordinates as little endian 32 bit words.
+ */
+struct ntag424_ECCPointType
+{
+  uint32_t x[NTAG424_ECC_WORDS]; ///< x coordinate
+  uint32_t y[NTAG424_ECC_WORDS]; ///< y coordinate
+};
+
+/**
+ * @brief Comb tables of the base point and the public key.
+ */
+struct ntag424_OriginalityType
+{
+  ntag424_ECCPointType base[NTAG424_ECC_COMB_POINTS]; ///< comb of G
+  ntag424_ECCPointType key[NTAG424_ECC_COMB_POINTS];  ///< comb of the key
+  uint32_t r2[NTAG424_ECC_WORDS]; ///< 2^448 mod n (Montgomery)
+  uint32_t n0;                    ///< -1/n mod 2^32 (Montgomery)
+};
+
+/**
+ * @brief One signature of ntag424_originality_verify_batch().
+ */
+struct ntag424_SignatureJobType
+{
+  const uint8_t *uid;       ///< UID of the tag
+  uint8_t uid_length;       ///< length of uid (1-28)
+  const uint8_t *signature; ///< Read_Sig response (56 byte)
+};
+
+uint8_t ntag424_originality_init(ntag424_OriginalityType *ctx,
+                                 const uint8_t *pubkey = NULL);
+uint8_t ntag424_originality_verify(const ntag424_OriginalityType *ctx,
+                                   const uint8_t *uid, uint8_t uid_length,
+                                   const uint8_t *signature);
+size_t ntag424_originality_verify_batch(const ntag424_OriginalityType *ctx,
+                                        const ntag424_SignatureJobType *jobs,
+                                        size_t count, bool *results);
+
+#endif
@@ -0,0 +1,104 @@
+/**************************************************************************/
+/*!
+    @file ntag424_rng.cpp
+
+    Pooled random bytes, see ntag424_rng.h.
+*/
+/**************************************************************************/
+
+#include "ntag424_rng.h"
+
+#include <string.h>
+
+#include "mbedtls/platform_util.h"
+
+/**************************************************************************/
+/*!
+    @brief   initialize the pool and fill it.
+
+    @param   rng        random pool
+    @param   provider   crypto provider, NULL = ntag424_crypto_default()
+*/
+/**************************************************************************/
+void ntag424_rng_init(ntag424_RNGPoolType *rng,
+                      const ntag424_CryptoProviderType *provider)
+{
+  rng->provider = (provider != NULL) ? provider : ntag424_crypto_default();
+  rng->available = 0;
+  ntag424_rng_refill(rng);
+}
+
+/**************************************************************************/
+/*!
+    @brief   replace the bytes handed out since the last refill. Cheap if
+   nothing was used, call it whenever there is idle time.
+
+    @param   rng   random pool
+
+    @return  true if bytes were drawn from the entropy source; false if
+   nothing was used or the entropy source failed
+*/
+/**************************************************************************/
+bool ntag424_rng_refill(ntag424_RNGPoolType *rng)
+{
+  uint8_t used = NTAG424_RNG_POOLSIZE - rng->available;
+  if (used == 0)
+  {
+    return false;
+  }
+  // the used bytes are at the front, the unused ones stay where they are
+  if (!rng->provider->random(rng->pool, used))
+  {
+    mbedtls_platform_zeroize(rng->pool, used);
+    return false;
+  }
+  rng->available = NTAG424_RNG_POOLSIZE;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief   take random bytes out of the pool, refills it when it runs
+   empty.
+
+    @param   rng      random pool
+    @param   output   outputbuffer
+    @param   length   number of bytes
+
+    @return  1 = success; 0 = the entropy source failed (output is wiped)
+*/
+/**************************************************************************/
+uint8_t ntag424_rng_get(ntag424_RNGPoolType *rng, uint8_t *output,
+                        size_t length)
+{
+  uint8_t *begin = output;
+  while (length > 0)
+  {
+    if ((rng->available == 0) && !ntag424_rng_refill(rng))
+    {
+      mbedtls_platform_zeroize(begin, output - begin);
+      return 0;
+    }
+    uint8_t *start = rng->pool + NTAG424_RNG_POOLSIZE - rng->available;
+    size_t n = (length < rng->available) ? length : rng->available;
+    memcpy(output, start, n);
+    mbedtls_platform_zeroize(start, n);
+    rng->available -= n;
+    output += n;
+    length -= n;
+  }
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   wipe the pool.
+
+    @param   rng   random pool
+*/
+/**************************************************************************/
+void ntag424_rng_free(ntag424_RNGPoolType *rng)
+{
+  mbedtls_platform_zeroize(rng->pool, sizeof(rng->pool));
+  rng->available = 0;
+}
@@ -0,0 +1,41 @@
+/**************************************************************************/
+/*!
+    @file ntag424_rng.h
+
+    Pool of random bytes from the entropy source of the crypto provider
+    (hardware RNG of the ESP32, getrandom() on Linux). The pool is refilled
+    while the reader waits for the PN532, so RndA of an authentication is a
+    copy out of a warm pool instead of a call into the entropy source.
+    Bytes handed out are wiped from the pool, no byte is handed out twice.
+*/
+/**************************************************************************/
+
+#ifndef NTAG424_RNG_H
+#define NTAG424_RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ntag424_crypto.h"
+
+#define NTAG424_RNG_POOLSIZE 64 ///< Pool size, RndA of four authentications
+
+/**
+ * @brief Random pool state, pool[NTAG424_RNG_POOLSIZE - available..] is
+ * unused.
+ */
+struct ntag424_RNGPoolType
+{
+  uint8_t pool[NTAG424_RNG_POOLSIZE];         ///< random bytes
+  uint8_t available;                          ///< unused bytes in pool
+  const ntag424_CryptoProviderType *provider; ///< entropy source
+};
+
+void ntag424_rng_init(ntag424_RNGPoolType *rng,
+                      const ntag424_CryptoProviderType *provider = NULL);
+bool ntag424_rng_refill(ntag424_RNGPoolType *rng);
+uint8_t ntag424_rng_get(ntag424_RNGPoolType *rng, uint8_t *output,
+                        size_t length);
+void ntag424_rng_free(ntag424_RNGPoolType *rng);
+
+#endif
@@ -0,0 +1,510 @@
+/**************************************************************************/
+/*!
+    @file ntag424_sdm.cpp
+
+    Secure Dynamic Messaging (SUN) verification, see ntag424_sdm.h.
+*/
+/**************************************************************************/
+
+#include "ntag424_sdm.h"
+
+#include <string.h>
+
+#include "mbedtls/platform_util.h"
+
+#define NTAG424_SDM_SV_SIZE 16 ///< Size of the session vectors SV1/SV2
+
+/**************************************************************************/
+/*!
+    @brief   value of one hex digit.
+
+    @param   c      ASCII character
+
+    @return  0..15; 0xFF = not a hex digit
+*/
+/**************************************************************************/
+static uint8_t ntag424_sdm_hex_nibble(uint8_t c)
+{
+  if (c >= '0' && c <= '9')
+  {
+    return c - '0';
+  }
+  if (c >= 'A' && c <= 'F')
+  {
+    return c - 'A' + 10;
+  }
+  if (c >= 'a' && c <= 'f')
+  {
+    return c - 'a' + 10;
+  }
+  return 0xFF;
+}
+
+/**************************************************************************/
+/*!
+    @brief   decode length ASCII hex characters (as mirrored by the tag)
+   into length/2 bytes.
+
+    @param   hex     ASCII hex characters
+    @param   length  number of characters, must be even
+    @param   output  outputbuffer (>=length/2 bytes)
+
+    @return  1 = success; 0 = odd length or not a hex digit
+*/
+/**************************************************************************/
+uint8_t ntag424_sdm_hex_decode(const uint8_t *hex, size_t length,
+                               uint8_t *output)
+{
+  if (length % 2 != 0)
+  {
+    return 0;
+  }
+  for (size_t i = 0; i < length / 2; i++)
+  {
+    uint8_t hi = ntag424_sdm_hex_nibble(hex[2 * i]);
+    uint8_t lo = ntag424_sdm_hex_nibble(hex[2 * i + 1]);
+    if (hi == 0xFF || lo == 0xFF)
+    {
+      return 0;
+    }
+    output[i] = (uint8_t)((hi << 4) | lo);
+  }
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   true if the field [offset, offset+size) is inside the file.
+
+    @param   offset  offset of the field
+    @param   size    size of the field
+    @param   length  length of the file
+
+    @return  true = field is inside the file
+*/
+/**************************************************************************/
+static bool ntag424_sdm_inside(uint32_t offset, size_t size, size_t length)
+{
+  return offset <= length && size <= length - offset;
+}
+
+/**************************************************************************/
+/*!
+    @brief   extract the mirrored fields of a SUN message from the file data
+   (e.g. the NDEF URL read from the tag or received by the backend).
+
+    @param   layout  offsets configured in the file settings
+    @param   file    file data, starting at offset 0 of the file
+    @param   length  length of file
+    @param   msg     message to fill, mac_input points into file
+
+    @return  1 = success; 0 = field outside file or not hex
+*/
+/**************************************************************************/
+uint8_t ntag424_sdm_parse(const ntag424_SDMLayoutType *layout,
+                          const uint8_t *file, size_t length,
+                          ntag424_SDMMessageType *msg)
+{
+  memset(msg, 0, sizeof(*msg));
+  if (layout->picc_data_offset != NTAG424_SDM_OFFSET_NONE)
+  {
+    if (!ntag424_sdm_inside(layout->picc_data_offset,
+                            2 * NTAG424_SDM_PICCDATA_SIZE, length) ||
+        !ntag424_sdm_hex_decode(file + layout->picc_data_offset,
+                                2 * NTAG424_SDM_PICCDATA_SIZE,
+                                msg->picc_data))
+    {
+      return 0;
+    }
+    msg->picc_encrypted = true;
+  }
+  if (layout->uid_offset != NTAG424_SDM_OFFSET_NONE)
+  {
+    if (!ntag424_sdm_inside(layout->uid_offset, 2 * NTAG424_SDM_UID_SIZE,
+                            length) ||
+        !ntag424_sdm_hex_decode(file + layout->uid_offset,
+                                2 * NTAG424_SDM_UID_SIZE, msg->uid))
+    {
+      return 0;
+    }
+    msg->has_uid = true;
+  }
+  if (layout->read_ctr_offset != NTAG424_SDM_OFFSET_NONE)
+  {
+    uint8_t ctr[NTAG424_SDM_CTR_SIZE];
+    if (!ntag424_sdm_inside(layout->read_ctr_offset, 2 * NTAG424_SDM_CTR_SIZE,
+                            length) ||
+        !ntag424_sdm_hex_decode(file + layout->read_ctr_offset,
+                                2 * NTAG424_SDM_CTR_SIZE, ctr))
+    {
+      return 0;
+    }
+    // mirrored MSB first, used LSB first in the session vectors
+    for (int i = 0; i < NTAG424_SDM_CTR_SIZE; i++)
+    {
+      msg->read_ctr[i] = ctr[NTAG424_SDM_CTR_SIZE - 1 - i];
+    }
+    msg->has_read_ctr = true;
+  }
+  if (layout->enc_offset != NTAG424_SDM_OFFSET_NONE)
+  {
+    if (layout->enc_length % (2 * NTAG424_AES_BLOCKSIZE) != 0 ||
+        layout->enc_length > 2 * NTAG424_SDM_ENC_MAXSIZE ||
+        !ntag424_sdm_inside(layout->enc_offset, layout->enc_length, length) ||
+        !ntag424_sdm_hex_decode(file + layout->enc_offset, layout->enc_length,
+                                msg->enc_data))
+    {
+      return 0;
+    }
+    msg->enc_length = layout->enc_length / 2;
+  }
+  if (layout->mac_offset == NTAG424_SDM_OFFSET_NONE ||
+      layout->mac_input_offset > layout->mac_offset ||
+      !ntag424_sdm_inside(layout->mac_offset, 2 * NTAG424_SDM_MAC_SIZE,
+                          length) ||
+      !ntag424_sdm_hex_decode(file + layout->mac_offset,
+                              2 * NTAG424_SDM_MAC_SIZE, msg->mac))
+  {
+    return 0;
+  }
+  msg->mac_input = file + layout->mac_input_offset;
+  msg->mac_input_length = layout->mac_offset - layout->mac_input_offset;
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   decrypt PICCData and take UID and SDMReadCtr from it.
+
+    @param   meta_ctx   SDMMetaRead key, expanded for decryption
+    @param   picc_data  16 byte encrypted PICCData
+    @param   result     uid/read_ctr are set
+
+    @return  1 = success; 0 = PICCDataTag invalid (wrong key)
+*/
+/**************************************************************************/
+uint8_t ntag424_sdm_decrypt_picc(const ntag424_AESType *meta_ctx,
+                                 const uint8_t *picc_data,
+                                 ntag424_SDMResultType *result)
+{
+  uint8_t plain[NTAG424_SDM_PICCDATA_SIZE];
+  uint8_t success = 1;
+  // cbc with zero iv over one block
+  meta_ctx->provider->aes_ecb(meta_ctx, picc_data, plain);
+  uint8_t tag = plain[0];
+  uint8_t pos = 1;
+  result->has_uid = false;
+  result->has_read_ctr = false;
+  if (tag & NTAG424_SDM_PICCTAG_UID)
+  {
+    if ((tag & NTAG424_SDM_PICCTAG_UIDLEN) != NTAG424_SDM_UID_SIZE)
+    {
+      success = 0;
+    }
+    else
+    {
+      memcpy(result->uid, plain + pos, NTAG424_SDM_UID_SIZE);
+      result->has_uid = true;
+      pos += NTAG424_SDM_UID_SIZE;
+    }
+  }
+  if (success && (tag & NTAG424_SDM_PICCTAG_CTR))
+  {
+    result->read_ctr = (uint32_t)plain[pos] | ((uint32_t)plain[pos + 1] << 8) |
+                       ((uint32_t)plain[pos + 2] << 16);
+    result->has_read_ctr = true;
+  }
+  mbedtls_platform_zeroize(plain, sizeof(plain));
+  return success;
+}
+
+/**************************************************************************/
+/*!
+    @brief   build SV1 (SDM encryption) and SV2 (SDM mac) from the mirrored
+   UID and SDMReadCtr.
+
+    @param   result  uid/read_ctr of the message
+    @param   sv1     outputbuffer (16 bytes), NULL = not needed
+    @param   sv2     outputbuffer (16 bytes)
+*/
+/**************************************************************************/
+void ntag424_sdm_session_vectors(const ntag424_SDMResultType *result,
+                                 uint8_t *sv1, uint8_t *sv2)
+{
+  uint8_t pos = 6;
+  const uint8_t header[6] = {0x3C, 0xC3, 0x00, 0x01, 0x00, 0x80};
+  memset(sv2, 0, NTAG424_SDM_SV_SIZE);
+  memcpy(sv2, header, sizeof(header));
+  if (result->has_uid)
+  {
+    memcpy(sv2 + pos, result->uid, NTAG424_SDM_UID_SIZE);
+    pos += NTAG424_SDM_UID_SIZE;
+  }
+  if (result->has_read_ctr)
+  {
+    sv2[pos++] = (uint8_t)(result->read_ctr);
+    sv2[pos++] = (uint8_t)(result->read_ctr >> 8);
+    sv2[pos++] = (uint8_t)(result->read_ctr >> 16);
+  }
+  if (sv1 != NULL)
+  {
+    memcpy(sv1, sv2, NTAG424_SDM_SV_SIZE);
+    sv1[0] = 0xC3;
+    sv1[1] = 0x3C;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   take UID and SDMReadCtr of msg, decrypting PICCData if needed.
+
+    @param   meta_ctx   SDMMetaRead key (decrypt), may be NULL for plain msg
+    @param   msg        message
+    @param   result     cleared, uid/read_ctr are set
+
+    @return  1 = success; 0 = PICCData invalid
+*/
+/**************************************************************************/
+static uint8_t ntag424_sdm_identity(const ntag424_AESType *meta_ctx,
+                                    const ntag424_SDMMessageType *msg,
+                                    ntag424_SDMResultType *result)
+{
+  memset(result, 0, sizeof(*result));
+  if (msg->picc_encrypted)
+  {
+    return (meta_ctx != NULL) ? ntag424_sdm_decrypt_picc(meta_ctx,
+                                                         msg->picc_data, result)
+                              : 0;
+  }
+  if (msg->has_uid)
+  {
+    memcpy(result->uid, msg->uid, NTAG424_SDM_UID_SIZE);
+    result->has_uid = true;
+  }
+  if (msg->has_read_ctr)
+  {
+    result->read_ctr = (uint32_t)msg->read_ctr[0] |
+                       ((uint32_t)msg->read_ctr[1] << 8) |
+                       ((uint32_t)msg->read_ctr[2] << 16);
+    result->has_read_ctr = true;
+  }
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   compare the truncated cmac with SDMMAC in constant time and
+   decrypt SDMENCFileData of a valid message.
+
+    @param   msg        message
+    @param   cmac       16 byte cmac of the SDMMAC input
+    @param   enc_key    KSesSDMFileReadENC, used if msg has SDMENCFileData
+    @param   result     valid/enc_data are set
+    @param   provider   crypto provider
+
+    @return  1 = valid; 0 = invalid
+*/
+/**************************************************************************/
+static uint8_t ntag424_sdm_check(const ntag424_SDMMessageType *msg,
+                                 const uint8_t *cmac, const uint8_t *enc_key,
+                                 ntag424_SDMResultType *result,
+                                 const ntag424_CryptoProviderType *provider)
+{
+  uint8_t cmac_short[NTAG424_CMAC_SHORTSIZE];
+  uint8_t diff = 0;
+  ntag424_cmac_truncate(cmac, cmac_short);
+  for (int i = 0; i < NTAG424_SDM_MAC_SIZE; i++)
+  {
+    diff |= cmac_short[i] ^ msg->mac[i];
+  }
+  if (diff != 0)
+  {
+    return 0;
+  }
+  if (msg->enc_length > 0)
+  {
+    // SDMENCFileData needs both UID and SDMReadCtr mirrored
+    if (!result->has_uid || !result->has_read_ctr)
+    {
+      return 0;
+    }
+    ntag424_AESType ctx;
+    uint8_t iv[NTAG424_AES_BLOCKSIZE];
+    memset(iv, 0, sizeof(iv));
+    iv[0] = (uint8_t)(result->read_ctr);
+    iv[1] = (uint8_t)(result->read_ctr >> 8);
+    iv[2] = (uint8_t)(result->read_ctr >> 16);
+    ntag424_aes_setkey(&ctx, provider, enc_key, NTAG424_AES_ENCRYPT);
+    ctx.provider->aes_ecb(&ctx, iv, iv);
+    ntag424_aes_free(&ctx);
+    ntag424_aes_setkey(&ctx, provider, enc_key, NTAG424_AES_DECRYPT);
+    ctx.provider->aes_cbc(&ctx, iv, msg->enc_data, result->enc_data,
+                          msg->enc_length);
+    ntag424_aes_free(&ctx);
+    result->enc_length = msg->enc_length;
+  }
+  result->valid = true;
+  return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief   verify one SUN message.
+
+    @param   keys       SDMMetaRead/SDMFileRead keys
+    @param   msg        message, see ntag424_sdm_parse()
+    @param   result     uid, read_ctr, validity and decrypted file data
+    @param   provider   crypto provider, NULL = ntag424_crypto_default()
+
+    @return  1 = SDMMAC valid; 0 = invalid
+*/
+/**************************************************************************/
+uint8_t ntag424_sdm_verify(const ntag424_SDMKeysType *keys,
+                           const ntag424_SDMMessageType *msg,
+                           ntag424_SDMResultType *result,
+                           const ntag424_CryptoProviderType *provider)
+{
+  ntag424_AESType meta_ctx;
+  uint8_t sv1[NTAG424_SDM_SV_SIZE];
+  uint8_t sv2[NTAG424_SDM_SV_SIZE];
+  uint8_t enc_key[NTAG424_CMAC_BLOCKSIZE];
+  uint8_t mac_key[NTAG424_CMAC_BLOCKSIZE];
+  uint8_t cmac[NTAG424_CMAC_BLOCKSIZE];
+  uint8_t success = 0;
+
+  if (provider == NULL)
+  {
+    provider = ntag424_crypto_default();
+  }
+  if (msg->picc_encrypted)
+  {
+    ntag424_aes_setkey(&meta_ctx, provider, keys->meta_key,
+                       NTAG424_AES_DECRYPT);
+  }
+  success = ntag424_sdm_identity(msg->picc_encrypted ? &meta_ctx : NULL, msg,
+                                 result);
+  if (msg->picc_encrypted)
+  {
+    ntag424_aes_free(&meta_ctx);
+  }
+  if (success)
+  {
+    ntag424_CMACType engine;
+    ntag424_cmac_init(&engine, provider);
+    ntag424_sdm_session_vectors(result, sv1, sv2);
+    ntag424_cmac_setkey(&engine, keys->file_key);
+    ntag424_cmac_update(&engine, sv2, sizeof(sv2));
+    ntag424_cmac_finish(&engine, mac_key);
+    if (msg->enc_length > 0)
+    {
+      ntag424_cmac_update(&engine, sv1, sizeof(sv1));
+      ntag424_cmac_finish(&engine, enc_key);
+    }
+    ntag424_cmac_setkey(&engine, mac_key);
+    ntag424_cmac_update(&engine, msg->mac_input, msg->mac_input_length);
+    ntag424_cmac_finish(&engine, cmac);
+    ntag424_cmac_free(&engine);
+    success = ntag424_sdm_check(msg, cmac, enc_key, result, provider);
+  }
+  mbedtls_platform_zeroize(enc_key, sizeof(enc_key));
+  mbedtls_platform_zeroize(mac_key, sizeof(mac_key));
+  return success;
+}
+
+/**************************************************************************/
+/*!
+    @brief   verify count SUN messages sharing the same keys. Runs in rounds
+   of NTAG424_SDM_BATCH messages, the session key derivation and the SDMMAC
+   of a round each go through one ntag424_cmac_batch() call.
+
+    @param   keys       SDMMetaRead/SDMFileRead keys
+    @param   msgs       messages, see ntag424_sdm_parse()
+    @param   count      number of messages
+    @param   results    one result per message
+    @param   provider   crypto provider, NULL = ntag424_crypto_default()
+
+    @return  number of valid messages
+*/
+/**************************************************************************/
+size_t ntag424_sdm_verify_batch(const ntag424_SDMKeysType *keys,
+                                const ntag424_SDMMessageType *msgs,
+                                size_t count, ntag424_SDMResultType *results,
+                                const ntag424_CryptoProviderType *provider)
+{
+  ntag424_AESType meta_ctx;
+  uint8_t sv[NTAG424_SDM_BATCH][2][NTAG424_SDM_SV_SIZE];
+  uint8_t session[NTAG424_SDM_BATCH][2][NTAG424_CMAC_BLOCKSIZE];
+  uint8_t cmac[NTAG424_SDM_BATCH][NTAG424_CMAC_BLOCKSIZE];
+  ntag424_CMACJobType jobs[2 * NTAG424_SDM_BATCH];
+  bool ok[NTAG424_SDM_BATCH];
+  size_t valid = 0;
+
+  if (provider == NULL)
+  {
+    provider = ntag424_crypto_default();
+  }
+  bool meta_ready = (keys->meta_key != NULL);
+  if (meta_ready)
+  {
+    ntag424_aes_setkey(&meta_ctx, provider, keys->meta_key,
+                       NTAG424_AES_DECRYPT);
+  }
+  for (size_t base = 0; base < count; base += NTAG424_SDM_BATCH)
+  {
+    const ntag424_SDMMessageType *msg = msgs + base;
+    ntag424_SDMResultType *result = results + base;
+    size_t n = count - base;
+    if (n > NTAG424_SDM_BATCH)
+    {
+      n = NTAG424_SDM_BATCH;
+    }
+
+    // session keys: SV2 -> KSesSDMFileReadMAC, SV1 -> KSesSDMFileReadENC
+    size_t njobs = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+      ok[i] = ntag424_sdm_identity(meta_ready ? &meta_ctx : NULL, &msg[i],
+                                   &result[i]);
+      if (!ok[i])
+      {
+        continue;
+      }
+      ntag424_sdm_session_vectors(&result[i], sv[i][0], sv[i][1]);
+      jobs[njobs++] = {keys->file_key, sv[i][1], NTAG424_SDM_SV_SIZE,
+                       session[i][1]};
+      if (msg[i].enc_length > 0)
+      {
+        jobs[njobs++] = {keys->file_key, sv[i][0], NTAG424_SDM_SV_SIZE,
+                         session[i][0]};
+      }
+    }
+    ntag424_cmac_batch(jobs, njobs, provider);
+
+    // SDMMAC input under the session mac keys
+    njobs = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+      if (ok[i])
+      {
+        jobs[njobs++] = {session[i][1], msg[i].mac_input,
+                         msg[i].mac_input_length, cmac[i]};
+      }
+    }
+    ntag424_cmac_batch(jobs, njobs, provider);
+
+    for (size_t i = 0; i < n; i++)
+    {
+      if (ok[i] && ntag424_sdm_check(&msg[i], cmac[i], session[i][0],
+                                     &result[i], provider))
+      {
+        valid++;
+      }
+    }
+  }
+  if (meta_ready)
+  {
+    ntag424_aes_free(&meta_ctx);
+  }
+  mbedtls_platform_zeroize(session, sizeof(session));
+  return valid;
+}
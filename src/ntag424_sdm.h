@@ -0,0 +1,111 @@
+/**************************************************************************/
+/*!
+    @file ntag424_sdm.h
+
+    Verification of NTAG424 Secure Dynamic Messaging (SUN) messages: parse
+    the mirrored fields out of the file data, decrypt PICCData, derive the
+    SDM session keys, check SDMMAC and decrypt SDMENCFileData (NT4H2421Gx
+    datasheet chapter 9.3, AN12196). Runs on the reader as well as on a
+    backend, ntag424_sdm_verify_batch() verifies many taps at once with the
+    multi-lane cmac of the crypto provider.
+*/
+/**************************************************************************/
+
+#ifndef NTAG424_SDM_H
+#define NTAG424_SDM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ntag424_cmac.h"
+#include "ntag424_crypto.h"
+
+#define NTAG424_SDM_PICCDATA_SIZE 16 ///< Size of the encrypted PICCData
+#define NTAG424_SDM_UID_SIZE 7       ///< Size of the mirrored UID
+#define NTAG424_SDM_CTR_SIZE 3       ///< Size of SDMReadCtr
+#define NTAG424_SDM_MAC_SIZE 8       ///< Size of SDMMAC
+#define NTAG424_SDM_ENC_MAXSIZE 128  ///< Max. size of SDMENCFileData (binary)
+#define NTAG424_SDM_OFFSET_NONE 0xFFFFFFUL ///< Offset of a field not mirrored
+#define NTAG424_SDM_BATCH 16 ///< Messages per round of ntag424_sdm_verify_batch
+
+#define NTAG424_SDM_PICCTAG_UID 0x80    ///< PICCDataTag: UID mirrored
+#define NTAG424_SDM_PICCTAG_CTR 0x40    ///< PICCDataTag: SDMReadCtr mirrored
+#define NTAG424_SDM_PICCTAG_UIDLEN 0x0F ///< PICCDataTag: UID length
+
+/**
+ * @brief Offsets of the mirrored fields in the file data, as configured
+ * with ChangeFileSettings. Unused fields are NTAG424_SDM_OFFSET_NONE.
+ */
+struct ntag424_SDMLayoutType
+{
+  uint32_t picc_data_offset; ///< PICCDataOffset, encrypted UID/SDMReadCtr
+  uint32_t uid_offset;       ///< UIDOffset, plain UID mirror
+  uint32_t read_ctr_offset;  ///< SDMReadCtrOffset, plain SDMReadCtr mirror
+  uint32_t mac_input_offset; ///< SDMMACInputOffset
+  uint32_t enc_offset;       ///< SDMENCOffset
+  uint32_t enc_length;       ///< SDMENCLength (ASCII characters)
+  uint32_t mac_offset;       ///< SDMMACOffset
+};
+
+/**
+ * @brief Keys of the SDM access rights.
+ */
+struct ntag424_SDMKeysType
+{
+  const uint8_t *meta_key; ///< SDMMetaRead key, decrypts PICCData
+  const uint8_t *file_key; ///< SDMFileRead key, SDMMAC and SDMENCFileData
+};
+
+/**
+ * @brief One SUN message, binary fields already hex decoded.
+ */
+struct ntag424_SDMMessageType
+{
+  bool picc_encrypted; ///< true = picc_data is set, false = uid/read_ctr
+  uint8_t picc_data[NTAG424_SDM_PICCDATA_SIZE]; ///< encrypted PICCData
+  bool has_uid;                              ///< true = uid is mirrored
+  uint8_t uid[NTAG424_SDM_UID_SIZE];         ///< plain UID
+  bool has_read_ctr;                         ///< true = read_ctr is mirrored
+  uint8_t read_ctr[NTAG424_SDM_CTR_SIZE];    ///< plain SDMReadCtr, LSB first
+  const uint8_t *mac_input; ///< SDMMACInputOffset..SDMMACOffset of the file
+  size_t mac_input_length;  ///< length of mac_input, may be 0
+  uint8_t mac[NTAG424_SDM_MAC_SIZE];          ///< SDMMAC
+  uint8_t enc_data[NTAG424_SDM_ENC_MAXSIZE];  ///< SDMENCFileData
+  size_t enc_length;                          ///< 0 = no SDMENCFileData
+};
+
+/**
+ * @brief Outcome of the verification of one SUN message.
+ */
+struct ntag424_SDMResultType
+{
+  bool valid;                        ///< true = SDMMAC verified
+  bool has_uid;                      ///< true = uid is known
+  uint8_t uid[NTAG424_SDM_UID_SIZE]; ///< UID of the tag
+  bool has_read_ctr;                 ///< true = read_ctr is known
+  uint32_t read_ctr;                 ///< SDMReadCtr
+  uint8_t enc_data[NTAG424_SDM_ENC_MAXSIZE]; ///< decrypted SDMENCFileData
+  size_t enc_length;                         ///< length of enc_data
+};
+
+uint8_t ntag424_sdm_hex_decode(const uint8_t *hex, size_t length,
+                               uint8_t *output);
+uint8_t ntag424_sdm_parse(const ntag424_SDMLayoutType *layout,
+                          const uint8_t *file, size_t length,
+                          ntag424_SDMMessageType *msg);
+uint8_t ntag424_sdm_decrypt_picc(const ntag424_AESType *meta_ctx,
+                                 const uint8_t *picc_data,
+                                 ntag424_SDMResultType *result);
+void ntag424_sdm_session_vectors(const ntag424_SDMResultType *result,
+                                 uint8_t *sv1, uint8_t *sv2);
+uint8_t ntag424_sdm_verify(const ntag424_SDMKeysType *keys,
+                           const ntag424_SDMMessageType *msg,
+                           ntag424_SDMResultType *result,
+                           const ntag424_CryptoProviderType *provider = NULL);
+size_t ntag424_sdm_verify_batch(const ntag424_SDMKeysType *keys,
+                                const ntag424_SDMMessageType *msgs,
+                                size_t count, ntag424_SDMResultType *results,
+                                const ntag424_CryptoProviderType *provider =
+                                    NULL);
+
+#endif
@@ -0,0 +1,113 @@
+/**************************************************************************/
+/*!
+    @file test_cmac/test_main.cpp
+
+    AES-CMAC engine against the RFC 4493 test vectors (key 2b7e1516...),
+    contiguous, in pieces, scattered and batched.
+
+    pio test -e native -f test_cmac
+*/
+/**************************************************************************/
+
+#include <string.h>
+#include <unity.h>
+
+#include "ntag424_cmac.h"
+
+static const uint8_t key[16] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae,
+                                0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88,
+                                0x09, 0xcf, 0x4f, 0x3c};
+static const uint8_t message[64] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11,
+    0x73, 0x93, 0x17, 0x2a, 0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c,
+    0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51, 0x30, 0xc8, 0x1c, 0x46,
+    0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b,
+    0xe6, 0x6c, 0x37, 0x10};
+static const size_t lengths[4] = {0, 16, 40, 64};
+static const uint8_t expected[4][16] = {
+    {0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28, 0x7f, 0xa3, 0x7d, 0x12,
+     0x9b, 0x75, 0x67, 0x46},
+    {0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44, 0xf7, 0x9b, 0xdd, 0x9d,
+     0xd0, 0x4a, 0x28, 0x7c},
+    {0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61,
+     0x14, 0x97, 0xc8, 0x27},
+    {0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92, 0xfc, 0x49, 0x74, 0x17,
+     0x79, 0x36, 0x3c, 0xfe}};
+
+static ntag424_CMACType engine;
+
+void setUp(void)
+{
+  ntag424_cmac_init(&engine);
+  TEST_ASSERT_TRUE(ntag424_cmac_setkey(&engine, key));
+}
+
+void tearDown(void) { ntag424_cmac_free(&engine); }
+
+static void test_rfc4493(void)
+{
+  uint8_t cmac[16];
+  for (int i = 0; i < 4; i++)
+  {
+    ntag424_cmac_update(&engine, message, lengths[i]);
+    ntag424_cmac_finish(&engine, cmac);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected[i], cmac, 16);
+  }
+}
+
+static void test_rfc4493_pieces(void)
+{
+  // odd split points cross the block boundaries
+  uint8_t cmac[16];
+  ntag424_cmac_update(&engine, message, 7);
+  ntag424_cmac_update(&engine, message + 7, 9);
+  ntag424_cmac_update(&engine, message + 16, 17);
+  ntag424_cmac_update(&engine, message + 33, 7);
+  ntag424_cmac_finish(&engine, cmac);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected[2], cmac, 16);
+
+  // reset drops the partial message, the key stays
+  ntag424_cmac_update(&engine, message, 5);
+  ntag424_cmac_reset(&engine);
+  ntag424_cmac_update(&engine, message, 64);
+  ntag424_cmac_finish(&engine, cmac);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected[3], cmac, 16);
+}
+
+static void test_rfc4493_segments(void)
+{
+  uint8_t cmac[16];
+  ntag424_SegmentType segments[3] = {
+      {message, 1}, {NULL, 0}, {message + 1, 39}};
+  ntag424_cmac_segments(&engine, segments, 3, cmac);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected[2], cmac, 16);
+}
+
+static void test_rfc4493_batch(void)
+{
+  uint8_t cmacs[4][16];
+  ntag424_CMACJobType jobs[4];
+  for (int i = 0; i < 4; i++)
+  {
+    jobs[i].key = key;
+    jobs[i].data = message;
+    jobs[i].length = lengths[i];
+    jobs[i].cmac = cmacs[i];
+  }
+  ntag424_cmac_batch(jobs, 4);
+  for (int i = 0; i < 4; i++)
+  {
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected[i], cmacs[i], 16);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_rfc4493);
+  RUN_TEST(test_rfc4493_pieces);
+  RUN_TEST(test_rfc4493_segments);
+  RUN_TEST(test_rfc4493_batch);
+  return UNITY_END();
+}
@@ -0,0 +1,102 @@
+/**************************************************************************/
+/*!
+    @file test_crc32/test_main.cpp
+
+    CRC32/JAMCRC against the standard check value and zlib crc32() results
+    for lengths that hit the table, hardware and folding paths.
+
+    pio test -e native -f test_crc32
+*/
+/**************************************************************************/
+
+#include <string.h>
+#include <unity.h>
+
+#include "ntag424_crc32.h"
+
+// zlib.crc32() of the first length bytes of data (byte i = 7 * i + 3)
+static const size_t lengths[6] = {1, 15, 64, 65, 255, 1000};
+static const uint32_t expected[6] = {0x4B0BBE37, 0x7C619EDC, 0xCBD9ECF0,
+                                     0x6D195777, 0x8AF1EB92, 0x17BC2A46};
+
+static uint8_t data[1000];
+
+void setUp(void)
+{
+  for (size_t i = 0; i < sizeof(data); i++)
+  {
+    data[i] = (uint8_t)(i * 7 + 3);
+  }
+}
+
+void tearDown(void) {}
+
+static void test_check_values(void)
+{
+  const char *check = "123456789";
+  const char *fox = "The quick brown fox jumps over the lazy dog";
+  uint8_t zero[32];
+  memset(zero, 0, sizeof(zero));
+  TEST_ASSERT_EQUAL_HEX32(0xCBF43926,
+                          ntag424_crc32((const uint8_t *)check, 9));
+  TEST_ASSERT_EQUAL_HEX32(~0xCBF43926UL & 0xFFFFFFFFUL,
+                          ntag424_jamcrc((const uint8_t *)check, 9));
+  TEST_ASSERT_EQUAL_HEX32(0x414FA339,
+                          ntag424_crc32((const uint8_t *)fox, strlen(fox)));
+  TEST_ASSERT_EQUAL_HEX32(0x190A55AD, ntag424_crc32(zero, sizeof(zero)));
+  TEST_ASSERT_EQUAL_HEX32(0, ntag424_crc32(zero, 0));
+}
+
+static void test_zlib(void)
+{
+  for (int i = 0; i < 6; i++)
+  {
+    TEST_ASSERT_EQUAL_HEX32(expected[i], ntag424_crc32(data, lengths[i]));
+  }
+  // unaligned start
+  TEST_ASSERT_EQUAL_HEX32(0x3E2180EE, ntag424_crc32(data + 3, 200));
+}
+
+static void test_update_chunks(void)
+{
+  uint32_t crc = NTAG424_CRC32_INIT;
+  crc = ntag424_crc32_update(crc, data, 1);
+  crc = ntag424_crc32_update(crc, data + 1, 63);
+  crc = ntag424_crc32_update(crc, data + 64, 129);
+  crc = ntag424_crc32_update(crc, data + 193, 807);
+  TEST_ASSERT_EQUAL_HEX32(expected[5], ~crc);
+}
+
+static void test_jamcrc_batch(void)
+{
+  uint32_t crcs[9];
+  ntag424_jamcrc_batch(data, 16, 64, 4, crcs);
+  for (int i = 0; i < 4; i++)
+  {
+    TEST_ASSERT_EQUAL_HEX32(ntag424_jamcrc(data + 64 * i, 16), crcs[i]);
+  }
+  // four lanes at a time plus the rest, short and folded lengths
+  const size_t batch_lengths[7] = {0, 5, 8, 16, 21, 64, 100};
+  for (int l = 0; l < 7; l++)
+  {
+    for (size_t count = 1; count <= 9; count++)
+    {
+      ntag424_jamcrc_batch(data + 1, batch_lengths[l], 100, count, crcs);
+      for (size_t i = 0; i < count; i++)
+      {
+        TEST_ASSERT_EQUAL_HEX32(
+            ntag424_jamcrc(data + 1 + 100 * i, batch_lengths[l]), crcs[i]);
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_check_values);
+  RUN_TEST(test_zlib);
+  RUN_TEST(test_update_chunks);
+  RUN_TEST(test_jamcrc_batch);
+  return UNITY_END();
+}
@@ -0,0 +1,86 @@
+/**************************************************************************/
+/*!
+    @file test_diversify/test_main.cpp
+
+    AES-128 key diversification against the AN10922 example (UID
+    04782E21801D80, AID 3042F5, SystemID "NXP Abu") and the derived key
+    cache built on it.
+
+    pio test -e native -f test_diversify
+*/
+/**************************************************************************/
+
+#include <string.h>
+#include <unity.h>
+
+#include "ntag424_diversify.h"
+
+static const uint8_t master[16] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+                                   0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB,
+                                   0xCC, 0xDD, 0xEE, 0xFF};
+static const uint8_t uid[7] = {0x04, 0x78, 0x2E, 0x21, 0x80, 0x1D, 0x80};
+static const uint8_t system_id[10] = {0x30, 0x42, 0xF5, 0x4E, 0x58,
+                                      0x50, 0x20, 0x41, 0x62, 0x75};
+static const uint8_t expected[16] = {0xA8, 0xDD, 0x63, 0xA3, 0xB8, 0x9D,
+                                     0x54, 0xB3, 0x7C, 0xA8, 0x02, 0x47,
+                                     0x3F, 0xDA, 0x91, 0x75};
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static void test_an10922(void)
+{
+  ntag424_CMACType cmac;
+  uint8_t input[17];
+  uint8_t key[16];
+
+  memcpy(input, uid, sizeof(uid));
+  memcpy(input + sizeof(uid), system_id, sizeof(system_id));
+  ntag424_cmac_init(&cmac);
+  TEST_ASSERT_TRUE(ntag424_diversify(&cmac, master, input, 17, key));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, key, 16);
+  TEST_ASSERT_FALSE(ntag424_diversify(&cmac, master, input, 0, key));
+  ntag424_cmac_free(&cmac);
+}
+
+static void test_cache(void)
+{
+  ntag424_KeyEntryType store_entries[2];
+  ntag424_KeyStoreType store;
+  ntag424_DivKeyType entries[2];
+  ntag424_DivCacheType cache;
+  const uint8_t other[2][7] = {{0x04, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06},
+                               {0x04, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16}};
+
+  ntag424_keystore_init(&store, store_entries, 2);
+  TEST_ASSERT_TRUE(ntag424_keystore_add(&store, 1, 3, master));
+  ntag424_divcache_init(&cache, &store, system_id, sizeof(system_id),
+                        entries, 2);
+
+  uint8_t *key = ntag424_divcache_get(&cache, uid, 7, 1, 3);
+  TEST_ASSERT_NOT_NULL(key);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, key, 16);
+  TEST_ASSERT_TRUE(ntag424_divcache_get(&cache, uid, 7, 1, 3) == key);
+  TEST_ASSERT_EQUAL_UINT32(1, cache.hits);
+  TEST_ASSERT_EQUAL_UINT32(1, cache.misses);
+  TEST_ASSERT_NULL(ntag424_divcache_get(&cache, uid, 7, 1, 4));
+
+  // the third card evicts the least recently used one
+  TEST_ASSERT_NOT_NULL(ntag424_divcache_get(&cache, other[0], 7, 1, 3));
+  TEST_ASSERT_NOT_NULL(ntag424_divcache_get(&cache, other[1], 7, 1, 3));
+  TEST_ASSERT_NOT_NULL(ntag424_divcache_get(&cache, other[1], 7, 1, 3));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected,
+                               ntag424_divcache_get(&cache, uid, 7, 1, 3), 16);
+  TEST_ASSERT_EQUAL_UINT32(2, cache.hits);
+  TEST_ASSERT_EQUAL_UINT32(4, cache.misses);
+  ntag424_divcache_free(&cache);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_an10922);
+  RUN_TEST(test_cache);
+  return UNITY_END();
+}
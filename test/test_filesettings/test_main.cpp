@@ -0,0 +1,97 @@
+/**************************************************************************/
+/*!
+    @file test_filesettings/test_main.cpp
+
+    File settings against the AN12196 ChangeFileSettings and
+    GetFileSettings examples, in particular the order of the two
+    SDMAccessRights bytes.
+
+    pio test -e native -f test_filesettings
+*/
+/**************************************************************************/
+
+#include <string.h>
+#include <unity.h>
+
+#include "ntag424_filesettings.h"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static void test_encode(void)
+{
+  // FileOption 40, AccessRights 00E0, SDMOptions C1, SDMAccessRights F121
+  const uint8_t expected[] = {0x40, 0x00, 0xE0, 0xC1, 0xF1, 0x21,
+                              0x20, 0x00, 0x00, 0x43, 0x00, 0x00,
+                              0x43, 0x00, 0x00};
+  ntag424_FileSettingsType settings;
+  uint8_t buffer[NTAG424_FS_ENCODED_MAXSIZE];
+
+  memset(&settings, 0, sizeof(settings));
+  settings.file_type = NTAG424_FS_FILETYPE_STANDARD;
+  settings.sdm_enabled = true;
+  settings.read = NTAG424_FS_ACCESS_FREE;
+  settings.sdm_options = NTAG424_FS_SDM_UID | NTAG424_FS_SDM_READCTR |
+                         NTAG424_FS_SDM_ASCII;
+  settings.sdm_meta_read = 2;
+  settings.sdm_file_read = 1;
+  settings.sdm_ctr_ret = 1;
+  settings.picc_data_offset = 0x20;
+  settings.mac_input_offset = 0x43;
+  settings.mac_offset = 0x43;
+  TEST_ASSERT_EQUAL(sizeof(expected),
+                    ntag424_filesettings_encode(&settings, buffer));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+}
+
+static void test_decode(void)
+{
+  // SDMOptions D1, SDMAccessRights FE00, PICCData/MACInput/ENC/MAC offsets
+  const uint8_t response[] = {0x00, 0x40, 0xEE, 0xEE, 0x00, 0x01, 0x00,
+                              0xD1, 0xFE, 0x00, 0x1F, 0x00, 0x00, 0x44,
+                              0x00, 0x00, 0x44, 0x00, 0x00, 0x20, 0x00,
+                              0x00, 0x6A, 0x00, 0x00};
+  ntag424_FileSettingsType settings;
+  uint8_t buffer[NTAG424_FS_ENCODED_MAXSIZE];
+
+  TEST_ASSERT_TRUE(
+      ntag424_filesettings_decode(response, sizeof(response), &settings));
+  TEST_ASSERT_EQUAL_HEX8(NTAG424_FS_FILETYPE_STANDARD, settings.file_type);
+  TEST_ASSERT_TRUE(settings.sdm_enabled);
+  TEST_ASSERT_EQUAL_HEX8(NTAG424_FS_ACCESS_FREE, settings.read);
+  TEST_ASSERT_EQUAL_HEX8(NTAG424_FS_ACCESS_FREE, settings.change);
+  TEST_ASSERT_EQUAL_HEX32(0x100, settings.file_size);
+  TEST_ASSERT_EQUAL_HEX8(0xD1, settings.sdm_options);
+  TEST_ASSERT_EQUAL_HEX8(NTAG424_FS_ACCESS_FREE, settings.sdm_ctr_ret);
+  TEST_ASSERT_EQUAL_HEX8(0, settings.sdm_meta_read);
+  TEST_ASSERT_EQUAL_HEX8(0, settings.sdm_file_read);
+  TEST_ASSERT_EQUAL_HEX32(0x1F, settings.picc_data_offset);
+  TEST_ASSERT_EQUAL_HEX32(0x44, settings.mac_input_offset);
+  TEST_ASSERT_EQUAL_HEX32(0x44, settings.enc_offset);
+  TEST_ASSERT_EQUAL_HEX32(0x20, settings.enc_length);
+  TEST_ASSERT_EQUAL_HEX32(0x6A, settings.mac_offset);
+
+  // encoded back it is the response without FileType and FileSize
+  TEST_ASSERT_EQUAL(sizeof(response) - 4,
+                    ntag424_filesettings_encode(&settings, buffer));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(response + 1, buffer, 3);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(response + 7, buffer + 3,
+                               sizeof(response) - 7);
+
+  // one byte short or long
+  uint8_t longer[sizeof(response) + 1] = {0};
+  memcpy(longer, response, sizeof(response));
+  TEST_ASSERT_FALSE(
+      ntag424_filesettings_decode(response, sizeof(response) - 1, &settings));
+  TEST_ASSERT_FALSE(
+      ntag424_filesettings_decode(longer, sizeof(longer), &settings));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_encode);
+  RUN_TEST(test_decode);
+  return UNITY_END();
+}
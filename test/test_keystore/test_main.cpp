@@ -0,0 +1,216 @@
+/**************************************************************************/
+/*!
+    @file test_keystore/test_main.cpp
+
+    Key store: keys.json with duplicate (slot, version) pairs is rejected,
+    and a key ring reload leaves a store alone while a reader holds it.
+    Key change manifests: key data, key 0 last, a batch of cards.
+
+    pio test -e native -f test_keystore
+*/
+/**************************************************************************/
+
+#include <string.h>
+#include <unity.h>
+
+#include "ntag424_crc32.h"
+#include "ntag424_keystore.h"
+
+#define KEY0 "00000000000000000000000000000000"
+#define KEY1 "11111111111111111111111111111111"
+#define KEY2 "22222222222222222222222222222222"
+
+static ntag424_KeyEntryType entries[2][32];
+static ntag424_KeyStoreType stores[2];
+
+static uint8_t load(ntag424_KeyStoreType *store, const char *json)
+{
+  return ntag424_keystore_load_json(store, json, strlen(json));
+}
+
+static uint8_t reload(ntag424_KeyRingType *ring, const char *json)
+{
+  return ntag424_keyring_reload(ring, (const uint8_t *)json, strlen(json));
+}
+
+void setUp(void)
+{
+  ntag424_keystore_init(&stores[0], entries[0], 32);
+  ntag424_keystore_init(&stores[1], entries[1], 32);
+}
+
+void tearDown(void) {}
+
+static void test_json(void)
+{
+  TEST_ASSERT_EQUAL(1, load(&stores[0], "{\"version\": 2, \"authKey\": \"" KEY1
+                                        "\", \"defaultKey\": \"" KEY0
+                                        "\", \"keys\": [{\"slot\": 1, "
+                                        "\"version\": 1, \"key\": \"" KEY2
+                                        "\"}]}"));
+  TEST_ASSERT_EQUAL(7, stores[0].count);
+  TEST_ASSERT_EQUAL_HEX8(0x11, ntag424_keystore_find(&stores[0], 1, 2)[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x22, ntag424_keystore_find(&stores[0], 1, 1)[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x00, ntag424_keystore_find(&stores[0], 4, 0)[0]);
+  TEST_ASSERT_NULL(ntag424_keystore_find(&stores[0], 2, 2));
+}
+
+static void test_duplicates(void)
+{
+  const char *duplicates[] = {
+      // named key and keys[] of the same version
+      "{\"authKey\": \"" KEY1 "\", \"keys\": [{\"slot\": 1, \"version\": 1, "
+      "\"key\": \"" KEY2 "\"}]}",
+      // named key at version 0 next to defaultKey
+      "{\"version\": 0, \"authKey\": \"" KEY1 "\", \"defaultKey\": \"" KEY0
+      "\"}",
+      // keys[] twice
+      "{\"keys\": [{\"slot\": 3, \"version\": 5, \"key\": \"" KEY1 "\"}, "
+      "{\"slot\": 3, \"version\": 5, \"key\": \"" KEY2 "\"}]}",
+      // named key twice
+      "{\"readKey\": \"" KEY1 "\", \"readKey\": \"" KEY2 "\"}",
+  };
+  for (size_t i = 0; i < sizeof(duplicates) / sizeof(duplicates[0]); i++)
+  {
+    TEST_ASSERT_EQUAL(0, load(&stores[0], duplicates[i]));
+    TEST_ASSERT_EQUAL(0, stores[0].count);
+  }
+}
+
+static void test_binary_duplicates(void)
+{
+  const uint8_t key[NTAG424_KEYSTORE_KEYSIZE] = {0x11};
+  uint8_t buffer[64];
+  ntag424_keystore_add(&stores[0], 1, 1, key);
+  ntag424_keystore_add(&stores[0], 2, 1, key);
+  // second record exported as keyno 1 again
+  stores[0].entries[1].keyno = 1;
+  size_t length = ntag424_keystore_export(&stores[0], buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL(0, ntag424_keystore_load_binary(&stores[1], buffer,
+                                                    length));
+  TEST_ASSERT_EQUAL(0, stores[1].count);
+}
+
+static void test_reload_held(void)
+{
+  ntag424_KeyRingType ring;
+  ntag424_keyring_init(&ring, &stores[0], &stores[1]);
+  TEST_ASSERT_EQUAL(1, reload(&ring, "{\"authKey\": \"" KEY1 "\"}"));
+
+  // a card in progress holds the keys of the first reload
+  ntag424_KeyStoreType *held = ntag424_keyring_acquire(&ring);
+  TEST_ASSERT_EQUAL_PTR(&stores[1], held);
+  TEST_ASSERT_EQUAL(1, reload(&ring, "{\"authKey\": \"" KEY2 "\"}"));
+  TEST_ASSERT_EQUAL_PTR(&stores[0], ring.stores[ring.active]);
+
+  // the next reload would overwrite the held store
+  TEST_ASSERT_EQUAL(0, reload(&ring, "{\"authKey\": \"" KEY0 "\"}"));
+  TEST_ASSERT_EQUAL_PTR(&stores[0], ring.stores[ring.active]);
+  TEST_ASSERT_EQUAL_HEX8(0x11, ntag424_keystore_find(held, 1, 1)[0]);
+
+  ntag424_keyring_release(&ring, held);
+  TEST_ASSERT_EQUAL(1, reload(&ring, "{\"authKey\": \"" KEY0 "\"}"));
+  held = ntag424_keyring_acquire(&ring);
+  TEST_ASSERT_EQUAL_HEX8(0x00, ntag424_keystore_find(held, 1, 1)[0]);
+  ntag424_keyring_release(&ring, held);
+  ntag424_keyring_clear(&ring);
+}
+
+static void test_manifests(void)
+{
+  uint8_t keys[3][NTAG424_KEYCOUNT][2][NTAG424_KEYSTORE_KEYSIZE];
+  ntag424_KeyChangeType changes[3][3];
+  ntag424_KeyManifestType manifests[3], manifest;
+  for (int c = 0; c < 3; c++)
+  {
+    for (int k = 0; k < 3; k++)
+    {
+      // key 0 first, it has to be sent last
+      uint8_t keyno = (uint8_t)(k * 2);
+      memset(keys[c][keyno][0], 0x10 * c + keyno, 16);
+      memset(keys[c][keyno][1], 0x80 + 0x10 * c + keyno, 16);
+      keys[c][keyno][1][15] = (uint8_t)k;
+      changes[c][k].keyno = keyno;
+      changes[c][k].oldkey = keys[c][keyno][0];
+      changes[c][k].newkey = keys[c][keyno][1];
+      changes[c][k].version = (uint8_t)(c + 1);
+    }
+  }
+  // unused entries compare equal
+  memset(manifests, 0, sizeof(manifests));
+  TEST_ASSERT_EQUAL(1, ntag424_keychange_manifests(changes[0], 3, 3,
+                                                   manifests));
+  for (int c = 0; c < 3; c++)
+  {
+    memset(&manifest, 0, sizeof(manifest));
+    TEST_ASSERT_EQUAL(1, ntag424_keychange_manifest(changes[c], 3, &manifest));
+    TEST_ASSERT_EQUAL_MEMORY(&manifest, &manifests[c], sizeof(manifest));
+    TEST_ASSERT_EQUAL(3, manifest.count);
+    TEST_ASSERT_EQUAL(2, manifest.keys[0].keyno);
+    TEST_ASSERT_EQUAL(4, manifest.keys[1].keyno);
+    TEST_ASSERT_EQUAL(0, manifest.keys[2].keyno);
+
+    // key 1-4: old ^ new || KeyVer || JamCRC32(new), LSB first
+    const ntag424_KeyCryptogramType *key2 = &manifest.keys[0];
+    uint32_t jamcrc = ntag424_jamcrc(keys[c][2][1], 16);
+    TEST_ASSERT_EQUAL(21, key2->length);
+    TEST_ASSERT_EQUAL_HEX8(keys[c][2][0][0] ^ keys[c][2][1][0], key2->data[0]);
+    TEST_ASSERT_EQUAL(c + 1, key2->data[16]);
+    TEST_ASSERT_EQUAL_HEX32(jamcrc, (uint32_t)key2->data[17] |
+                                        ((uint32_t)key2->data[18] << 8) |
+                                        ((uint32_t)key2->data[19] << 16) |
+                                        ((uint32_t)key2->data[20] << 24));
+    // key 0: new || KeyVer
+    TEST_ASSERT_EQUAL(17, manifest.keys[2].length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(keys[c][0][1], manifest.keys[2].data, 16);
+  }
+
+  // key 0 twice on the last card fails the batch
+  changes[2][1].keyno = 0;
+  TEST_ASSERT_EQUAL(0, ntag424_keychange_manifests(changes[0], 3, 3,
+                                                   manifests));
+  TEST_ASSERT_EQUAL(0, manifests[0].count);
+}
+
+static void test_manifests_chunks(void)
+{
+  // 11 cards of 4 changes span three jamcrc batches
+  static uint8_t keys[11][4][NTAG424_KEYSTORE_KEYSIZE];
+  static ntag424_KeyChangeType changes[11][4];
+  static ntag424_KeyManifestType manifests[11], manifest;
+  memset(manifests, 0, sizeof(manifests));
+  for (int c = 0; c < 11; c++)
+  {
+    for (int k = 0; k < 4; k++)
+    {
+      for (int b = 0; b < NTAG424_KEYSTORE_KEYSIZE; b++)
+      {
+        keys[c][k][b] = (uint8_t)(31 * c + 7 * k + b);
+      }
+      changes[c][k].keyno = (uint8_t)((k + c) % 5);
+      changes[c][k].oldkey = keys[c][(k + 1) % 4];
+      changes[c][k].newkey = keys[c][k];
+      changes[c][k].version = (uint8_t)k;
+    }
+  }
+  TEST_ASSERT_EQUAL(1, ntag424_keychange_manifests(changes[0], 4, 11,
+                                                   manifests));
+  for (int c = 0; c < 11; c++)
+  {
+    memset(&manifest, 0, sizeof(manifest));
+    TEST_ASSERT_EQUAL(1, ntag424_keychange_manifest(changes[c], 4, &manifest));
+    TEST_ASSERT_EQUAL_MEMORY(&manifest, &manifests[c], sizeof(manifest));
+  }
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_json);
+  RUN_TEST(test_duplicates);
+  RUN_TEST(test_binary_duplicates);
+  RUN_TEST(test_reload_held);
+  RUN_TEST(test_manifests);
+  RUN_TEST(test_manifests_chunks);
+  return UNITY_END();
+}
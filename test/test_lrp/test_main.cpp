@@ -0,0 +1,220 @@
+/**************************************************************************/
+/*!
+    @file test_lrp/test_main.cpp
+
+    LRP against the AN12304 examples: plaintexts and updated keys, EvalLRP,
+    LRP-CMAC and LRICB, plus the LRICB counter chain against evaluation from
+    scratch. AuthenticateLRPFirst against the AN12321 example: session keys,
+    both MACs and the PICCData at EncCtr 0.
+
+    pio test -e native -f test_lrp
+*/
+/**************************************************************************/
+
+#include <string.h>
+#include <unity.h>
+
+#include "ntag424_cmac.h"
+#include "ntag424_lrp.h"
+
+static ntag424_LRPType lrp;
+
+void setUp(void) { ntag424_lrp_init(&lrp); }
+
+void tearDown(void) { ntag424_lrp_free(&lrp); }
+
+static void test_setkey(void)
+{
+  const uint8_t key[16] = {0x56, 0x78, 0x26, 0xB8, 0xDA, 0x8E, 0x76, 0x84,
+                           0x32, 0xA9, 0x54, 0x8D, 0xBE, 0x4A, 0xA3, 0xA0};
+  const uint8_t p0[16] = {0xAC, 0x20, 0xD3, 0x9F, 0x53, 0x41, 0xFE, 0x98,
+                          0xDF, 0xCA, 0x21, 0xDA, 0x86, 0xBA, 0x79, 0x14};
+  const uint8_t p15[16] = {0x71, 0xB4, 0x44, 0xAF, 0x25, 0x7A, 0x93, 0x21,
+                           0x53, 0x11, 0xD7, 0x58, 0xDD, 0x33, 0x32, 0x47};
+  const uint8_t k0[16] = {0x16, 0x3D, 0x14, 0xED, 0x24, 0xED, 0x93, 0x53,
+                          0x73, 0x56, 0x8E, 0xC5, 0x21, 0xE9, 0x6C, 0xF4};
+  const uint8_t k1[16] = {0x1C, 0x51, 0x9C, 0x00, 0x02, 0x08, 0xB9, 0x5A,
+                          0x39, 0xA6, 0x5D, 0xB0, 0x58, 0x32, 0x71, 0x88};
+  // updated key 2 of the same key, the driver only generates 0 and 1
+  const uint8_t k2[16] = {0xFE, 0x30, 0xAB, 0x50, 0x46, 0x7E, 0x61, 0x78,
+                          0x3B, 0xFE, 0x6B, 0x5E, 0x05, 0x60, 0x16, 0x0E};
+  const uint8_t input[2] = {0x13, 0x59};
+  const uint8_t eval[16] = {0x1B, 0xA2, 0xC0, 0xC5, 0x78, 0x99, 0x6B, 0xC4,
+                            0x97, 0xDD, 0x18, 0x1C, 0x68, 0x85, 0xA9, 0xDD};
+  uint8_t output[16];
+
+  TEST_ASSERT_TRUE(ntag424_lrp_setkey(&lrp, key));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(p0, lrp.plaintexts[0], 16);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(p15, lrp.plaintexts[15], 16);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(k0, lrp.updated_keys[0], 16);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(k1, lrp.updated_keys[1], 16);
+
+  // EvalLRP(k'2, 1359, final) with k'2 loaded into slot 0
+  memcpy(lrp.updated_keys[0], k2, 16);
+  TEST_ASSERT_TRUE(ntag424_lrp_eval(&lrp, 0, input, 4, true, output));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(eval, output, 16);
+  TEST_ASSERT_FALSE(ntag424_lrp_eval(&lrp, 2, input, 4, true, output));
+}
+
+static void test_cmac(void)
+{
+  const uint8_t keys[2][16] = {
+      {0x81, 0x95, 0x08, 0x8C, 0xE6, 0xC3, 0x93, 0x70, 0x8E, 0xBB, 0xE6,
+       0xC7, 0x91, 0x4E, 0xCB, 0x0B},
+      {0x5A, 0xA9, 0xF6, 0xC6, 0xDE, 0x51, 0x38, 0x11, 0x3D, 0xF5, 0xD6,
+       0xB6, 0xC7, 0x7D, 0x5D, 0x52}};
+  const uint8_t message1[6] = {0xBB, 0xD5, 0xB8, 0x57, 0x72, 0xC7};
+  const uint8_t message2[16] = {0xA4, 0x43, 0x4D, 0x74, 0x0C, 0x2C,
+                                0xB6, 0x65, 0xFE, 0x53, 0x96, 0x95,
+                                0x91, 0x89, 0x38, 0x3F};
+  const uint8_t expected[2][16] = {
+      {0xAD, 0x85, 0x95, 0xE0, 0xB4, 0x9C, 0x5C, 0x0D, 0xB1, 0x8E, 0x77,
+       0x35, 0x5F, 0x5A, 0xAF, 0xF6},
+      {0x8B, 0x43, 0xAD, 0xF7, 0x67, 0xE4, 0x6B, 0x69, 0x2E, 0x8F, 0x24,
+       0xE8, 0x37, 0xCB, 0x5E, 0xFC}};
+  const uint8_t *messages[2] = {message1, message2};
+  const size_t lengths[2] = {sizeof(message1), sizeof(message2)};
+  ntag424_CMACType cmac;
+  uint8_t output[16];
+
+  ntag424_cmac_init(&cmac);
+  for (int i = 0; i < 2; i++)
+  {
+    TEST_ASSERT_TRUE(ntag424_lrp_setkey(&lrp, keys[i]));
+    TEST_ASSERT_TRUE(ntag424_cmac_setkey_lrp(&cmac, &lrp, 0));
+    ntag424_cmac_update(&cmac, messages[i], lengths[i]);
+    ntag424_cmac_finish(&cmac, output);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected[i], output, 16);
+  }
+  ntag424_cmac_free(&cmac);
+}
+
+static void test_lricb(void)
+{
+  const uint8_t key[16] = {0xE0, 0xC4, 0x93, 0x5F, 0xF0, 0xC2, 0x54, 0xCD,
+                           0x2C, 0xEF, 0x8F, 0xDD, 0xC3, 0x24, 0x60, 0xCF};
+  // plaintext 012D7F16 53CAF650 3C6AB0C1 010E8CB0, padded with 80 00..
+  uint8_t data[32] = {0x01, 0x2D, 0x7F, 0x16, 0x53, 0xCA, 0xF6, 0x50,
+                      0x3C, 0x6A, 0xB0, 0xC1, 0x01, 0x0E, 0x8C, 0xB0,
+                      0x80};
+  const uint8_t expected[32] = {
+      0xFC, 0xBB, 0xAC, 0xAA, 0x4F, 0x29, 0x18, 0x24, 0x64, 0xF9, 0x9D,
+      0xE4, 0x10, 0x85, 0x26, 0x6F, 0x48, 0x0E, 0x86, 0x3E, 0x48, 0x7B,
+      0xAA, 0xF6, 0x87, 0xB4, 0x3E, 0xD1, 0xEC, 0xE0, 0xD6, 0x23};
+  uint8_t plain[32];
+  uint32_t counter = 0xC3315DBF;
+
+  memcpy(plain, data, sizeof(plain));
+  TEST_ASSERT_TRUE(ntag424_lrp_setkey(&lrp, key));
+  TEST_ASSERT_TRUE(ntag424_lrp_lricb(&lrp, 0, &counter, data, data, 32,
+                                     NTAG424_AES_ENCRYPT));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, data, 32);
+  TEST_ASSERT_EQUAL_HEX32(0xC3315DC1, counter);
+
+  counter = 0xC3315DBF;
+  TEST_ASSERT_TRUE(ntag424_lrp_lricb(&lrp, 0, &counter, data, data, 32,
+                                     NTAG424_AES_DECRYPT));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(plain, data, 32);
+  TEST_ASSERT_FALSE(ntag424_lrp_lricb(&lrp, 0, &counter, data, data, 15,
+                                      NTAG424_AES_ENCRYPT));
+}
+
+static void test_lricb_chain(void)
+{
+  // across a carry into the upper nibbles, block by block from scratch
+  uint8_t plain[16 * 40], chained[16 * 40], scratch[16 * 40];
+  const uint8_t key[16] = {0};
+  uint32_t c1 = 0xFFFFFFEB, c2 = c1;
+
+  for (size_t i = 0; i < sizeof(plain); i++)
+  {
+    plain[i] = (uint8_t)(7 * i);
+  }
+  TEST_ASSERT_TRUE(ntag424_lrp_setkey(&lrp, key));
+  TEST_ASSERT_TRUE(ntag424_lrp_lricb(&lrp, 1, &c1, plain, chained,
+                                     sizeof(plain), NTAG424_AES_ENCRYPT));
+  for (int b = 0; b < 40; b++)
+  {
+    lrp.chain_valid = false;
+    TEST_ASSERT_TRUE(ntag424_lrp_lricb(&lrp, 1, &c2, plain + 16 * b,
+                                       scratch + 16 * b, 16,
+                                       NTAG424_AES_ENCRYPT));
+  }
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(scratch, chained, sizeof(plain));
+  TEST_ASSERT_EQUAL_HEX32(c2, c1);
+}
+
+static void test_authenticate(void)
+{
+  // AN12321 AuthenticateLRPFirst with key 0 = 00..00
+  const uint8_t key[16] = {0};
+  const uint8_t rnda[16] = {0x74, 0xD7, 0xDF, 0x6A, 0x2C, 0xEC, 0x0B, 0x72,
+                            0xB4, 0x12, 0xDE, 0x0D, 0x2B, 0x11, 0x17, 0xE6};
+  const uint8_t rndb[16] = {0x56, 0x10, 0x9A, 0x31, 0x97, 0x7C, 0x85, 0x53,
+                            0x19, 0xCD, 0x46, 0x18, 0xC9, 0xD2, 0xAE, 0xD2};
+  const uint8_t sv[32] = {0x00, 0x01, 0x00, 0x80, 0x74, 0xD7, 0x89, 0x7A,
+                          0xB6, 0xDD, 0x9C, 0x0E, 0x85, 0x53, 0x19, 0xCD,
+                          0x46, 0x18, 0xC9, 0xD2, 0xAE, 0xD2, 0xB4, 0x12,
+                          0xDE, 0x0D, 0x2B, 0x11, 0x17, 0xE6, 0x96, 0x69};
+  const uint8_t master[16] = {0x13, 0x2D, 0x7E, 0x6F, 0x35, 0xBA, 0x86, 0x1F,
+                              0x39, 0xB3, 0x72, 0x21, 0x21, 0x4E, 0x25, 0xA5};
+  const uint8_t mac_key[16] = {0xF5, 0x6C, 0xAD, 0xE5, 0x98, 0xCC, 0x2A, 0x3F,
+                               0xE4, 0x7E, 0x43, 0x8C, 0xFE, 0xB8, 0x85, 0xDB};
+  const uint8_t enc_key[16] = {0xE9, 0x04, 0x3D, 0x65, 0xAB, 0x21, 0xC0, 0xC4,
+                               0x22, 0x78, 0x10, 0x99, 0xAB, 0x25, 0xEF, 0xDD};
+  const uint8_t pcd_mac[16] = {0x18, 0x9B, 0x59, 0xDC, 0xED, 0xC3, 0x1A, 0x3D,
+                               0x3F, 0x38, 0xEF, 0x8D, 0x48, 0x10, 0xB3, 0xB4};
+  const uint8_t picc_enc[16] = {0xF4, 0xFC, 0x20, 0x9D, 0x9D, 0x60, 0x62, 0x35,
+                                0x88, 0xB2, 0x99, 0xFA, 0x5D, 0x6B, 0x2D, 0x71};
+  const uint8_t picc_mac[16] = {0x01, 0x25, 0xF8, 0x54, 0x7D, 0x9F, 0xB8, 0xD5,
+                                0x72, 0xC9, 0x0D, 0x2C, 0x2A, 0x14, 0xE2, 0x35};
+  // TI || PDcap2 || PCDcap2
+  const uint8_t picc_data[16] = {0x58, 0xEE, 0x94, 0x24, 0x02, 0x00,
+                                 0x00, 0x00, 0x00, 0x00, 0x02, 0x00,
+                                 0x00, 0x00, 0x00, 0x00};
+  ntag424_CMACType cmac;
+  uint8_t output[16];
+  uint32_t enc_counter = 0;
+
+  ntag424_cmac_init(&cmac);
+  TEST_ASSERT_TRUE(ntag424_lrp_setkey(&lrp, key));
+  TEST_ASSERT_TRUE(ntag424_cmac_setkey_lrp(&cmac, &lrp, 0));
+  ntag424_cmac_update(&cmac, sv, sizeof(sv));
+  ntag424_cmac_finish(&cmac, output);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(master, output, 16);
+
+  TEST_ASSERT_TRUE(ntag424_lrp_setkey(&lrp, master));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(mac_key, lrp.updated_keys[NTAG424_LRP_KEY_MAC],
+                               16);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(enc_key, lrp.updated_keys[NTAG424_LRP_KEY_ENC],
+                               16);
+  TEST_ASSERT_TRUE(ntag424_cmac_setkey_lrp(&cmac, &lrp, NTAG424_LRP_KEY_MAC));
+  ntag424_cmac_update(&cmac, rnda, 16);
+  ntag424_cmac_update(&cmac, rndb, 16);
+  ntag424_cmac_finish(&cmac, output);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(pcd_mac, output, 16);
+  ntag424_cmac_update(&cmac, rndb, 16);
+  ntag424_cmac_update(&cmac, rnda, 16);
+  ntag424_cmac_update(&cmac, picc_enc, 16);
+  ntag424_cmac_finish(&cmac, output);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(picc_mac, output, 16);
+  ntag424_cmac_free(&cmac);
+
+  // PICCData is EncCtr 0, the first command of the session continues at 1
+  TEST_ASSERT_TRUE(ntag424_lrp_lricb(&lrp, NTAG424_LRP_KEY_ENC, &enc_counter,
+                                     picc_enc, output, 16,
+                                     NTAG424_AES_DECRYPT));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(picc_data, output, 16);
+  TEST_ASSERT_EQUAL_HEX32(1, enc_counter);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_setkey);
+  RUN_TEST(test_cmac);
+  RUN_TEST(test_lricb);
+  RUN_TEST(test_lricb_chain);
+  RUN_TEST(test_authenticate);
+  return UNITY_END();
+}
@@ -0,0 +1,110 @@
+/**************************************************************************/
+/*!
+    @file test_originality/test_main.cpp
+
+    Originality signature against the AN12196 Read_Sig example, verified
+    with the NXP public key, plus rejection of tampered and out of range
+    signatures.
+
+    pio test -e native -f test_originality
+*/
+/**************************************************************************/
+
+#include <string.h>
+#include <unity.h>
+
+#include "ntag424_originality.h"
+
+static const uint8_t uid[7] = {0x04, 0x51, 0x8D, 0xFA, 0xA9, 0x61, 0x80};
+static const uint8_t signature[NTAG424_ECC_SIG_SIZE] = {
+    0xD1, 0x94, 0x0D, 0x17, 0xCF, 0xED, 0xA4, 0xBF, 0xF8, 0x03, 0x59, 0xAB,
+    0x97, 0x5F, 0x9F, 0x65, 0x14, 0x31, 0x3E, 0x8F, 0x90, 0xC1, 0xD3, 0xCA,
+    0xAF, 0x59, 0x41, 0xAD, 0x74, 0x4A, 0x1C, 0xDF, 0x9A, 0x83, 0xF8, 0x83,
+    0xCA, 0xFE, 0x0F, 0xE9, 0x5D, 0x19, 0x39, 0xB1, 0xB7, 0xE4, 0x71, 0x13,
+    0x99, 0x33, 0x24, 0x47, 0x3B, 0x78, 0x5D, 0x21};
+// order n of secp224r1
+static const uint8_t order[NTAG424_ECC_SIZE] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0x16, 0xA2, 0xE0, 0xB8, 0xF0, 0x3E,
+    0x13, 0xDD, 0x29, 0x45, 0x5C, 0x5C, 0x2A, 0x3D};
+
+static ntag424_OriginalityType ctx;
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static void test_verify(void)
+{
+  TEST_ASSERT_TRUE(ntag424_originality_init(&ctx));
+  TEST_ASSERT_TRUE(
+      ntag424_originality_verify(&ctx, uid, sizeof(uid), signature));
+}
+
+static void test_tampered(void)
+{
+  uint8_t bad_uid[sizeof(uid)];
+  uint8_t bad[NTAG424_ECC_SIG_SIZE];
+
+  memcpy(bad_uid, uid, sizeof(uid));
+  bad_uid[6] ^= 0x01;
+  TEST_ASSERT_FALSE(
+      ntag424_originality_verify(&ctx, bad_uid, sizeof(uid), signature));
+
+  memcpy(bad, signature, sizeof(bad));
+  bad[40] ^= 0x01;
+  TEST_ASSERT_FALSE(ntag424_originality_verify(&ctx, uid, sizeof(uid), bad));
+  TEST_ASSERT_FALSE(ntag424_originality_verify(&ctx, uid, 0, signature));
+}
+
+static void test_range(void)
+{
+  uint8_t bad[NTAG424_ECC_SIG_SIZE];
+
+  // r = 0, r = n, s = n
+  memcpy(bad, signature, sizeof(bad));
+  memset(bad, 0, NTAG424_ECC_SIZE);
+  TEST_ASSERT_FALSE(ntag424_originality_verify(&ctx, uid, sizeof(uid), bad));
+  memcpy(bad, order, NTAG424_ECC_SIZE);
+  TEST_ASSERT_FALSE(ntag424_originality_verify(&ctx, uid, sizeof(uid), bad));
+  memcpy(bad, signature, sizeof(bad));
+  memcpy(bad + NTAG424_ECC_SIZE, order, NTAG424_ECC_SIZE);
+  TEST_ASSERT_FALSE(ntag424_originality_verify(&ctx, uid, sizeof(uid), bad));
+}
+
+static void test_batch(void)
+{
+  // more jobs than one round, every third one tampered
+  uint8_t bad[NTAG424_ECC_SIG_SIZE];
+  ntag424_SignatureJobType jobs[NTAG424_ECC_BATCH + 5];
+  bool results[NTAG424_ECC_BATCH + 5];
+  size_t count = sizeof(jobs) / sizeof(jobs[0]);
+  size_t expected = 0;
+
+  memcpy(bad, signature, sizeof(bad));
+  bad[3] ^= 0x80;
+  for (size_t i = 0; i < count; i++)
+  {
+    jobs[i].uid = uid;
+    jobs[i].uid_length = sizeof(uid);
+    jobs[i].signature = (i % 3 == 2) ? bad : signature;
+    expected += (i % 3 != 2);
+  }
+  TEST_ASSERT_EQUAL(expected,
+                    ntag424_originality_verify_batch(&ctx, jobs, count,
+                                                     results));
+  for (size_t i = 0; i < count; i++)
+  {
+    TEST_ASSERT_EQUAL(i % 3 != 2, results[i]);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_verify);
+  RUN_TEST(test_tampered);
+  RUN_TEST(test_range);
+  RUN_TEST(test_batch);
+  return UNITY_END();
+}
@@ -0,0 +1,107 @@
+/**************************************************************************/
+/*!
+    @file test_rng/test_main.cpp
+
+    Random pool: bytes are handed out once and refilled, a failing entropy
+    source is reported instead of retried forever.
+
+    pio test -e native -f test_rng
+*/
+/**************************************************************************/
+
+#include <string.h>
+#include <unity.h>
+
+#include "ntag424_rng.h"
+
+static uint8_t entropy_ok;   ///< result of the fake entropy source
+static uint8_t entropy_next; ///< next byte of the fake entropy source
+static size_t entropy_calls; ///< calls of the fake entropy source
+static ntag424_CryptoProviderType provider;
+
+static uint8_t fake_random(uint8_t *output, size_t length)
+{
+  entropy_calls++;
+  if (!entropy_ok)
+  {
+    return 0;
+  }
+  for (size_t i = 0; i < length; i++)
+  {
+    output[i] = ++entropy_next;
+  }
+  return 1;
+}
+
+void setUp(void)
+{
+  provider = *ntag424_crypto_default();
+  provider.random = fake_random;
+  entropy_ok = 1;
+  entropy_next = 0;
+  entropy_calls = 0;
+}
+
+void tearDown(void) {}
+
+static void test_platform(void)
+{
+  uint8_t a[32], b[32];
+  TEST_ASSERT_EQUAL(1, ntag424_platform_random(a, sizeof(a)));
+  TEST_ASSERT_EQUAL(1, ntag424_platform_random(b, sizeof(b)));
+  TEST_ASSERT_FALSE(memcmp(a, b, sizeof(a)) == 0);
+}
+
+static void test_pool(void)
+{
+  ntag424_RNGPoolType rng;
+  uint8_t output[NTAG424_RNG_POOLSIZE + 8];
+  ntag424_rng_init(&rng, &provider);
+  TEST_ASSERT_EQUAL(1, entropy_calls);
+  TEST_ASSERT_FALSE(ntag424_rng_refill(&rng));
+
+  // the whole pool plus 8 bytes of a refill, no byte twice
+  TEST_ASSERT_EQUAL(1, ntag424_rng_get(&rng, output, sizeof(output)));
+  for (size_t i = 0; i < sizeof(output); i++)
+  {
+    TEST_ASSERT_EQUAL_HEX8((uint8_t)(i + 1), output[i]);
+  }
+  TEST_ASSERT_EQUAL(2, entropy_calls);
+  TEST_ASSERT_TRUE(ntag424_rng_refill(&rng));
+  TEST_ASSERT_EQUAL(NTAG424_RNG_POOLSIZE, rng.available);
+  ntag424_rng_free(&rng);
+}
+
+static void test_failing_source(void)
+{
+  ntag424_RNGPoolType rng;
+  uint8_t output[NTAG424_RNG_POOLSIZE + 16];
+  ntag424_rng_init(&rng, &provider);
+  entropy_ok = 0;
+
+  // the pool still has bytes, the refill fails and wipes what was taken
+  memset(output, 0xA5, sizeof(output));
+  TEST_ASSERT_EQUAL(0, ntag424_rng_get(&rng, output, sizeof(output)));
+  for (size_t i = 0; i < sizeof(output); i++)
+  {
+    TEST_ASSERT_EQUAL_HEX8((i < NTAG424_RNG_POOLSIZE) ? 0 : 0xA5, output[i]);
+  }
+  TEST_ASSERT_EQUAL(0, rng.available);
+  TEST_ASSERT_FALSE(ntag424_rng_refill(&rng));
+  TEST_ASSERT_EQUAL(0, ntag424_rng_get(&rng, output, 16));
+
+  // a working source again serves the next request
+  entropy_ok = 1;
+  TEST_ASSERT_EQUAL(1, ntag424_rng_get(&rng, output, 16));
+  TEST_ASSERT_EQUAL(NTAG424_RNG_POOLSIZE - 16, rng.available);
+  ntag424_rng_free(&rng);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_platform);
+  RUN_TEST(test_pool);
+  RUN_TEST(test_failing_source);
+  return UNITY_END();
+}
@@ -0,0 +1,132 @@
+/**************************************************************************/
+/*!
+    @file test_sdm/test_main.cpp
+
+    SUN verification against the AN12196 examples (all keys zero):
+    encrypted PICCData, plain UID/SDMReadCtr mirror and encrypted file data.
+
+    pio test -e native -f test_sdm
+*/
+/**************************************************************************/
+
+#include <string.h>
+#include <unity.h>
+
+#include "ntag424_sdm.h"
+
+#define NONE NTAG424_SDM_OFFSET_NONE
+
+static const uint8_t zero[16] = {0};
+static const ntag424_SDMKeysType keys = {zero, zero};
+
+/**************************************************************************/
+/*!
+    @brief   offset of the value of parameter name in url.
+*/
+/**************************************************************************/
+static uint32_t offset(const char *url, const char *name)
+{
+  return (uint32_t)(strstr(url, name) - url + strlen(name));
+}
+
+/**************************************************************************/
+/*!
+    @brief   parse url with layout and verify it, single and batched.
+*/
+/**************************************************************************/
+static uint8_t verify(const char *url, const ntag424_SDMLayoutType *layout,
+                      ntag424_SDMResultType *result)
+{
+  ntag424_SDMMessageType msg;
+  ntag424_SDMResultType batch;
+  TEST_ASSERT_TRUE(ntag424_sdm_parse(layout, (const uint8_t *)url,
+                                     strlen(url), &msg));
+  uint8_t valid = ntag424_sdm_verify(&keys, &msg, result);
+  TEST_ASSERT_EQUAL(valid, ntag424_sdm_verify_batch(&keys, &msg, 1, &batch));
+  TEST_ASSERT_EQUAL(result->valid, batch.valid);
+  return valid;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static void test_picc_data(void)
+{
+  const char *url = "https://choose.url.com/ntag424?"
+                    "e=EF963FF7828658A599F3041510671E88&c=94EED9EE65337086";
+  const uint8_t uid[7] = {0x04, 0xDE, 0x5F, 0x1E, 0xAC, 0xC0, 0x40};
+  uint32_t mac = offset(url, "c=");
+  ntag424_SDMLayoutType layout = {offset(url, "e="), NONE, NONE, mac,
+                                  NONE, 0, mac};
+  ntag424_SDMResultType result;
+
+  TEST_ASSERT_TRUE(verify(url, &layout, &result));
+  TEST_ASSERT_TRUE(result.has_uid && result.has_read_ctr);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(uid, result.uid, 7);
+  TEST_ASSERT_EQUAL_UINT32(0x3D, result.read_ctr);
+}
+
+static void test_plain_mirror(void)
+{
+  const char *url = "https://www.my424dna.com/?uid=041E3C8A2D6B80"
+                    "&ctr=000006&cmac=4B00064004B0B3D3";
+  const uint8_t uid[7] = {0x04, 0x1E, 0x3C, 0x8A, 0x2D, 0x6B, 0x80};
+  uint32_t mac = offset(url, "cmac=");
+  ntag424_SDMLayoutType layout = {NONE, offset(url, "uid="),
+                                  offset(url, "ctr="), mac, NONE, 0, mac};
+  ntag424_SDMResultType result;
+
+  TEST_ASSERT_TRUE(verify(url, &layout, &result));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(uid, result.uid, 7);
+  TEST_ASSERT_EQUAL_UINT32(6, result.read_ctr);
+
+  // the MAC does not cover "uid=...&cmac=" as MAC input
+  layout.mac_input_offset = layout.uid_offset;
+  TEST_ASSERT_FALSE(verify(url, &layout, &result));
+}
+
+static void test_enc_file_data(void)
+{
+  const char *url = "https://www.my424dna.com/?"
+                    "picc_data=FD91EC264309878BE6345CBE53BADF40"
+                    "&enc=CEE9A53E3E463EF1F459635736738962"
+                    "&cmac=ECC1E7F6C6C73BF6";
+  const uint8_t uid[7] = {0x04, 0x95, 0x8C, 0xAA, 0x5C, 0x5E, 0x80};
+  uint32_t enc = offset(url, "enc=");
+  ntag424_SDMLayoutType layout = {offset(url, "picc_data="), NONE, NONE,
+                                  enc, enc, 32, offset(url, "cmac=")};
+  ntag424_SDMResultType result;
+
+  TEST_ASSERT_TRUE(verify(url, &layout, &result));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(uid, result.uid, 7);
+  TEST_ASSERT_EQUAL_UINT32(8, result.read_ctr);
+  TEST_ASSERT_EQUAL(16, result.enc_length);
+  TEST_ASSERT_EQUAL_MEMORY("xxxxxxxxxxxxxxxx", result.enc_data, 16);
+}
+
+static void test_tampered(void)
+{
+  char url[] = "https://choose.url.com/ntag424?"
+               "e=EF963FF7828658A599F3041510671E88&c=94EED9EE65337086";
+  uint32_t mac = offset(url, "c=");
+  ntag424_SDMLayoutType layout = {offset(url, "e="), NONE, NONE, mac,
+                                  NONE, 0, mac};
+  ntag424_SDMResultType result;
+
+  url[mac + 15] = '7';
+  TEST_ASSERT_FALSE(verify(url, &layout, &result));
+  url[mac + 15] = '6';
+  url[layout.picc_data_offset] = 'F';
+  TEST_ASSERT_FALSE(verify(url, &layout, &result));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_picc_data);
+  RUN_TEST(test_plain_mirror);
+  RUN_TEST(test_enc_file_data);
+  RUN_TEST(test_tampered);
+  return UNITY_END();
+}
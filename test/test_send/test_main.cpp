@@ -0,0 +1,1355 @@
+/**************************************************************************/
+/*!
+    @file test_send/test_main.cpp
+
+    The secure messaging layer works on ntag424_Workspace only: plain, MAC
+    and FULL commands, chained response frames and the authentication run
+    against a card behind the fake PN532 of lib/ntag424_host without a
+    single heap allocation. malloc() and friends are interposed and count
+    while the commands run. The stack depth of a plain, a FULL command and
+    the authentication is measured by running each in a thread on a painted
+    static stack, while the card answers on a stack of its own. The numbers
+    next to ntag424_WorkspaceType come from here.
+
+    Behaviour against the card model: the FULL mode ivs cached during RF
+    time serve the next command and are dropped when NonFirst re-keys.
+    91 AF chaining in both directions, a response without MAC fails.
+    ReadData and WriteData of a 256 byte file split into the largest
+    chunks of one frame in each comm mode. NonFirst keeps TI and CmdCtr.
+    The application and EF selections are skipped while valid and dropped
+    on every activation and when the card stops answering. AuthenticateAny
+    tries the key of the last card with the same UID prefix first, then
+    the candidates by hits. AuthenticateByVersion takes the key of the
+    version GetKeyVersion reports from the key store. ChangeKeys changes
+    key 0 last and authenticates with the new key 0, from the changes or
+    from manifests prepared for a batch of cards.
+
+    pio test -e native -f test_send
+*/
+/**************************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+#include <ucontext.h>
+#include <unity.h>
+
+#include "Adafruit_PN532_NTAG424.h"
+#include "ntag424_crc32.h"
+#include "ntag424_host.h"
+#include "ntag424_originality.h"
+
+#define TEST_STACK_SIZE 65536  ///< stack of the measuring thread in byte
+#define TEST_STACK_PAINT 0xA5  ///< paint byte
+#define TEST_STACK_BOUND 4096  ///< stack of one command, -O0 included
+#define TEST_CARD_STACK 65536  ///< stack of the fake card in byte
+#define TEST_COMMANDS 16       ///< repetitions of each secured command
+#define CARD_FILESIZE 256      ///< size of file 2 of the card
+#define CARD_BUFFERSIZE 288    ///< longest command or response of the card
+#define CARD_CHUNKS 8          ///< logged ReadData and WriteData lengths
+
+#ifdef __GLIBC__
+extern "C"
+{
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t count, size_t size);
+  void *__libc_realloc(void *ptr, size_t size);
+  void __libc_free(void *ptr);
+}
+
+static bool counting;
+static size_t allocations;
+
+extern "C" void *malloc(size_t size)
+{
+  allocations += counting;
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+  allocations += counting;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+  allocations += counting;
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr)
+{
+  allocations += counting && ptr;
+  __libc_free(ptr);
+}
+#endif
+
+static const uint8_t uid[7] = {0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+static const uint8_t key[16] = {0};
+
+/**
+ * @brief NTAG424 with five keys, all zero and version 0 after card_reset():
+ * ISOSelectFile, GetVersion (three frames), AuthenticateEV2First and
+ * NonFirst, GetCardUID (FULL), GetKeyVersion, ChangeKey, Read_Sig and
+ * ReadData and WriteData of file 2 in file_mode. Every command of a session
+ * is counted, the lengths of ReadData and WriteData are logged in chunks,
+ * the changed keys in changed. Responses
+ * longer than frame_size continue with 91 AF, a WriteData longer than one
+ * frame is collected from its 91 AF frames. Out of the field (present
+ * false) the card leaves every apdu unanswered.
+ */
+static struct
+{
+  uint8_t keys[NTAG424_KEYCOUNT][16]; ///< application keys
+  uint8_t versions[NTAG424_KEYCOUNT];  ///< key versions
+  uint8_t file[CARD_FILESIZE];         ///< file 2
+  ntag424_CommMode file_mode;          ///< comm mode of file 2
+  uint8_t rndb[16];        ///< RndB of the running authentication
+  uint8_t auth_pending;    ///< INS of the answered part 1, 0 = none
+  uint8_t auth_keyno;      ///< key of the running authentication
+  uint8_t auth_last;       ///< INS of the last authentication
+  uint8_t version_frame;   ///< next GetVersion frame
+  bool present;            ///< in the field, false = apdus go unanswered
+  bool authenticated;      ///< session established
+  uint8_t keyno;           ///< key of the session
+  uint8_t ti[4];           ///< transaction identifier
+  uint16_t counter;        ///< CmdCtr
+  ntag424_AESType enc;     ///< SesAuthENCKey, encryption
+  ntag424_AESType dec;     ///< SesAuthENCKey, decryption
+  ntag424_CMACType mac;    ///< SesAuthMACKey
+  uint8_t out[CARD_BUFFERSIZE]; ///< response of the running command
+  size_t out_length;            ///< length of out
+  size_t out_position;          ///< bytes of out sent so far
+  size_t frame_size;            ///< response bytes per frame
+  bool strip_mac;               ///< send the next response without MAC
+  uint8_t in[CARD_BUFFERSIZE];  ///< chained WriteData command
+  size_t in_length;             ///< bytes of in received so far
+  size_t in_expected;           ///< length of the whole command
+  size_t selects;          ///< ISOSelectFile commands
+  size_t auths;            ///< authentications started
+  size_t frames;           ///< apdus received
+  size_t chunks[CARD_CHUNKS];   ///< length of each ReadData and WriteData
+  size_t chunk_count;           ///< entries in chunks
+  uint8_t changed[NTAG424_KEYCOUNT]; ///< key numbers in ChangeKey order
+  size_t change_count;               ///< entries in changed
+} card;
+
+static const uint8_t signature[NTAG424_ECC_SIG_SIZE] = {
+    0x1C, 0xA2, 0x98, 0xFC, 0x3F, 0x0F, 0x04, 0xA3, 0x29, 0x25, 0x4A, 0xC0,
+    0xDF, 0x7A, 0x3E, 0xB8, 0xE7, 0x56, 0xC0, 0x76, 0xBD, 0x1B, 0xAA, 0xF0,
+    0x20, 0x0E, 0x9D, 0xE7, 0x4B, 0x90, 0x50, 0x41, 0xDC, 0x7E, 0x33, 0x7A,
+    0x10, 0xF6, 0x16, 0x0C, 0x4F, 0x10, 0x7C, 0x4A, 0xE3, 0xA0, 0x6F, 0xC6,
+    0x2D, 0x18, 0x2E, 0x5B, 0x5E, 0x95, 0x4F, 0xC2};
+
+/**************************************************************************/
+/*!
+    @brief   data || SW1 SW2 as card response.
+*/
+/**************************************************************************/
+static size_t card_status(uint8_t *response, size_t length, uint8_t sw1,
+                          uint8_t sw2)
+{
+  response[length] = sw1;
+  response[length + 1] = sw2;
+  return length + 2;
+}
+
+/**************************************************************************/
+/*!
+    @brief   AES-128 cbc with key keyno and a zero iv.
+*/
+/**************************************************************************/
+static void card_cbc(uint8_t keyno, uint8_t mode, const uint8_t *input,
+                     uint8_t *output, size_t length)
+{
+  ntag424_AESType aes;
+  uint8_t iv[16] = {0};
+  ntag424_aes_setkey(&aes, NULL, card.keys[keyno], mode);
+  aes.provider->aes_cbc(&aes, iv, input, output, length);
+  ntag424_aes_free(&aes);
+}
+
+/**************************************************************************/
+/*!
+    @brief   truncated MAC of a || counter || TI || data.
+*/
+/**************************************************************************/
+static void card_mac(uint8_t a, const uint8_t *data, size_t length,
+                     uint8_t *mac)
+{
+  uint8_t header[7] = {a, (uint8_t)card.counter, (uint8_t)(card.counter >> 8),
+                       card.ti[0], card.ti[1], card.ti[2], card.ti[3]};
+  uint8_t cmac[16];
+  ntag424_cmac_update(&card.mac, header, sizeof(header));
+  ntag424_cmac_update(&card.mac, data, length);
+  ntag424_cmac_finish(&card.mac, cmac);
+  ntag424_cmac_truncate(cmac, mac);
+}
+
+/**************************************************************************/
+/*!
+    @brief   count a command of the session, a MAC'd one only if its MAC is
+   right.
+*/
+/**************************************************************************/
+static bool card_command(uint8_t ins, const uint8_t *data, size_t length,
+                         ntag424_CommMode mode)
+{
+  uint8_t mac[8];
+  if (mode == ntag424_CommMode::Plain)
+  {
+    card.counter += card.authenticated;
+    return true;
+  }
+  if (!card.authenticated || (length < 8))
+  {
+    return false;
+  }
+  card_mac(ins, data, length - 8, mac);
+  if (memcmp(mac, data + length - 8, 8) != 0)
+  {
+    return false;
+  }
+  card.counter++;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief   encrypted iv a b || TI || counter of the session.
+*/
+/**************************************************************************/
+static void card_iv(uint8_t a, uint8_t b, uint16_t counter, uint8_t *iv)
+{
+  memset(iv, 0, 16);
+  iv[0] = a;
+  iv[1] = b;
+  memcpy(iv + 2, card.ti, 4);
+  iv[6] = (uint8_t)counter;
+  iv[7] = (uint8_t)(counter >> 8);
+  card.enc.provider->aes_ecb(&card.enc, iv, iv);
+}
+
+/**************************************************************************/
+/*!
+    @brief   decrypt and unpad FULL command data, after card_command() has
+   counted the command.
+*/
+/**************************************************************************/
+static bool card_decrypt(const uint8_t *data, size_t length, uint8_t *plain,
+                         size_t *plain_length)
+{
+  uint8_t iv[16];
+  if ((length == 0) || (length % 16 != 0))
+  {
+    return false;
+  }
+  card_iv(0xA5, 0x5A, (uint16_t)(card.counter - 1), iv);
+  card.dec.provider->aes_cbc(&card.dec, iv, data, plain, length);
+  while ((length > 0) && (plain[length - 1] == 0x00))
+  {
+    length--;
+  }
+  if ((length == 0) || (plain[length - 1] != 0x80))
+  {
+    return false;
+  }
+  *plain_length = length - 1;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief   next frame of the response in card.out, 91 AF if more follow.
+*/
+/**************************************************************************/
+static size_t card_frame(uint8_t *response)
+{
+  size_t length = card.out_length - card.out_position;
+  if (length > card.frame_size)
+  {
+    length = card.frame_size;
+  }
+  memcpy(response, card.out + card.out_position, length);
+  card.out_position += length;
+  return card_status(response, length, 0x91,
+                     (card.out_position < card.out_length) ? 0xAF : 0x00);
+}
+
+/**************************************************************************/
+/*!
+    @brief   response in mode: MAC'd, encrypted first if full.
+*/
+/**************************************************************************/
+static size_t card_secure(ntag424_CommMode mode, const uint8_t *data,
+                          size_t length, uint8_t *response)
+{
+  uint8_t *out = card.out;
+  memcpy(out, data, length);
+  if ((mode == ntag424_CommMode::Full) && (length > 0))
+  {
+    uint8_t iv[16];
+    card_iv(0x5A, 0xA5, card.counter, iv);
+    out[length] = 0x80;
+    memset(out + length + 1, 0, 15 - length % 16);
+    length += 16 - length % 16;
+    card.enc.provider->aes_cbc(&card.enc, iv, out, out, length);
+  }
+  if ((mode != ntag424_CommMode::Plain) && !card.strip_mac)
+  {
+    card_mac(0x00, out, length, out + length);
+    length += 8;
+  }
+  card.strip_mac = false;
+  card.out_length = length;
+  card.out_position = 0;
+  return card_frame(response);
+}
+
+/**************************************************************************/
+/*!
+    @brief   authentication part 2: check RndB', derive the session keys and
+   answer E(K, TI || RndA' || PDcap2 || PCDcap2), NonFirst E(K, RndA')
+   keeping TI and CmdCtr.
+*/
+/**************************************************************************/
+static size_t card_authenticate(const uint8_t *data, size_t length,
+                                uint8_t *response)
+{
+  uint8_t plain[32];
+  uint8_t ins = card.auth_pending;
+  uint8_t keyno = card.auth_keyno;
+  card.auth_pending = 0;
+  if (length != 32)
+  {
+    return card_status(response, 0, 0x91, 0x7E);
+  }
+  card_cbc(keyno, NTAG424_AES_DECRYPT, data, plain, 32);
+  const uint8_t *rnda = plain;
+  for (int i = 0; i < 16; i++)
+  {
+    if (plain[16 + i] != card.rndb[(i + 1) % 16])
+    {
+      return card_status(response, 0, 0x91, 0xAE);
+    }
+  }
+  // SV1/SV2 = A5 5A / 5A A5 || 00 01 00 80 || RndA[15:14] ||
+  // (RndA[13:8] ^ RndB[15:10]) || RndB[9:0] || RndA[7:0]
+  uint8_t sv[32] = {0xA5, 0x5A, 0x00, 0x01, 0x00, 0x80, rnda[0], rnda[1]};
+  for (int i = 0; i < 6; i++)
+  {
+    sv[8 + i] = rnda[2 + i] ^ card.rndb[i];
+  }
+  memcpy(sv + 14, card.rndb + 6, 10);
+  memcpy(sv + 24, rnda + 8, 8);
+  uint8_t session_enc[16], session_mac[16];
+  ntag424_CMACType master;
+  ntag424_cmac_init(&master);
+  ntag424_cmac_setkey(&master, card.keys[keyno]);
+  ntag424_cmac_update(&master, sv, sizeof(sv));
+  ntag424_cmac_finish(&master, session_enc);
+  sv[0] = 0x5A;
+  sv[1] = 0xA5;
+  ntag424_cmac_update(&master, sv, sizeof(sv));
+  ntag424_cmac_finish(&master, session_mac);
+  ntag424_cmac_free(&master);
+  ntag424_aes_free(&card.enc);
+  ntag424_aes_free(&card.dec);
+  ntag424_aes_setkey(&card.enc, NULL, session_enc, NTAG424_AES_ENCRYPT);
+  ntag424_aes_setkey(&card.dec, NULL, session_enc, NTAG424_AES_DECRYPT);
+  ntag424_cmac_setkey(&card.mac, session_mac);
+  card.keyno = keyno;
+  card.authenticated = true;
+
+  uint8_t answer[32] = {0};
+  uint8_t *rnda_rotl = answer;
+  if (ins == 0x71)
+  {
+    card.ti[0] = 0x9D;
+    card.ti[1] = 0x00;
+    card.ti[2] = 0xC4;
+    card.ti[3] = (uint8_t)card.auths;
+    card.counter = 0;
+    memcpy(answer, card.ti, 4);
+    rnda_rotl += 4;
+  }
+  for (int i = 0; i < 16; i++)
+  {
+    rnda_rotl[i] = rnda[(i + 1) % 16];
+  }
+  length = (ins == 0x71) ? 32 : 16;
+  card_cbc(keyno, NTAG424_AES_ENCRYPT, answer, response, length);
+  return card_status(response, length, 0x91, 0x00);
+}
+
+/**************************************************************************/
+/*!
+    @brief   log the length of a ReadData or WriteData.
+*/
+/**************************************************************************/
+static void card_chunk(size_t length)
+{
+  if (card.chunk_count < CARD_CHUNKS)
+  {
+    card.chunks[card.chunk_count] = length;
+  }
+  card.chunk_count++;
+}
+
+/**************************************************************************/
+/*!
+    @brief   ReadData of file 2: FileNo || Offset || Length, length 0 reads
+   to the end of the file.
+*/
+/**************************************************************************/
+static size_t card_read(const uint8_t *data, size_t length, uint8_t *response)
+{
+  if ((length < 7) || (data[0] != 0x02))
+  {
+    return card_status(response, 0, 0x91, 0xF0);
+  }
+  if (!card_command(0xAD, data, length, card.file_mode))
+  {
+    return card_status(response, 0, 0x91, 0x1E);
+  }
+  size_t offset = data[1] | (data[2] << 8) | (data[3] << 16);
+  size_t size = data[4] | (data[5] << 8) | (data[6] << 16);
+  if ((size == 0) && (offset < CARD_FILESIZE))
+  {
+    size = CARD_FILESIZE - offset;
+  }
+  if (offset + size > CARD_FILESIZE)
+  {
+    return card_status(response, 0, 0x91, 0xBE);
+  }
+  card_chunk(size);
+  return card_secure(card.file_mode, card.file + offset, size, response);
+}
+
+/**************************************************************************/
+/*!
+    @brief   WriteData of file 2: FileNo || Offset || Length || data.
+*/
+/**************************************************************************/
+static size_t card_write(const uint8_t *data, size_t length, uint8_t *response)
+{
+  uint8_t plain[CARD_FILESIZE + 16];
+  size_t mac_length = (card.file_mode == ntag424_CommMode::Plain) ? 0 : 8;
+  if ((length < 7 + mac_length) || (data[0] != 0x02))
+  {
+    return card_status(response, 0, 0x91, 0xF0);
+  }
+  if (!card_command(0x8D, data, length, card.file_mode))
+  {
+    return card_status(response, 0, 0x91, 0x1E);
+  }
+  size_t offset = data[1] | (data[2] << 8) | (data[3] << 16);
+  size_t size = data[4] | (data[5] << 8) | (data[6] << 16);
+  const uint8_t *body = data + 7;
+  size_t body_length = length - 7 - mac_length;
+  if ((card.file_mode == ntag424_CommMode::Full) &&
+      !card_decrypt(data + 7, body_length, plain, &body_length))
+  {
+    return card_status(response, 0, 0x91, 0x1E);
+  }
+  if (card.file_mode == ntag424_CommMode::Full)
+  {
+    body = plain;
+  }
+  if ((body_length != size) || (offset + size > CARD_FILESIZE))
+  {
+    return card_status(response, 0, 0x91, 0x7E);
+  }
+  memcpy(card.file + offset, body, size);
+  card_chunk(size);
+  // FULL answers with the MAC alone
+  return card_secure((card.file_mode == ntag424_CommMode::Plain)
+                         ? ntag424_CommMode::Plain
+                         : ntag424_CommMode::Mac,
+                     plain, 0, response);
+}
+
+/**************************************************************************/
+/*!
+    @brief   first frame of a WriteData: keep it if the data, padding and
+   MAC of the length in the command header do not fit.
+*/
+/**************************************************************************/
+static bool card_write_chained(const uint8_t *data, size_t length)
+{
+  if (length < 7)
+  {
+    return false;
+  }
+  size_t size = data[4] | (data[5] << 8) | (data[6] << 16);
+  size_t expected = 7 + size;
+  if (card.file_mode == ntag424_CommMode::Full)
+  {
+    expected = 7 + (size / 16 + 1) * 16 + 8;
+  }
+  else if (card.file_mode == ntag424_CommMode::Mac)
+  {
+    expected += 8;
+  }
+  if ((length >= expected) || (expected > sizeof(card.in)))
+  {
+    return false;
+  }
+  memcpy(card.in, data, length);
+  card.in_length = length;
+  card.in_expected = expected;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief   ChangeKey in a key 0 session: the session key from NewKey ||
+   KeyVer, ending the session without response MAC, any other key from
+   OldKey ^ NewKey || KeyVer || JamCRC32(NewKey).
+*/
+/**************************************************************************/
+static size_t card_changekey(const uint8_t *data, size_t length,
+                             uint8_t *response)
+{
+  uint8_t plain[32], newkey[16];
+  size_t plain_length;
+  if ((length < 1 + 16 + 8) || (length > 1 + sizeof(plain) + 8) ||
+      (data[0] >= NTAG424_KEYCOUNT))
+  {
+    return card_status(response, 0, 0x91, 0x7E);
+  }
+  if (!card_command(0xC4, data, length, ntag424_CommMode::Full) ||
+      !card_decrypt(data + 1, length - 1 - 8, plain, &plain_length))
+  {
+    return card_status(response, 0, 0x91, 0x1E);
+  }
+  uint8_t keyno = data[0];
+  if (card.keyno != 0)
+  {
+    return card_status(response, 0, 0x91, 0x9D);
+  }
+  if (keyno == card.keyno)
+  {
+    if (plain_length != 17)
+    {
+      return card_status(response, 0, 0x91, 0x7E);
+    }
+    memcpy(newkey, plain, 16);
+  }
+  else
+  {
+    if (plain_length != 21)
+    {
+      return card_status(response, 0, 0x91, 0x7E);
+    }
+    for (int i = 0; i < 16; i++)
+    {
+      newkey[i] = plain[i] ^ card.keys[keyno][i];
+    }
+    uint32_t jamcrc = (uint32_t)plain[17] | ((uint32_t)plain[18] << 8) |
+                      ((uint32_t)plain[19] << 16) |
+                      ((uint32_t)plain[20] << 24);
+    if (ntag424_jamcrc(newkey, 16) != jamcrc)
+    {
+      return card_status(response, 0, 0x91, 0x1E);
+    }
+  }
+  memcpy(card.keys[keyno], newkey, 16);
+  card.versions[keyno] = plain[16];
+  card.changed[card.change_count++] = keyno;
+  if (keyno == card.keyno)
+  {
+    card.authenticated = false;
+    return card_status(response, 0, 0x91, 0x00);
+  }
+  return card_secure(ntag424_CommMode::Mac, plain, 0, response);
+}
+
+/**************************************************************************/
+/*!
+    @brief   answer one apdu, see card_switch().
+*/
+/**************************************************************************/
+static size_t card_apdu(const uint8_t *apdu, size_t length, uint8_t *response)
+{
+  static const uint8_t version[28] = {
+      0x04, 0x04, 0x02, 0x30, 0x00, 0x11, 0x05, 0x04, 0x04, 0x02,
+      0x01, 0x02, 0x11, 0x05, 0x04, 0x11, 0x22, 0x33, 0x44, 0x55,
+      0x66, 0xCF, 0x39, 0x41, 0x14, 0x81, 0x49, 0x10};
+  uint8_t ins = apdu[1];
+  const uint8_t *data = apdu + 5;
+  size_t data_length = (length > 5) ? apdu[4] : 0;
+  uint8_t plain[16];
+
+  if (!card.present)
+  {
+    return 0;
+  }
+  card.frames++;
+  if (apdu[0] == 0x00)
+  {
+    // ISOSelectFile, selecting the application ends the session
+    card.selects++;
+    if (apdu[2] == 0x04)
+    {
+      card.authenticated = false;
+    }
+    return card_status(response, 0, 0x90, 0x00);
+  }
+  switch (ins)
+  {
+  case 0x60: // GetVersion
+    card_command(ins, data, data_length, ntag424_CommMode::Plain);
+    memcpy(response, version, 7);
+    card.version_frame = 1;
+    return card_status(response, 7, 0x91, 0xAF);
+  case 0x71: // AuthenticateEV2First
+  case 0x77: // AuthenticateEV2NonFirst
+    if ((data_length < 1) || (data[0] >= NTAG424_KEYCOUNT) ||
+        ((ins == 0x77) && !card.authenticated))
+    {
+      return card_status(response, 0, 0x91, 0x40);
+    }
+    // a failing authentication ends the session
+    card.authenticated = false;
+    card.auths++;
+    for (int i = 0; i < 16; i++)
+    {
+      card.rndb[i] = (uint8_t)(0x31 * i + 7 + card.auths);
+    }
+    card.auth_pending = ins;
+    card.auth_keyno = data[0];
+    card.auth_last = ins;
+    card_cbc(card.auth_keyno, NTAG424_AES_ENCRYPT, card.rndb, response, 16);
+    return card_status(response, 16, 0x91, 0xAF);
+  case 0xAF: // AdditionalFrame
+    if (card.auth_pending)
+    {
+      return card_authenticate(data, data_length, response);
+    }
+    if (card.version_frame == 1)
+    {
+      memcpy(response, version + 7, 7);
+      card.version_frame = 2;
+      return card_status(response, 7, 0x91, 0xAF);
+    }
+    if (card.version_frame == 2)
+    {
+      memcpy(response, version + 14, 14);
+      card.version_frame = 0;
+      return card_status(response, 14, 0x91, 0x00);
+    }
+    if (card.in_length < card.in_expected)
+    {
+      if (card.in_length + data_length > card.in_expected)
+      {
+        card.in_expected = 0;
+        return card_status(response, 0, 0x91, 0x7E);
+      }
+      memcpy(card.in + card.in_length, data, data_length);
+      card.in_length += data_length;
+      if (card.in_length < card.in_expected)
+      {
+        return card_status(response, 0, 0x91, 0xAF);
+      }
+      return card_write(card.in, card.in_length, response);
+    }
+    if (card.out_position < card.out_length)
+    {
+      return card_frame(response);
+    }
+    break;
+  case 0x51: // GetCardUID
+    if (!card_command(ins, data, data_length, ntag424_CommMode::Mac))
+    {
+      return card_status(response, 0, 0x91, 0x1E);
+    }
+    return card_secure(ntag424_CommMode::Full, uid, sizeof(uid), response);
+  case 0x64: // GetKeyVersion
+    if (!card_command(ins, data, data_length,
+                      card.authenticated ? ntag424_CommMode::Mac
+                                         : ntag424_CommMode::Plain))
+    {
+      return card_status(response, 0, 0x91, 0x1E);
+    }
+    if ((data_length < 1) || (data[0] >= NTAG424_KEYCOUNT))
+    {
+      return card_status(response, 0, 0x91, 0x9E);
+    }
+    plain[0] = card.versions[data[0]];
+    return card_secure(card.authenticated ? ntag424_CommMode::Mac
+                                          : ntag424_CommMode::Plain,
+                       plain, 1, response);
+  case 0x3C: // Read_Sig, FULL in a session
+    if (!card_command(ins, data, data_length,
+                      card.authenticated ? ntag424_CommMode::Mac
+                                         : ntag424_CommMode::Plain))
+    {
+      return card_status(response, 0, 0x91, 0x1E);
+    }
+    return card_secure(card.authenticated ? ntag424_CommMode::Full
+                                          : ntag424_CommMode::Plain,
+                       signature, sizeof(signature), response);
+  case 0xAD: // ReadData
+    return card_read(data, data_length, response);
+  case 0x8D: // WriteData
+    if (card_write_chained(data, data_length))
+    {
+      return card_status(response, 0, 0x91, 0xAF);
+    }
+    return card_write(data, data_length, response);
+  case 0xC4: // ChangeKey
+    return card_changekey(data, data_length, response);
+  }
+  return card_status(response, 0, 0x91, 0x1C);
+}
+
+/**************************************************************************/
+/*!
+    @brief   factory state: keys zero, file 2 zero and plain, nothing
+   counted.
+*/
+/**************************************************************************/
+static void card_reset(void)
+{
+  memset(card.keys, 0, sizeof(card.keys));
+  memset(card.versions, 0, sizeof(card.versions));
+  memset(card.file, 0, sizeof(card.file));
+  card.file_mode = ntag424_CommMode::Plain;
+  card.frame_size = CARD_BUFFERSIZE;
+  card.strip_mac = false;
+  card.present = true;
+  card.selects = 0;
+  card.auths = 0;
+  card.frames = 0;
+  card.chunk_count = 0;
+  card.change_count = 0;
+}
+
+static ucontext_t card_context;   ///< card_run() on card_stack
+static ucontext_t driver_context; ///< caller of card_switch()
+static uint8_t card_stack[TEST_CARD_STACK] __attribute__((aligned(64)));
+
+/**
+ * @brief apdu handed from card_switch() to card_run(), and the answer.
+ */
+static struct
+{
+  const uint8_t *apdu;    ///< apdu of the driver
+  size_t length;          ///< length of apdu
+  uint8_t *response;      ///< response buffer of the fake PN532
+  size_t response_length; ///< length of the answer
+} card_call;
+
+/**************************************************************************/
+/*!
+    @brief   answer the apdus of card_switch() on card_stack.
+*/
+/**************************************************************************/
+static void card_run(void)
+{
+  while (true)
+  {
+    card_call.response_length =
+        card_apdu(card_call.apdu, card_call.length, card_call.response);
+    swapcontext(&card_context, &driver_context);
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief   card function of the fake PN532. The card runs on a stack of
+   its own, so the stack measured for a command is the one of the driver.
+*/
+/**************************************************************************/
+static size_t card_switch(const uint8_t *apdu, size_t length,
+                          uint8_t *response)
+{
+  card_call.apdu = apdu;
+  card_call.length = length;
+  card_call.response = response;
+  swapcontext(&driver_context, &card_context);
+  return card_call.response_length;
+}
+
+static Adafruit_PN532 nfc(2, 3, &Wire);
+
+static uint8_t stack_region[TEST_STACK_SIZE] __attribute__((aligned(64)));
+static bool stack_result; ///< result of the command stack_measure() ran
+
+void setUp(void) { card_reset(); }
+
+void tearDown(void) {}
+
+/**************************************************************************/
+/*!
+    @brief   thread of stack_measure(): run the command on the painted stack.
+*/
+/**************************************************************************/
+static void *stack_thread(void *command)
+{
+  stack_result = ((bool (*)(void))command)();
+  return NULL;
+}
+
+/**************************************************************************/
+/*!
+    @brief   run a command in a thread whose stack is stack_region, painted
+   with TEST_STACK_PAINT beforehand.
+    @param   command  command to run
+    @return  bytes of stack_region written by the thread
+*/
+/**************************************************************************/
+static size_t stack_measure(bool (*command)(void))
+{
+  pthread_attr_t attr;
+  pthread_t thread;
+  size_t i = 0;
+
+  memset(stack_region, TEST_STACK_PAINT, sizeof(stack_region));
+  stack_result = false;
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr, stack_region, sizeof(stack_region));
+  if ((pthread_create(&thread, &attr, stack_thread, (void *)command) != 0) ||
+      (pthread_join(thread, NULL) != 0))
+  {
+    stack_result = false;
+  }
+  pthread_attr_destroy(&attr);
+  // the stack grows down, thread descriptor and TLS sit at the top
+  while ((i < sizeof(stack_region)) && (stack_region[i] == TEST_STACK_PAINT))
+  {
+    i++;
+  }
+  return sizeof(stack_region) - i;
+}
+
+static bool command_none(void) { return true; }
+
+static bool command_version(void) { return nfc.ntag424_isNTAG424(); }
+
+static bool command_authenticate(void)
+{
+  return nfc.ntag424_Authenticate((uint8_t *)key, 0);
+}
+
+static bool command_uid(void)
+{
+  uint8_t buffer[16];
+  return nfc.ntag424_GetCardUID(buffer) == sizeof(uid);
+}
+
+/**************************************************************************/
+/*!
+    @brief   put the card into the field: fresh card state, no session.
+*/
+/**************************************************************************/
+static void card_field(void)
+{
+  card.present = true;
+  card.auth_pending = 0;
+  card.version_frame = 0;
+  card.out_length = 0;
+  card.out_position = 0;
+  card.in_expected = 0;
+  card.authenticated = false;
+}
+
+/**************************************************************************/
+/*!
+    @brief   put the card into the field, activated by InListPassiveTarget.
+*/
+/**************************************************************************/
+static bool activate(void)
+{
+  uint8_t found[7];
+  uint8_t found_length;
+
+  card_field();
+  return nfc.readPassiveTargetID(PN532_MIFARE_ISO14443A, found, &found_length,
+                                 100) &&
+         (found_length == sizeof(uid)) &&
+         (memcmp(found, uid, sizeof(uid)) == 0);
+}
+
+static void test_activate(void)
+{
+  ntag424_cmac_init(&card.mac);
+  ntag424_aes_setkey(&card.enc, NULL, key, NTAG424_AES_ENCRYPT);
+  ntag424_aes_setkey(&card.dec, NULL, key, NTAG424_AES_DECRYPT);
+  getcontext(&card_context);
+  card_context.uc_stack.ss_sp = card_stack;
+  card_context.uc_stack.ss_size = sizeof(card_stack);
+  card_context.uc_link = NULL;
+  makecontext(&card_context, card_run, 0);
+  ntag424_host_attach(card_switch, uid);
+  TEST_ASSERT_TRUE(nfc.begin());
+  nfc.SAMConfig();
+  TEST_ASSERT_TRUE(activate());
+}
+
+static void test_no_allocation(void)
+{
+#ifdef __GLIBC__
+  uint8_t buffer[16];
+  uint8_t version;
+
+  allocations = 0;
+  counting = true;
+  bool ntag424 = nfc.ntag424_isNTAG424();
+  bool authenticated = nfc.ntag424_Authenticate((uint8_t *)key, 0);
+  size_t uids = 0, versions = 0;
+  for (int i = 0; i < TEST_COMMANDS; i++)
+  {
+    uids += (nfc.ntag424_GetCardUID(buffer) == sizeof(uid)) &&
+            (memcmp(buffer, uid, sizeof(uid)) == 0);
+    versions += nfc.ntag424_GetKeyVersion(0, &version) && (version == 0);
+  }
+  counting = false;
+
+  TEST_ASSERT_TRUE(ntag424);
+  TEST_ASSERT_TRUE(authenticated);
+  TEST_ASSERT_EQUAL(TEST_COMMANDS, uids);
+  TEST_ASSERT_EQUAL(TEST_COMMANDS, versions);
+  TEST_ASSERT_EQUAL(0, allocations);
+#else
+  TEST_IGNORE_MESSAGE("malloc interposition needs glibc");
+#endif
+}
+
+static void test_stack(void)
+{
+  uint8_t version;
+  size_t base, used[3];
+  char message[80];
+
+  // a first run binds the lazy symbols of the thread start and the commands
+  TEST_ASSERT_TRUE(activate());
+  stack_measure(command_none);
+  TEST_ASSERT_TRUE(command_version() && command_authenticate() &&
+                   command_uid());
+  // thread start and TLS, subtracted from the commands
+  base = stack_measure(command_none);
+  TEST_ASSERT_TRUE(stack_result);
+  TEST_ASSERT_TRUE(activate());
+  used[0] = stack_measure(command_version) - base;
+  TEST_ASSERT_TRUE(stack_result);
+  used[1] = stack_measure(command_authenticate) - base;
+  TEST_ASSERT_TRUE(stack_result);
+  used[2] = stack_measure(command_uid) - base;
+  TEST_ASSERT_TRUE(stack_result);
+  TEST_ASSERT_TRUE(nfc.ntag424_GetKeyVersion(0, &version));
+
+  snprintf(message, sizeof(message),
+           "stack GetVersion %u, Authenticate %u, GetCardUID %u byte",
+           (unsigned)used[0], (unsigned)used[1], (unsigned)used[2]);
+  TEST_MESSAGE(message);
+  for (int i = 0; i < 3; i++)
+  {
+    TEST_ASSERT_LESS_OR_EQUAL(TEST_STACK_BOUND, used[i]);
+  }
+}
+
+static void test_iv_cache(void)
+{
+  Adafruit_PN532::ntag424_IVCacheType *cache = &nfc.ntag424_Session.ivcache;
+  uint8_t data[16];
+  for (int i = 0; i < 16; i++)
+  {
+    data[i] = (uint8_t)(0x40 + i);
+  }
+  card.file_mode = ntag424_CommMode::Full;
+  TEST_ASSERT_TRUE(activate());
+  TEST_ASSERT_TRUE(nfc.ntag424_Authenticate((uint8_t *)key, 0));
+
+  // both ivs of the next counter are computed while the card is busy
+  TEST_ASSERT_EQUAL(16, nfc.ntag424_WriteData(data, 2, 0, 16,
+                                              ntag424_CommMode::Full));
+  TEST_ASSERT_EQUAL(nfc.ntag424_Session.cmd_counter, cache->cmd_counter);
+  TEST_ASSERT_EQUAL(3, cache->valid);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(data, card.file, 16);
+
+  // the next command encrypts with the cached iv, a poisoned one shows up
+  // in the first plain byte
+  cache->iv[NTAG424_IV_CMD][0] ^= 0x01;
+  TEST_ASSERT_EQUAL(16, nfc.ntag424_WriteData(data, 2, 16, 16,
+                                              ntag424_CommMode::Full));
+  TEST_ASSERT_EQUAL_HEX8(data[0] ^ 0x01, card.file[16]);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(data + 1, card.file + 17, 15);
+
+  // NonFirst keeps the counter, the ivs of the old session keys are gone
+  int counter = nfc.ntag424_Session.cmd_counter;
+  TEST_ASSERT_EQUAL(3, cache->valid);
+  TEST_ASSERT_TRUE(nfc.ntag424_Authenticate((uint8_t *)key, 0));
+  TEST_ASSERT_EQUAL(counter, nfc.ntag424_Session.cmd_counter);
+  TEST_ASSERT_EQUAL(0, cache->valid);
+  TEST_ASSERT_EQUAL(16, nfc.ntag424_WriteData(data, 2, 32, 16,
+                                              ntag424_CommMode::Full));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(data, card.file + 32, 16);
+}
+
+static void test_chaining(void)
+{
+  uint8_t buffer[NTAG424_ECC_SIG_SIZE];
+  uint8_t data[200];
+  uint8_t header[7] = {0x02, 0x00, 0x00, 0x00, sizeof(data), 0x00, 0x00};
+  uint8_t result[16];
+  for (size_t i = 0; i < sizeof(data); i++)
+  {
+    data[i] = (uint8_t)(3 * i + 1);
+  }
+  card.frame_size = 24;
+  TEST_ASSERT_TRUE(activate());
+  TEST_ASSERT_TRUE(nfc.ntag424_Authenticate((uint8_t *)key, 0));
+
+  // 64 byte cryptogram + MAC of the signature in three 91 AF frames
+  card.frames = 0;
+  TEST_ASSERT_EQUAL(sizeof(buffer), nfc.ntag424_ReadSig(buffer));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(signature, buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL(3, card.frames);
+
+  // 208 byte cryptogram + MAC of a WriteData in three frames
+  card.file_mode = ntag424_CommMode::Full;
+  card.frames = 0;
+  TEST_ASSERT_EQUAL(2, nfc.ntag424_send<ntag424_CommMode::Full>(
+                           NTAG424_APDU_WRITEDATA, header, data, sizeof(data),
+                           result, sizeof(result)));
+  TEST_ASSERT_EQUAL_HEX8(0x91, result[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x00, result[1]);
+  TEST_ASSERT_EQUAL(3, card.frames);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(data, card.file, sizeof(data));
+  TEST_ASSERT_EQUAL(card.counter, nfc.ntag424_Session.cmd_counter);
+
+  // a response without its MAC is rejected, chained or not
+  card.strip_mac = true;
+  TEST_ASSERT_EQUAL(0, nfc.ntag424_ReadSig(buffer));
+  card.file_mode = ntag424_CommMode::Mac;
+  card.strip_mac = true;
+  TEST_ASSERT_EQUAL(0, nfc.ntag424_WriteData(data, 2, 0, 16,
+                                             ntag424_CommMode::Mac));
+  TEST_ASSERT_EQUAL(16, nfc.ntag424_WriteData(data, 2, 0, 16,
+                                              ntag424_CommMode::Mac));
+}
+
+static void test_chunks(void)
+{
+  // largest chunks with one frame per command, a 256 byte file in each mode
+  static const ntag424_CommMode modes[3] = {ntag424_CommMode::Plain,
+                                            ntag424_CommMode::Mac,
+                                            ntag424_CommMode::Full};
+  static const size_t writes[3][3] = {
+      {105, 105, 46}, {97, 97, 62}, {95, 95, 66}};
+  static const size_t reads[3][3] = {
+      {108, 108, 40}, {100, 100, 56}, {95, 95, 66}};
+  uint8_t data[CARD_FILESIZE], buffer[CARD_FILESIZE];
+  for (size_t i = 0; i < sizeof(data); i++)
+  {
+    data[i] = (uint8_t)(0xFF - i);
+  }
+  TEST_ASSERT_TRUE(activate());
+  TEST_ASSERT_TRUE(nfc.ntag424_Authenticate((uint8_t *)key, 0));
+
+  for (int m = 0; m < 3; m++)
+  {
+    card.file_mode = modes[m];
+    memset(card.file, 0, sizeof(card.file));
+    card.frames = 0;
+    card.chunk_count = 0;
+    TEST_ASSERT_EQUAL(sizeof(data), nfc.ntag424_WriteData(data, 2, 0,
+                                                          sizeof(data),
+                                                          modes[m]));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, card.file, sizeof(data));
+    TEST_ASSERT_EQUAL(3, card.chunk_count);
+    TEST_ASSERT_EQUAL(3, card.frames);
+    for (size_t c = 0; c < 3; c++)
+    {
+      TEST_ASSERT_EQUAL(writes[m][c], card.chunks[c]);
+    }
+
+    memset(buffer, 0, sizeof(buffer));
+    card.frames = 0;
+    card.chunk_count = 0;
+    TEST_ASSERT_EQUAL(sizeof(buffer), nfc.ntag424_ReadData(buffer, 2, 0,
+                                                           sizeof(buffer),
+                                                           modes[m]));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(3, card.chunk_count);
+    TEST_ASSERT_EQUAL(3, card.frames);
+    for (size_t c = 0; c < 3; c++)
+    {
+      TEST_ASSERT_EQUAL(reads[m][c], card.chunks[c]);
+    }
+  }
+  TEST_ASSERT_EQUAL(card.counter, nfc.ntag424_Session.cmd_counter);
+
+  // offsets continue across the chunks
+  memset(buffer, 0, sizeof(buffer));
+  TEST_ASSERT_EQUAL(150, nfc.ntag424_ReadData(buffer, 2, 100, 150,
+                                              ntag424_CommMode::Full));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(data + 100, buffer, 150);
+}
+
+static void test_nonfirst(void)
+{
+  uint8_t key1[16], buffer[16], ti[4];
+  uint8_t version;
+  memset(key1, 0x11, sizeof(key1));
+  memcpy(card.keys[1], key1, sizeof(key1));
+  TEST_ASSERT_TRUE(activate());
+  TEST_ASSERT_TRUE(nfc.ntag424_Authenticate((uint8_t *)key, 0));
+  TEST_ASSERT_EQUAL(sizeof(uid), nfc.ntag424_GetCardUID(buffer));
+  TEST_ASSERT_EQUAL(sizeof(uid), nfc.ntag424_GetCardUID(buffer));
+  memcpy(ti, nfc.ntag424_authresponse_TI, sizeof(ti));
+
+  // switching to key 1: two exchanges, no select, TI and CmdCtr stay
+  card.frames = 0;
+  TEST_ASSERT_TRUE(nfc.ntag424_Authenticate(key1, 1));
+  TEST_ASSERT_EQUAL_HEX8(0x77, card.auth_last);
+  TEST_ASSERT_EQUAL(2, card.frames);
+  TEST_ASSERT_EQUAL(1, card.selects);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(ti, nfc.ntag424_authresponse_TI, sizeof(ti));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(card.ti, ti, sizeof(ti));
+  TEST_ASSERT_EQUAL(2, nfc.ntag424_Session.cmd_counter);
+  TEST_ASSERT_EQUAL(2, card.counter);
+  TEST_ASSERT_EQUAL(1, nfc.ntag424_Session.keyno);
+
+  // the session keys of key 1 go on with the counter
+  TEST_ASSERT_TRUE(nfc.ntag424_GetKeyVersion(1, &version));
+  TEST_ASSERT_EQUAL(sizeof(uid), nfc.ntag424_GetCardUID(buffer));
+  TEST_ASSERT_EQUAL(4, card.counter);
+
+  // a failing NonFirst ends the session, EV2First starts the next one
+  TEST_ASSERT_FALSE(nfc.ntag424_Authenticate((uint8_t *)key, 1));
+  TEST_ASSERT_FALSE(nfc.ntag424_Session.authenticated);
+  TEST_ASSERT_TRUE(nfc.ntag424_Authenticate(key1, 1));
+  TEST_ASSERT_EQUAL_HEX8(0x71, card.auth_last);
+  TEST_ASSERT_EQUAL(0, nfc.ntag424_Session.cmd_counter);
+  TEST_ASSERT_EQUAL(sizeof(uid), nfc.ntag424_GetCardUID(buffer));
+}
+
+static void test_selection(void)
+{
+  uint8_t dfn[NTAG424_DFN_SIZE] = {0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01};
+  uint8_t wrong[16], buffer[16];
+  memset(wrong, 0x5A, sizeof(wrong));
+  TEST_ASSERT_TRUE(activate());
+  TEST_ASSERT_TRUE(nfc.ntag424_Authenticate((uint8_t *)key, 0));
+  TEST_ASSERT_EQUAL(1, card.selects);
+
+  // the application and an EF stay selected, the session with them
+  TEST_ASSERT_TRUE(nfc.ntag424_ISOSelectFileByDFN(dfn));
+  TEST_ASSERT_TRUE(nfc.ntag424_ISOSelectFileById(0xE104));
+  TEST_ASSERT_TRUE(nfc.ntag424_ISOSelectFileById(0xE104));
+  TEST_ASSERT_EQUAL(2, card.selects);
+  TEST_ASSERT_TRUE(nfc.ntag424_Session.authenticated);
+
+  // a failed authentication leaves the selection alone
+  TEST_ASSERT_FALSE(nfc.ntag424_Authenticate(wrong, 0));
+  TEST_ASSERT_TRUE(nfc.ntag424_Authenticate((uint8_t *)key, 0));
+  TEST_ASSERT_EQUAL_HEX8(0x71, card.auth_last);
+  TEST_ASSERT_EQUAL(2, card.selects);
+
+  // a target that stops answering is forgotten
+  card.present = false;
+  TEST_ASSERT_EQUAL(0, nfc.ntag424_GetCardUID(buffer));
+  TEST_ASSERT_FALSE(nfc.ntag424_Session.authenticated);
+  TEST_ASSERT_FALSE(nfc.ntag424_Selection.df_valid);
+  TEST_ASSERT_EQUAL(NTAG424_SELECTION_NONE, nfc.ntag424_Selection.ef);
+  TEST_ASSERT_EQUAL(0, nfc.ntag424_Selection.uid_length);
+  TEST_ASSERT_EQUAL(0, nfc.ntag424_Session.ivcache.valid);
+  card_field();
+  TEST_ASSERT_TRUE(nfc.ntag424_Authenticate((uint8_t *)key, 0));
+  TEST_ASSERT_EQUAL(3, card.selects);
+
+  // each activation starts over, the DF select deselects the EF
+  TEST_ASSERT_TRUE(nfc.ntag424_ISOSelectFileById(0xE104));
+  TEST_ASSERT_EQUAL(4, card.selects);
+  TEST_ASSERT_TRUE(activate());
+  TEST_ASSERT_EQUAL(sizeof(uid), nfc.ntag424_Selection.uid_length);
+  TEST_ASSERT_TRUE(nfc.ntag424_Authenticate((uint8_t *)key, 0));
+  TEST_ASSERT_TRUE(nfc.ntag424_ISOSelectFileById(0xE104));
+  TEST_ASSERT_EQUAL(6, card.selects);
+  card_field();
+  TEST_ASSERT_TRUE(nfc.inListPassiveTarget());
+  TEST_ASSERT_FALSE(nfc.ntag424_Session.authenticated);
+  TEST_ASSERT_TRUE(nfc.ntag424_Authenticate((uint8_t *)key, 0));
+  TEST_ASSERT_EQUAL(7, card.selects);
+}
+
+static void test_authenticate_any(void)
+{
+  uint8_t wrong[16], key2[16];
+  memset(wrong, 0x5A, sizeof(wrong));
+  memset(key2, 0x22, sizeof(key2));
+  memcpy(card.keys[2], key2, sizeof(key2));
+  ntag424_KeyCandidateType candidates[2] = {{wrong, 2, 0}, {key2, 2, 0}};
+
+  // in list order, the application selected once for both tries
+  TEST_ASSERT_TRUE(activate());
+  TEST_ASSERT_EQUAL(1, nfc.ntag424_AuthenticateAny(candidates, 2, uid,
+                                                   sizeof(uid)));
+  TEST_ASSERT_EQUAL(2, card.auths);
+  TEST_ASSERT_EQUAL(1, card.selects);
+  TEST_ASSERT_EQUAL(0, candidates[0].hits);
+  TEST_ASSERT_EQUAL(1, candidates[1].hits);
+  TEST_ASSERT_EQUAL(2, nfc.ntag424_Session.keyno);
+
+  // more hits go first
+  candidates[0].hits = 10;
+  card.auths = 0;
+  TEST_ASSERT_TRUE(activate());
+  TEST_ASSERT_EQUAL(1, nfc.ntag424_AuthenticateAny(candidates, 2));
+  TEST_ASSERT_EQUAL(2, card.auths);
+  TEST_ASSERT_EQUAL(2, candidates[1].hits);
+
+  // the key of the last card with this UID prefix goes before the hits
+  card.auths = 0;
+  TEST_ASSERT_TRUE(activate());
+  TEST_ASSERT_EQUAL(1, nfc.ntag424_AuthenticateAny(candidates, 2, uid,
+                                                   sizeof(uid)));
+  TEST_ASSERT_EQUAL(1, card.auths);
+  TEST_ASSERT_EQUAL(3, candidates[1].hits);
+
+  // no key matches, each one tried once
+  card.auths = 0;
+  TEST_ASSERT_TRUE(activate());
+  TEST_ASSERT_EQUAL(-1, nfc.ntag424_AuthenticateAny(candidates, 1, uid,
+                                                    sizeof(uid)));
+  TEST_ASSERT_EQUAL(1, card.auths);
+  TEST_ASSERT_FALSE(nfc.ntag424_Session.authenticated);
+}
+
+static void test_key_version(void)
+{
+  ntag424_KeyEntryType entries[2];
+  ntag424_KeyStoreType store;
+  uint8_t key2[2][16];
+  memset(key2[0], 0x24, sizeof(key2[0]));
+  memset(key2[1], 0x25, sizeof(key2[1]));
+  ntag424_keystore_init(&store, entries, 2);
+  TEST_ASSERT_EQUAL(1, ntag424_keystore_add(&store, 2, 4, key2[0]));
+  TEST_ASSERT_EQUAL(1, ntag424_keystore_add(&store, 2, 5, key2[1]));
+
+  // the version the card reports picks the key, no failed authentication
+  for (uint8_t version = 4; version <= 5; version++)
+  {
+    memcpy(card.keys[2], key2[version - 4], sizeof(card.keys[2]));
+    card.versions[2] = version;
+    card.auths = 0;
+    TEST_ASSERT_TRUE(activate());
+    TEST_ASSERT_EQUAL(1, nfc.ntag424_AuthenticateByVersion(&store, 2));
+    TEST_ASSERT_EQUAL(1, card.auths);
+    TEST_ASSERT_EQUAL(2, nfc.ntag424_Session.keyno);
+  }
+
+  // in a session GetKeyVersion is MACed, a version not in the store
+  // does not try any key
+  card.versions[2] = 6;
+  card.auths = 0;
+  TEST_ASSERT_EQUAL(0, nfc.ntag424_AuthenticateByVersion(&store, 2));
+  TEST_ASSERT_EQUAL(0, card.auths);
+  TEST_ASSERT_TRUE(nfc.ntag424_Session.authenticated);
+}
+
+static void test_change_keys(void)
+{
+  uint8_t keys[NTAG424_KEYCOUNT][16], wrong[16];
+  for (int k = 0; k < NTAG424_KEYCOUNT; k++)
+  {
+    memset(keys[k], 0xC0 + k, sizeof(keys[k]));
+  }
+  memset(wrong, 0x5A, sizeof(wrong));
+  ntag424_KeyChangeType changes[3] = {{0, (uint8_t *)key, keys[0], 1},
+                                      {1, (uint8_t *)key, keys[1], 2},
+                                      {3, (uint8_t *)key, keys[3], 3}};
+
+  // key 0 changed last, the new key 0 authenticated at the end
+  TEST_ASSERT_TRUE(activate());
+  TEST_ASSERT_EQUAL(1, nfc.ntag424_ChangeKeys((uint8_t *)key, changes, 3));
+  TEST_ASSERT_EQUAL(3, card.change_count);
+  TEST_ASSERT_EQUAL(1, card.changed[0]);
+  TEST_ASSERT_EQUAL(3, card.changed[1]);
+  TEST_ASSERT_EQUAL(0, card.changed[2]);
+  for (int i = 0; i < 3; i++)
+  {
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(keys[changes[i].keyno],
+                                 card.keys[changes[i].keyno], 16);
+    TEST_ASSERT_EQUAL(changes[i].version, card.versions[changes[i].keyno]);
+  }
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(key, card.keys[2], 16);
+  TEST_ASSERT_EQUAL(2, card.auths);
+  TEST_ASSERT_EQUAL_HEX8(0x71, card.auth_last);
+  TEST_ASSERT_TRUE(card.authenticated);
+  TEST_ASSERT_EQUAL(0, card.keyno);
+  TEST_ASSERT_TRUE(nfc.ntag424_Session.authenticated);
+  TEST_ASSERT_EQUAL(0, nfc.ntag424_Session.keyno);
+
+  // the key 0 session goes on, without key 0 no re-authentication
+  changes[0] = {1, keys[1], keys[4], 4};
+  TEST_ASSERT_EQUAL(1, nfc.ntag424_ChangeKeys(keys[0], changes, 1));
+  TEST_ASSERT_EQUAL(2, card.auths);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(keys[4], card.keys[1], 16);
+  TEST_ASSERT_TRUE(nfc.ntag424_Session.authenticated);
+
+  // a wrong old key fails the card's CRC check
+  changes[0] = {2, wrong, keys[2], 5};
+  TEST_ASSERT_EQUAL(0, nfc.ntag424_ChangeKeys(keys[0], changes, 1));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(key, card.keys[2], 16);
+  TEST_ASSERT_EQUAL(0, card.versions[2]);
+}
+
+static void test_change_manifests(void)
+{
+  static const uint8_t keynos[3] = {0, 2, 4};
+  uint8_t keys[2][3][16];
+  ntag424_KeyChangeType changes[2][3];
+  ntag424_KeyManifestType manifests[2];
+  for (int c = 0; c < 2; c++)
+  {
+    for (int k = 0; k < 3; k++)
+    {
+      memset(keys[c][k], 0x10 * (c + 1) + k, sizeof(keys[c][k]));
+      changes[c][k] = {keynos[k], (uint8_t *)key, keys[c][k], (uint8_t)(c + 1)};
+    }
+  }
+  TEST_ASSERT_EQUAL(1, ntag424_keychange_manifests(changes[0], 3, 2,
+                                                   manifests));
+
+  // prepared before the cards arrive, each card gets its own keys
+  for (int c = 0; c < 2; c++)
+  {
+    card_reset();
+    TEST_ASSERT_TRUE(activate());
+    TEST_ASSERT_EQUAL(1, nfc.ntag424_ChangeKeys((uint8_t *)key,
+                                                &manifests[c]));
+    TEST_ASSERT_EQUAL(3, card.change_count);
+    TEST_ASSERT_EQUAL(2, card.changed[0]);
+    TEST_ASSERT_EQUAL(4, card.changed[1]);
+    TEST_ASSERT_EQUAL(0, card.changed[2]);
+    for (int k = 0; k < 3; k++)
+    {
+      TEST_ASSERT_EQUAL_HEX8_ARRAY(keys[c][k], card.keys[keynos[k]], 16);
+      TEST_ASSERT_EQUAL(c + 1, card.versions[keynos[k]]);
+    }
+    TEST_ASSERT_EQUAL(2, card.auths);
+    TEST_ASSERT_TRUE(nfc.ntag424_Session.authenticated);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_activate);
+  RUN_TEST(test_no_allocation);
+  RUN_TEST(test_stack);
+  RUN_TEST(test_iv_cache);
+  RUN_TEST(test_chaining);
+  RUN_TEST(test_chunks);
+  RUN_TEST(test_nonfirst);
+  RUN_TEST(test_selection);
+  RUN_TEST(test_authenticate_any);
+  RUN_TEST(test_key_version);
+  RUN_TEST(test_change_keys);
+  RUN_TEST(test_change_manifests);
+  return UNITY_END();
+}